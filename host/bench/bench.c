@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "driver/uart.h"
+
+#include "constants.h"
+#include "timer.h"
+#include "events.h"
+#include "power.h"
+#include "network.h"
+#include "cache.h"
+#include "dns.h"
+#include "link.h"
+#include "messages.h"
+#include "stats.h"
+#include "arena.h"
+#include "refresh.h"
+#include "store.h"
+#include "uart.h"
+
+#include "sim_hooks.h"
+#include "sim_time.h"
+#include "serial_line.h"
+#include "standin.h"
+#include "display_sim.h"
+
+/*
+ * Boots the firmware against the stand-in server and the simulated display
+ * and lets it run request cycles off the hw_timer the way it does on the
+ * chip, in real time, so a cycle starts every REQUEST_PERIOD_MS. The
+ * stage times are the firmware's own histograms from stats.c. What each
+ * cycle and request allocated comes from the calls app_main makes, which
+ * the bench is linked with --wrap for (see CMakeLists.txt), so the
+ * firmware isn't touched for them.
+ *
+ * Every cycle asks for both tides and swell, so switching the fixtures
+ * every two cycles asks for each version of both twice, once changed and
+ * once answered with a 304.
+ *
+ * Times are wall clock on the host, so they only mean anything relative to
+ * each other and to the serial line, which runs at real baud rates.
+ *
+ * With --no-allocs it's a soak test: once booted, every buffer a cycle needs
+ * should come from the arena or static storage, so any heap allocation in a
+ * cycle, any arena allocation that didn't fit, or heap still in use after
+ * the last cycle that wasn't before the first fails the run.
+ *
+ * The saved lists are removed before booting, unless --keep-store, where
+ * booting without a good record to show fails the run.
+ */
+#define DEFAULT_CYCLES 8
+#define FIXTURE_VERSIONS 2
+#define CYCLES_PER_VERSION 2
+#define API_HOST "spotcheck.brianteam.dev"
+// The first cycle waits out a whole period after boot
+#define CYCLE_TIMEOUT_MS (REQUEST_PERIOD_MS * 2 + 10000)
+// What SoftwareSerial holds, and what the ESP's UART driver was given
+#define DISPLAY_RX_BUFFER_SIZE 64
+#define ESP_RX_BUFFER_SIZE (UART_BUF_SIZE * 2)
+
+void app_main(void);
+
+void __real_power_cycle_start(void);
+void __real_power_sleep_until_next_request(void);
+int __real_perform_request(request *request_obj, char **read_buffer);
+int __real_perform_streamed_request(request *request_obj, json_stream_parser *parser);
+
+typedef struct {
+    int version;
+    // Connect, send, read and parse, for all of the cycle's requests.
+    // Streamed responses go out to the display as they're parsed, so that's
+    // in here too
+    uint32_t request_heap_allocs;
+    // Time spent in link_send, waiting on ACKs included
+    uint32_t link_us;
+    uint32_t payload_bytes;
+    // What the list update cost on the wire, and what the whole list would have
+    uint32_t list_bytes;
+    uint32_t full_list_bytes;
+    // power_cycle_start until power_sleep_until_next_request
+    uint32_t cycle_us;
+    uint32_t heap_allocs;
+    uint32_t heap_in_use;
+    uint32_t first_pixel_ms;
+    uint32_t server_requests;
+    uint32_t not_modified;
+} cycle_result;
+
+static const char *stage_names[STAGE_COUNT] = {
+    "wifi connect",
+    "http connect",
+    "http body",
+    "response alloc",
+    "json parse",
+    "link send",
+    "request cycle",
+    "network ready",
+    "dns query",
+    "inflate",
+    "first display"
+};
+
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cycle_done;
+static cycle_result *results;
+static int num_cycles;
+static int cycles_done;
+// Before the first cycle started, once app_main had booted
+static uint32_t booted_heap_in_use;
+
+// Where the cycle in progress started, all only touched by the main task
+static cycle_result current;
+static int64_t cycle_start_us;
+static uint32_t cycle_start_allocs;
+static link_stats cycle_start_link;
+static list_update_stats cycle_start_updates;
+static standin_stats cycle_start_server;
+
+static void *app_main_thread(void *arg) {
+    app_main();
+    return NULL;
+}
+
+void __wrap_power_cycle_start(void) {
+    memset(&current, 0, sizeof(current));
+    cycle_start_us = esp_timer_get_time();
+    sim_heap_stats heap = sim_get_heap_stats();
+    cycle_start_allocs = heap.allocs;
+    if (cycles_done == 0) {
+        booted_heap_in_use = heap.bytes_in_use;
+    }
+    cycle_start_link = get_link_stats();
+    cycle_start_updates = get_list_update_stats();
+    cycle_start_server = get_standin_stats();
+    __real_power_cycle_start();
+}
+
+int __wrap_perform_request(request *request_obj, char **read_buffer) {
+    uint32_t allocs = sim_get_heap_stats().allocs;
+    int result = __real_perform_request(request_obj, read_buffer);
+    current.request_heap_allocs += sim_get_heap_stats().allocs - allocs;
+    return result;
+}
+
+int __wrap_perform_streamed_request(request *request_obj, json_stream_parser *parser) {
+    uint32_t allocs = sim_get_heap_stats().allocs;
+    int result = __real_perform_streamed_request(request_obj, parser);
+    current.request_heap_allocs += sim_get_heap_stats().allocs - allocs;
+    return result;
+}
+
+// The end of the cycle, so this is where the fixtures move on for the next
+void __wrap_power_sleep_until_next_request(void) {
+    link_stats link = get_link_stats();
+    standin_stats server = get_standin_stats();
+    list_update_stats updates = get_list_update_stats();
+    current.cycle_us = esp_timer_get_time() - cycle_start_us;
+    sim_heap_stats heap = sim_get_heap_stats();
+    current.heap_allocs = heap.allocs - cycle_start_allocs;
+    current.heap_in_use = heap.bytes_in_use;
+    current.link_us = link.send_time_us - cycle_start_link.send_time_us;
+    current.payload_bytes = link.payload_bytes - cycle_start_link.payload_bytes;
+    current.list_bytes = updates.bytes_sent - cycle_start_updates.bytes_sent;
+    current.full_list_bytes = updates.full_bytes - cycle_start_updates.full_bytes;
+    current.server_requests = server.requests - cycle_start_server.requests;
+    current.not_modified = server.not_modified - cycle_start_server.not_modified;
+    if (current.payload_bytes > 0) {
+        current.first_pixel_ms = get_display_sim_stats().time_to_first_pixel_ms;
+    }
+
+    pthread_mutex_lock(&results_lock);
+    if (cycles_done < num_cycles) {
+        current.version = (cycles_done / CYCLES_PER_VERSION) % FIXTURE_VERSIONS;
+        results[cycles_done++] = current;
+        standin_set_version((cycles_done / CYCLES_PER_VERSION) % FIXTURE_VERSIONS);
+        pthread_cond_broadcast(&cycle_done);
+    }
+    pthread_mutex_unlock(&results_lock);
+
+    __real_power_sleep_until_next_request();
+}
+
+// The firmware's own histograms, then how soon the display had each list up
+static void print_stages() {
+    printf("\n%-16s %6s %10s %10s\n", "stage", "count", "avg ms", "max ms");
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        stage_histogram histogram = get_stage_histogram(stage);
+        if (histogram.count == 0) {
+            continue;
+        }
+
+        printf("%-16s %6u %10.2f %10.2f\n", stage_names[stage], histogram.count,
+               histogram.total_us / 1000.0 / histogram.count, histogram.max_us / 1000.0);
+    }
+
+    // A 304 sends nothing, so there's nothing to put up either. The message
+    // scrolling when a list arrives is finished first, so first pixel is
+    // mostly how much of that was left
+    uint32_t lists = 0;
+    uint32_t total_ms = 0;
+    uint32_t max_ms = 0;
+    for (int i = 0; i < num_cycles; i++) {
+        if (results[i].payload_bytes > 0) {
+            lists++;
+            total_ms += results[i].first_pixel_ms;
+            max_ms = results[i].first_pixel_ms > max_ms ? results[i].first_pixel_ms : max_ms;
+        }
+    }
+    if (lists > 0) {
+        printf("%-16s %6u %10.2f %10.2f\n", "first pixel", lists, (double)total_ms / lists, (double)max_ms);
+    }
+}
+
+static void print_cycles() {
+    printf("\n%5s %7s %10s %10s %10s %10s %11s %14s %8s %5s\n", "cycle", "version", "cycle ms",
+           "link ms", "list bytes", "as full", "heap allocs", "request allocs", "requests", "304s");
+    for (int i = 0; i < num_cycles; i++) {
+        const cycle_result *result = &results[i];
+        printf("%5d %7d %10.2f %10.2f %10u %10u %11u %14u %8u %5u\n", i, result->version, result->cycle_us / 1000.0,
+               result->link_us / 1000.0, result->list_bytes, result->full_list_bytes, result->heap_allocs,
+               result->request_heap_allocs, result->server_requests, result->not_modified);
+    }
+}
+
+static void print_totals() {
+    sim_heap_stats heap = sim_get_heap_stats();
+    printf("\nheap: allocs=%u frees=%u failed=%u in_use=%u peak=%u of %u min_free=%u\n",
+           heap.allocs, heap.frees, heap.failed_allocs, heap.bytes_in_use, heap.peak_bytes_in_use, SIM_HEAP_SIZE,
+           esp_get_minimum_free_heap_size());
+
+    arena_stats arena = get_arena_stats();
+    printf("arena: size=%u high_water=%u allocs=%u failed=%u resets=%u\n",
+           arena.size, arena.high_water, arena.allocs, arena.failed_allocs, arena.resets);
+
+    // The shipped POWER_MODE stays awake, so the duty cycle is 100% and wake
+    // to data is from boot, only the sleeping modes measure it every cycle
+    power_stats power = get_power_stats();
+    printf("power: mode=%d cycles=%u duty=%u%% wake_to_ready=%ums wake_to_data=%ums\n",
+           POWER_MODE, power.cycles, get_duty_cycle_percent(), power.wake_to_ready_us / 1000,
+           power.wake_to_data_us / 1000);
+
+    event_stats events = get_event_stats();
+    printf("events: handled=%u dropped=%u idle=%u%% (%llums busy)\n",
+           events.events_handled, events.events_dropped, get_idle_percent(),
+           (unsigned long long)events.busy_us / 1000);
+
+    wifi_connect_stats wifi = get_wifi_connect_stats();
+    printf("wifi: full=%u fast=%u\n", wifi.full_connects, wifi.fast_connects);
+
+    timer_stats timers = get_timer_stats();
+    printf("timer: wakeups=%u empty=%u expirations=%u loads=%u wakeup avg=%lluus max=%uus\n",
+           timers.wakeups, timers.empty_wakeups, timers.expirations, timers.hw_loads,
+           (unsigned long long)(timers.wakeups ? timers.wakeup_us / timers.wakeups : 0), timers.max_wakeup_us);
+
+    pipeline_stats pipeline = get_pipeline_stats();
+    printf("refresh: batches=%u depth avg=%.2f max=%u wait=%llums fetch=%llums output=%llums overlap=%llums capped=%u\n",
+           pipeline.batches, pipeline.batches ? (double)pipeline.queue_depth_total / pipeline.batches : 0.0,
+           pipeline.max_queue_depth, (unsigned long long)pipeline.producer_wait_us / 1000,
+           (unsigned long long)pipeline.fetch_us / 1000, (unsigned long long)pipeline.output_us / 1000,
+           (unsigned long long)pipeline.overlap_us / 1000, pipeline.values_capped);
+
+    store_stats store = get_store_stats();
+    printf("store: loaded=%d saves=%u writes=%u unchanged=%u failed=%u written=%u record=%u load=%uus\n",
+           store.loaded, store.saves, store.writes, store.unchanged, store.failed_writes,
+           store.bytes_written, store.record_bytes, store.load_us);
+
+    connection_stats connections = get_connection_stats();
+    printf("http: requests=%u opened=%u reused=%u stale=%u server_closes=%u body=%u decoded=%u\n",
+           connections.requests, connections.connections_opened, connections.connections_reused,
+           connections.stale_reconnects, connections.server_closes, connections.body_bytes_received,
+           connections.body_bytes_decoded);
+
+    cache_stats cache = get_cache_stats();
+    printf("cache: fresh=%u revalidated=%u misses=%u\n", cache.fresh_hits, cache.revalidated_hits, cache.misses);
+
+    dns_stats dns = get_dns_stats();
+    printf("dns: lookups=%u fresh=%u stale=%u misses=%u queries=%u failures=%u\n",
+           dns.lookups, dns.fresh_hits, dns.stale_hits, dns.misses, dns.queries, dns.query_failures);
+
+    link_stats link = get_link_stats();
+    printf("link: baud=%u frames=%u failed=%u retransmits=%u nacks=%u rejects=%u timeouts=%u payload=%u send=%llums\n",
+           link.baud_rate, link.frames_sent, link.frames_failed, link.retransmits, link.nacks, link.rejects,
+           link.timeouts, link.payload_bytes, (unsigned long long)link.send_time_us / 1000);
+
+    list_update_stats updates = get_list_update_stats();
+    printf("lists: full=%u delta=%u unchanged=%u rejected=%u bytes=%u (as full lists %u)\n",
+           updates.full_updates, updates.delta_updates, updates.unchanged_updates, updates.rejected_deltas,
+           updates.bytes_sent, updates.full_bytes);
+
+    for (int direction = 0; direction < SERIAL_DIRECTION_COUNT; direction++) {
+        serial_line_stats line = get_serial_line_stats(direction);
+        printf("serial %s: sent=%u garbled=%u overflowed=%u lost=%u missed=%u\n",
+               direction == SERIAL_TO_DISPLAY ? "to display" : "from display",
+               line.bytes_sent, line.bytes_garbled, line.bytes_overflowed, line.bytes_lost, line.bytes_missed);
+    }
+
+    display_sim_stats display = get_display_sim_stats();
+    printf("display: first_pixel=%ums frames=%u late_max=%ums rx_overflows=%u dropped=%u shown=%u shows=%u pixels=%u\n",
+           display.time_to_first_pixel_ms, display.frames_drawn, display.frame_late_max_ms, display.rx_overflows,
+           display.arena_dropped_bytes, display.messages_shown, display.strip_shows, display.pixels_set);
+
+    standin_stats server = get_standin_stats();
+    printf("server: connections=%u requests=%u 304s=%u gzip=%u not_found=%u host_mismatches=%u body=%u dns=%u\n",
+           server.connections, server.requests, server.not_modified, server.gzip_responses, server.not_found,
+           server.host_mismatches, server.body_bytes_sent, server.dns_queries);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--cycles N] [--keep-store] [--no-allocs]\n", name);
+}
+
+// What --no-allocs checks, once all the cycles have been printed
+static bool cycles_stayed_off_the_heap() {
+    bool ok = true;
+    for (int i = 0; i < num_cycles; i++) {
+        if (results[i].heap_allocs > 0) {
+            fprintf(stderr, "Cycle %d made %u heap allocations\n", i, results[i].heap_allocs);
+            ok = false;
+        }
+    }
+
+    arena_stats arena = get_arena_stats();
+    if (arena.failed_allocs > 0) {
+        fprintf(stderr, "%u arena allocations didn't fit\n", arena.failed_allocs);
+        ok = false;
+    }
+
+    if (num_cycles > 0 && results[num_cycles - 1].heap_in_use != booted_heap_in_use) {
+        fprintf(stderr, "Heap in use went from %u to %u bytes\n", booted_heap_in_use,
+                results[num_cycles - 1].heap_in_use);
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    num_cycles = DEFAULT_CYCLES;
+    bool keep_store = false;
+    bool no_allocs = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            num_cycles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--keep-store") == 0) {
+            keep_store = true;
+        } else if (strcmp(argv[i], "--no-allocs") == 0) {
+            no_allocs = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (num_cycles <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!keep_store) {
+        remove(STORE_FILE);
+        remove(STORE_TEMP_FILE);
+    }
+
+    uint16_t http_port = standin_start_http(FIXTURE_DIR, API_HOST);
+    uint16_t dns_port = standin_start_dns();
+    if (!http_port || !dns_port) {
+        fprintf(stderr, "Couldn't start the stand-in servers\n");
+        return 1;
+    }
+    sim_net_redirect(http_port, dns_port);
+    standin_set_version(0);
+
+    serial_line_init(SERIAL_TO_DISPLAY, DISPLAY_RX_BUFFER_SIZE);
+    serial_line_init(SERIAL_FROM_DISPLAY, ESP_RX_BUFFER_SIZE);
+    sim_uart_attach(LINK_UART);
+    display_sim_start();
+
+    results = sim_calloc(num_cycles, sizeof(cycle_result));
+    sim_cond_init(&cycle_done);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, app_main_thread, NULL);
+    pthread_detach(thread);
+
+    bool all_finished = true;
+    pthread_mutex_lock(&results_lock);
+    while (cycles_done < num_cycles) {
+        int waiting_for = cycles_done;
+        struct timespec deadline = sim_deadline(esp_timer_get_time() + (int64_t)CYCLE_TIMEOUT_MS * 1000);
+        while (cycles_done == waiting_for
+               && pthread_cond_timedwait(&cycle_done, &results_lock, &deadline) == 0) {
+        }
+        if (cycles_done == waiting_for) {
+            fprintf(stderr, "Cycle %d didn't finish\n", cycles_done);
+            all_finished = false;
+            break;
+        }
+    }
+    // Stays locked, so the firmware stops at the end of its next cycle
+    // rather than changing anything under the printing
+
+    num_cycles = cycles_done;
+    print_stages();
+    print_cycles();
+    print_totals();
+    bool allocs_ok = !no_allocs || cycles_stayed_off_the_heap();
+
+    display_sim_stats display = get_display_sim_stats();
+    if (display.messages_shown == 0) {
+        fprintf(stderr, "Display never got a list\n");
+        return 1;
+    }
+    if (keep_store && !get_store_stats().loaded) {
+        fprintf(stderr, "No saved lists to boot from\n");
+        return 1;
+    }
+    return all_finished && allocs_ok ? 0 : 1;
+}
@@ -0,0 +1,281 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "cJSON.h"
+
+typedef struct {
+    const char *cursor;
+    int depth;
+} parse_state;
+
+static const char *error_ptr;
+
+static bool parse_value(cJSON *item, parse_state *state);
+
+static void skip_whitespace(parse_state *state) {
+    while (*state->cursor && isspace((unsigned char)*state->cursor)) {
+        state->cursor++;
+    }
+}
+
+static cJSON *new_item() {
+    cJSON *item = malloc(sizeof(cJSON));
+    if (item) {
+        memset(item, 0, sizeof(cJSON));
+    }
+    return item;
+}
+
+static unsigned hex_value(const char *hex) {
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = hex[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return 0x110000;
+        }
+    }
+
+    return value;
+}
+
+// Like cJSON, measures the string first so it's one allocation of the most
+// it could decode to
+static char *parse_string(parse_state *state) {
+    const char *start = state->cursor + 1;
+    const char *end = start;
+    while (*end && *end != '"') {
+        if (*end == '\\' && end[1]) {
+            end++;
+        }
+        end++;
+    }
+    if (*end != '"') {
+        return NULL;
+    }
+
+    char *out = malloc(end - start + 1);
+    if (!out) {
+        return NULL;
+    }
+
+    char *next = out;
+    for (const char *in = start; in < end; in++) {
+        if (*in != '\\') {
+            *next++ = *in;
+            continue;
+        }
+
+        in++;
+        switch (*in) {
+            case 'b': *next++ = '\b'; break;
+            case 'f': *next++ = '\f'; break;
+            case 'n': *next++ = '\n'; break;
+            case 'r': *next++ = '\r'; break;
+            case 't': *next++ = '\t'; break;
+            case '"':
+            case '\\':
+            case '/':
+                *next++ = *in;
+                break;
+            case 'u': {
+                unsigned code = end - in > 4 ? hex_value(in + 1) : 0x110000;
+                if (code > 0xFFFF) {
+                    free(out);
+                    return NULL;
+                }
+                in += 4;
+                // UTF-8, surrogates are passed through one at a time
+                if (code < 0x80) {
+                    *next++ = code;
+                } else if (code < 0x800) {
+                    *next++ = 0xC0 | (code >> 6);
+                    *next++ = 0x80 | (code & 0x3F);
+                } else {
+                    *next++ = 0xE0 | (code >> 12);
+                    *next++ = 0x80 | ((code >> 6) & 0x3F);
+                    *next++ = 0x80 | (code & 0x3F);
+                }
+                break;
+            }
+            default:
+                free(out);
+                return NULL;
+        }
+    }
+
+    *next = '\0';
+    state->cursor = end + 1;
+    return out;
+}
+
+static bool parse_number(cJSON *item, parse_state *state) {
+    char *end;
+    double number = strtod(state->cursor, &end);
+    if (end == state->cursor) {
+        return false;
+    }
+
+    item->type = cJSON_Number;
+    item->valuedouble = number;
+    item->valueint = number >= 2147483647.0 ? 2147483647 : number <= -2147483648.0 ? -2147483647 - 1 : (int)number;
+    state->cursor = end;
+    return true;
+}
+
+// Members or elements up to close, each a child node linked after the last
+static bool parse_children(cJSON *item, parse_state *state, char close, bool keyed) {
+    if (++state->depth > CJSON_NESTING_LIMIT) {
+        return false;
+    }
+
+    state->cursor++;
+    skip_whitespace(state);
+    if (*state->cursor == close) {
+        state->cursor++;
+        state->depth--;
+        return true;
+    }
+
+    cJSON *last = NULL;
+    while (true) {
+        cJSON *child = new_item();
+        if (!child) {
+            return false;
+        }
+        if (last) {
+            last->next = child;
+            child->prev = last;
+        } else {
+            item->child = child;
+        }
+        last = child;
+
+        skip_whitespace(state);
+        if (keyed) {
+            if (*state->cursor != '"' || !(child->string = parse_string(state))) {
+                return false;
+            }
+            skip_whitespace(state);
+            if (*state->cursor != ':') {
+                return false;
+            }
+            state->cursor++;
+            skip_whitespace(state);
+        }
+
+        if (!parse_value(child, state)) {
+            return false;
+        }
+
+        skip_whitespace(state);
+        if (*state->cursor == ',') {
+            state->cursor++;
+            continue;
+        }
+        if (*state->cursor != close) {
+            return false;
+        }
+
+        state->cursor++;
+        state->depth--;
+        return true;
+    }
+}
+
+static bool parse_value(cJSON *item, parse_state *state) {
+    const char *cursor = state->cursor;
+    if (strncmp(cursor, "null", 4) == 0) {
+        item->type = cJSON_NULL;
+        state->cursor += 4;
+        return true;
+    }
+    if (strncmp(cursor, "false", 5) == 0) {
+        item->type = cJSON_False;
+        state->cursor += 5;
+        return true;
+    }
+    if (strncmp(cursor, "true", 4) == 0) {
+        item->type = cJSON_True;
+        item->valueint = 1;
+        state->cursor += 4;
+        return true;
+    }
+
+    switch (*cursor) {
+        case '"':
+            item->type = cJSON_String;
+            return (item->valuestring = parse_string(state)) != NULL;
+        case '[':
+            item->type = cJSON_Array;
+            return parse_children(item, state, ']', false);
+        case '{':
+            item->type = cJSON_Object;
+            return parse_children(item, state, '}', true);
+        default:
+            return (*cursor == '-' || isdigit((unsigned char)*cursor)) && parse_number(item, state);
+    }
+}
+
+cJSON *cJSON_Parse(const char *value) {
+    error_ptr = NULL;
+    if (!value) {
+        return NULL;
+    }
+
+    parse_state state = { value, 0 };
+    cJSON *item = new_item();
+    if (!item) {
+        return NULL;
+    }
+
+    skip_whitespace(&state);
+    if (!parse_value(item, &state)) {
+        error_ptr = state.cursor;
+        cJSON_Delete(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+const char *cJSON_GetErrorPtr(void) {
+    return error_ptr;
+}
+
+void cJSON_Delete(cJSON *item) {
+    while (item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+    cJSON *child = object ? object->child : NULL;
+    while (child && (!child->string || strcasecmp(child->string, string) != 0)) {
+        child = child->next;
+    }
+
+    return child;
+}
+
+char *cJSON_GetStringValue(cJSON *item) {
+    return item && item->type == cJSON_String ? item->valuestring : NULL;
+}
+
+void cJSON_free(void *object) {
+    free(object);
+}
@@ -0,0 +1,55 @@
+#ifndef cJSON__h
+#define cJSON__h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stand-in for the cJSON the SDK bundles, with the same tree and the same
+ * allocations: one malloc per node, one per object key and one per string
+ * value, all through the firmware's malloc so the heap stub counts them.
+ * main/ doesn't use it anymore, it's kept as the baseline json_bench and
+ * test_json_stream measure the firmware's parsers against. Only the calls
+ * main/ used to make.
+ */
+#define cJSON_Invalid (0)
+#define cJSON_False   (1 << 0)
+#define cJSON_True    (1 << 1)
+#define cJSON_NULL    (1 << 2)
+#define cJSON_Number  (1 << 3)
+#define cJSON_String  (1 << 4)
+#define cJSON_Array   (1 << 5)
+#define cJSON_Object  (1 << 6)
+
+#define CJSON_NESTING_LIMIT 1000
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    // Key, for a member of an object
+    char *string;
+} cJSON;
+
+cJSON *cJSON_Parse(const char *value);
+// Where the last failed parse gave up
+const char *cJSON_GetErrorPtr(void);
+void cJSON_Delete(cJSON *item);
+// Keys are compared without case, same as cJSON
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
+char *cJSON_GetStringValue(cJSON *item);
+void cJSON_free(void *object);
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
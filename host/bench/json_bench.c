@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "json.h"
+
+#include "sim_hooks.h"
+
+/*
+ * What the buffered path costs per response, before and after cJSON was
+ * taken out: the old cJSON_Parse, cJSON_GetObjectItem and cJSON_ArrayForEach
+ * walk against json_list_find and json_list_next over the same bodies.
+ * Neither sends anything, it's only the parse.
+ *
+ * The in place walk writes over the buffer it's given, so each of its runs
+ * starts with a copy of the body back into it and that copy is timed along
+ * with it. Times are wall clock on the host, so they only mean anything
+ * relative to each other. The allocation counts are what the heap stub saw
+ * for one parse and are the same on the chip.
+ */
+#define DEFAULT_ITERATIONS 2000
+#define MIN_BODY_SIZE 1024
+#define MAX_BODY_SIZE (32 * 1024)
+
+typedef struct {
+    int values;
+    int value_bytes;
+    uint32_t allocs;
+    uint32_t peak_bytes;
+    double us_per_parse;
+} parse_result;
+
+// A response in the API's shape padded out to about size bytes, same as
+// test_json_stream's
+static void build_body(char *body, int size) {
+    int length = sprintf(body, "{\"errorMessage\":\"\",\"meta\":{\"spot\":\"wedge\",\"days\":2},\"data\":[");
+    int count = 0;
+    while (length < size - 48) {
+        length += sprintf(&body[length], "%s\"Tue 10/13 High 5.4 ft at 10:48am #%d\"", count > 0 ? "," : "", count);
+        count++;
+    }
+    sprintf(&body[length], "]}");
+}
+
+static double now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+// Returns false if the tree didn't fit in the heap
+static bool parse_with_cjson(const char *body, parse_result *result) {
+    result->values = 0;
+    result->value_bytes = 0;
+
+    cJSON *json = cJSON_Parse(body);
+    if (json == NULL) {
+        return false;
+    }
+    cJSON *data_value = cJSON_GetObjectItem(json, "data");
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, data_value) {
+        char *text = cJSON_GetStringValue(item);
+        result->values++;
+        result->value_bytes += strlen(text);
+    }
+    cJSON_Delete(json);
+    return true;
+}
+
+static bool parse_in_place(char *buffer, const char *body, int length, parse_result *result) {
+    result->values = 0;
+    result->value_bytes = 0;
+
+    memcpy(buffer, body, length + 1);
+    json_list_iter iter;
+    if (!json_list_find(&iter, buffer, length)) {
+        return false;
+    }
+    char *value;
+    int value_length;
+    while (json_list_next(&iter, &value, &value_length)) {
+        result->values++;
+        result->value_bytes += value_length;
+    }
+    return true;
+}
+
+static bool measure(bool in_place, char *buffer, const char *body, int length, int iterations, parse_result *result) {
+    sim_reset_heap_peak();
+    sim_heap_stats before = sim_get_heap_stats();
+    bool ok = in_place ? parse_in_place(buffer, body, length, result) : parse_with_cjson(body, result);
+    sim_heap_stats after = sim_get_heap_stats();
+    result->allocs = after.allocs - before.allocs;
+    result->peak_bytes = after.peak_bytes_in_use - before.bytes_in_use;
+    if (!ok) {
+        return false;
+    }
+
+    parse_result repeat;
+    double start = now_us();
+    for (int i = 0; i < iterations; i++) {
+        if (in_place) {
+            parse_in_place(buffer, body, length, &repeat);
+        } else {
+            parse_with_cjson(body, &repeat);
+        }
+    }
+    result->us_per_parse = (now_us() - start) / iterations;
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--iterations N]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int iterations = DEFAULT_ITERATIONS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (iterations <= 0) {
+        usage(argv[0]);
+    }
+
+    static char body[MAX_BODY_SIZE + 64];
+    static char buffer[MAX_BODY_SIZE + 64];
+    int failures = 0;
+
+    printf("%6s %6s | %10s %7s %10s | %11s %7s %10s\n", "body", "values",
+           "cJSON us", "allocs", "peak B", "in place us", "allocs", "peak B");
+    for (int size = MIN_BODY_SIZE; size <= MAX_BODY_SIZE; size *= 2) {
+        build_body(body, size);
+        int length = strlen(body);
+
+        parse_result tree;
+        parse_result walk;
+        bool tree_ok = measure(false, buffer, body, length, iterations, &tree);
+        bool walk_ok = measure(true, buffer, body, length, iterations, &walk);
+
+        // The in place walk has to find everything cJSON did without touching the heap
+        if (!walk_ok || walk.allocs != 0 || walk.peak_bytes != 0 ||
+            (tree_ok && (walk.values != tree.values || walk.value_bytes != tree.value_bytes))) {
+            fprintf(stderr, "In place walk of the %d byte body went wrong\n", length);
+            failures++;
+        }
+
+        printf("%6d %6d | ", length, walk.values);
+        if (tree_ok) {
+            printf("%10.1f %7u %10u", tree.us_per_parse, tree.allocs, tree.peak_bytes);
+        } else {
+            printf("%29s", "out of heap");
+        }
+        printf(" | %11.1f %7u %10u\n", walk.us_per_parse, walk.allocs, walk.peak_bytes);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+// Everything the sketch includes, pulled in here first so none of it ends up
+// inside the namespace below
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <TVout.h>
+#include <TVoutfonts/fontALL.h>
+#include <SoftwareSerial.h>
+#include <util/crc16.h>
+
+#include "display_sim.h"
+
+// Its own namespace so the sketch's globals can't clash with the firmware's
+namespace display {
+#include "../../spot_check_display/spot_check_display.h"
+#include "sketch_prototypes.h"
+#include "../../spot_check_display/spot_check_display.ino"
+}
+
+// How long loop() sleeps between runs so it doesn't starve the firmware's
+// threads. Well under a byte time at the fastest baud rate
+#define LOOP_IDLE_US 100
+
+// Held by the sketch's thread while it runs. The sketch can sit in one
+// loop() for as long as a list takes to scroll, so it also lets go in
+// display_sim_yield whenever someone's waiting
+static pthread_mutex_t sketch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int waiting = 0;
+
+static void lock_sketch()
+{
+  __atomic_add_fetch(&waiting, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&sketch_lock);
+  __atomic_sub_fetch(&waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+void display_sim_yield(void)
+{
+  while (__atomic_load_n(&waiting, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_unlock(&sketch_lock);
+    sched_yield();
+    pthread_mutex_lock(&sketch_lock);
+  }
+}
+
+static void *sketch_thread(void *arg)
+{
+  while (true) {
+    pthread_mutex_lock(&sketch_lock);
+    display::loop();
+    pthread_mutex_unlock(&sketch_lock);
+    usleep(LOOP_IDLE_US);
+  }
+
+  return NULL;
+}
+
+void display_sim_start(void)
+{
+  pthread_mutex_lock(&sketch_lock);
+  display::setup();
+  pthread_mutex_unlock(&sketch_lock);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, sketch_thread, NULL);
+  pthread_detach(thread);
+}
+
+display_sim_stats get_display_sim_stats(void)
+{
+  lock_sketch();
+  display_sim_stats stats = {
+    display::arena_dropped_bytes,
+    display::arena_dropped_msgs,
+    display::frames_drawn,
+    display::frame_late_max_ms,
+    display::rx_overflows,
+    display::rx_timeouts,
+    (uint32_t)display::time_to_first_pixel_ms,
+    display::front_list->count,
+    display::strip.shows,
+    display::strip.pixels_set
+  };
+  pthread_mutex_unlock(&sketch_lock);
+  return stats;
+}
+
+void display_sim_stop_scrolling(void)
+{
+  lock_sketch();
+  display::playing = false;
+  display::scroll_step = -1;
+  pthread_mutex_unlock(&sketch_lock);
+}
+
+int display_sim_message(int index, char *out, int size)
+{
+  lock_sketch();
+  display::message_list *list = display::front_list;
+  if (index >= list->count || list->is_columns) {
+    pthread_mutex_unlock(&sketch_lock);
+    return -1;
+  }
+
+  int length = 0;
+  for (uint16_t i = display::list_message_start(list, index); i < list->msg_end[index]; i++) {
+    uint8_t b = list->arena[i];
+    bool is_word = (b & DICT_TOKEN_FLAG) && (b & ~DICT_TOKEN_FLAG) < sizeof(display::dict_words) / sizeof(display::dict_words[0]);
+    const char *word = is_word ? display::dict_words[b & ~DICT_TOKEN_FLAG] : NULL;
+    int word_length = is_word ? strlen(word) : 1;
+    for (int c = 0; c < word_length && length < size - 1; c++) {
+      // Same as the sign, a token it doesn't know scrolls as '?'
+      out[length++] = is_word ? word[c] : (b & DICT_TOKEN_FLAG) ? '?' : (char)b;
+    }
+  }
+  out[length] = '\0';
+  pthread_mutex_unlock(&sketch_lock);
+  return length;
+}
@@ -0,0 +1,51 @@
+#ifndef DISPLAY_SIM_H
+#define DISPLAY_SIM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The display sketch built for the host, on its own thread. It talks to the
+ * firmware over the serial line like the real one, so both ends of the line
+ * have to be set up with serial_line_init first.
+ */
+typedef struct {
+    // The sketch's own diagnostics
+    uint16_t arena_dropped_bytes;
+    uint8_t arena_dropped_msgs;
+    uint32_t frames_drawn;
+    uint16_t frame_late_max_ms;
+    uint16_t rx_overflows;
+    uint16_t rx_timeouts;
+    // From LIST_START arriving to the list's first frame, for the last list
+    uint32_t time_to_first_pixel_ms;
+    // Messages in the list on the sign
+    uint8_t messages_shown;
+    // What went out to the LEDs
+    uint32_t strip_shows;
+    uint32_t pixels_set;
+} display_sim_stats;
+
+// Runs setup(), then loop() for as long as the process does
+void display_sim_start(void);
+display_sim_stats get_display_sim_stats(void);
+// Stops whatever list is scrolling and leaves the sign as it is, so what's
+// sent next isn't competing with show()
+void display_sim_stop_scrolling(void);
+/*
+ * Message index of the list on the sign with its dictionary tokens
+ * expanded, null terminated and cut to fit out. Returns its length, or -1
+ * if there's no such message or the list is pre-rendered columns.
+ */
+int display_sim_message(int index, char *out, int size);
+// For the sketch's serial port, lets anyone waiting on its state in
+void display_sim_yield(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef ADAFRUIT_NEOPIXEL_H
+#define ADAFRUIT_NEOPIXEL_H
+
+#include <Arduino.h>
+
+#include "serial_line.h"
+
+#define NEO_GRB     ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_KHZ800  0x0000
+
+// 24 bits a pixel at 800KHz
+#define NEOPIXEL_US_PER_PIXEL 30
+// More than the sketch's strip has
+#define NEOPIXEL_MAX_PIXELS 512
+
+/*
+ * Counts what the sketch asks of the strip and keeps the colors it sets
+ * instead of driving one. show() takes as long as clocking the whole strip
+ * out would, which on the real board is time with interrupts off, so
+ * SoftwareSerial misses whatever arrives from the ESP meanwhile.
+ */
+class Adafruit_NeoPixel {
+ public:
+  Adafruit_NeoPixel(uint16_t n, int16_t pin, uint16_t type)
+    : num_pixels(n < NEOPIXEL_MAX_PIXELS ? n : NEOPIXEL_MAX_PIXELS), shows(0), pixels_set(0), pixels() {}
+
+  void begin() {}
+
+  void show()
+  {
+    shows++;
+    int64_t done_us = esp_timer_get_time() + (int64_t)num_pixels * NEOPIXEL_US_PER_PIXEL;
+    serial_line_deaf_until(SERIAL_TO_DISPLAY, done_us);
+    sim_sleep_until(done_us);
+  }
+
+  void setPixelColor(uint16_t n, uint32_t c)
+  {
+    if (n < num_pixels) {
+      pixels[n] = c;
+      pixels_set++;
+    }
+  }
+
+  uint32_t getPixelColor(uint16_t n) const
+  {
+    return n < num_pixels ? pixels[n] : 0;
+  }
+
+  void setBrightness(uint8_t brightness) {}
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b)
+  {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+  uint16_t num_pixels;
+  uint32_t shows;
+  uint32_t pixels_set;
+  uint32_t pixels[NEOPIXEL_MAX_PIXELS];
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "sim_time.h"
+
+/*
+ * Just enough of the Arduino core for the display sketch. Time comes from
+ * the same clock as the ESP side, and program memory is ordinary memory.
+ * Reads from it are counted though, on the AVR each one is a trip to flash.
+ */
+#define PROGMEM
+#define F(string) (string)
+#define pgm_read_byte_near(address) (pgm_reads()++, *(const uint8_t *)(address))
+#define strlen_P(string) (pgm_reads() += strlen(string) + 1, strlen(string))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+inline uint32_t &pgm_reads()
+{
+  static uint32_t count;
+  return count;
+}
+
+inline unsigned long millis()
+{
+  return esp_timer_get_time() / 1000;
+}
+
+inline void delay(unsigned long ms)
+{
+  sim_sleep_until(esp_timer_get_time() + (int64_t)ms * 1000);
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SOFTWARE_SERIAL_H
+#define SOFTWARE_SERIAL_H
+
+#include <Arduino.h>
+
+#include "serial_line.h"
+#include "display_sim.h"
+
+/*
+ * The display's end of the serial line. Reads come off SERIAL_TO_DISPLAY,
+ * which the host sets up with SoftwareSerial's 64 byte RX buffer, and writes
+ * block until they're clocked out like the real one does. Every wait in the
+ * sketch polls available(), so that's where the host gets to look at its state.
+ */
+class SoftwareSerial {
+ public:
+  SoftwareSerial(uint8_t rx_pin, uint8_t tx_pin) : baud(0) {}
+
+  void begin(long speed)
+  {
+    baud = speed;
+  }
+
+  void end()
+  {
+    baud = 0;
+  }
+
+  int available()
+  {
+    display_sim_yield();
+    return baud ? serial_line_available(SERIAL_TO_DISPLAY) : 0;
+  }
+
+  int read()
+  {
+    uint8_t c;
+    if (!baud || serial_line_read(SERIAL_TO_DISPLAY, &c, 1, baud, 0) != 1) {
+      return -1;
+    }
+
+    return c;
+  }
+
+  // Whether the RX buffer filled up and dropped something since the last call
+  bool overflow()
+  {
+    return baud && serial_line_take_overflow(SERIAL_TO_DISPLAY);
+  }
+
+  size_t write(const uint8_t *buffer, size_t size)
+  {
+    serial_line_write(SERIAL_FROM_DISPLAY, buffer, size, baud);
+    sim_sleep_until(serial_line_tx_done_us(SERIAL_FROM_DISPLAY));
+    return size;
+  }
+
+ private:
+  uint32_t baud;
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef TVOUT_H
+#define TVOUT_H
+
+// The sketch only uses TVout for its fonts, see TVoutfonts/fontALL.h
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef FONTALL_H
+#define FONTALL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+// The firmware keeps its own copy of TVout's font4x6 for rendering columns,
+// so that's the one the sketch gets too
+namespace tvout {
+#include "../../../../main/font.c"
+}
+
+using tvout::font4x6;
+
+#endif
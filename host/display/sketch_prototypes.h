@@ -0,0 +1,4 @@
+// Included inside the sketch's namespace, just before it. The Arduino IDE
+// adds a prototype for every function in a sketch, so the sketch can call
+// ones defined further down. These are the ones it does
+void link_send_response_payload(uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t length);
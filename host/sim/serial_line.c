@@ -0,0 +1,183 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "esp_timer.h"
+#include "sim_time.h"
+#include "serial_line.h"
+
+typedef struct {
+    uint8_t byte;
+    uint32_t baud;
+    int64_t arrival_us;
+} line_byte;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    // Oldest first, queue[head] through queue[head + count - 1]
+    line_byte queue[SERIAL_LINE_QUEUE_SIZE];
+    int head;
+    int count;
+    int rx_buffer_size;
+    int64_t busy_until_us;
+    // Anything arriving in here is missed
+    int64_t deaf_from_us;
+    int64_t deaf_until_us;
+    bool overflowed;
+    serial_line_stats stats;
+} serial_line;
+
+static serial_line lines[SERIAL_DIRECTION_COUNT];
+
+void serial_line_init(serial_direction direction, int rx_buffer_size) {
+    serial_line *line = &lines[direction];
+    memset(line, 0, sizeof(*line));
+    pthread_mutex_init(&line->lock, NULL);
+    sim_cond_init(&line->changed);
+    line->rx_buffer_size = rx_buffer_size;
+}
+
+/*
+ * How many bytes have arrived by now. Ones that landed while the receiver
+ * was deaf are dropped, and so are the newest ones past the receiver's
+ * buffer size, the way SoftwareSerial drops what comes in while its buffer
+ * is full. Call with the lock held.
+ */
+static int arrived(serial_line *line, int64_t now_us) {
+    int count = 0;
+    while (count < line->count && line->queue[line->head + count].arrival_us <= now_us) {
+        line_byte *next = &line->queue[line->head + count];
+        if (next->arrival_us >= line->deaf_from_us && next->arrival_us < line->deaf_until_us) {
+            memmove(next, next + 1, (line->count - count - 1) * sizeof(line_byte));
+            line->count--;
+            line->stats.bytes_missed++;
+            continue;
+        }
+        count++;
+    }
+
+    if (line->rx_buffer_size > 0 && count > line->rx_buffer_size) {
+        int dropped = count - line->rx_buffer_size;
+        line_byte *keep_end = &line->queue[line->head + line->rx_buffer_size];
+        memmove(keep_end, keep_end + dropped, (line->count - count) * sizeof(line_byte));
+        line->count -= dropped;
+        line->stats.bytes_overflowed += dropped;
+        line->overflowed = true;
+        count = line->rx_buffer_size;
+    }
+
+    return count;
+}
+
+void serial_line_write(serial_direction direction, const uint8_t *data, int length, uint32_t baud) {
+    serial_line *line = &lines[direction];
+    pthread_mutex_lock(&line->lock);
+
+    if (line->head + line->count + length > SERIAL_LINE_QUEUE_SIZE) {
+        memmove(line->queue, &line->queue[line->head], line->count * sizeof(line_byte));
+        line->head = 0;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t start_us = line->busy_until_us > now_us ? line->busy_until_us : now_us;
+    for (int i = 0; i < length; i++) {
+        int64_t arrival_us = start_us + ((int64_t)(i + 1) * SERIAL_BITS_PER_BYTE * 1000000) / baud;
+        if (line->head + line->count == SERIAL_LINE_QUEUE_SIZE) {
+            line->stats.bytes_lost++;
+            continue;
+        }
+
+        line_byte *slot = &line->queue[line->head + line->count++];
+        slot->byte = data[i];
+        slot->baud = baud;
+        slot->arrival_us = arrival_us;
+        line->busy_until_us = arrival_us;
+        line->stats.bytes_sent++;
+    }
+
+    pthread_cond_broadcast(&line->changed);
+    pthread_mutex_unlock(&line->lock);
+}
+
+int64_t serial_line_tx_done_us(serial_direction direction) {
+    serial_line *line = &lines[direction];
+    pthread_mutex_lock(&line->lock);
+    int64_t done_us = line->busy_until_us;
+    pthread_mutex_unlock(&line->lock);
+    return done_us;
+}
+
+int serial_line_available(serial_direction direction) {
+    serial_line *line = &lines[direction];
+    pthread_mutex_lock(&line->lock);
+    int count = arrived(line, esp_timer_get_time());
+    pthread_mutex_unlock(&line->lock);
+    return count;
+}
+
+int serial_line_read(serial_direction direction, uint8_t *out, int length, uint32_t baud, int64_t deadline_us) {
+    serial_line *line = &lines[direction];
+    int read = 0;
+    pthread_mutex_lock(&line->lock);
+
+    while (true) {
+        int64_t now_us = esp_timer_get_time();
+        int available = arrived(line, now_us);
+        while (available > 0 && read < length) {
+            line_byte *next = &line->queue[line->head++];
+            line->count--;
+            available--;
+            // A receiver at the wrong rate samples the bits in the wrong places
+            if (next->baud != baud) {
+                out[read++] = next->byte ^ 0xA5;
+                line->stats.bytes_garbled++;
+            } else {
+                out[read++] = next->byte;
+            }
+        }
+
+        if (read == length || now_us >= deadline_us) {
+            break;
+        }
+
+        // Sleep until the next byte lands, or a write wakes us
+        int64_t wake_us = deadline_us;
+        if (line->count > 0 && line->queue[line->head].arrival_us < wake_us) {
+            wake_us = line->queue[line->head].arrival_us;
+        }
+        struct timespec wake = sim_deadline(wake_us);
+        pthread_cond_timedwait(&line->changed, &line->lock, &wake);
+    }
+
+    pthread_mutex_unlock(&line->lock);
+    return read;
+}
+
+void serial_line_deaf_until(serial_direction direction, int64_t until_us) {
+    serial_line *line = &lines[direction];
+    pthread_mutex_lock(&line->lock);
+    int64_t now_us = esp_timer_get_time();
+    // Settle what arrived before now against the last window
+    arrived(line, now_us);
+    line->deaf_from_us = now_us;
+    line->deaf_until_us = until_us;
+    pthread_mutex_unlock(&line->lock);
+}
+
+bool serial_line_take_overflow(serial_direction direction) {
+    serial_line *line = &lines[direction];
+    pthread_mutex_lock(&line->lock);
+    arrived(line, esp_timer_get_time());
+    bool overflowed = line->overflowed;
+    line->overflowed = false;
+    pthread_mutex_unlock(&line->lock);
+    return overflowed;
+}
+
+serial_line_stats get_serial_line_stats(serial_direction direction) {
+    serial_line *line = &lines[direction];
+    pthread_mutex_lock(&line->lock);
+    serial_line_stats copy = line->stats;
+    pthread_mutex_unlock(&line->lock);
+    return copy;
+}
@@ -0,0 +1,63 @@
+#ifndef SERIAL_LINE_H
+#define SERIAL_LINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The wire between the ESP's UART and the display's SoftwareSerial. Each
+ * direction queues bytes with the time they finish arriving, one start bit,
+ * eight data bits and a stop bit at the sender's baud rate after the line is
+ * free. A byte read at a different rate than it was sent at comes out
+ * garbled, like it would on the pins.
+ */
+#define SERIAL_LINE_QUEUE_SIZE 4096
+#define SERIAL_BITS_PER_BYTE 10
+
+typedef enum {
+    SERIAL_TO_DISPLAY,
+    SERIAL_FROM_DISPLAY,
+    SERIAL_DIRECTION_COUNT
+} serial_direction;
+
+typedef struct {
+    uint32_t bytes_sent;
+    uint32_t bytes_garbled;
+    // Dropped because the receiver's buffer was full
+    uint32_t bytes_overflowed;
+    // Dropped because SERIAL_LINE_QUEUE_SIZE was
+    uint32_t bytes_lost;
+    // Dropped because they arrived while the receiver wasn't listening
+    uint32_t bytes_missed;
+} serial_line_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// rx_buffer_size is how many arrived bytes the receiver holds before it
+// drops more, 0 for no limit
+void serial_line_init(serial_direction direction, int rx_buffer_size);
+// Queues the bytes and returns straight away, like a UART with a big fifo
+void serial_line_write(serial_direction direction, const uint8_t *data, int length, uint32_t baud);
+// When the last byte written will have finished arriving
+int64_t serial_line_tx_done_us(serial_direction direction);
+// Bytes that have arrived and not been read
+int serial_line_available(serial_direction direction);
+/*
+ * Read up to length bytes, waiting until deadline_us (esp_timer time) for
+ * them to arrive. Returns how many were read. baud is the receiver's rate.
+ */
+int serial_line_read(serial_direction direction, uint8_t *out, int length, uint32_t baud, int64_t deadline_us);
+// Bytes that finish arriving from now until until_us are missed, the way
+// SoftwareSerial misses what comes in while interrupts are off
+void serial_line_deaf_until(serial_direction direction, int64_t until_us);
+// Whether anything was dropped for a full buffer since the last call
+bool serial_line_take_overflow(serial_direction direction);
+serial_line_stats get_serial_line_stats(serial_direction direction);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include "sim_hooks.h"
+#include "standin.h"
+
+#define MAX_REQUEST_LENGTH 2048
+#define MAX_ENDPOINT_LENGTH 32
+#define MAX_FIXTURES 16
+#define MAX_CONNECTIONS 8
+// Added to zlib's window bits to get a gzip wrapper
+#define GZIP_WRAPPER_BITS 16
+#define SEND_CHUNK_SIZE 512
+#define DNS_HEADER_SIZE 12
+#define DNS_MAX_PACKET_SIZE 512
+#define DNS_RCODE_SERVFAIL 2
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+
+typedef struct {
+    char endpoint[MAX_ENDPOINT_LENGTH];
+    int version;
+    char etag[MAX_ENDPOINT_LENGTH + 16];
+    uint8_t *body;
+    int body_length;
+} fixture;
+
+static pthread_mutex_t standin_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *fixtures_dir;
+static const char *host;
+static fixture fixtures[MAX_FIXTURES];
+static int num_fixtures;
+static int current_version;
+// One endpoint can be held at another version, see standin_set_endpoint_version
+static char held_endpoint[MAX_ENDPOINT_LENGTH];
+static int held_version;
+static bool closing;
+static int gzip_window_bits = STANDIN_GZIP_WINDOW_BITS;
+static int max_age_s;
+static uint32_t response_delay_ms;
+static int open_socks[MAX_CONNECTIONS];
+static int num_open_socks;
+static standin_stats stats;
+static uint32_t dns_ttl_s = STANDIN_DNS_TTL_S;
+static bool dns_failing;
+
+void standin_set_version(int version) {
+    pthread_mutex_lock(&standin_lock);
+    current_version = version;
+    held_endpoint[0] = '\0';
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_set_endpoint_version(const char *endpoint, int version) {
+    pthread_mutex_lock(&standin_lock);
+    snprintf(held_endpoint, sizeof(held_endpoint), "%s", endpoint);
+    held_version = version;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_set_max_age_s(int new_max_age_s) {
+    pthread_mutex_lock(&standin_lock);
+    max_age_s = new_max_age_s;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_set_response_delay_ms(uint32_t delay_ms) {
+    pthread_mutex_lock(&standin_lock);
+    response_delay_ms = delay_ms;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_set_gzip_window_bits(int window_bits) {
+    pthread_mutex_lock(&standin_lock);
+    gzip_window_bits = window_bits;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_set_connection_close(bool close_after_response) {
+    pthread_mutex_lock(&standin_lock);
+    closing = close_after_response;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_drop_connections(void) {
+    pthread_mutex_lock(&standin_lock);
+    for (int i = 0; i < num_open_socks; i++) {
+        shutdown(open_socks[i], SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&standin_lock);
+}
+
+standin_stats get_standin_stats(void) {
+    pthread_mutex_lock(&standin_lock);
+    standin_stats copy = stats;
+    pthread_mutex_unlock(&standin_lock);
+    return copy;
+}
+
+// Compressed for each response, so a change of window applies from the next
+// one. NULL if zlib failed, otherwise for the caller to sim_free
+static uint8_t *gzip_body(const fixture *file, int window_bits, int *gzipped_length) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits + GZIP_WRAPPER_BITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+
+    uLong bound = deflateBound(&stream, file->body_length);
+    uint8_t *gzipped = sim_malloc(bound);
+    stream.next_in = file->body;
+    stream.avail_in = file->body_length;
+    stream.next_out = gzipped;
+    stream.avail_out = bound;
+    bool done = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+    *gzipped_length = stream.total_out;
+    deflateEnd(&stream);
+    if (!done) {
+        sim_free(gzipped);
+        return NULL;
+    }
+    return gzipped;
+}
+
+// Read the first time each is asked for. Call with the lock held
+static fixture *find_fixture(const char *endpoint, int version) {
+    for (int i = 0; i < num_fixtures; i++) {
+        if (fixtures[i].version == version && strcmp(fixtures[i].endpoint, endpoint) == 0) {
+            return &fixtures[i];
+        }
+    }
+
+    if (num_fixtures == MAX_FIXTURES) {
+        return NULL;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s_%d.json", fixtures_dir, endpoint, version);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    fixture *file = &fixtures[num_fixtures];
+    memset(file, 0, sizeof(*file));
+    fseek(f, 0, SEEK_END);
+    file->body_length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->body = sim_malloc(file->body_length);
+    bool read = fread(file->body, 1, file->body_length, f) == (size_t)file->body_length;
+    fclose(f);
+    if (!read) {
+        sim_free(file->body);
+        return NULL;
+    }
+
+    snprintf(file->endpoint, sizeof(file->endpoint), "%s", endpoint);
+    file->version = version;
+    snprintf(file->etag, sizeof(file->etag), "\"%s-%d\"", endpoint, version);
+    num_fixtures++;
+    return file;
+}
+
+static bool send_all(int sock, const void *data, int length) {
+    const uint8_t *next = data;
+    while (length > 0) {
+        ssize_t sent = send(sock, next, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        next += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+// Value of header key in a request, copied out. Returns false if it isn't there
+static bool get_header(const char *request, const char *key, char *value, int max_length) {
+    const char *line = strstr(request, "\r\n");
+    int key_length = strlen(key);
+    while (line && line[2] != '\r') {
+        line += 2;
+        if (strncasecmp(line, key, key_length) == 0 && line[key_length] == ':') {
+            const char *start = line + key_length + 1;
+            while (*start == ' ') {
+                start++;
+            }
+            const char *end = strstr(start, "\r\n");
+            int length = end - start < max_length - 1 ? end - start : max_length - 1;
+            memcpy(value, start, length);
+            value[length] = '\0';
+            return true;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return false;
+}
+
+static bool send_chunked(int sock, const uint8_t *body, int length) {
+    char size_line[16];
+    for (int offset = 0; offset < length; offset += SEND_CHUNK_SIZE) {
+        int chunk_length = length - offset < SEND_CHUNK_SIZE ? length - offset : SEND_CHUNK_SIZE;
+        int line_length = snprintf(size_line, sizeof(size_line), "%x\r\n", chunk_length);
+        if (!send_all(sock, size_line, line_length) || !send_all(sock, &body[offset], chunk_length) || !send_all(sock, "\r\n", 2)) {
+            return false;
+        }
+    }
+
+    return send_all(sock, "0\r\n\r\n", 5);
+}
+
+// Returns false if the connection should close
+static bool respond(int sock, const char *request) {
+    char endpoint[MAX_ENDPOINT_LENGTH];
+    if (sscanf(request, "GET /%31[^? ]", endpoint) != 1) {
+        endpoint[0] = '\0';
+    }
+
+    char value[128];
+    bool host_matches = get_header(request, "Host", value, sizeof(value)) && strcmp(value, host) == 0;
+    bool gzip = get_header(request, "Accept-Encoding", value, sizeof(value)) && strstr(value, "gzip");
+    char if_none_match[64] = "";
+    get_header(request, "If-None-Match", if_none_match, sizeof(if_none_match));
+
+    pthread_mutex_lock(&standin_lock);
+    int version = strcmp(endpoint, held_endpoint) == 0 ? held_version : current_version;
+    fixture *file = endpoint[0] ? find_fixture(endpoint, version) : NULL;
+    bool not_modified = file && strcmp(if_none_match, file->etag) == 0;
+    bool close_after = closing;
+    uint32_t delay_ms = response_delay_ms;
+    char cache_control[32];
+    if (max_age_s > 0) {
+        snprintf(cache_control, sizeof(cache_control), "max-age=%d", max_age_s);
+    } else {
+        snprintf(cache_control, sizeof(cache_control), "no-cache");
+    }
+    stats.requests++;
+    stats.host_mismatches += host_matches ? 0 : 1;
+    stats.not_found += file ? 0 : 1;
+    stats.not_modified += not_modified ? 1 : 0;
+    uint8_t *gzipped = NULL;
+    int gzipped_length = 0;
+    if (file && !not_modified && gzip) {
+        gzipped = gzip_body(file, gzip_window_bits, &gzipped_length);
+    }
+    stats.gzip_responses += gzipped ? 1 : 0;
+    if (file && !not_modified) {
+        stats.body_bytes_sent += gzipped ? gzipped_length : file->body_length;
+    }
+    pthread_mutex_unlock(&standin_lock);
+
+    if (delay_ms > 0) {
+        usleep(delay_ms * 1000);
+    }
+
+    const char *connection = close_after ? "Connection: close\r\n" : "";
+    char headers[256];
+    if (!file) {
+        int length = snprintf(headers, sizeof(headers), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n%s\r\n", connection);
+        return send_all(sock, headers, length) && !close_after;
+    }
+
+    if (not_modified) {
+        int length = snprintf(headers, sizeof(headers),
+                              "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: %s\r\n%s\r\n",
+                              file->etag, cache_control, connection);
+        return send_all(sock, headers, length) && !close_after;
+    }
+
+    if (gzipped) {
+        int length = snprintf(headers, sizeof(headers),
+                              "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Encoding: gzip\r\n"
+                              "Transfer-Encoding: chunked\r\nETag: %s\r\nCache-Control: %s\r\n%s\r\n",
+                              file->etag, cache_control, connection);
+        bool sent = send_all(sock, headers, length) && send_chunked(sock, gzipped, gzipped_length);
+        sim_free(gzipped);
+        return sent && !close_after;
+    }
+
+    int length = snprintf(headers, sizeof(headers),
+                          "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                          "ETag: %s\r\nCache-Control: %s\r\n%s\r\n",
+                          file->body_length, file->etag, cache_control, connection);
+    return send_all(sock, headers, length) && send_all(sock, file->body, file->body_length) && !close_after;
+}
+
+// Kept so standin_drop_connections can find them
+static void track_connection(int sock, bool open) {
+    pthread_mutex_lock(&standin_lock);
+    if (open) {
+        stats.connections++;
+        if (num_open_socks < MAX_CONNECTIONS) {
+            open_socks[num_open_socks++] = sock;
+        }
+    } else {
+        for (int i = 0; i < num_open_socks; i++) {
+            if (open_socks[i] == sock) {
+                open_socks[i] = open_socks[--num_open_socks];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&standin_lock);
+}
+
+static void *connection_thread(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    char request[MAX_REQUEST_LENGTH + 1] = "";
+    int length = 0;
+
+    while (true) {
+        char *end = NULL;
+        while (!(end = strstr(request, "\r\n\r\n"))) {
+            if (length == MAX_REQUEST_LENGTH) {
+                goto done;
+            }
+            ssize_t received = recv(sock, &request[length], MAX_REQUEST_LENGTH - length, 0);
+            if (received <= 0) {
+                goto done;
+            }
+            length += received;
+            request[length] = '\0';
+        }
+
+        if (!respond(sock, request)) {
+            break;
+        }
+
+        // GETs have no body, whatever follows is the next request
+        int request_length = end + 4 - request;
+        length -= request_length;
+        memmove(request, end + 4, length + 1);
+    }
+
+done:
+    track_connection(sock, false);
+    close(sock);
+    return NULL;
+}
+
+static void *http_thread(void *arg) {
+    int listener = (int)(intptr_t)arg;
+    while (true) {
+        int sock = accept(listener, NULL, NULL);
+        if (sock < 0) {
+            continue;
+        }
+
+        // Headers and body go out in separate sends, without this the body
+        // waits on the client's delayed ACK
+        int no_delay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        track_connection(sock, true);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_thread, (void *)(intptr_t)sock) != 0) {
+            track_connection(sock, false);
+            close(sock);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+static int bind_loopback(int type, uint16_t *port) {
+    int sock = socket(AF_INET, type, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    socklen_t address_length = sizeof(address);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) != 0
+        || getsockname(sock, (struct sockaddr *)&address, &address_length) != 0
+        || (type == SOCK_STREAM && listen(sock, 4) != 0)) {
+        close(sock);
+        return -1;
+    }
+
+    *port = ntohs(address.sin_port);
+    return sock;
+}
+
+static uint16_t start_thread(void *(*thread_function)(void *), int sock, uint16_t port) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, thread_function, (void *)(intptr_t)sock) != 0) {
+        close(sock);
+        return 0;
+    }
+
+    pthread_detach(thread);
+    return port;
+}
+
+uint16_t standin_start_http(const char *fixture_dir, const char *expected_host) {
+    fixtures_dir = fixture_dir;
+    host = expected_host;
+
+    uint16_t port;
+    int listener = bind_loopback(SOCK_STREAM, &port);
+    return listener < 0 ? 0 : start_thread(http_thread, listener, port);
+}
+
+void standin_set_dns_ttl_s(uint32_t ttl_s) {
+    pthread_mutex_lock(&standin_lock);
+    dns_ttl_s = ttl_s;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+void standin_set_dns_failing(bool failing) {
+    pthread_mutex_lock(&standin_lock);
+    dns_failing = failing;
+    pthread_mutex_unlock(&standin_lock);
+}
+
+static int put_u16(uint8_t *data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value;
+    return 2;
+}
+
+static int put_u32(uint8_t *data, uint32_t value) {
+    put_u16(data, value >> 16);
+    return 2 + put_u16(&data[2], value);
+}
+
+// Name, type, class and TTL of a record, the data length and data are up to the caller
+static int put_record_header(uint8_t *data, uint16_t name_offset, uint16_t type, uint32_t ttl_s) {
+    int length = put_u16(data, 0xC000 | name_offset);   // Compressed, a pointer to the name
+    length += put_u16(&data[length], type);
+    length += put_u16(&data[length], 1);                // IN
+    return length + put_u32(&data[length], ttl_s);
+}
+
+// The question copied back with a CNAME and an A record after it, or with
+// SERVFAIL and no answers while failing
+static int build_dns_answer(uint8_t *packet, int length, uint32_t ttl_s, bool failing) {
+    if (length < DNS_HEADER_SIZE || length + 64 > DNS_MAX_PACKET_SIZE) {
+        return 0;
+    }
+
+    packet[2] = 0x81;                       // Response, recursion desired
+    packet[3] = failing ? 0x80 | DNS_RCODE_SERVFAIL : 0x80;
+    put_u16(&packet[6], failing ? 0 : 2);
+    memset(&packet[8], 0, 4);               // No authority or additional records
+    if (failing) {
+        return length;
+    }
+
+    // cdn.<the question's name>
+    length += put_record_header(&packet[length], DNS_HEADER_SIZE, DNS_TYPE_CNAME, ttl_s);
+    length += put_u16(&packet[length], 6);
+    uint16_t alias_offset = length;
+    memcpy(&packet[length], "\3cdn", 4);
+    length += 4;
+    length += put_u16(&packet[length], 0xC000 | DNS_HEADER_SIZE);
+
+    length += put_record_header(&packet[length], alias_offset, DNS_TYPE_A, ttl_s * 2);
+    length += put_u16(&packet[length], 4);
+    length += put_u32(&packet[length], INADDR_LOOPBACK);
+    return length;
+}
+
+static void *dns_thread(void *arg) {
+    int sock = (int)(intptr_t)arg;
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        ssize_t length = recvfrom(sock, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_length);
+        if (length <= 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&standin_lock);
+        stats.dns_queries++;
+        uint32_t ttl_s = dns_ttl_s;
+        bool failing = dns_failing;
+        pthread_mutex_unlock(&standin_lock);
+
+        int answer_length = build_dns_answer(packet, length, ttl_s, failing);
+        if (answer_length > 0) {
+            sendto(sock, packet, answer_length, 0, (struct sockaddr *)&from, from_length);
+        }
+    }
+
+    return NULL;
+}
+
+uint16_t standin_start_dns(void) {
+    uint16_t port;
+    int sock = bind_loopback(SOCK_DGRAM, &port);
+    return sock < 0 ? 0 : start_thread(dns_thread, sock, port);
+}
@@ -0,0 +1,72 @@
+#ifndef STANDIN_H
+#define STANDIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STANDIN_DNS_TTL_S 300
+// zlib's default and what servers use, matches can reach back 32KB
+#define STANDIN_GZIP_WINDOW_BITS 15
+
+/*
+ * Local stand-in for the API server on 127.0.0.1. It serves
+ * <fixture_dir>/<endpoint>_<version>.json for any /<endpoint>?... request,
+ * with the version picked by standin_set_version. Bodies go out gzipped and
+ * chunked when the request accepts gzip, plain with a Content-Length
+ * otherwise. Every response carries an ETag for its file, so a matching
+ * If-None-Match gets a 304, and Cache-Control: no-cache so the firmware
+ * always asks, unless standin_set_max_age_s says otherwise.
+ * Connections are kept alive unless standin_set_connection_close says
+ * otherwise.
+ *
+ * standin_start_dns adds a DNS server on its own port that answers every A
+ * query with a CNAME to an alias and the alias's A record, 127.0.0.1, the
+ * way a CDN fronted host looks. The CNAME carries the TTL set by
+ * standin_set_dns_ttl_s and the A record twice that.
+ */
+typedef struct {
+    uint32_t connections;
+    uint32_t requests;
+    uint32_t not_modified;
+    uint32_t not_found;
+    uint32_t gzip_responses;
+    // Requests whose Host header wasn't the one passed to standin_start_http
+    uint32_t host_mismatches;
+    // As sent, so compressed for the gzipped ones
+    uint32_t body_bytes_sent;
+    uint32_t dns_queries;
+} standin_stats;
+
+// Returns the port it's listening on, 0 if it couldn't start
+uint16_t standin_start_http(const char *fixture_dir, const char *expected_host);
+uint16_t standin_start_dns(void);
+
+void standin_set_version(int version);
+// Just this endpoint, until the next standin_set_version
+void standin_set_endpoint_version(const char *endpoint, int version);
+// Cache-Control: max-age instead of no-cache when above 0
+void standin_set_max_age_s(int max_age_s);
+// Held back this long before answering, like the round trip and the server's
+// own time on a real connection. 0 until set
+void standin_set_response_delay_ms(uint32_t delay_ms);
+// What gzip compresses with from the next response on, 9 (512 bytes) to 15
+void standin_set_gzip_window_bits(int window_bits);
+// Every response says Connection: close and the socket is closed after it
+void standin_set_connection_close(bool close_after_response);
+// Closes every open connection, like a server timing out idle ones
+void standin_drop_connections(void);
+// STANDIN_DNS_TTL_S until set
+void standin_set_dns_ttl_s(uint32_t ttl_s);
+// Answers every query with SERVFAIL while set, like an upstream outage
+void standin_set_dns_failing(bool failing);
+standin_stats get_standin_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,282 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "sim_time.h"
+#include "sim_hooks.h"
+
+// Main task priority in the SDK, what app_main runs at
+#define MAIN_TASK_PRIORITY 1
+
+struct sim_task {
+    TaskFunction_t function;
+    void *arg;
+    UBaseType_t priority;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+};
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+static pthread_mutex_t critical_lock;
+static __thread struct sim_task *current_task;
+
+__attribute__((constructor)) static void init_critical() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void sim_enter_critical(void) {
+    pthread_mutex_lock(&critical_lock);
+}
+
+void sim_exit_critical(void) {
+    pthread_mutex_unlock(&critical_lock);
+}
+
+static struct sim_task *new_task(TaskFunction_t function, void *arg, UBaseType_t priority) {
+    struct sim_task *task = sim_calloc(1, sizeof(struct sim_task));
+    task->function = function;
+    task->arg = arg;
+    task->priority = priority;
+    pthread_mutex_init(&task->lock, NULL);
+    sim_cond_init(&task->notified);
+    return task;
+}
+
+// Threads that weren't made by xTaskCreate (like whatever runs app_main) get
+// a task the first time they need one
+static struct sim_task *task_self() {
+    if (!current_task) {
+        current_task = new_task(NULL, NULL, MAIN_TASK_PRIORITY);
+    }
+
+    return current_task;
+}
+
+static void *task_thread(void *arg) {
+    current_task = arg;
+    current_task->function(current_task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle_out) {
+    struct sim_task *task = new_task(function, arg, priority);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_thread, task) != 0) {
+        sim_free(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+
+    if (handle_out) {
+        *handle_out = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    assert(task == NULL);
+    struct sim_task *self = task_self();
+    current_task = NULL;
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->notified);
+    sim_free(self);
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_sleep_until(sim_ticks_deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / (portTICK_PERIOD_MS * 1000));
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : task_self())->priority;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_broadcast(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct sim_task *task = task_self();
+    struct timespec deadline = sim_deadline(sim_ticks_deadline(ticks));
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_value == 0) {
+        if (pthread_cond_timedwait(&task->notified, &task->lock, &deadline) != 0) {
+            break;
+        }
+    }
+
+    uint32_t value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue *queue = sim_calloc(1, sizeof(struct sim_queue));
+    queue->items = sim_calloc(length, item_size > 0 ? item_size : 1);
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    sim_cond_init(&queue->changed);
+    return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    xSemaphoreGive(mutex);
+    return mutex;
+}
+
+// Waits until there's room to send or something to receive, or the deadline
+// passes. Call with the lock held
+static bool wait_until(struct sim_queue *queue, bool sending, TickType_t ticks) {
+    struct timespec deadline = sim_deadline(sim_ticks_deadline(ticks));
+    while (sending ? queue->count == queue->length : queue->count == 0) {
+        if (ticks == 0 || pthread_cond_timedwait(&queue->changed, &queue->lock, &deadline) != 0) {
+            return sending ? queue->count < queue->length : queue->count > 0;
+        }
+    }
+
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    if (!wait_until(queue, true, ticks)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size > 0) {
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    if (!wait_until(queue, false, ticks)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct sim_event_group *group = sim_calloc(1, sizeof(struct sim_event_group));
+    pthread_mutex_init(&group->lock, NULL);
+    sim_cond_init(&group->changed);
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->changed);
+    sim_free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    struct timespec deadline = sim_deadline(sim_ticks_deadline(ticks));
+    pthread_mutex_lock(&group->lock);
+    bool satisfied = false;
+    while (true) {
+        EventBits_t set = group->bits & bits;
+        satisfied = wait_for_all ? set == bits : set != 0;
+        if (satisfied) {
+            break;
+        }
+        if (ticks == 0 || pthread_cond_timedwait(&group->changed, &group->lock, &deadline) != 0) {
+            break;
+        }
+    }
+
+    // Same as FreeRTOS, the bits as they were before any clearing
+    EventBits_t result = group->bits;
+    if (satisfied && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return result;
+}
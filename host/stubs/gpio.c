@@ -0,0 +1,129 @@
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "sim_hooks.h"
+
+typedef struct {
+    int level;
+    gpio_int_type_t intr_type;
+    gpio_isr_t isr_handler;
+    void *isr_arg;
+} sim_pin;
+
+static pthread_mutex_t pins_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_pin pins[GPIO_NUM_MAX];
+static bool isr_service_installed;
+
+__attribute__((constructor)) static void init_pins() {
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        pins[i].level = 1;
+    }
+}
+
+static bool edge_fires(gpio_int_type_t intr_type, int old_level, int new_level) {
+    switch (intr_type) {
+        case GPIO_INTR_POSEDGE:
+            return !old_level && new_level;
+        case GPIO_INTR_NEGEDGE:
+            return old_level && !new_level;
+        case GPIO_INTR_ANYEDGE:
+            return old_level != new_level;
+        case GPIO_INTR_LOW_LEVEL:
+            return !new_level;
+        case GPIO_INTR_HIGH_LEVEL:
+            return new_level;
+        default:
+            return false;
+    }
+}
+
+void sim_gpio_set_level(int gpio_num, int level) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return;
+    }
+
+    // The ISR reads the level itself, so it has to be set before it runs
+    pthread_mutex_lock(&pins_lock);
+    sim_pin *pin = &pins[gpio_num];
+    int old_level = pin->level;
+    pin->level = level ? 1 : 0;
+    bool fire = isr_service_installed && pin->isr_handler && edge_fires(pin->intr_type, old_level, pin->level);
+    gpio_isr_t handler = pin->isr_handler;
+    void *arg = pin->isr_arg;
+    pthread_mutex_unlock(&pins_lock);
+
+    if (fire) {
+        portENTER_CRITICAL();
+        handler(arg);
+        portEXIT_CRITICAL();
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    pthread_mutex_lock(&pins_lock);
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        if (config->pin_bit_mask & (1UL << i)) {
+            pins[i].intr_type = config->intr_type;
+        }
+    }
+    pthread_mutex_unlock(&pins_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int no_use) {
+    if (isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    isr_service_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&pins_lock);
+    pins[gpio_num].isr_handler = isr_handler;
+    pins[gpio_num].isr_arg = args;
+    pthread_mutex_unlock(&pins_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pins_lock);
+    int level = pins[gpio_num].level;
+    pthread_mutex_unlock(&pins_lock);
+    return level;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&pins_lock);
+    pins[gpio_num].intr_type = intr_type;
+    pthread_mutex_unlock(&pins_lock);
+    return ESP_OK;
+}
+
+// Light sleep never waits on the pin here, so this only takes over the
+// interrupt type the way it does on the chip
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return gpio_set_intr_type(gpio_num, intr_type);
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+    return gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE);
+}
@@ -0,0 +1,125 @@
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "sim_hooks.h"
+
+// Resolved by the linker's --wrap, see CMakeLists.txt
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_heap_stats stats;
+
+void *sim_malloc(size_t size) {
+    return __real_malloc(size);
+}
+
+void *sim_calloc(size_t count, size_t size) {
+    return __real_calloc(count, size);
+}
+
+void sim_free(void *ptr) {
+    __real_free(ptr);
+}
+
+/*
+ * Sizes come from malloc_usable_size so a free can take off exactly what its
+ * alloc added. An allocation that would take the firmware past
+ * SIM_HEAP_SIZE fails like it would on the chip.
+ */
+static void *count_alloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return NULL;
+    }
+
+    uint32_t usable = malloc_usable_size(ptr);
+    pthread_mutex_lock(&heap_lock);
+    if (stats.bytes_in_use + usable > SIM_HEAP_SIZE) {
+        stats.failed_allocs++;
+        pthread_mutex_unlock(&heap_lock);
+        __real_free(ptr);
+        return NULL;
+    }
+
+    stats.allocs++;
+    stats.bytes_in_use += usable;
+    if (stats.bytes_in_use > stats.peak_bytes_in_use) {
+        stats.peak_bytes_in_use = stats.bytes_in_use;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return ptr;
+}
+
+static void count_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    uint32_t usable = malloc_usable_size(ptr);
+    pthread_mutex_lock(&heap_lock);
+    stats.frees++;
+    stats.bytes_in_use -= usable;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void *__wrap_malloc(size_t size) {
+    return count_alloc(__real_malloc(size), size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    return count_alloc(__real_calloc(count, size), count * size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return __wrap_malloc(size);
+    }
+
+    // Counted as a free and a new allocation. If it fails the old block stays
+    void *copy = __wrap_malloc(size);
+    if (!copy) {
+        return NULL;
+    }
+
+    size_t old_size = malloc_usable_size(ptr);
+    memcpy(copy, ptr, old_size < size ? old_size : size);
+    count_free(ptr);
+    __real_free(ptr);
+    return copy;
+}
+
+void __wrap_free(void *ptr) {
+    count_free(ptr);
+    __real_free(ptr);
+}
+
+sim_heap_stats sim_get_heap_stats(void) {
+    pthread_mutex_lock(&heap_lock);
+    sim_heap_stats copy = stats;
+    pthread_mutex_unlock(&heap_lock);
+    return copy;
+}
+
+void sim_reset_heap_peak(void) {
+    pthread_mutex_lock(&heap_lock);
+    stats.peak_bytes_in_use = stats.bytes_in_use;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return SIM_HEAP_SIZE - sim_get_heap_stats().bytes_in_use;
+}
+
+// Only since the last sim_reset_heap_peak, rather than since boot
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return SIM_HEAP_SIZE - sim_get_heap_stats().peak_bytes_in_use;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return esp_get_free_heap_size();
+}
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "esp_http_client.h"
+#include "sim_time.h"
+#include "esp_timer.h"
+#include "sim_hooks.h"
+
+#define MAX_HEADERS 8
+#define MAX_HEADER_KEY_LENGTH 32
+#define MAX_HEADER_VALUE_LENGTH 128
+#define MAX_HOST_LENGTH 64
+#define MAX_PATH_LENGTH 256
+#define MAX_LINE_LENGTH 256
+#define DEFAULT_BUFFER_SIZE 512
+#define DEFAULT_TIMEOUT_MS 5000
+// Body length when there's no Content-Length, it runs until the socket closes
+#define UNTIL_CLOSE -1
+
+typedef struct {
+    char key[MAX_HEADER_KEY_LENGTH];
+    char value[MAX_HEADER_VALUE_LENGTH];
+} request_header;
+
+struct esp_http_client {
+    http_event_handle_cb event_handler;
+    void *user_data;
+    int timeout_ms;
+
+    char host[MAX_HOST_LENGTH];
+    char path[MAX_PATH_LENGTH];
+    request_header headers[MAX_HEADERS];
+    int num_headers;
+
+    int sock;
+    // Received but not handed out yet, buffer[start] up to buffer[end]
+    char *buffer;
+    int buffer_size;
+    int start;
+    int end;
+
+    int status_code;
+    int content_length;
+    bool chunked;
+    // What's left of the body, or of the current chunk if it's chunked
+    int body_left;
+    bool chunk_needs_crlf;
+    bool body_done;
+};
+
+static uint32_t connect_delay_ms;
+
+void sim_http_set_connect_delay_ms(uint32_t delay_ms) {
+    connect_delay_ms = delay_ms;
+}
+
+static void fire_event(esp_http_client_handle_t client, esp_http_client_event_id_t event_id,
+                       void *data, int data_len, char *header_key, char *header_value) {
+    if (!client->event_handler) {
+        return;
+    }
+
+    esp_http_client_event_t event = {
+        .event_id = event_id,
+        .client = client,
+        .data = data,
+        .data_len = data_len,
+        .user_data = client->user_data,
+        .header_key = header_key,
+        .header_value = header_value
+    };
+    client->event_handler(&event);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    esp_http_client_handle_t client = sim_calloc(1, sizeof(struct esp_http_client));
+    if (!client) {
+        return NULL;
+    }
+
+    client->buffer_size = config->buffer_size > 0 ? config->buffer_size : DEFAULT_BUFFER_SIZE;
+    client->buffer = sim_malloc(client->buffer_size);
+    if (!client->buffer) {
+        sim_free(client);
+        return NULL;
+    }
+
+    client->event_handler = config->event_handler;
+    client->user_data = config->user_data;
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : DEFAULT_TIMEOUT_MS;
+    client->sock = -1;
+    esp_http_client_set_header(client, "User-Agent", "ESP32 HTTP Client/1.0");
+    if (config->url && esp_http_client_set_url(client, config->url) != ESP_OK) {
+        esp_http_client_cleanup(client);
+        return NULL;
+    }
+
+    return client;
+}
+
+static request_header *find_header(esp_http_client_handle_t client, const char *key) {
+    for (int i = 0; i < client->num_headers; i++) {
+        if (strcasecmp(client->headers[i].key, key) == 0) {
+            return &client->headers[i];
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    if (strlen(key) >= MAX_HEADER_KEY_LENGTH || strlen(value) >= MAX_HEADER_VALUE_LENGTH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    request_header *header = find_header(client, key);
+    if (!header) {
+        if (client->num_headers == MAX_HEADERS) {
+            return ESP_ERR_NO_MEM;
+        }
+        header = &client->headers[client->num_headers++];
+        strcpy(header->key, key);
+    }
+
+    strcpy(header->value, value);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key) {
+    request_header *header = find_header(client, key);
+    if (header) {
+        *header = client->headers[--client->num_headers];
+    }
+
+    return ESP_OK;
+}
+
+// Same as the SDK, a new host closes the old connection and rewrites Host
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url) {
+    const char *scheme = "http://";
+    if (strncmp(url, scheme, strlen(scheme)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *host = url + strlen(scheme);
+    const char *path = strchr(host, '/');
+    int host_length = path ? path - host : (int)strlen(host);
+    if (host_length == 0 || host_length >= MAX_HOST_LENGTH || (path && strlen(path) >= MAX_PATH_LENGTH)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char new_host[MAX_HOST_LENGTH];
+    memcpy(new_host, host, host_length);
+    new_host[host_length] = '\0';
+    if (client->host[0] && strcmp(new_host, client->host) != 0) {
+        esp_http_client_close(client);
+    }
+
+    strcpy(client->host, new_host);
+    strcpy(client->path, path ? path : "/");
+    return esp_http_client_set_header(client, "Host", client->host);
+}
+
+static esp_err_t connect_socket(esp_http_client_handle_t client) {
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->sock < 0) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+
+    struct timeval timeout = {
+        .tv_sec = client->timeout_ms / 1000,
+        .tv_usec = (client->timeout_ms % 1000) * 1000
+    };
+    int no_delay = 1;
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client->sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(sim_http_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    if (connect(client->sock, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(client->sock);
+        client->sock = -1;
+        return ESP_ERR_HTTP_CONNECT;
+    }
+
+    // Loopback connects straight away, a real server is a round trip away
+    if (connect_delay_ms) {
+        sim_sleep_until(esp_timer_get_time() + (int64_t)connect_delay_ms * 1000);
+    }
+
+    fire_event(client, HTTP_EVENT_ON_CONNECTED, NULL, 0, NULL, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+    if (client->sock < 0) {
+        esp_err_t error = connect_socket(client);
+        if (error != ESP_OK) {
+            return error;
+        }
+    }
+
+    // Whatever was left of the last response goes, same as the SDK
+    client->start = 0;
+    client->end = 0;
+    client->status_code = 0;
+    client->content_length = 0;
+    client->chunked = false;
+    client->body_left = 0;
+    client->chunk_needs_crlf = false;
+    client->body_done = false;
+
+    char request[MAX_PATH_LENGTH + MAX_HEADERS * (MAX_HEADER_KEY_LENGTH + MAX_HEADER_VALUE_LENGTH + 4) + 32];
+    int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\n", client->path);
+    for (int i = 0; i < client->num_headers; i++) {
+        length += snprintf(&request[length], sizeof(request) - length, "%s: %s\r\n",
+                           client->headers[i].key, client->headers[i].value);
+    }
+    length += snprintf(&request[length], sizeof(request) - length, "\r\n");
+
+    if (send(client->sock, request, length, MSG_NOSIGNAL) != length) {
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+
+    fire_event(client, HTTP_EVENT_HEADER_SENT, NULL, 0, NULL, NULL);
+    return ESP_OK;
+}
+
+// More bytes into the buffer. Returns false if the socket closed or timed out
+static bool receive_more(esp_http_client_handle_t client) {
+    if (client->start == client->end) {
+        client->start = 0;
+        client->end = 0;
+    } else if (client->end == client->buffer_size) {
+        memmove(client->buffer, &client->buffer[client->start], client->end - client->start);
+        client->end -= client->start;
+        client->start = 0;
+    }
+
+    if (client->sock < 0 || client->end == client->buffer_size) {
+        return false;
+    }
+
+    ssize_t received;
+    do {
+        received = recv(client->sock, &client->buffer[client->end], client->buffer_size - client->end, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0) {
+        return false;
+    }
+
+    client->end += received;
+    return true;
+}
+
+// Next CRLF terminated line, without the CRLF. Returns false if there wasn't one
+static bool read_line(esp_http_client_handle_t client, char *line, int max_length) {
+    while (true) {
+        char *found = memchr(&client->buffer[client->start], '\n', client->end - client->start);
+        if (found) {
+            int length = found - &client->buffer[client->start];
+            int copy_length = length > 0 && found[-1] == '\r' ? length - 1 : length;
+            if (copy_length >= max_length) {
+                copy_length = max_length - 1;
+            }
+            memcpy(line, &client->buffer[client->start], copy_length);
+            line[copy_length] = '\0';
+            client->start += length + 1;
+            return true;
+        }
+
+        if (!receive_more(client)) {
+            return false;
+        }
+    }
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    char line[MAX_LINE_LENGTH];
+    if (!read_line(client, line, sizeof(line)) || sscanf(line, "HTTP/%*d.%*d %d", &client->status_code) != 1) {
+        return ESP_FAIL;
+    }
+
+    client->content_length = UNTIL_CLOSE;
+    while (true) {
+        if (!read_line(client, line, sizeof(line))) {
+            return ESP_FAIL;
+        }
+        if (line[0] == '\0') {
+            break;
+        }
+
+        char *value = strchr(line, ':');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        while (*value == ' ') {
+            value++;
+        }
+
+        if (strcasecmp(line, "Content-Length") == 0) {
+            client->content_length = atoi(value);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "chunked") == 0) {
+            client->chunked = true;
+        }
+        fire_event(client, HTTP_EVENT_ON_HEADER, NULL, 0, line, value);
+    }
+
+    // These never have a body, whatever the headers say
+    if (client->status_code == 204 || client->status_code == 304 || client->status_code / 100 == 1) {
+        client->chunked = false;
+        client->content_length = 0;
+    }
+
+    if (client->chunked) {
+        client->content_length = -1;
+        client->body_left = 0;
+    } else {
+        client->body_left = client->content_length;
+        client->body_done = client->content_length == 0;
+    }
+    return client->content_length;
+}
+
+// Up to length body bytes straight off the buffer or the socket
+static int read_raw(esp_http_client_handle_t client, char *out, int length) {
+    if (client->start == client->end && !receive_more(client)) {
+        return 0;
+    }
+
+    int available = client->end - client->start;
+    int copy_length = available < length ? available : length;
+    memcpy(out, &client->buffer[client->start], copy_length);
+    client->start += copy_length;
+    return copy_length;
+}
+
+// Moves on to the next chunk. Returns false if the framing was broken
+static bool next_chunk(esp_http_client_handle_t client) {
+    char line[MAX_LINE_LENGTH];
+    if (client->chunk_needs_crlf && (!read_line(client, line, sizeof(line)) || line[0] != '\0')) {
+        return false;
+    }
+
+    if (!read_line(client, line, sizeof(line))) {
+        return false;
+    }
+
+    char *end;
+    long size = strtol(line, &end, 16);
+    if (end == line || size < 0) {
+        return false;
+    }
+
+    client->body_left = size;
+    client->chunk_needs_crlf = true;
+    if (size == 0) {
+        // Trailers, up to the blank line
+        do {
+            if (!read_line(client, line, sizeof(line))) {
+                return false;
+            }
+        } while (line[0] != '\0');
+        client->body_done = true;
+    }
+    return true;
+}
+
+/*
+ * Like the SDK, keeps reading until length bytes or the end of the body.
+ * Returns 0 once the body's all been read and -1 if the connection broke
+ * before anything could be read.
+ */
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int length) {
+    int total = 0;
+    while (total < length && !client->body_done) {
+        if (client->chunked && client->body_left == 0) {
+            if (!next_chunk(client)) {
+                return total > 0 ? total : -1;
+            }
+            continue;
+        }
+
+        int want = length - total;
+        if (client->body_left != UNTIL_CLOSE && client->body_left < want) {
+            want = client->body_left;
+        }
+
+        int received = read_raw(client, &buffer[total], want);
+        if (received == 0) {
+            if (client->body_left == UNTIL_CLOSE) {
+                client->body_done = true;
+                break;
+            }
+            return total > 0 ? total : -1;
+        }
+
+        fire_event(client, HTTP_EVENT_ON_DATA, &buffer[total], received, NULL, NULL);
+        total += received;
+        if (client->body_left != UNTIL_CLOSE) {
+            client->body_left -= received;
+            if (!client->chunked && client->body_left == 0) {
+                client->body_done = true;
+            }
+        }
+    }
+
+    if (client->body_done && total == 0) {
+        fire_event(client, HTTP_EVENT_ON_FINISH, NULL, 0, NULL, NULL);
+    }
+    return total;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status_code;
+}
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client) {
+    return client->chunked;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->sock >= 0) {
+        close(client->sock);
+        client->sock = -1;
+        fire_event(client, HTTP_EVENT_DISCONNECTED, NULL, 0, NULL, NULL);
+    }
+
+    client->start = 0;
+    client->end = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    if (!client) {
+        return ESP_FAIL;
+    }
+
+    esp_http_client_close(client);
+    sim_free(client->buffer);
+    sim_free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,164 @@
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/hw_timer.h"
+#include "esp_timer.h"
+#include "sim_time.h"
+
+/*
+ * One thread waits out each load and calls the callback. Every change bumps
+ * the generation so a wait that was overtaken by a reload or a disable
+ * starts over instead of firing. A wait is against a real deadline, so when
+ * the clock jumps the thread is woken to work it out again from fire_at_us.
+ * Lock order is always the critical section first, then this lock.
+ */
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_changed;
+static void (*callback)(void *arg);
+static void *callback_arg;
+static uint32_t clkdiv;
+static bool reload;
+static uint32_t load_data;
+static bool enabled;
+static uint32_t generation;
+static int64_t fire_at_us;
+static uint32_t clock_moves;
+
+static int64_t load_us() {
+    uint32_t ticks_per_us = (TIMER_BASE_CLK >> clkdiv) / 1000000;
+    return load_data / (ticks_per_us > 0 ? ticks_per_us : 1);
+}
+
+static void *timer_thread(void *arg) {
+    pthread_mutex_lock(&timer_lock);
+    while (true) {
+        if (!enabled) {
+            pthread_cond_wait(&timer_changed, &timer_lock);
+            continue;
+        }
+
+        uint32_t waiting_generation = generation;
+        uint32_t waiting_clock_moves = clock_moves;
+        struct timespec deadline = sim_deadline(fire_at_us);
+        while (generation == waiting_generation && clock_moves == waiting_clock_moves
+               && pthread_cond_timedwait(&timer_changed, &timer_lock, &deadline) == 0) {
+        }
+        if (generation != waiting_generation) {
+            continue;
+        }
+        if (clock_moves != waiting_clock_moves && esp_timer_get_time() < fire_at_us) {
+            continue;
+        }
+
+        if (reload) {
+            fire_at_us += load_us();
+        } else {
+            enabled = false;
+        }
+        pthread_mutex_unlock(&timer_lock);
+
+        portENTER_CRITICAL();
+        // Could have been disabled while we were getting in
+        pthread_mutex_lock(&timer_lock);
+        bool still_due = generation == waiting_generation;
+        pthread_mutex_unlock(&timer_lock);
+        if (still_due) {
+            callback(callback_arg);
+        }
+        portEXIT_CRITICAL();
+
+        pthread_mutex_lock(&timer_lock);
+    }
+
+    return NULL;
+}
+
+esp_err_t hw_timer_init(void (*new_callback)(void *arg), void *arg) {
+    if (callback) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    callback = new_callback;
+    callback_arg = arg;
+    sim_cond_init(&timer_changed);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, timer_thread, NULL) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+static void changed() {
+    generation++;
+    pthread_cond_broadcast(&timer_changed);
+}
+
+void sim_hw_timer_clock_moved(void) {
+    pthread_mutex_lock(&timer_lock);
+    clock_moves++;
+    pthread_cond_broadcast(&timer_changed);
+    pthread_mutex_unlock(&timer_lock);
+}
+
+esp_err_t hw_timer_set_clkdiv(hw_timer_clkdiv_t new_clkdiv) {
+    pthread_mutex_lock(&timer_lock);
+    clkdiv = new_clkdiv;
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+uint32_t hw_timer_get_clkdiv(void) {
+    pthread_mutex_lock(&timer_lock);
+    uint32_t value = clkdiv;
+    pthread_mutex_unlock(&timer_lock);
+    return value;
+}
+
+esp_err_t hw_timer_set_intr_type(hw_timer_intr_type_t intr_type) {
+    return ESP_OK;
+}
+
+esp_err_t hw_timer_set_reload(bool new_reload) {
+    pthread_mutex_lock(&timer_lock);
+    reload = new_reload;
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+esp_err_t hw_timer_set_load_data(uint32_t new_load_data) {
+    if (new_load_data >= (1 << 23)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&timer_lock);
+    load_data = new_load_data;
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+esp_err_t hw_timer_enable(bool enable) {
+    pthread_mutex_lock(&timer_lock);
+    enabled = enable;
+    if (enable) {
+        fire_at_us = esp_timer_get_time() + load_us();
+    }
+    changed();
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+bool hw_timer_get_enable(void) {
+    pthread_mutex_lock(&timer_lock);
+    bool value = enabled;
+    pthread_mutex_unlock(&timer_lock);
+    return value;
+}
+
+esp_err_t hw_timer_alarm_us(uint32_t value, bool new_reload) {
+    hw_timer_set_clkdiv(TIMER_CLKDIV_16);
+    hw_timer_set_reload(new_reload);
+    hw_timer_set_load_data(((TIMER_BASE_CLK >> TIMER_CLKDIV_16) / 1000000) * value);
+    return hw_timer_enable(true);
+}
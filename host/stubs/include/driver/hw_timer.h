@@ -0,0 +1,33 @@
+#ifndef HW_TIMER_H
+#define HW_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+// FRC1 counts down from the load value at the APB clock over the divider
+#define TIMER_BASE_CLK 80000000
+
+typedef enum {
+    TIMER_CLKDIV_1 = 0,
+    TIMER_CLKDIV_16 = 4,
+    TIMER_CLKDIV_256 = 8
+} hw_timer_clkdiv_t;
+
+typedef enum {
+    TIMER_EDGE_INT = 0,
+    TIMER_LEVEL_INT
+} hw_timer_intr_type_t;
+
+esp_err_t hw_timer_init(void (*callback)(void *arg), void *arg);
+esp_err_t hw_timer_set_clkdiv(hw_timer_clkdiv_t clkdiv);
+uint32_t hw_timer_get_clkdiv(void);
+esp_err_t hw_timer_set_intr_type(hw_timer_intr_type_t intr_type);
+esp_err_t hw_timer_set_reload(bool reload);
+esp_err_t hw_timer_set_load_data(uint32_t load_data);
+esp_err_t hw_timer_enable(bool enable);
+bool hw_timer_get_enable(void);
+esp_err_t hw_timer_alarm_us(uint32_t value, bool reload);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+// No separate RTC memory here, and nothing survives a "deep sleep"
+#define RTC_DATA_ATTR
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+// There's no fragmentation to model, so this is all of the free heap
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef ESP_SLEEP_H
+#define ESP_SLEEP_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
+// The CPU would be halted, so rather than wait the clock jumps ahead by the
+// timer wakeup, or less if sim_light_sleep_wake_after_us says a pin woke
+// it, and it returns straight away
+esp_err_t esp_light_sleep_start(void);
+// There's no reboot to come back from, so the sim just ends
+void esp_deep_sleep(uint64_t time_in_us) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef ESP_TASK_WDT_H
+#define ESP_TASK_WDT_H
+
+// No watchdog on the host
+static inline void esp_task_wdt_reset(void) {}
+
+#endif
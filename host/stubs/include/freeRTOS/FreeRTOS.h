@@ -0,0 +1,2 @@
+// timer.c includes it with this spelling, which only works on case-insensitive file systems
+#include "../freertos/FreeRTOS.h"
@@ -0,0 +1,60 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/*
+ * Host stand-in for the parts of FreeRTOS the firmware uses, on pthreads.
+ * Ticks are 10ms like the ESP8266 SDK's default CONFIG_FREERTOS_HZ. The
+ * critical section is one process wide recursive lock, which the hw_timer
+ * and gpio stubs also hold while running their "ISRs", so a critical
+ * section keeps them out the same way masking interrupts does on the chip.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define tskIDLE_PRIORITY 0
+
+#define BIT0 (1 << 0)
+#define BIT1 (1 << 1)
+#define BIT2 (1 << 2)
+#define BIT3 (1 << 3)
+#define BIT4 (1 << 4)
+#define BIT5 (1 << 5)
+#define BIT6 (1 << 6)
+#define BIT7 (1 << 7)
+
+void sim_enter_critical(void);
+void sim_exit_critical(void);
+
+#define portENTER_CRITICAL() sim_enter_critical()
+#define portEXIT_CRITICAL() sim_exit_critical()
+// Nothing to switch to, the woken task's thread is already runnable
+#define portYIELD_FROM_ISR()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "queue.h"
+
+// Same as FreeRTOS, a semaphore is a queue of zero sized items
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary() xQueueCreate(1, 0)
+#define xSemaphoreTake(semaphore, ticks) xQueueReceive((semaphore), NULL, (ticks))
+#define xSemaphoreGive(semaphore) xQueueSend((semaphore), NULL, 0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Starts out given
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef LWIP_DNS_H
+#define LWIP_DNS_H
+
+#include <stdint.h>
+
+#include "lwip/inet.h"
+
+typedef ip4_addr_t ip_addr_t;
+
+#define ip_addr_isany(ipaddr) ((ipaddr) == NULL || (ipaddr)->addr == 0)
+#define ip_addr_get_ip4_u32(ipaddr) ((ipaddr)->addr)
+
+// The server DHCP handed out, which sim_sendto points at the stand-in
+const ip_addr_t *dns_getserver(uint8_t index);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef LWIP_INET_H
+#define LWIP_INET_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// IPv4 only, like the firmware's lwip config
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+// Formats into a static buffer, same as lwip
+char *ip4addr_ntoa(const ip4_addr_t *addr);
+
+#endif
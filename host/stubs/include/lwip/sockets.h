@@ -0,0 +1,21 @@
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "lwip/inet.h"
+
+/*
+ * The host's own sockets, except that datagrams for port 53 go to the DNS
+ * stand-in wherever they're addressed (see sim_hooks.h). lwip maps these
+ * names onto its own functions with macros too.
+ */
+ssize_t sim_sendto(int sock, const void *data, size_t length, int flags,
+                   const struct sockaddr *to, socklen_t to_length);
+#define sendto sim_sendto
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// What menuconfig would generate, only the options the firmware reads
+#define CONFIG_ESP_WIFI_SSID "host-sim"
+#define CONFIG_ESP_WIFI_PASSWORD "host-sim"
+#define CONFIG_ESP_MAXIMUM_RETRY 5
+
+#endif
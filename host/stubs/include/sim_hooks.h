@@ -0,0 +1,88 @@
+#ifndef SIM_HOOKS_H
+#define SIM_HOOKS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "serial_line.h"
+
+/*
+ * What a host program uses to drive the SDK stubs. Nothing in main/ includes
+ * this, the firmware only ever sees the SDK's own headers.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Every http connection goes to 127.0.0.1:http_port, and every DNS query to
+// 127.0.0.1:dns_port, whatever host they were meant for. 0 leaves DNS alone
+void sim_net_redirect(uint16_t http_port, uint16_t dns_port);
+
+// Where the http client stub actually connects, 0 before sim_net_redirect
+uint16_t sim_http_port(void);
+
+// How long each new http connection takes to open, 0 by default. Reused
+// connections don't wait
+void sim_http_set_connect_delay_ms(uint32_t delay_ms);
+
+// The last esp_wifi_set_ps, as a wifi_ps_type_t
+int sim_wifi_power_save(void);
+
+// Each association waits scan_ms first unless the config names the AP's
+// BSSID and channel, then dhcp_ms unless DHCP was stopped. 0 by default
+void sim_wifi_set_connect_delays_ms(uint32_t scan_ms, uint32_t dhcp_ms);
+// The AP moves to another channel, so going straight to the old one fails
+void sim_wifi_set_ap_channel(uint8_t channel);
+// The AP drops us, like it does when it reboots or we go out of range
+void sim_wifi_drop(void);
+
+// Drive a pin, firing its handler if the interrupt type matches the change
+void sim_gpio_set_level(int gpio_num, int level);
+// The next light sleep ends wake_us in, before its timer wakeup, the way a
+// press on a wakeup pin ends it. Set the pin's level to go with it
+void sim_light_sleep_wake_after_us(int64_t wake_us);
+
+// Wire port's TX to SERIAL_TO_DISPLAY and its RX to SERIAL_FROM_DISPLAY
+void sim_uart_attach(int port);
+
+// Moves esp_timer_get_time, and every wait timed against it, ahead without
+// waiting. Light sleep does this with its timer wakeup
+void sim_advance_clock_us(int64_t time_us);
+
+// For tests with only the one thread: the clock stops, and sim_sleep_until,
+// and everything that sleeps through it, moves it to when it would have woken
+// up instead. So the clock only moves for those and sim_advance_clock_us
+void sim_set_skip_sleeps(bool skip);
+
+/*
+ * Everything the firmware mallocs goes through here (the link wraps
+ * malloc/calloc/realloc/free). The stubs, the stand-ins and libc internals
+ * use the real allocator and aren't counted, so these are the firmware's own
+ * allocations and not what the SDK would add on the chip.
+ */
+#define SIM_HEAP_SIZE (48 * 1024)
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failed_allocs;
+    uint32_t bytes_in_use;
+    uint32_t peak_bytes_in_use;
+} sim_heap_stats;
+
+sim_heap_stats sim_get_heap_stats(void);
+// Starts peak_bytes_in_use over from what's in use now
+void sim_reset_heap_peak(void);
+
+// For stub and stand-in code, never counted
+void *sim_malloc(size_t size);
+void *sim_calloc(size_t count, size_t size);
+void sim_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SIM_TIME_H
+#define SIM_TIME_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Everything in the sim runs off one clock, esp_timer_get_time(). These turn
+ * its times into deadlines for the timed waits the stubs block in.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Condition variable that times out against the monotonic clock
+void sim_cond_init(pthread_cond_t *cond);
+// Absolute deadline for pthread_cond_timedwait on one of those
+struct timespec sim_deadline(int64_t time_us);
+// esp_timer time for a wait of ticks from now, INT64_MAX for portMAX_DELAY
+int64_t sim_ticks_deadline(uint32_t ticks);
+void sim_sleep_until(int64_t time_us);
+// The clock jumped ahead, so a load the hw_timer is waiting out may be due.
+// Only sim_advance_clock_us calls this
+void sim_hw_timer_clock_moved(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
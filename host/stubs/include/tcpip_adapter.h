@@ -0,0 +1,40 @@
+#ifndef TCPIP_ADAPTER_H
+#define TCPIP_ADAPTER_H
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "lwip/inet.h"
+
+typedef enum {
+    TCPIP_ADAPTER_IF_STA,
+    TCPIP_ADAPTER_IF_AP,
+    TCPIP_ADAPTER_IF_MAX
+} tcpip_adapter_if_t;
+
+typedef struct {
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+extern esp_event_base_t IP_EVENT;
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP
+} ip_event_t;
+
+typedef struct {
+    tcpip_adapter_if_t if_index;
+    tcpip_adapter_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+void tcpip_adapter_init(void);
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if, const tcpip_adapter_ip_info_t *ip_info);
+
+#endif
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "tcpip_adapter.h"
+#include "lwip/sockets.h"
+#include "lwip/dns.h"
+#include "sim_hooks.h"
+
+#define MAX_HANDLERS 8
+#define MAX_EVENT_DATA 64
+#define EVENT_QUEUE_LENGTH 8
+#define DNS_PORT 53
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_entry;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t data[MAX_EVENT_DATA];
+} posted_event;
+
+static pthread_mutex_t handlers_lock = PTHREAD_MUTEX_INITIALIZER;
+static event_handler_entry handlers[MAX_HANDLERS];
+static QueueHandle_t event_queue;
+
+static uint16_t http_port;
+static uint16_t dns_port;
+static wifi_ps_type_t power_save = WIFI_PS_MIN_MODEM;
+static uint32_t scan_ms;
+static uint32_t dhcp_ms;
+static bool dhcp_enabled = true;
+static tcpip_adapter_ip_info_t static_ip_info;
+static bool associated;
+static wifi_config_t sta_config;
+
+// The one AP there is
+static const uint8_t ap_bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static uint8_t ap_channel = 6;
+
+void sim_net_redirect(uint16_t new_http_port, uint16_t new_dns_port) {
+    http_port = new_http_port;
+    dns_port = new_dns_port;
+}
+
+uint16_t sim_http_port(void) {
+    return http_port;
+}
+
+void sim_wifi_set_connect_delays_ms(uint32_t new_scan_ms, uint32_t new_dhcp_ms) {
+    scan_ms = new_scan_ms;
+    dhcp_ms = new_dhcp_ms;
+}
+
+void sim_wifi_set_ap_channel(uint8_t channel) {
+    ap_channel = channel;
+}
+
+void sim_wifi_drop(void) {
+    associated = false;
+}
+
+static void event_loop_task(void *arg) {
+    posted_event event;
+    while (1) {
+        if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // Copied out so a handler can unregister itself
+        event_handler_entry matching[MAX_HANDLERS];
+        int num_matching = 0;
+        pthread_mutex_lock(&handlers_lock);
+        for (int i = 0; i < MAX_HANDLERS; i++) {
+            event_handler_entry *entry = &handlers[i];
+            if (entry->handler && entry->base == event.base && (entry->id == ESP_EVENT_ANY_ID || entry->id == event.id)) {
+                matching[num_matching++] = *entry;
+            }
+        }
+        pthread_mutex_unlock(&handlers_lock);
+
+        for (int i = 0; i < num_matching; i++) {
+            matching[i].handler(matching[i].arg, event.base, event.id, event.data);
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    if (event_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    event_queue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(posted_event));
+    xTaskCreate(event_loop_task, "sys_evt", 2048, NULL, 20, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg) {
+    esp_err_t result = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&handlers_lock);
+    for (int i = 0; i < MAX_HANDLERS; i++) {
+        if (!handlers[i].handler) {
+            handlers[i] = (event_handler_entry) {event_base, event_id, event_handler, event_handler_arg};
+            result = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&handlers_lock);
+    return result;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+                                       esp_event_handler_t event_handler) {
+    pthread_mutex_lock(&handlers_lock);
+    for (int i = 0; i < MAX_HANDLERS; i++) {
+        event_handler_entry *entry = &handlers[i];
+        if (entry->handler == event_handler && entry->base == event_base && entry->id == event_id) {
+            entry->handler = NULL;
+        }
+    }
+    pthread_mutex_unlock(&handlers_lock);
+    return ESP_OK;
+}
+
+// Queued for the loop task, so handlers never run on the poster's task
+static esp_err_t post_event(esp_event_base_t event_base, int32_t event_id,
+                            const void *event_data, size_t event_data_size) {
+    posted_event event = {
+        .base = event_base,
+        .id = event_id
+    };
+    if (event_data_size > MAX_EVENT_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (event_data_size > 0) {
+        memcpy(event.data, event_data, event_data_size);
+    }
+
+    return xQueueSend(event_queue, &event, portMAX_DELAY) == pdTRUE ? ESP_OK : ESP_FAIL;
+}
+
+void tcpip_adapter_init(void) {
+}
+
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if) {
+    dhcp_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if) {
+    dhcp_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if, const tcpip_adapter_ip_info_t *ip_info) {
+    static_ip_info = *ip_info;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    return mode == WIFI_MODE_STA ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_wifi_set_config(esp_interface_t interface, wifi_config_t *config) {
+    sta_config = *config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    return post_event(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0);
+}
+
+// Its own task, like the SDK's wifi task, so the event loop isn't held up
+static void associate_task(void *arg) {
+    // Naming the AP and its channel is what lets the SDK skip the scan
+    bool ap_named = sta_config.sta.bssid_set && sta_config.sta.channel != 0;
+    if (!ap_named) {
+        vTaskDelay(pdMS_TO_TICKS(scan_ms));
+    } else if (memcmp(sta_config.sta.bssid, ap_bssid, sizeof(ap_bssid)) != 0
+               || sta_config.sta.channel != ap_channel) {
+        post_event(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0);
+        vTaskDelete(NULL);
+        return;
+    }
+    associated = true;
+
+    ip_event_got_ip_t got_ip = {
+        .if_index = TCPIP_ADAPTER_IF_STA,
+        .ip_changed = false
+    };
+    if (dhcp_enabled || static_ip_info.ip.addr == 0) {
+        vTaskDelay(pdMS_TO_TICKS(dhcp_ms));
+        got_ip.ip_info.ip.addr = htonl(INADDR_LOOPBACK);
+        got_ip.ip_info.netmask.addr = htonl(0xFF000000);
+        got_ip.ip_info.gw.addr = htonl(INADDR_LOOPBACK);
+    } else {
+        got_ip.ip_info = static_ip_info;
+    }
+    post_event(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip));
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_wifi_connect(void) {
+    return xTaskCreate(associate_task, "wifi_assoc", 2048, NULL, 20, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    associated = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    power_save = type;
+    return ESP_OK;
+}
+
+int sim_wifi_power_save(void) {
+    return power_save;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    if (!associated) {
+        return ESP_FAIL;
+    }
+
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, ap_bssid, sizeof(ap_info->bssid));
+    memcpy(ap_info->ssid, sta_config.sta.ssid, sizeof(sta_config.sta.ssid));
+    ap_info->primary = ap_channel;
+    ap_info->rssi = -50;
+    return ESP_OK;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr) {
+    static char text[16];
+    struct in_addr in = { .s_addr = addr->addr };
+    snprintf(text, sizeof(text), "%s", inet_ntoa(in));
+    return text;
+}
+
+const ip_addr_t *dns_getserver(uint8_t index) {
+    // What a home router would hand out, sim_sendto sends it to the stand-in
+    static ip_addr_t server;
+    server.addr = htonl(0xC0A80101);
+    return index == 0 ? &server : NULL;
+}
+
+#undef sendto
+ssize_t sim_sendto(int sock, const void *data, size_t length, int flags,
+                   const struct sockaddr *to, socklen_t to_length) {
+    struct sockaddr_in redirected;
+    if (dns_port && to->sa_family == AF_INET && ntohs(((const struct sockaddr_in *)to)->sin_port) == DNS_PORT) {
+        memset(&redirected, 0, sizeof(redirected));
+        redirected.sin_family = AF_INET;
+        redirected.sin_port = htons(dns_port);
+        redirected.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        to = (const struct sockaddr *)&redirected;
+        to_length = sizeof(redirected);
+    }
+
+    return sendto(sock, data, length, flags, to, to_length);
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_sleep.h"
+#include "esp_spiffs.h"
+#include "sim_time.h"
+#include "sim_hooks.h"
+
+static int64_t start_us;
+// Time skipped by light sleep and sim_advance_clock_us, on top of real time
+static volatile int64_t skipped_us;
+static bool skip_sleeps;
+// Real time, when skip_sleeps stopped it
+static int64_t stopped_us;
+
+static int64_t monotonic_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Time starts with the process, like esp_timer starts at boot
+__attribute__((constructor)) static void init_clock() {
+    start_us = monotonic_us();
+}
+
+int64_t esp_timer_get_time(void) {
+    int64_t real_us = skip_sleeps ? stopped_us : monotonic_us() - start_us;
+    return real_us + skipped_us;
+}
+
+void sim_advance_clock_us(int64_t time_us) {
+    skipped_us += time_us;
+    sim_hw_timer_clock_moved();
+}
+
+void sim_cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+struct timespec sim_deadline(int64_t time_us) {
+    // Far enough out for portMAX_DELAY without overflowing time_t
+    int64_t max_us = (int64_t)365 * 24 * 60 * 60 * 1000000;
+    int64_t absolute_us = start_us - skipped_us + (time_us < max_us ? time_us : max_us);
+    struct timespec deadline = {
+        .tv_sec = absolute_us / 1000000,
+        .tv_nsec = (absolute_us % 1000000) * 1000
+    };
+    return deadline;
+}
+
+int64_t sim_ticks_deadline(uint32_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        return INT64_MAX;
+    }
+
+    return esp_timer_get_time() + (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+void sim_set_skip_sleeps(bool skip) {
+    if (skip && !skip_sleeps) {
+        stopped_us = monotonic_us() - start_us;
+    } else if (!skip && skip_sleeps) {
+        // Carry on from where the clock stopped
+        skipped_us -= monotonic_us() - start_us - stopped_us;
+    }
+    skip_sleeps = skip;
+}
+
+void sim_sleep_until(int64_t time_us) {
+    if (skip_sleeps) {
+        int64_t now_us = esp_timer_get_time();
+        if (time_us > now_us) {
+            sim_advance_clock_us(time_us - now_us);
+        }
+        return;
+    }
+
+    struct timespec deadline = sim_deadline(time_us);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+static esp_log_level_t log_level = ESP_LOG_VERBOSE;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    printf("(%lld) %s: ", (long long)(esp_timer_get_time() / 1000), tag);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_HTTP_CONNECT:
+            return "ESP_ERR_HTTP_CONNECT";
+        case ESP_ERR_HTTP_WRITE_DATA:
+            return "ESP_ERR_HTTP_WRITE_DATA";
+        case ESP_ERR_HTTP_FETCH_HEADER:
+            return "ESP_ERR_HTTP_FETCH_HEADER";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+static uint64_t timer_wakeup_us;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+    timer_wakeup_us = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+    return ESP_OK;
+}
+
+// -1 when nothing's due to cut the next light sleep short
+static int64_t gpio_wakeup_after_us = -1;
+
+void sim_light_sleep_wake_after_us(int64_t wake_us) {
+    gpio_wakeup_after_us = wake_us;
+}
+
+esp_err_t esp_light_sleep_start(void) {
+    bool woken_early = gpio_wakeup_after_us >= 0 && (uint64_t)gpio_wakeup_after_us < timer_wakeup_us;
+    sim_advance_clock_us(woken_early ? gpio_wakeup_after_us : (int64_t)timer_wakeup_us);
+    gpio_wakeup_after_us = -1;
+    return ESP_OK;
+}
+
+void esp_deep_sleep(uint64_t time_in_us) {
+    printf("Deep sleep for %llums, the sim ends here\n", (unsigned long long)(time_in_us / 1000));
+    exit(0);
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf) {
+    if (mkdir(conf->base_path, 0755) != 0 && errno != EEXIST) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
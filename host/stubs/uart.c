@@ -0,0 +1,77 @@
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "sim_time.h"
+#include "sim_hooks.h"
+
+static int attached_port = -1;
+static uint32_t baud_rates[UART_NUM_MAX];
+
+void sim_uart_attach(int port) {
+    attached_port = port;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *config) {
+    if (uart_num >= UART_NUM_MAX || config->baud_rate <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    baud_rates[uart_num] = config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int no_use) {
+    return uart_num < UART_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait) {
+    if (uart_num != attached_port) {
+        // Nothing's wired to its RX pin
+        vTaskDelay(ticks_to_wait);
+        return 0;
+    }
+
+    return serial_line_read(SERIAL_FROM_DISPLAY, buf, length, baud_rates[uart_num], sim_ticks_deadline(ticks_to_wait));
+}
+
+// With no TX buffer the SDK blocks until everything's in the FIFO, here it
+// just gets queued on the line and takes its time arriving
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size) {
+    if (uart_num != attached_port) {
+        fwrite(src, 1, size, stdout);
+        return size;
+    }
+
+    serial_line_write(SERIAL_TO_DISPLAY, (const uint8_t *)src, size, baud_rates[uart_num]);
+    return size;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate) {
+    if (uart_num >= UART_NUM_MAX || baudrate == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    baud_rates[uart_num] = baudrate;
+    return ESP_OK;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait) {
+    if (uart_num != attached_port) {
+        fflush(stdout);
+        return ESP_OK;
+    }
+
+    int64_t done_us = serial_line_tx_done_us(SERIAL_TO_DISPLAY);
+    int64_t deadline_us = sim_ticks_deadline(ticks_to_wait);
+    if (done_us > deadline_us) {
+        sim_sleep_until(deadline_us);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    sim_sleep_until(done_us);
+    return ESP_OK;
+}
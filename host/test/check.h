@@ -0,0 +1,42 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Bare minimum for the host tests. A failed check prints where it was and
+ * carries on, CHECK_RESULT at the end of main makes ctest see the failure.
+ */
+static int check_failures;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition); \
+        check_failures++; \
+    } \
+} while (0)
+
+#define CHECK_INT(actual, expected) do { \
+    long long check_actual = (actual); \
+    long long check_expected = (expected); \
+    if (check_actual != check_expected) { \
+        printf("%s:%d: failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, check_actual, check_expected); \
+        check_failures++; \
+    } \
+} while (0)
+
+// Compares length bytes of actual against the null terminated expected
+#define CHECK_TEXT(actual, length, expected) do { \
+    int check_length = (length); \
+    const char *check_expected = (expected); \
+    if (check_length != (int)strlen(check_expected) || memcmp((actual), check_expected, check_length) != 0) { \
+        printf("%s:%d: failed: %s is \"%.*s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, \
+               check_length, (const char *)(actual), check_expected); \
+        check_failures++; \
+    } \
+} while (0)
+
+#define CHECK_RESULT() (check_failures == 0 ? 0 : (printf("%d checks failed\n", check_failures), 1))
+
+#endif
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Saves what the API answers the firmware's requests with as the fixtures
+# for one version, e.g. ./capture.sh 0 today and ./capture.sh 1 tomorrow so
+# the two differ. Same url and params as build_request in main/network.c
+set -e
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 <version>" >&2
+    exit 2
+fi
+
+cd "$(dirname "$0")"
+API="${API:-http://spotcheck.brianteam.dev}"
+trap 'rm -f ./*.json.tmp' EXIT
+
+for endpoint in tides swell; do
+    curl --fail --silent --show-error --compressed \
+        "$API/$endpoint?days=2&spot=wedge" -o "${endpoint}_$1.json.tmp"
+    mv "${endpoint}_$1.json.tmp" "${endpoint}_$1.json"
+done
@@ -0,0 +1,74 @@
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "arena.h"
+#include "check.h"
+
+static void test_alignment() {
+    init_arena();
+
+    uint8_t *first = arena_alloc(1);
+    uint8_t *second = arena_alloc(13);
+    uint8_t *third = arena_alloc(8);
+    CHECK(first != NULL && second != NULL && third != NULL);
+    CHECK_INT((uintptr_t)first % ARENA_ALIGNMENT, 0);
+    CHECK_INT(second - first, ARENA_ALIGNMENT);
+    CHECK_INT(third - second, 2 * ARENA_ALIGNMENT);
+
+    arena_stats stats = get_arena_stats();
+    CHECK_INT(stats.size, ARENA_SIZE);
+    CHECK_INT(stats.used, 3 * ARENA_ALIGNMENT + 8);
+    CHECK_INT(stats.allocs, 3);
+}
+
+static void test_full() {
+    init_arena();
+
+    // Exactly fills it, after the first one's rounded up
+    uint8_t *first = arena_alloc(1);
+    uint8_t *rest = arena_alloc(ARENA_SIZE - ARENA_ALIGNMENT);
+    CHECK(rest != NULL);
+    CHECK(rest + ARENA_SIZE - ARENA_ALIGNMENT == first + ARENA_SIZE);
+
+    CHECK(arena_alloc(1) == NULL);
+    CHECK(arena_alloc(ARENA_SIZE * 2) == NULL);
+    // A zero size alloc still has to fit
+    CHECK(arena_alloc(0) != NULL);
+
+    arena_stats stats = get_arena_stats();
+    CHECK_INT(stats.failed_allocs, 2);
+    CHECK_INT(stats.used, ARENA_SIZE);
+
+    // Too big for even an empty arena
+    init_arena();
+    CHECK(arena_alloc(ARENA_SIZE + 1) == NULL);
+    CHECK(arena_alloc(SIZE_MAX) == NULL);
+    CHECK_INT(get_arena_stats().failed_allocs, 2);
+}
+
+static void test_reset() {
+    init_arena();
+
+    uint8_t *first = arena_alloc(100);
+    arena_alloc(200);
+    arena_reset();
+    // Everything's free again, starting from the same spot
+    CHECK(arena_alloc(ARENA_SIZE) == first);
+    arena_reset();
+    arena_alloc(16);
+
+    // High water is over every cycle, used is just this one
+    arena_stats stats = get_arena_stats();
+    CHECK_INT(stats.high_water, ARENA_SIZE);
+    CHECK_INT(stats.used, 16);
+    CHECK_INT(stats.resets, 2);
+    CHECK_INT(stats.allocs, 4);
+}
+
+int main() {
+    test_alignment();
+    test_full();
+    test_reset();
+    return CHECK_RESULT();
+}
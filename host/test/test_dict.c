@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "dict.h"
+#include "json.h"
+#include "link.h"
+#include "check.h"
+
+/*
+ * Round trips text through dict_encode and the expansion the display does,
+ * then encodes every string in the fixtures to see what the dictionary
+ * saves on real shaped responses and what encoding costs. What expanding
+ * costs the display is in test_render.
+ */
+#define FIXTURE_BUFFER_SIZE 8192
+#define ENCODE_PASSES 1000
+
+static const char *words[] = DICT_WORDS;
+#define NUM_WORDS (sizeof(words) / sizeof(words[0]))
+
+// What the display does as it scrolls
+static int expand(const uint8_t *encoded, int length, char *out) {
+    int out_length = 0;
+    for (int i = 0; i < length; i++) {
+        if (encoded[i] & DICT_TOKEN_FLAG) {
+            const char *word = words[encoded[i] & ~DICT_TOKEN_FLAG];
+            memcpy(&out[out_length], word, strlen(word));
+            out_length += strlen(word);
+        } else {
+            out[out_length++] = encoded[i];
+        }
+    }
+    return out_length;
+}
+
+static int word_index(const char *word) {
+    for (int i = 0; i < NUM_WORDS; i++) {
+        if (strcmp(words[i], word) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void test_round_trip() {
+    const char *texts[] = {
+        "High 5.4 ft at 6:15 am",
+        "Low tide Tomorrow at 12:30 pm",
+        "Swell 3 ft from WNW, period 12 sec",
+        "Wind 10 kts NNE falling",
+        "",
+        "x"
+    };
+
+    for (int i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        int length = strlen(texts[i]);
+        uint8_t encoded[128];
+        char expanded[256];
+        int encoded_length = dict_encode(texts[i], length, encoded, sizeof(encoded));
+        CHECK(encoded_length <= length);
+        CHECK_INT(dict_encoded_length(texts[i], length, sizeof(encoded)), encoded_length);
+        CHECK_TEXT(expanded, expand(encoded, encoded_length, expanded), texts[i]);
+    }
+}
+
+static void test_longest_match() {
+    uint8_t encoded[16];
+
+    // "Monday" rather than "Mon" then "day"
+    CHECK_INT(dict_encode("Monday", 6, encoded, sizeof(encoded)), 1);
+    CHECK_INT(encoded[0], DICT_TOKEN_FLAG | word_index("Monday"));
+
+    // " tide" takes the space, where "tide" would leave it behind
+    CHECK_INT(dict_encode("Low tide", 8, encoded, sizeof(encoded)), 2);
+    CHECK_INT(encoded[0], DICT_TOKEN_FLAG | word_index("Low"));
+    CHECK_INT(encoded[1], DICT_TOKEN_FLAG | word_index(" tide"));
+
+    // Only whole words match, a prefix of one is plain text
+    CHECK_INT(dict_encode("Mo", 2, encoded, sizeof(encoded)), 2);
+    CHECK_INT(encoded[0], 'M');
+    CHECK_INT(encoded[1], 'o');
+}
+
+static void test_non_ascii() {
+    uint8_t encoded[16];
+    CHECK_INT(dict_encode("a\xC3\xA9z", 4, encoded, sizeof(encoded)), 4);
+    CHECK_TEXT(encoded, 4, "a??z");
+}
+
+static void test_max_length() {
+    const char *text = "High tide at 6:15 am";
+    int length = strlen(text);
+    uint8_t encoded[16];
+    memset(encoded, 0xFF, sizeof(encoded));
+
+    dict_stats before = get_dict_stats();
+    CHECK_INT(dict_encode(text, length, encoded, 3), 3);
+    CHECK_INT(dict_encoded_length(text, length, 3), 3);
+    CHECK_INT(encoded[3], 0xFF);
+
+    // Counts what made it in, "High", " tide" and " at "
+    dict_stats after = get_dict_stats();
+    CHECK_INT(after.bytes_in - before.bytes_in, 13);
+    CHECK_INT(after.bytes_out - before.bytes_out, 3);
+}
+
+static int64_t cpu_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Milliseconds the bytes take on the wire at baud, 10 bits a byte
+static double link_ms(int bytes, int baud) {
+    return bytes * 10 * 1000.0 / baud;
+}
+
+static void test_fixture_corpus() {
+    const char *fixtures[] = {"tides_0", "tides_1", "swell_0", "swell_1", "tides_2"};
+    int total_strings = 0;
+    int total_text = 0;
+    int total_encoded = 0;
+    int64_t total_encode_ns = 0;
+
+    for (int f = 0; f < sizeof(fixtures) / sizeof(fixtures[0]); f++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.json", FIXTURE_DIR, fixtures[f]);
+        FILE *file = fopen(path, "rb");
+        CHECK(file != NULL);
+        if (!file) {
+            continue;
+        }
+        static char body[FIXTURE_BUFFER_SIZE];
+        int body_length = fread(body, 1, sizeof(body), file);
+        fclose(file);
+
+        int strings = 0;
+        int text = 0;
+        int encoded_bytes = 0;
+        int64_t encode_ns = 0;
+        json_list_iter iter;
+        char *value;
+        int length;
+        CHECK(json_list_find(&iter, body, body_length));
+        while (json_list_next(&iter, &value, &length)) {
+            uint8_t encoded[LINK_MAX_PAYLOAD];
+            char expanded[LINK_MAX_PAYLOAD * DICT_MAX_WORD_LENGTH];
+            int encoded_length = dict_encode(value, length, encoded, sizeof(encoded));
+            CHECK_TEXT(expanded, expand(encoded, encoded_length, expanded), (value[length] = '\0', value));
+
+            int64_t start_ns = cpu_now_ns();
+            for (int pass = 0; pass < ENCODE_PASSES; pass++) {
+                dict_encode(value, length, encoded, sizeof(encoded));
+            }
+            encode_ns += (cpu_now_ns() - start_ns) / ENCODE_PASSES;
+
+            strings++;
+            text += length;
+            encoded_bytes += encoded_length;
+        }
+
+        CHECK(strings > 0);
+        CHECK(encoded_bytes < text);
+        printf("%s: %d strings, %d -> %d bytes (%.2fx), encode %lld ns a string\n", fixtures[f], strings,
+               text, encoded_bytes, (double)text / encoded_bytes, (long long)(encode_ns / strings));
+        total_strings += strings;
+        total_text += text;
+        total_encoded += encoded_bytes;
+        total_encode_ns += encode_ns;
+    }
+
+    // Each string is its own frame
+    int framed = total_text + total_strings * LINK_FRAME_OVERHEAD;
+    int framed_encoded = total_encoded + total_strings * LINK_FRAME_OVERHEAD;
+    printf("all: %d strings, text %d -> %d bytes (%.2fx), framed %d -> %d bytes, "
+           "%.0f -> %.0f ms at %d baud, encode %lld ns a string\n", total_strings, total_text, total_encoded,
+           (double)total_text / total_encoded, framed, framed_encoded, link_ms(framed, LINK_DEFAULT_BAUD),
+           link_ms(framed_encoded, LINK_DEFAULT_BAUD), LINK_DEFAULT_BAUD,
+           (long long)(total_encode_ns / total_strings));
+}
+
+int main() {
+    init_dict();
+    test_round_trip();
+    test_longest_match();
+    test_non_ascii();
+    test_max_length();
+    test_fixture_corpus();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "dns.h"
+#include "check.h"
+#include "sim_hooks.h"
+#include "standin.h"
+
+/*
+ * Resolves against the DNS stand-in, moving the clock past TTLs to check when
+ * the cache answers, when it answers stale while the refresh task asks again,
+ * and when a lookup has to wait on a query.
+ */
+#define HOST "spotcheck.brianteam.dev"
+#define REFRESH_WAIT_MS 2000
+#define CACHED_LOOKUPS 100000
+
+static int64_t cpu_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void resolve_loopback() {
+    uint32_t addr = 0;
+    CHECK(dns_resolve(HOST, &addr));
+    CHECK_INT(addr, htonl(INADDR_LOOPBACK));
+}
+
+// The refresh runs on its own task, so give it a moment
+static void wait_for_refreshes(uint32_t refreshes, uint32_t query_failures) {
+    for (int waited_ms = 0; waited_ms < REFRESH_WAIT_MS; waited_ms += 10) {
+        dns_stats stats = get_dns_stats();
+        if (stats.refreshes + stats.query_failures >= refreshes + query_failures) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    dns_stats stats = get_dns_stats();
+    CHECK_INT(stats.refreshes, refreshes);
+    CHECK_INT(stats.query_failures, query_failures);
+}
+
+static void test_miss_then_fresh_hits() {
+    resolve_loopback();
+    resolve_loopback();
+
+    dns_stats stats = get_dns_stats();
+    CHECK_INT(stats.lookups, 2);
+    CHECK_INT(stats.misses, 1);
+    CHECK_INT(stats.fresh_hits, 1);
+    CHECK_INT(stats.queries, 1);
+    CHECK_INT(get_standin_stats().dns_queries, 1);
+}
+
+// The CNAME's TTL is the lower of the two, so that's the one that counts
+static void test_stale_hit_refreshes_in_background() {
+    sim_advance_clock_us((STANDIN_DNS_TTL_S - 1) * 1000000LL);
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().fresh_hits, 2);
+
+    sim_advance_clock_us(2 * 1000000LL);
+    resolve_loopback();
+    dns_stats stats = get_dns_stats();
+    CHECK_INT(stats.stale_hits, 1);
+    CHECK_INT(stats.misses, 1);
+    wait_for_refreshes(1, 0);
+    CHECK_INT(get_standin_stats().dns_queries, 2);
+
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().fresh_hits, 3);
+}
+
+static void test_short_ttl_is_clamped() {
+    standin_set_dns_ttl_s(5);
+    dns_invalidate(HOST);
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().misses, 2);
+
+    sim_advance_clock_us((DNS_MIN_TTL_S - 1) * 1000000LL);
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().fresh_hits, 4);
+
+    sim_advance_clock_us(2 * 1000000LL);
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().stale_hits, 2);
+    wait_for_refreshes(2, 0);
+    standin_set_dns_ttl_s(STANDIN_DNS_TTL_S);
+}
+
+// The old address keeps being handed out through an outage until
+// DNS_MAX_STALE_S runs out, then lookups fail
+static void test_outage_serves_stale_then_fails() {
+    standin_set_dns_failing(true);
+    sim_advance_clock_us((DNS_MIN_TTL_S + 1) * 1000000LL);
+    resolve_loopback();
+    wait_for_refreshes(2, 1);
+
+    sim_advance_clock_us(DNS_MAX_STALE_S / 2 * 1000000LL);
+    resolve_loopback();
+    wait_for_refreshes(2, 2);
+    CHECK_INT(get_dns_stats().stale_hits, 4);
+
+    sim_advance_clock_us(DNS_MAX_STALE_S * 1000000LL);
+    uint32_t addr;
+    CHECK(!dns_resolve(HOST, &addr));
+    dns_stats stats = get_dns_stats();
+    CHECK_INT(stats.misses, 3);
+    CHECK_INT(stats.query_failures, 3);
+
+    standin_set_dns_failing(false);
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().misses, 4);
+}
+
+static void test_invalidate_forces_a_query() {
+    uint32_t queries = get_dns_stats().queries;
+    dns_invalidate(HOST);
+    resolve_loopback();
+    CHECK_INT(get_dns_stats().queries, queries + 1);
+}
+
+// Loopback, so the query time is close to the least a lookup can cost. On
+// the chip it's a round trip to the router and often upstream as well
+static void test_cached_lookup_cost() {
+    dns_stats stats = get_dns_stats();
+    uint32_t average_query_us = (uint32_t)(stats.query_time_us / stats.queries);
+
+    uint32_t addr;
+    int64_t start_ns = cpu_now_ns();
+    for (int i = 0; i < CACHED_LOOKUPS; i++) {
+        dns_resolve(HOST, &addr);
+    }
+    int64_t lookup_ns = (cpu_now_ns() - start_ns) / CACHED_LOOKUPS;
+
+    CHECK_INT(get_dns_stats().queries, stats.queries);
+    printf("dns: query %uus on loopback (max %uus), cached lookup %lldns\n",
+           average_query_us, stats.max_query_us, (long long)lookup_ns);
+}
+
+int main() {
+    uint16_t dns_port = standin_start_dns();
+    if (dns_port == 0) {
+        printf("Couldn't start the stand-in server\n");
+        return 1;
+    }
+    sim_net_redirect(0, dns_port);
+    init_dns();
+
+    test_miss_then_fresh_hits();
+    test_stale_hit_refreshes_in_background();
+    test_short_ttl_is_clamped();
+    test_outage_serves_stale_then_fails();
+    test_invalidate_forces_a_query();
+    test_cached_lookup_cost();
+    return CHECK_RESULT();
+}
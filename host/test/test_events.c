@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "events.h"
+#include "check.h"
+
+#define TICK_US 10000
+#define NUM_TICKS 50
+
+// Stands in for the hw_timer ISR, posting a tick every TICK_US
+static void *timer_isr_thread(void *arg) {
+    for (int i = 0; i < NUM_TICKS; i++) {
+        usleep(TICK_US);
+        post_event_from_isr(EVENT_TIMER_EXPIRED);
+    }
+
+    return NULL;
+}
+
+// Spins for handle_us per event, like the main loop doing a request
+static void run_ticks(int64_t handle_us) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, timer_isr_thread, NULL);
+    for (int i = 0; i < NUM_TICKS; i++) {
+        event_type event;
+        CHECK(wait_for_event(&event, portMAX_DELAY));
+        CHECK_INT(event, EVENT_TIMER_EXPIRED);
+        int64_t start_us = esp_timer_get_time();
+        while (esp_timer_get_time() - start_us < handle_us) {
+        }
+    }
+    pthread_join(thread, NULL);
+}
+
+// With nothing to do between ticks the main task should be asleep nearly
+// all the time, not spinning on flags like the old loop
+static void test_idle_while_blocked() {
+    event_stats before = get_event_stats();
+    run_ticks(0);
+
+    event_stats after = get_event_stats();
+    CHECK_INT(after.events_handled - before.events_handled, NUM_TICKS);
+    CHECK_INT(after.events_dropped, 0);
+    CHECK(get_idle_percent() >= 95);
+    printf("idle %d%% with nothing to do between %dms ticks\n", get_idle_percent(), TICK_US / 1000);
+}
+
+// And busy time shows up as busy, so the number means something
+static void test_busy_time_counts() {
+    event_stats before = get_event_stats();
+    run_ticks(TICK_US / 2);
+
+    event_stats after = get_event_stats();
+    uint64_t idle_us = after.idle_us - before.idle_us;
+    uint64_t busy_us = after.busy_us - before.busy_us;
+    int idle_percent = (int)(idle_us * 100 / (idle_us + busy_us));
+    CHECK(idle_percent > 30 && idle_percent < 70);
+    printf("idle %d%% when each tick takes half the tick to handle\n", idle_percent);
+}
+
+static void test_timeout_and_full_queue() {
+    event_type event;
+    CHECK(!wait_for_event(&event, 1));
+
+    // The ISR never blocks, past the queue's length events are dropped
+    event_stats before = get_event_stats();
+    for (int i = 0; i < EVENT_QUEUE_LENGTH + 2; i++) {
+        post_event_from_isr(EVENT_BUTTON_CHANGED);
+    }
+    CHECK_INT(get_event_stats().events_dropped - before.events_dropped, 2);
+    for (int i = 0; i < EVENT_QUEUE_LENGTH; i++) {
+        CHECK(wait_for_event(&event, 0));
+        CHECK_INT(event, EVENT_BUTTON_CHANGED);
+    }
+    CHECK(!wait_for_event(&event, 0));
+}
+
+int main() {
+    init_events();
+    test_idle_while_blocked();
+    test_busy_time_counts();
+    test_timeout_and_full_queue();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,229 @@
+#include <string.h>
+
+#include "gesture.h"
+#include "check.h"
+
+/*
+ * Feeds the recognizer edge traces with made up timestamps, the way the
+ * main task drains them off the ISR's ring, and checks which gestures come
+ * out and when. Nothing here reads the clock, so a trace can be replayed
+ * with its edges as late as they like.
+ */
+#define MS 1000LL
+#define MAX_GESTURES 8
+// Random bounce on every transition, each trace replayed with this many seeds
+#define BOUNCE_SEEDS 200
+// Bounce only ever lasts this long, well inside GESTURE_DEBOUNCE_MS
+#define MAX_BOUNCE_MS 20
+
+static gesture_type gestures[MAX_GESTURES];
+static int num_gestures;
+
+static void record(gesture_type gesture, void *handler_arg) {
+    if (num_gestures < MAX_GESTURES) {
+        gestures[num_gestures] = gesture;
+    }
+    num_gestures++;
+}
+
+static void start(gesture_recognizer *recognizer) {
+    num_gestures = 0;
+    gesture_init(recognizer, record, NULL);
+}
+
+static void edge(gesture_recognizer *recognizer, int64_t time_ms, bool pressed) {
+    button_edge e = {time_ms * MS, pressed};
+    gesture_feed_edge(recognizer, &e);
+}
+
+static void test_press() {
+    gesture_recognizer r;
+    start(&r);
+    CHECK_INT(gesture_next_deadline_us(&r), -1);
+
+    edge(&r, 0, true);
+    CHECK_INT(gesture_next_deadline_us(&r), GESTURE_DEBOUNCE_MS * MS);
+    edge(&r, 100, false);
+
+    // Waits out the chance of a second press, timed from the release
+    gesture_advance(&r, (100 + GESTURE_DOUBLE_PRESS_MS) * MS - 1);
+    CHECK_INT(num_gestures, 0);
+    CHECK_INT(gesture_next_deadline_us(&r), (100 + GESTURE_DOUBLE_PRESS_MS) * MS);
+    gesture_advance(&r, (100 + GESTURE_DOUBLE_PRESS_MS) * MS);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gestures[0], GESTURE_PRESS);
+    CHECK_INT(gesture_next_deadline_us(&r), -1);
+}
+
+static void test_bounce() {
+    gesture_recognizer r;
+    start(&r);
+
+    // Never holds a level long enough to count
+    for (int i = 0; i < 10; i++) {
+        edge(&r, i * 3, i % 2 == 0);
+    }
+    edge(&r, 30, false);
+    gesture_advance(&r, 5000 * MS);
+    CHECK_INT(num_gestures, 0);
+
+    // Bouncing on the way down and up is still one press
+    edge(&r, 6000, true);
+    edge(&r, 6002, false);
+    edge(&r, 6005, true);
+    edge(&r, 6100, false);
+    edge(&r, 6103, true);
+    edge(&r, 6106, false);
+    gesture_advance(&r, 8000 * MS);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gestures[0], GESTURE_PRESS);
+}
+
+static void test_double_press() {
+    gesture_recognizer r;
+    start(&r);
+
+    edge(&r, 0, true);
+    edge(&r, 100, false);
+    edge(&r, 200, true);
+    edge(&r, 300, false);
+    // Fires as soon as the second release settles, no waiting for a third
+    gesture_advance(&r, (300 + GESTURE_DEBOUNCE_MS) * MS);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gestures[0], GESTURE_DOUBLE_PRESS);
+
+    gesture_advance(&r, 5000 * MS);
+    CHECK_INT(num_gestures, 1);
+
+    // Too slow for a double, that's two presses
+    edge(&r, 6000, true);
+    edge(&r, 6100, false);
+    edge(&r, 6100 + GESTURE_DOUBLE_PRESS_MS + 10, true);
+    edge(&r, 6100 + GESTURE_DOUBLE_PRESS_MS + 100, false);
+    gesture_advance(&r, 8000 * MS);
+    CHECK_INT(num_gestures, 3);
+    CHECK_INT(gestures[1], GESTURE_PRESS);
+    CHECK_INT(gestures[2], GESTURE_PRESS);
+}
+
+static void test_long_press() {
+    gesture_recognizer r;
+    start(&r);
+
+    edge(&r, 0, true);
+    gesture_advance(&r, GESTURE_LONG_PRESS_MS * MS - 1);
+    CHECK_INT(num_gestures, 0);
+    // Fires while still held
+    gesture_advance(&r, GESTURE_LONG_PRESS_MS * MS);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gestures[0], GESTURE_LONG_PRESS);
+
+    // Letting go afterwards isn't a press as well
+    edge(&r, 3000, false);
+    gesture_advance(&r, 5000 * MS);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gesture_next_deadline_us(&r), -1);
+}
+
+static void test_late_edges() {
+    gesture_recognizer r;
+    start(&r);
+
+    // Edges that sat in a queue are judged on when they happened. The
+    // first press ran out of time before the second started, even though
+    // nothing looked at the recognizer in between
+    edge(&r, 0, true);
+    edge(&r, 50, false);
+    edge(&r, 50 + GESTURE_DOUBLE_PRESS_MS + 1, true);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gestures[0], GESTURE_PRESS);
+
+    edge(&r, 50 + GESTURE_DOUBLE_PRESS_MS + 2000, false);
+    CHECK_INT(num_gestures, 2);
+    CHECK_INT(gestures[1], GESTURE_LONG_PRESS);
+}
+
+static void test_triple_press() {
+    gesture_recognizer r;
+    start(&r);
+
+    // The first two make the double, the third starts over as a press
+    for (int i = 0; i < 3; i++) {
+        edge(&r, i * 200, true);
+        edge(&r, i * 200 + 100, false);
+    }
+    gesture_advance(&r, 5000 * MS);
+    CHECK_INT(num_gestures, 2);
+    CHECK_INT(gestures[0], GESTURE_DOUBLE_PRESS);
+    CHECK_INT(gestures[1], GESTURE_PRESS);
+}
+
+static void test_hold_just_under_long() {
+    gesture_recognizer r;
+    start(&r);
+
+    edge(&r, 0, true);
+    edge(&r, GESTURE_LONG_PRESS_MS - GESTURE_DEBOUNCE_MS - 1, false);
+    gesture_advance(&r, 5000 * MS);
+    CHECK_INT(num_gestures, 1);
+    CHECK_INT(gestures[0], GESTURE_PRESS);
+}
+
+static uint32_t random_state;
+
+static uint32_t next_random(uint32_t limit) {
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 16) % limit;
+}
+
+// A clean transition at time_ms, with a burst of bounce ahead of it
+static void bouncy_edge(gesture_recognizer *recognizer, int64_t time_ms, bool pressed) {
+    int64_t bounce_ms = next_random(MAX_BOUNCE_MS);
+    int bounces = next_random(6) * 2;
+    for (int i = 0; i < bounces; i++) {
+        edge(recognizer, time_ms + bounce_ms * i / bounces, i % 2 == 0 ? pressed : !pressed);
+    }
+    edge(recognizer, time_ms + bounce_ms, pressed);
+}
+
+// Press, double press and long press, each with bounce on every transition,
+// come out as if the contacts were clean
+static void test_random_bounce() {
+    int wrong = 0;
+    for (uint32_t seed = 1; seed <= BOUNCE_SEEDS; seed++) {
+        random_state = seed;
+        gesture_recognizer r;
+        start(&r);
+
+        bouncy_edge(&r, 0, true);
+        bouncy_edge(&r, 120, false);
+        gesture_advance(&r, 1000 * MS);
+
+        bouncy_edge(&r, 2000, true);
+        bouncy_edge(&r, 2100, false);
+        bouncy_edge(&r, 2250, true);
+        bouncy_edge(&r, 2350, false);
+        gesture_advance(&r, 3000 * MS);
+
+        bouncy_edge(&r, 4000, true);
+        gesture_advance(&r, (4000 + MAX_BOUNCE_MS + GESTURE_LONG_PRESS_MS + GESTURE_DEBOUNCE_MS) * MS);
+        bouncy_edge(&r, 7000, false);
+        gesture_advance(&r, 9000 * MS);
+
+        wrong += num_gestures != 3 || gestures[0] != GESTURE_PRESS || gestures[1] != GESTURE_DOUBLE_PRESS
+                 || gestures[2] != GESTURE_LONG_PRESS;
+    }
+    CHECK_INT(wrong, 0);
+}
+
+int main() {
+    test_press();
+    test_bounce();
+    test_double_press();
+    test_long_press();
+    test_late_edges();
+    test_triple_press();
+    test_hold_just_under_long();
+    test_random_bounce();
+    return CHECK_RESULT();
+}
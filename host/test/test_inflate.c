@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "inflate.h"
+#include "check.h"
+
+#define MAX_DATA 16384
+// Odd sized so reads never line up with the block or chunk boundaries
+#define READ_SIZE 37
+#define DECODE_RUNS 1000
+
+// What inflate reads from and writes to
+typedef struct {
+    const uint8_t *input;
+    int input_length;
+    int input_offset;
+    uint8_t output[MAX_DATA];
+    int output_length;
+    // Stop once this much has been written, 0 for never
+    int stop_after;
+} stream;
+
+static int read_input(uint8_t *buf, int length, void *arg) {
+    stream *s = arg;
+    int remaining = s->input_length - s->input_offset;
+    int count = remaining < length ? remaining : length;
+    count = count < READ_SIZE ? count : READ_SIZE;
+    memcpy(buf, &s->input[s->input_offset], count);
+    s->input_offset += count;
+    return count;
+}
+
+static bool write_output(const uint8_t *data, int length, void *arg) {
+    stream *s = arg;
+    if (s->output_length + length > MAX_DATA) {
+        return false;
+    }
+
+    memcpy(&s->output[s->output_length], data, length);
+    s->output_length += length;
+    return s->stop_after == 0 || s->output_length < s->stop_after;
+}
+
+// window_bits as zlib takes them: 15 for zlib, -15 raw, 31 gzip
+static int compress_with_zlib(const uint8_t *data, int length, int level, int window_bits, uint8_t *out, int out_size) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    deflateInit2(&z, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    z.next_in = (uint8_t *)data;
+    z.avail_in = length;
+    z.next_out = out;
+    z.avail_out = out_size;
+    int result = deflate(&z, Z_FINISH);
+    int compressed_length = out_size - z.avail_out;
+    deflateEnd(&z);
+    return result == Z_STREAM_END ? compressed_length : -1;
+}
+
+static inflate_result run(content_encoding encoding, const uint8_t *input, int input_length, stream *s) {
+    memset(s, 0, sizeof(*s));
+    s->input = input;
+    s->input_length = input_length;
+    return inflate_stream(encoding, read_input, write_output, s);
+}
+
+// Looks like a response, lots of near repeats a few hundred bytes apart
+static int make_text(uint8_t *out, int size) {
+    int length = 0;
+    for (int i = 0; length + 64 < size; i++) {
+        length += snprintf((char *)&out[length], 64, "{\"t\":\"%02d:%02d\",\"h\":%d.%d},", i % 24, (i * 7) % 60, i % 9, i % 10);
+    }
+    return length;
+}
+
+// Doesn't compress at all
+static void make_noise(uint8_t *out, int length, uint32_t seed) {
+    for (int i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        out[i] = seed >> 16;
+    }
+}
+
+static uint8_t text[MAX_DATA];
+static uint8_t compressed[MAX_DATA * 2];
+static stream s;
+
+static void test_round_trips(int text_length) {
+    struct {
+        content_encoding encoding;
+        int window_bits;
+    } formats[] = {
+        {CONTENT_ENCODING_GZIP, 31},
+        {CONTENT_ENCODING_DEFLATE, 15},
+        {CONTENT_ENCODING_DEFLATE, -15}
+    };
+    // Stored, fixed/dynamic huffman at both ends of the effort scale
+    int levels[] = {0, 1, 9};
+
+    for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (int l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            // Keeps every match inside our window
+            int window_bits = formats[f].window_bits < 0 ? -12 : formats[f].window_bits - 3;
+            int length = compress_with_zlib(text, text_length, levels[l], window_bits, compressed, sizeof(compressed));
+            CHECK(length > 0);
+            CHECK_INT(run(formats[f].encoding, compressed, length, &s), INFLATE_OK);
+            CHECK_INT(s.output_length, text_length);
+            CHECK(memcmp(s.output, text, text_length) == 0);
+        }
+    }
+}
+
+static void test_short_input() {
+    uint8_t hello[] = "hi";
+    int length = compress_with_zlib(hello, 2, 6, 31, compressed, sizeof(compressed));
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, length, &s), INFLATE_OK);
+    CHECK_TEXT(s.output, s.output_length, "hi");
+
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, 0, &s), INFLATE_DATA_ERROR);
+}
+
+static void test_match_beyond_window() {
+    // The second copy is one long match INFLATE_WINDOW_SIZE + 1000 back
+    int half = INFLATE_WINDOW_SIZE + 1000;
+    make_noise(text, half, 1);
+    memcpy(&text[half], text, half);
+
+    int length = compress_with_zlib(text, half * 2, 9, 31, compressed, sizeof(compressed));
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, length, &s), INFLATE_WINDOW_TOO_SMALL);
+}
+
+static void test_corrupt_input() {
+    int text_length = make_text(text, 4000);
+    int length = compress_with_zlib(text, text_length, 6, 31, compressed, sizeof(compressed));
+
+    // The gzip trailer is the crc32 then the length
+    compressed[length - 8] ^= 0x01;
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, length, &s), INFLATE_DATA_ERROR);
+    compressed[length - 8] ^= 0x01;
+
+    compressed[length - 4] ^= 0x01;
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, length, &s), INFLATE_DATA_ERROR);
+    compressed[length - 4] ^= 0x01;
+
+    compressed[0] = 0x00;
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, length, &s), INFLATE_DATA_ERROR);
+    compressed[0] = 0x1F;
+
+    CHECK_INT(run(CONTENT_ENCODING_GZIP, compressed, length / 2, &s), INFLATE_DATA_ERROR);
+
+    // zlib's trailer is an adler32
+    length = compress_with_zlib(text, text_length, 6, 15, compressed, sizeof(compressed));
+    compressed[length - 1] ^= 0x01;
+    CHECK_INT(run(CONTENT_ENCODING_DEFLATE, compressed, length, &s), INFLATE_DATA_ERROR);
+}
+
+static void test_write_stops() {
+    int text_length = make_text(text, 8000);
+    int length = compress_with_zlib(text, text_length, 6, 31, compressed, sizeof(compressed));
+
+    memset(&s, 0, sizeof(s));
+    s.input = compressed;
+    s.input_length = length;
+    s.stop_after = 1000;
+    CHECK_INT(inflate_stream(CONTENT_ENCODING_GZIP, read_input, write_output, &s), INFLATE_WRITE_STOPPED);
+    CHECK(s.output_length >= 1000 && s.output_length < text_length);
+    CHECK(memcmp(s.output, text, s.output_length) == 0);
+}
+
+static int64_t cpu_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * What each fixture costs on the air plain and gzipped the way the stand-in
+ * sends it, with the 32KB window servers use and with one that fits ours,
+ * and how long it takes to inflate. Host CPU time, through READ_SIZE reads,
+ * so only a rough idea of the chip's
+ */
+static void test_fixture_sizes_and_decode_time() {
+    const char *names[] = {"tides_0", "swell_0", "tides_2"};
+    int window_bits[] = {15, 12};
+    for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.json", FIXTURE_DIR, names[i]);
+        FILE *f = fopen(path, "rb");
+        CHECK(f != NULL);
+        if (!f) {
+            continue;
+        }
+        int text_length = fread(text, 1, sizeof(text), f);
+        fclose(f);
+
+        for (int w = 0; w < sizeof(window_bits) / sizeof(window_bits[0]); w++) {
+            int length = compress_with_zlib(text, text_length, 9, window_bits[w] + 16, compressed, sizeof(compressed));
+            CHECK(length > 0);
+            inflate_result result = run(CONTENT_ENCODING_GZIP, compressed, length, &s);
+            printf("%s, %dKB window: %d bytes plain, %d gzipped (%d%%)", names[i], (1 << window_bits[w]) / 1024,
+                   text_length, length, length * 100 / text_length);
+            if (result != INFLATE_OK) {
+                // Only allowed when the server's window is bigger than ours
+                CHECK((1 << window_bits[w]) > INFLATE_WINDOW_SIZE);
+                CHECK_INT(result, INFLATE_WINDOW_TOO_SMALL);
+                printf(", %s\n", inflate_result_name(result));
+                continue;
+            }
+
+            int64_t start_ns = cpu_now_ns();
+            for (int run_number = 0; run_number < DECODE_RUNS; run_number++) {
+                run(CONTENT_ENCODING_GZIP, compressed, length, &s);
+            }
+            int64_t decode_ns = (cpu_now_ns() - start_ns) / DECODE_RUNS;
+            CHECK_INT(s.output_length, text_length);
+            CHECK(memcmp(s.output, text, text_length) == 0);
+            printf(", inflates in %.1fus\n", decode_ns / 1000.0);
+        }
+    }
+}
+
+int main() {
+    test_round_trips(make_text(text, 200));
+    test_round_trips(make_text(text, MAX_DATA));
+    test_short_input();
+    test_match_beyond_window();
+    test_corrupt_input();
+    test_write_stops();
+    test_fixture_sizes_and_decode_time();
+    return CHECK_RESULT();
+}
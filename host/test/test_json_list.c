@@ -0,0 +1,72 @@
+#include <string.h>
+
+#include "json.h"
+#include "check.h"
+
+// Copied out since the iterator writes over the buffer it's given
+static bool find(json_list_iter *iter, char *buffer, const char *body) {
+    strcpy(buffer, body);
+    return json_list_find(iter, buffer, strlen(body));
+}
+
+static void test_values_are_slices_of_the_buffer() {
+    char buffer[256];
+    json_list_iter iter;
+    CHECK(find(&iter, buffer, " { \"errorMessage\" : \"\", \"meta\":{\"data\":[\"no\"]}, \"data\" : "
+                              "[ \"High 5.4 ft\" , 7, {\"x\":\"]\"}, \"a\\\"b\\\\c\\/\\n\", \"\\u0041\\u00e9\" ] }"));
+
+    char *value;
+    int length;
+    CHECK(json_list_next(&iter, &value, &length));
+    CHECK_TEXT(value, length, "High 5.4 ft");
+    CHECK(value >= buffer && value < buffer + sizeof(buffer));
+    CHECK_INT(value[length], '\0');
+
+    // The number and the object aren't strings and get skipped
+    CHECK(json_list_next(&iter, &value, &length));
+    CHECK_TEXT(value, length, "a\"b\\c/\n");
+    CHECK(json_list_next(&iter, &value, &length));
+    CHECK_TEXT(value, length, "A?");
+
+    CHECK(!json_list_next(&iter, &value, &length));
+    CHECK(iter.complete);
+}
+
+static void test_missing_list() {
+    char buffer[128];
+    json_list_iter iter;
+    CHECK(!find(&iter, buffer, "{\"errorMessage\":\"down\"}"));
+    CHECK(!find(&iter, buffer, "[\"data\"]"));
+    CHECK(!find(&iter, buffer, "{\"data\":\"not a list\"}"));
+    CHECK(!find(&iter, buffer, "{\"meta\":{\"data\":[\"nested\"]}}"));
+}
+
+static void test_cut_off_list() {
+    char buffer[128];
+    json_list_iter iter;
+    char *value;
+    int length;
+
+    CHECK(find(&iter, buffer, "{\"data\":[\"one\",\"two"));
+    CHECK(json_list_next(&iter, &value, &length));
+    CHECK_TEXT(value, length, "one");
+    CHECK(!json_list_next(&iter, &value, &length));
+    CHECK(!iter.complete);
+
+    CHECK(find(&iter, buffer, "{\"data\":[\"one\","));
+    CHECK(json_list_next(&iter, &value, &length));
+    CHECK(!json_list_next(&iter, &value, &length));
+    CHECK(!iter.complete);
+
+    // Ends there, rather than running out
+    CHECK(find(&iter, buffer, "{\"data\":[]}"));
+    CHECK(!json_list_next(&iter, &value, &length));
+    CHECK(iter.complete);
+}
+
+int main() {
+    test_values_are_slices_of_the_buffer();
+    test_missing_list();
+    test_cut_off_list();
+    return CHECK_RESULT();
+}
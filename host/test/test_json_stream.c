@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "json.h"
+#include "arena.h"
+#include "check.h"
+#include "sim_hooks.h"
+
+#define MAX_VALUES 16
+// What network.c reads the body in (STREAM_READ_CHUNK_SIZE)
+#define READ_CHUNK_SIZE 256
+#define MIN_BODY_SIZE 1024
+#define MAX_BODY_SIZE (64 * 1024)
+
+typedef struct {
+    char values[MAX_VALUES][JSON_STREAM_MAX_STRING_LENGTH + 1];
+    int lengths[MAX_VALUES];
+    int count;
+} collected_values;
+
+static void collect(char *value, int length, void *handler_arg) {
+    collected_values *collected = handler_arg;
+    if (collected->count < MAX_VALUES) {
+        memcpy(collected->values[collected->count], value, length + 1);
+        collected->lengths[collected->count++] = length;
+    }
+}
+
+// Feeds body chunk_size bytes at a time. Returns what json_stream_feed last said
+static bool feed_in_chunks(json_stream_parser *parser, collected_values *collected, const char *body, int chunk_size) {
+    memset(collected, 0, sizeof(*collected));
+    json_stream_init(parser, collect, collected);
+
+    int length = strlen(body);
+    bool ok = true;
+    for (int offset = 0; offset < length && ok; offset += chunk_size) {
+        int remaining = length - offset;
+        ok = json_stream_feed(parser, &body[offset], remaining < chunk_size ? remaining : chunk_size);
+    }
+    return ok;
+}
+
+static void test_finds_list_at_every_split() {
+    const char *body = "{\"errorMessage\":\"\",\"meta\":{\"data\":[\"not this\"],\"n\":[1,2,{\"x\":\"y\"}]},"
+                       "\"data\":[\"High 5.4 ft\",\"esc \\\"q\\\" \\\\ \\/\",\"tab\\there\",\"\\u0041\\u00e9\"],\"after\":\"z\"}";
+
+    for (int chunk_size = 1; chunk_size <= (int)strlen(body); chunk_size++) {
+        json_stream_parser parser;
+        collected_values collected;
+        CHECK(feed_in_chunks(&parser, &collected, body, chunk_size));
+        CHECK_INT(collected.count, 4);
+        CHECK_TEXT(collected.values[0], collected.lengths[0], "High 5.4 ft");
+        CHECK_TEXT(collected.values[1], collected.lengths[1], "esc \"q\" \\ /");
+        CHECK_TEXT(collected.values[2], collected.lengths[2], "tab\there");
+        // Anything past ascii turns into a placeholder
+        CHECK_TEXT(collected.values[3], collected.lengths[3], "A?");
+        CHECK_INT(parser.values_found, 4);
+        CHECK(json_stream_complete(&parser));
+    }
+}
+
+/*
+ * A body cut off anywhere, even after the list's closing bracket, could be
+ * missing strings the handler never saw, so only the whole document counts.
+ */
+static void test_complete_needs_the_whole_body() {
+    const char *body = "{\"data\":[\"one\",\"two\"],\"after\":[\"x\"]}";
+    int length = strlen(body);
+    json_stream_parser parser;
+    collected_values collected;
+
+    for (int cut = 0; cut < length; cut++) {
+        memset(&collected, 0, sizeof(collected));
+        json_stream_init(&parser, collect, &collected);
+        CHECK(json_stream_feed(&parser, body, cut));
+        CHECK(!json_stream_complete(&parser));
+    }
+
+    CHECK(feed_in_chunks(&parser, &collected, body, 5));
+    CHECK(json_stream_complete(&parser));
+
+    // Whole, but there's no list to have got
+    CHECK(feed_in_chunks(&parser, &collected, "{\"errorMessage\":\"down\"}", 5));
+    CHECK(!json_stream_complete(&parser));
+    CHECK(feed_in_chunks(&parser, &collected, "{\"meta\":{\"data\":[\"nested\"]}}", 5));
+    CHECK(!json_stream_complete(&parser));
+    CHECK_INT(collected.count, 0);
+
+    // An empty list is still a whole one
+    CHECK(feed_in_chunks(&parser, &collected, "{\"data\":[]}", 5));
+    CHECK(json_stream_complete(&parser));
+}
+
+static void test_truncates_long_strings() {
+    char body[JSON_STREAM_MAX_STRING_LENGTH * 2 + 64];
+    char long_value[JSON_STREAM_MAX_STRING_LENGTH + 11];
+    memset(long_value, 'x', sizeof(long_value) - 1);
+    long_value[sizeof(long_value) - 1] = '\0';
+    snprintf(body, sizeof(body), "{\"data\":[\"%s\",\"short\"]}", long_value);
+
+    json_stream_parser parser;
+    collected_values collected;
+    CHECK(feed_in_chunks(&parser, &collected, body, 7));
+    CHECK_INT(collected.count, 2);
+    CHECK_INT(collected.lengths[0], JSON_STREAM_MAX_STRING_LENGTH);
+    CHECK_TEXT(collected.values[1], collected.lengths[1], "short");
+    CHECK_INT(parser.values_truncated, 1);
+}
+
+static void test_malformed_bodies() {
+    json_stream_parser parser;
+    collected_values collected;
+
+    CHECK(!feed_in_chunks(&parser, &collected, "{\"data\":[\"\\u00zz\"]}", 3));
+
+    CHECK(!feed_in_chunks(&parser, &collected, "{\"data\":[]}}", 3));
+
+    // Nested deeper than the parser tracks
+    char deep[JSON_STREAM_MAX_DEPTH + 2];
+    memset(deep, '[', sizeof(deep) - 1);
+    deep[sizeof(deep) - 1] = '\0';
+    CHECK(!feed_in_chunks(&parser, &collected, deep, 5));
+}
+
+typedef struct {
+    int count;
+    int mismatches;
+} counted_values;
+
+// The strings build_body writes are numbered, so each one can be checked
+static void count_value(char *value, int length, void *handler_arg) {
+    counted_values *counted = handler_arg;
+    char expected[64];
+    int expected_length = snprintf(expected, sizeof(expected), "Tue 10/13 High 5.4 ft at 10:48am #%d", counted->count);
+    if (length != expected_length || memcmp(value, expected, length) != 0) {
+        counted->mismatches++;
+    }
+    counted->count++;
+}
+
+// A response in the API's shape padded out to about size bytes. Returns how
+// many strings are in its list
+static int build_body(char *body, int size) {
+    int length = sprintf(body, "{\"errorMessage\":\"\",\"meta\":{\"spot\":\"wedge\",\"days\":2},\"data\":[");
+    int count = 0;
+    while (length < size - 48) {
+        length += sprintf(&body[length], "%s\"Tue 10/13 High 5.4 ft at 10:48am #%d\"", count > 0 ? "," : "", count);
+        count++;
+    }
+    sprintf(&body[length], "]}");
+    return count;
+}
+
+/*
+ * Bodies from 1KB to 64KB, replayed in network.c's read chunks and in odd
+ * sized ones. The parser and the read chunk come out of the arena the way
+ * refresh.c and network.c take them, and the parser holds nothing but its
+ * own struct, so however big the body gets nothing should be allocated,
+ * and neither the heap's nor the arena's high water mark should move. The
+ * cJSON tree the buffered path builds from the same body is there to show
+ * the heap's does move when it should, up until the tree doesn't fit in
+ * the heap at all.
+ */
+static void test_growing_bodies_stay_off_the_heap() {
+    static char body[MAX_BODY_SIZE + 64];
+    const int chunk_sizes[] = {READ_CHUNK_SIZE, 37};
+    uint32_t last_tree_peak = 0;
+    init_arena();
+
+    for (int size = MIN_BODY_SIZE; size <= MAX_BODY_SIZE; size *= 2) {
+        int expected_count = build_body(body, size);
+        int length = strlen(body);
+        for (int i = 0; i < (int)(sizeof(chunk_sizes) / sizeof(chunk_sizes[0])); i++) {
+            sim_reset_heap_peak();
+            sim_heap_stats before = sim_get_heap_stats();
+
+            arena_reset();
+            json_stream_parser *parser = arena_alloc(sizeof(json_stream_parser));
+            char *chunk = arena_alloc(READ_CHUNK_SIZE);
+            CHECK(parser != NULL && chunk != NULL);
+            if (!parser || !chunk) {
+                return;
+            }
+
+            counted_values counted = {0, 0};
+            json_stream_init(parser, count_value, &counted);
+            bool ok = true;
+            for (int offset = 0; offset < length && ok; offset += chunk_sizes[i]) {
+                int remaining = length - offset;
+                int read = remaining < chunk_sizes[i] ? remaining : chunk_sizes[i];
+                memcpy(chunk, &body[offset], read);
+                ok = json_stream_feed(parser, chunk, read);
+            }
+
+            sim_heap_stats after = sim_get_heap_stats();
+            CHECK(ok);
+            CHECK_INT(counted.count, expected_count);
+            CHECK_INT(counted.mismatches, 0);
+            CHECK_INT(after.allocs - before.allocs, 0);
+            CHECK_INT(after.peak_bytes_in_use, before.bytes_in_use);
+        }
+        arena_stats arena = get_arena_stats();
+        CHECK_INT(arena.failed_allocs, 0);
+        CHECK_INT(arena.high_water, arena.used);
+
+        sim_reset_heap_peak();
+        sim_heap_stats before = sim_get_heap_stats();
+        cJSON *tree = cJSON_Parse(body);
+        sim_heap_stats after = sim_get_heap_stats();
+        cJSON_Delete(tree);
+        uint32_t tree_peak = after.peak_bytes_in_use - before.bytes_in_use;
+        printf("%6d byte body, %4d strings: stream parser %d bytes, arena high water %u of %u and no heap, ",
+               length, expected_count, (int)sizeof(json_stream_parser), arena.high_water, arena.size);
+        if (tree) {
+            CHECK(tree_peak > last_tree_peak);
+            last_tree_peak = tree_peak;
+            printf("cJSON tree %u bytes in %u allocations\n", tree_peak, after.allocs - before.allocs);
+        } else {
+            // Only because it ran out of the chip's heap
+            CHECK(after.failed_allocs > before.failed_allocs);
+            printf("cJSON tree ran out of heap\n");
+        }
+    }
+}
+
+int main() {
+    test_finds_list_at_every_split();
+    test_complete_needs_the_whole_body();
+    test_truncates_long_strings();
+    test_malformed_bodies();
+    test_growing_bodies_stay_off_the_heap();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+
+#include "link.h"
+#include "json.h"
+#include "uart.h"
+
+#include "sim_hooks.h"
+#include "sim_time.h"
+#include "serial_line.h"
+#include "display_sim.h"
+#include "check.h"
+
+#define RESPONSE_TIMEOUT_US 100000
+// The rate and commands the text protocol used before the link
+#define TEXT_PROTOCOL_BAUD 9600
+#define TEXT_START_COMMAND "START_LIST%"
+#define TEXT_END_COMMAND "END_LIST%"
+// Lists sent while the display scrolls the one before, a few frames apart
+#define STREAM_LISTS 24
+#define STREAM_GAP_MS 50
+
+// A day of tides, what a list usually carries
+static const char *tides[] = {
+    "Tue 10/13 High 5.4 ft at 10:48am",
+    "Tue 10/13 Low 0.2 ft at 5:02pm",
+    "Tue 10/13 High 4.1 ft at 11:15pm",
+    "Wed 10/14 Low 1.9 ft at 4:31am",
+    "Wed 10/14 High 5.6 ft at 11:20am",
+    "Wed 10/14 Low -0.1 ft at 5:44pm",
+    "Wed 10/14 High 4.3 ft at 11:58pm",
+    "Thu 10/15 Low 1.7 ft at 5:10am"
+};
+#define NUM_TIDES (sizeof(tides) / sizeof(tides[0]))
+
+static void test_crc() {
+    // The standard CRC-16/XMODEM check value
+    const uint8_t *check = (const uint8_t *)"123456789";
+    CHECK_INT(link_crc16(0, check, 9), 0x31C3);
+    // Carried across calls, which is how responses are checked
+    CHECK_INT(link_crc16(link_crc16(0, check, 4), &check[4], 5), 0x31C3);
+    CHECK_INT(link_crc16(0, check, 0), 0);
+}
+
+static void test_connect() {
+    init_link();
+
+    link_stats stats = get_link_stats();
+    CHECK_INT(stats.baud_rate, 57600);
+    // The display starts at 9600, so the probes at each faster rate go unanswered
+    CHECK_INT(stats.frames_failed, 3);
+    CHECK_INT(stats.retransmits, 0);
+}
+
+static void test_list_frames() {
+    send_list_start();
+    send_list_item("High 5.4 ft", 11);
+    send_list_item("Low 0.2 ft", 10);
+    send_list_item("Waves 2-3 ft", 12);
+    send_list_end();
+
+    // Each ACK is only sent once the display has taken in the frame
+    CHECK_INT(get_display_sim_stats().messages_shown, 3);
+    char message[32];
+    CHECK_INT(display_sim_message(1, message, sizeof(message)), 10);
+    CHECK_TEXT(message, 10, "Low 0.2 ft");
+    CHECK_INT(display_sim_message(3, message, sizeof(message)), -1);
+
+    link_stats stats = get_link_stats();
+    CHECK_INT(stats.retransmits, 0);
+    CHECK_INT(stats.nacks, 0);
+    CHECK_INT(stats.payload_bytes, 33);
+}
+
+// Reads one response frame off the line and checks its crc
+static bool read_response(uint32_t baud, uint8_t *header) {
+    int64_t deadline_us = esp_timer_get_time() + RESPONSE_TIMEOUT_US;
+    if (serial_line_read(SERIAL_FROM_DISPLAY, header, LINK_HEADER_SIZE, baud, deadline_us) != LINK_HEADER_SIZE
+        || header[0] != LINK_START_OF_FRAME || header[3] != 0) {
+        return false;
+    }
+
+    uint8_t crc_bytes[LINK_CRC_SIZE];
+    if (serial_line_read(SERIAL_FROM_DISPLAY, crc_bytes, LINK_CRC_SIZE, baud, deadline_us) != LINK_CRC_SIZE) {
+        return false;
+    }
+    return link_crc16(0, &header[1], LINK_HEADER_SIZE - 1) == ((crc_bytes[0] << 8) | crc_bytes[1]);
+}
+
+static void test_bad_crc_is_nacked() {
+    uint32_t baud = get_link_stats().baud_rate;
+    uint8_t frame[] = {LINK_START_OF_FRAME, LINK_FRAME_PING, 0xA5, 1, 0x42, 0, 0};
+    uint16_t crc = link_crc16(0, &frame[1], 4);
+    frame[5] = crc >> 8;
+    frame[6] = (crc & 0xFF) ^ 0x01;
+    serial_line_write(SERIAL_TO_DISPLAY, frame, sizeof(frame), baud);
+
+    uint8_t header[LINK_HEADER_SIZE];
+    CHECK(read_response(baud, header));
+    CHECK_INT(header[1], LINK_FRAME_NACK);
+    CHECK_INT(header[2], 0xA5);
+
+    // Same frame with the right crc is ACKed
+    frame[6] = crc & 0xFF;
+    serial_line_write(SERIAL_TO_DISPLAY, frame, sizeof(frame), baud);
+    CHECK(read_response(baud, header));
+    CHECK_INT(header[1], LINK_FRAME_ACK);
+    CHECK_INT(header[2], 0xA5);
+}
+
+/*
+ * The same list both ways, timed from the first byte going out until the
+ * display has all of it. The text protocol went out blind at 9600 with a
+ * '$' or newline after everything, the link waits on an ACK per frame at
+ * whatever rate it negotiated. Only the strings count as bytes sent. The
+ * display's scroll is stopped first, since a list that starts arriving mid
+ * show() loses its first frame to a resend, see test_stream_of_lists.
+ *
+ * The display puts the first message up as soon as it's in, so the link's
+ * first pixel is well before the whole list has gone.
+ */
+static void test_throughput_against_text_protocol() {
+    int payload_bytes = 0;
+    for (int i = 0; i < NUM_TIDES; i++) {
+        payload_bytes += strlen(tides[i]);
+    }
+
+    // The display ignores all of it, there's no start of frame in there
+    char text[1024];
+    int length = sprintf(text, "%s\n", TEXT_START_COMMAND);
+    for (int i = 0; i < NUM_TIDES; i++) {
+        length += sprintf(&text[length], "%s$\n", tides[i]);
+    }
+    length += sprintf(&text[length], "%s\n", TEXT_END_COMMAND);
+
+    int64_t start_us = esp_timer_get_time();
+    serial_line_write(SERIAL_TO_DISPLAY, (const uint8_t *)text, length, TEXT_PROTOCOL_BAUD);
+    int64_t text_us = serial_line_tx_done_us(SERIAL_TO_DISPLAY) - start_us;
+    sim_sleep_until(serial_line_tx_done_us(SERIAL_TO_DISPLAY));
+    uint32_t text_bytes_per_sec = (uint64_t)payload_bytes * 1000000 / text_us;
+
+    display_sim_stop_scrolling();
+
+    link_stats before = get_link_stats();
+    start_us = esp_timer_get_time();
+    send_list_start();
+    for (int i = 0; i < NUM_TIDES; i++) {
+        send_list_item(tides[i], strlen(tides[i]));
+    }
+    send_list_end();
+    int64_t link_us = esp_timer_get_time() - start_us;
+    uint32_t link_bytes_per_sec = (uint64_t)payload_bytes * 1000000 / link_us;
+
+    link_stats after = get_link_stats();
+    CHECK_INT(after.payload_bytes - before.payload_bytes, payload_bytes);
+    CHECK_INT(after.retransmits - before.retransmits, 0);
+    CHECK_INT(get_display_sim_stats().messages_shown, NUM_TIDES);
+    // Six times the line rate, less a header, crc and ACK round trip per frame
+    // and however long the display's busy scrolling the last list
+    CHECK(link_bytes_per_sec > text_bytes_per_sec * 2);
+    uint32_t first_pixel_ms = get_display_sim_stats().time_to_first_pixel_ms;
+    CHECK(first_pixel_ms * 3 < link_us / 1000);
+
+    printf("%d bytes of strings: text protocol at %d baud %u bytes/sec (%lld ms), "
+           "link at %u baud %u bytes/sec (%lld ms, first pixel at %u ms), link_stats says %u bytes/sec\n",
+           payload_bytes, TEXT_PROTOCOL_BAUD, text_bytes_per_sec, (long long)text_us / 1000, after.baud_rate,
+           link_bytes_per_sec, (long long)link_us / 1000, first_pixel_ms, get_link_bytes_per_sec());
+}
+
+/*
+ * A run of lists of every size the firmware sends, each one starting while
+ * the display is still scrolling the last a few frames in. Each must land whole, nothing cut
+ * off for want of room. test_messages does thousands of these without the
+ * serial line in between.
+ *
+ * The sketch drains the port between frames, so its RX buffer never fills,
+ * and doesn't draw while the ESP is partway through a list. Only a list
+ * that starts just as show() turns interrupts off loses its first frame,
+ * which goes unACKed and is resent.
+ */
+static void test_stream_of_lists() {
+    display_sim_stats before = get_display_sim_stats();
+    link_stats link_before = get_link_stats();
+    serial_line_stats line_before = get_serial_line_stats(SERIAL_TO_DISPLAY);
+    int mismatched = 0;
+
+    for (int list = 0; list < STREAM_LISTS; list++) {
+        int count = 1 + list % NUM_TIDES;
+        send_list_start();
+        for (int i = 0; i < count; i++) {
+            const char *tide = tides[(list + i) % NUM_TIDES];
+            send_list_item(tide, strlen(tide));
+        }
+        send_list_end();
+
+        mismatched += get_display_sim_stats().messages_shown != count;
+        for (int i = 0; i < count; i++) {
+            const char *tide = tides[(list + i) % NUM_TIDES];
+            char message[64];
+            int length = display_sim_message(i, message, sizeof(message));
+            mismatched += length != (int)strlen(tide) || memcmp(message, tide, length) != 0;
+        }
+        sim_sleep_until(esp_timer_get_time() + (int64_t)STREAM_GAP_MS * (1 + list % 4) * 1000);
+    }
+
+    display_sim_stats after = get_display_sim_stats();
+    link_stats link_after = get_link_stats();
+    CHECK_INT(mismatched, 0);
+    CHECK_INT(after.arena_dropped_bytes - before.arena_dropped_bytes, 0);
+    CHECK_INT(after.arena_dropped_msgs - before.arena_dropped_msgs, 0);
+    CHECK_INT(after.rx_overflows - before.rx_overflows, 0);
+    CHECK_INT(link_after.frames_failed - link_before.frames_failed, 0);
+    // Still scrolling the whole time
+    CHECK(after.frames_drawn > before.frames_drawn);
+
+    printf("%d lists while scrolling: %u frames drawn, %u serial bytes missed during show(), "
+           "%u resends, frames up to %ums late\n", STREAM_LISTS, after.frames_drawn - before.frames_drawn,
+           get_serial_line_stats(SERIAL_TO_DISPLAY).bytes_missed - line_before.bytes_missed, link_after.retransmits - link_before.retransmits,
+           after.frame_late_max_ms);
+}
+
+int main() {
+    test_crc();
+
+    serial_line_init(SERIAL_TO_DISPLAY, 64);
+    serial_line_init(SERIAL_FROM_DISPLAY, UART_BUF_SIZE * 2);
+    sim_uart_attach(LINK_UART);
+    display_sim_start();
+    init_uart();
+
+    test_connect();
+    test_list_frames();
+    test_bad_crc_is_nacked();
+    test_throughput_against_text_protocol();
+    test_stream_of_lists();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/uart.h"
+
+#include "link.h"
+#include "json.h"
+#include "messages.h"
+#include "uart.h"
+#include "dict.h"
+
+#include "sim_hooks.h"
+#include "serial_line.h"
+#include "display_sim.h"
+#include "check.h"
+
+/*
+ * Sends list updates to the simulated display through
+ * message_list_send_update, checking the sign ends up with the list however
+ * it got there, and what each kind of update costs on the wire.
+ */
+
+// A day of tides, what a list usually carries
+static const char *tides[] = {
+    "Tue 10/13 High 5.4 ft at 10:48am",
+    "Tue 10/13 Low 0.2 ft at 5:02pm",
+    "Tue 10/13 High 4.1 ft at 11:15pm",
+    "Wed 10/14 Low 1.9 ft at 4:31am",
+    "Wed 10/14 High 5.6 ft at 11:20am",
+    "Wed 10/14 Low -0.1 ft at 5:44pm",
+    "Wed 10/14 High 4.3 ft at 11:58pm",
+    "Thu 10/15 Low 1.7 ft at 5:10am"
+};
+#define NUM_TIDES (sizeof(tides) / sizeof(tides[0]))
+
+static message_list list;
+
+static void set_list(const char **strings, int count) {
+    message_list_clear(&list);
+    for (int i = 0; i < count; i++) {
+        message_list_add(&list, strings[i], strlen(strings[i]));
+    }
+}
+
+// What's on the sign has to be list, however it got there
+static void check_display() {
+    CHECK_INT(get_display_sim_stats().messages_shown, list.count);
+    for (int i = 0; i < list.count; i++) {
+        int length;
+        const char *text = message_list_get(&list, i, &length);
+        char shown[LINK_MAX_PAYLOAD * DICT_MAX_WORD_LENGTH];
+        CHECK(display_sim_message(i, shown, sizeof(shown)) >= 0);
+        CHECK_TEXT(text, length, shown);
+    }
+}
+
+static void test_first_update_is_full() {
+    const char *strings[] = {"High 5.4 ft at 6:15 am", "Low 0.2 ft at 12:30 pm", "High 4.9 ft at 6:45 pm", "Low 0.8 ft"};
+    set_list(strings, 4);
+    message_list_send_update(&list);
+
+    list_update_stats stats = get_list_update_stats();
+    CHECK_INT(stats.full_updates, 1);
+    CHECK_INT(stats.delta_updates, 0);
+    CHECK_INT(stats.bytes_sent, stats.full_bytes);
+    check_display();
+}
+
+static void test_same_list_is_unchanged() {
+    message_list_send_update(&list);
+
+    list_update_stats stats = get_list_update_stats();
+    CHECK_INT(stats.full_updates, 1);
+    CHECK_INT(stats.unchanged_updates, 1);
+    check_display();
+}
+
+static void test_edits_are_deltas() {
+    // Replace in the middle
+    const char *replaced[] = {"High 5.4 ft at 6:15 am", "Low 0.3 ft at 12:30 pm", "High 4.9 ft at 6:45 pm", "Low 0.8 ft"};
+    set_list(replaced, 4);
+    message_list_send_update(&list);
+    check_display();
+
+    // Insert at the front, then at the back
+    const char *inserted[] = {"Today", "High 5.4 ft at 6:15 am", "Low 0.3 ft at 12:30 pm", "High 4.9 ft at 6:45 pm",
+                              "Low 0.8 ft", "Swell 3 ft"};
+    set_list(inserted, 5);
+    message_list_send_update(&list);
+    check_display();
+    set_list(inserted, 6);
+    message_list_send_update(&list);
+    check_display();
+
+    // Delete two from the middle
+    const char *deleted[] = {"Today", "High 5.4 ft at 6:15 am", "Low 0.8 ft", "Swell 3 ft"};
+    set_list(deleted, 4);
+    message_list_send_update(&list);
+    check_display();
+
+    list_update_stats stats = get_list_update_stats();
+    CHECK_INT(stats.full_updates, 1);
+    CHECK_INT(stats.delta_updates, 4);
+    CHECK_INT(stats.rejected_deltas, 0);
+    CHECK(stats.bytes_sent < stats.full_bytes);
+}
+
+static void test_new_list_is_full() {
+    // Nothing in common, a delta would cost more than the list
+    const char *strings[] = {"Swell 2 ft", "Wind 5 mph"};
+    set_list(strings, 2);
+    message_list_send_update(&list);
+
+    list_update_stats stats = get_list_update_stats();
+    CHECK_INT(stats.full_updates, 2);
+    CHECK_INT(stats.delta_updates, 4);
+    check_display();
+}
+
+static void test_rejected_delta_sends_full_list() {
+    // Something else replaced the display's list behind our back
+    send_list_start();
+    send_list_end();
+
+    const char *strings[] = {"Swell 2 ft", "Wind 6 mph"};
+    set_list(strings, 2);
+    message_list_send_update(&list);
+
+    list_update_stats stats = get_list_update_stats();
+    CHECK_INT(stats.rejected_deltas, 1);
+    CHECK_INT(stats.full_updates, 3);
+    CHECK_INT(get_link_stats().connects, 1);
+    check_display();
+}
+
+// Bytes on the wire for one update of list, checked against the link's count
+static uint32_t update_bytes() {
+    list_update_stats before = get_list_update_stats();
+    link_stats link_before = get_link_stats();
+    message_list_send_update(&list);
+    check_display();
+
+    uint32_t bytes = get_list_update_stats().bytes_sent - before.bytes_sent;
+    link_stats link = get_link_stats();
+    CHECK_INT(bytes, link.payload_bytes - link_before.payload_bytes
+                         + (link.frames_sent - link_before.frames_sent) * LINK_FRAME_OVERHEAD);
+    return bytes;
+}
+
+// A refresh where nothing changed, then one where a single tide did, against
+// sending the whole day again each time
+static void test_update_cost() {
+    set_list(tides, NUM_TIDES);
+    uint32_t full = update_bytes();
+    uint32_t unchanged = update_bytes();
+
+    const char *one_changed[NUM_TIDES];
+    memcpy(one_changed, tides, sizeof(tides));
+    one_changed[3] = "Wed 10/14 Low 2.0 ft at 4:33am";
+    set_list(one_changed, NUM_TIDES);
+    uint32_t delta = update_bytes();
+
+    CHECK(unchanged < full / 10);
+    CHECK(delta < full / 4);
+    printf("%d tides: full list %u bytes, unchanged %u bytes, one string changed %u bytes\n",
+           (int)NUM_TIDES, full, unchanged, delta);
+}
+
+int main() {
+    serial_line_init(SERIAL_TO_DISPLAY, 64);
+    serial_line_init(SERIAL_FROM_DISPLAY, UART_BUF_SIZE * 2);
+    sim_uart_attach(LINK_UART);
+    display_sim_start();
+    init_uart();
+    init_link();
+    init_dict();
+
+    test_first_update_is_full();
+    test_same_list_is_unchanged();
+    test_edits_are_deltas();
+    test_new_list_is_full();
+    test_rejected_delta_sends_full_list();
+    test_update_cost();
+    return CHECK_RESULT();
+}
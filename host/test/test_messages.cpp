@@ -0,0 +1,434 @@
+#include <stdint.h>
+
+// Everything the sketch includes, the same as display_sim.cpp
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <TVout.h>
+#include <TVoutfonts/fontALL.h>
+#include <SoftwareSerial.h>
+#include <util/crc16.h>
+
+#include "sim_hooks.h"
+#include "serial_line.h"
+#include "display_sim.h"
+#include "check.h"
+
+/*
+ * Feeds lists straight into the sketch's frame parser, the way loop() does
+ * with each byte it reads, and checks what ends up in the message arena.
+ * Then runs loop() against a scripted serial stream to check the scroll
+ * keeps to its schedule while the port is drained. The sketch is built in
+ * here rather than run on display_sim's thread, and nothing else runs, so
+ * the clock only moves when the test moves it or something in the sketch
+ * sleeps, and thousands of lists take no time. test_link sends lists
+ * through display_sim end to end.
+ */
+namespace display {
+#include "../../spot_check_display/spot_check_display.h"
+#include "sketch_prototypes.h"
+#include "../../spot_check_display/spot_check_display.ino"
+}
+
+#define NUM_LISTS 5000
+#define RESPONSE_SIZE (LINK_HEADER_SIZE + 2)
+#define MAX_FRAME_SIZE (LINK_HEADER_SIZE + LINK_MAX_PAYLOAD + 2)
+// How long the link waits on an ACK before resending, and how often it
+// does, see main/include/link.h
+#define ACK_TIMEOUT_MS 250
+#define MAX_RESENDS 3
+// Pings sent back to back while a list scrolls, and how big
+#define SCROLLING_PINGS 8
+#define SCROLLING_PING_SIZE 100
+
+static uint8_t next_seq;
+static uint32_t random_state = 12345;
+
+// Nothing scrolls here, so nothing polls the serial port for this
+void display_sim_yield(void) {
+}
+
+static uint32_t next_random(uint32_t limit) {
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 16) % limit;
+}
+
+// Frames it the way the ESP does, returns the size
+static int build_frame(uint8_t *frame, uint8_t type, const uint8_t *payload, uint8_t length) {
+    frame[0] = LINK_START_OF_FRAME;
+    frame[1] = type;
+    frame[2] = next_seq++;
+    frame[3] = length;
+    memcpy(&frame[LINK_HEADER_SIZE], payload, length);
+    uint16_t crc = 0;
+    for (int i = 1; i < LINK_HEADER_SIZE + length; i++) {
+        crc = _crc_xmodem_update(crc, frame[i]);
+    }
+    frame[LINK_HEADER_SIZE + length] = crc >> 8;
+    frame[LINK_HEADER_SIZE + length + 1] = crc & 0xFF;
+    return LINK_HEADER_SIZE + length + 2;
+}
+
+// The type of the response waiting on the line, or 0 if there isn't one yet
+static uint8_t take_response() {
+    // The sketch's write has already waited for the response to go out
+    uint8_t response[RESPONSE_SIZE];
+    if (serial_line_read(SERIAL_FROM_DISPLAY, response, RESPONSE_SIZE, LINK_DEFAULT_BAUD, 0) != RESPONSE_SIZE) {
+        return 0;
+    }
+    return response[1];
+}
+
+// Sends one frame a byte at a time and returns the type of what came back,
+// or 0 if nothing did
+static uint8_t send_frame(uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t frame[MAX_FRAME_SIZE];
+    int size = build_frame(frame, type, payload, length);
+    for (int i = 0; i < size; i++) {
+        if (display::link_receive_byte(frame[i])) {
+            display::handle_frame(&display::rx_frame);
+            display::answer_frame();
+        }
+    }
+    return take_response();
+}
+
+// A list of count messages, lengths[i] bytes each, packed into data. Columns
+// go out in frames of up to LINK_MAX_PAYLOAD, text is one frame a message
+static bool send_list(bool columns, const uint8_t *data, const int *lengths, int count) {
+    bool acked = send_frame(LINK_FRAME_LIST_START, NULL, 0) == LINK_FRAME_ACK;
+    const uint8_t *message = data;
+    for (int i = 0; i < count; i++) {
+        if (!columns) {
+            acked &= send_frame(LINK_FRAME_LIST_ITEM, message, lengths[i]) == LINK_FRAME_ACK;
+        } else {
+            int sent = 0;
+            do {
+                int chunk = lengths[i] - sent < LINK_MAX_PAYLOAD ? lengths[i] - sent : LINK_MAX_PAYLOAD;
+                sent += chunk;
+                uint8_t type = sent < lengths[i] ? LINK_FRAME_LIST_COLUMNS : LINK_FRAME_LIST_COLUMNS_END;
+                acked &= send_frame(type, &message[sent - chunk], chunk) == LINK_FRAME_ACK;
+            } while (sent < lengths[i]);
+        }
+        message += lengths[i];
+    }
+    acked &= send_frame(LINK_FRAME_LIST_END, NULL, 0) == LINK_FRAME_ACK;
+    return acked;
+}
+
+// Whether the list on the sign is exactly the one that was sent
+static bool arena_matches(bool columns, const uint8_t *data, const int *lengths, int count) {
+    display::message_list *list = display::front_list;
+    if (list->count != count || list->is_columns != columns) {
+        return false;
+    }
+
+    const uint8_t *message = data;
+    for (int i = 0; i < count; i++) {
+        uint16_t start = display::list_message_start(list, i);
+        if (list->msg_end[i] - start != lengths[i] || memcmp(&list->arena[start], message, lengths[i]) != 0) {
+            return false;
+        }
+        message += lengths[i];
+    }
+    return true;
+}
+
+// Lists of every shape that fits, as text and as columns, none of them
+// allocating or losing a byte
+static void test_lists_that_fit_arrive_whole() {
+    sim_heap_stats heap_before = sim_get_heap_stats();
+    int mismatched = 0;
+    int unacked = 0;
+    int longest_list = 0;
+
+    for (int list = 0; list < NUM_LISTS; list++) {
+        bool columns = list % 2 == 1;
+        int count = 1 + next_random(MAXMSGS);
+        uint8_t data[MSGARENASIZE];
+        int lengths[MAXMSGS];
+        int total = 0;
+
+        for (int i = 0; i < count; i++) {
+            // Shares out what's left of the arena, so some lists fill it exactly
+            int room = (MSGARENASIZE - total) / (count - i);
+            int max_length = columns ? room : (room < LINK_MAX_PAYLOAD ? room : LINK_MAX_PAYLOAD);
+            lengths[i] = list % 7 == 0 ? max_length : next_random(max_length + 1);
+            for (int c = 0; c < lengths[i]; c++) {
+                data[total + c] = columns ? next_random(1 << COLUMN_HEIGHT) : ' ' + next_random('~' - ' ' + 1);
+            }
+            total += lengths[i];
+        }
+        longest_list = total > longest_list ? total : longest_list;
+
+        unacked += !send_list(columns, data, lengths, count);
+        mismatched += !arena_matches(columns, data, lengths, count);
+    }
+
+    CHECK_INT(unacked, 0);
+    CHECK_INT(mismatched, 0);
+    CHECK_INT(longest_list, MSGARENASIZE);
+    CHECK_INT(display::arena_dropped_bytes, 0);
+    CHECK_INT(display::arena_dropped_msgs, 0);
+    CHECK_INT(sim_get_heap_stats().allocs - heap_before.allocs, 0);
+    printf("%d lists of up to %d messages and %d bytes, none cut short\n", NUM_LISTS, MAXMSGS, longest_list);
+}
+
+// What doesn't fit is cut off the end and counted, and the next list starts clean
+static void test_overflow_is_counted() {
+    uint8_t data[MSGARENASIZE + 64];
+    memset(data, 'x', sizeof(data));
+    int lengths[MAXMSGS + 2];
+    for (int i = 0; i < MAXMSGS + 2; i++) {
+        lengths[i] = 1;
+    }
+
+    // Three messages, the last of which runs 64 bytes past the end
+    int long_lengths[] = {MSGARENASIZE / 2, MSGARENASIZE / 2 - 32, 96};
+    send_list(false, data, long_lengths, 3);
+    CHECK_INT(display::front_list->count, 3);
+    CHECK_INT(display::front_list->msg_end[2], MSGARENASIZE);
+    CHECK_INT(display::arena_dropped_bytes, 64);
+
+    send_list(false, data, lengths, MAXMSGS + 2);
+    CHECK_INT(display::front_list->count, MAXMSGS);
+    CHECK_INT(display::arena_dropped_msgs, 2);
+
+    send_list(false, data, long_lengths, 2);
+    CHECK(arena_matches(false, data, long_lengths, 2));
+}
+
+// The list on the sign is left alone until the next one has a message to show
+static void test_list_swaps_on_first_message() {
+    const uint8_t *first = (const uint8_t *)"High 5.4 ftLow 0.2 ft";
+    int first_lengths[] = {11, 10};
+    const uint8_t *second = (const uint8_t *)"Waves 2-3 ftWind 5 kts";
+    int second_lengths[] = {12, 10};
+    send_list(false, first, first_lengths, 2);
+
+    CHECK_INT(send_frame(LINK_FRAME_LIST_START, NULL, 0), LINK_FRAME_ACK);
+    CHECK(arena_matches(false, first, first_lengths, 2));
+    CHECK_INT(send_frame(LINK_FRAME_LIST_ITEM, second, second_lengths[0]), LINK_FRAME_ACK);
+    CHECK(arena_matches(false, second, second_lengths, 1));
+    CHECK(display::playing);
+    CHECK_INT(send_frame(LINK_FRAME_LIST_ITEM, &second[12], second_lengths[1]), LINK_FRAME_ACK);
+    CHECK_INT(send_frame(LINK_FRAME_LIST_END, NULL, 0), LINK_FRAME_ACK);
+    CHECK(arena_matches(false, second, second_lengths, 2));
+    CHECK(display::front_list->complete);
+}
+
+// loop() with the clock moving a millisecond at a time, the way it spins on
+// the board. Returns when the response to a frame comes back, or after ms
+static uint8_t run_loop_for_ms(int ms) {
+    for (int i = 0; i < ms; i++) {
+        display::loop();
+        if (serial_line_available(SERIAL_FROM_DISPLAY) >= RESPONSE_SIZE) {
+            return take_response();
+        }
+        sim_advance_clock_us(1000);
+    }
+    return 0;
+}
+
+// How long bytes take on the wire at the default baud
+static int byte_times_ms(int bytes) {
+    return bytes * SERIAL_BITS_PER_BYTE * 1000 / LINK_DEFAULT_BAUD;
+}
+
+// Sends a frame over the serial line the way the link does, waiting on the
+// ACK and resending after ACK_TIMEOUT_MS, while loop() runs
+static bool send_scripted(uint8_t type, const uint8_t *payload, uint8_t length, int *resends) {
+    uint8_t frame[MAX_FRAME_SIZE];
+    int size = build_frame(frame, type, payload, length);
+    for (int attempt = 0; attempt <= MAX_RESENDS; attempt++) {
+        *resends += attempt > 0;
+        serial_line_write(SERIAL_TO_DISPLAY, frame, size, LINK_DEFAULT_BAUD);
+        if (run_loop_for_ms(ACK_TIMEOUT_MS) == LINK_FRAME_ACK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void reset_frame_stats() {
+    display::frames_drawn = 0;
+    display::frame_late_total_ms = 0;
+    display::frame_late_max_ms = 0;
+    display::rx_overflows = 0;
+    display::rx_timeouts = 0;
+}
+
+// Still on the first time through the list. A finished list goes round
+// again, so playing alone would never go false
+static bool scrolling() {
+    return display::scroll_step >= 0 || (display::playing && display::play_index < display::front_list->count);
+}
+
+// Frames go out SCROLLSPEED apart however long show() takes, rather than
+// SCROLLSPEED after the last one finished
+static void test_frames_keep_to_schedule() {
+    const char *message = "Waves 2-3 ft";
+    int length = strlen(message);
+    send_list(false, (const uint8_t *)message, &length, 1);
+    reset_frame_stats();
+
+    int frames = 0;
+    int64_t first_us = 0;
+    int64_t last_us = 0;
+    int64_t max_gap_error_us = 0;
+    while (scrolling()) {
+        uint32_t shows = display::strip.shows;
+        int64_t now_us = esp_timer_get_time();
+        display::loop();
+        if (display::strip.shows != shows) {
+            if (frames > 0) {
+                int64_t gap_error_us = now_us - last_us - SCROLLSPEED * 1000;
+                gap_error_us = gap_error_us < 0 ? -gap_error_us : gap_error_us;
+                max_gap_error_us = gap_error_us > max_gap_error_us ? gap_error_us : max_gap_error_us;
+            } else {
+                first_us = now_us;
+            }
+            last_us = now_us;
+            frames++;
+        }
+        sim_advance_clock_us(1000);
+    }
+
+    int show_ms = LEDS * NEOPIXEL_US_PER_PIXEL / 1000;
+    // One frame per column, the first as the message goes up
+    CHECK_INT(frames, length * FONT_WIDTH);
+    // Within the millisecond loop() spins at, whatever show() took
+    CHECK(max_gap_error_us <= 1000);
+    CHECK(display::frame_late_max_ms <= 1);
+    CHECK_INT(display::rx_overflows, 0);
+    printf("%d frames in %lld ms, %d ms apart with show() taking %d ms of each, at most %u ms late\n", frames,
+           (long long)(last_us - first_us) / 1000, SCROLLSPEED, show_ms, display::frame_late_max_ms);
+}
+
+/*
+ * The ESP sends while a list scrolls, waiting on each ACK and resending
+ * after ACK_TIMEOUT_MS like the link does. Each frame is bigger than
+ * SoftwareSerial's buffer, so it only gets through if loop() drains the
+ * port as it arrives. Pings don't touch the list, so the scroll keeps going,
+ * a frame at a time just before an ACK goes out.
+ */
+static void test_receive_while_scrolling() {
+    const char *message = "Tue 10/13 High 5.4 ft at 10:48am";
+    int length = strlen(message);
+    send_list(false, (const uint8_t *)message, &length, 1);
+    reset_frame_stats();
+    serial_line_stats line_before = get_serial_line_stats(SERIAL_TO_DISPLAY);
+    run_loop_for_ms(SCROLLSPEED / 2);
+
+    uint8_t payload[SCROLLING_PING_SIZE];
+    memset(payload, 'p', sizeof(payload));
+    int acked = 0;
+    int resends = 0;
+    for (int i = 0; i < SCROLLING_PINGS; i++) {
+        acked += send_scripted(LINK_FRAME_PING, payload, sizeof(payload), &resends);
+        CHECK(scrolling());
+    }
+
+    serial_line_stats line_after = get_serial_line_stats(SERIAL_TO_DISPLAY);
+    int frame_ms = byte_times_ms(LINK_HEADER_SIZE + SCROLLING_PING_SIZE + 2);
+    CHECK_INT(acked, SCROLLING_PINGS);
+    CHECK_INT(resends, 0);
+    CHECK_INT(line_after.bytes_missed - line_before.bytes_missed, 0);
+    CHECK_INT(display::rx_overflows, 0);
+    CHECK_INT(display::rx_timeouts, 0);
+    CHECK_INT(line_after.bytes_overflowed - line_before.bytes_overflowed, 0);
+    // A frame that falls due as an ACK goes out waits for the ACK, then
+    // RX_NEXT_FRAME_MS and the whole of the next ping, and no longer
+    CHECK(display::frames_drawn >= (uint32_t)(SCROLLING_PINGS * frame_ms / SCROLLSPEED));
+    CHECK(display::frame_late_max_ms <= byte_times_ms(RESPONSE_SIZE) + RX_NEXT_FRAME_MS + frame_ms + 1);
+    printf("%d pings of %d bytes while scrolling: %u frames drawn, frames up to %u ms late "
+           "(%d ms a ping at %d baud), nothing missed\n", SCROLLING_PINGS, SCROLLING_PING_SIZE,
+           display::frames_drawn, display::frame_late_max_ms, frame_ms, LINK_DEFAULT_BAUD);
+}
+
+/*
+ * A day of tides sent at the default baud to a sign with nothing on it. The
+ * first one is scrolling once it's in, rather than once the whole list is:
+ * time_to_first_pixel_ms, from LIST_START arriving, is LIST_START's ACK,
+ * the first message on the wire and the show() that puts it up, give or
+ * take the millisecond loop() and the sender poll at.
+ */
+static void test_first_pixel_before_list_arrives() {
+    static const char *tides[] = {
+        "Tue 10/13 High 5.4 ft at 10:48am",
+        "Tue 10/13 Low 0.2 ft at 5:02pm",
+        "Tue 10/13 High 4.1 ft at 11:15pm",
+        "Wed 10/14 Low 1.9 ft at 4:31am",
+    };
+    int num_tides = sizeof(tides) / sizeof(tides[0]);
+    display::playing = false;
+    display::scroll_step = -1;
+
+    int resends = 0;
+    int64_t start_us = esp_timer_get_time();
+    CHECK(send_scripted(LINK_FRAME_LIST_START, NULL, 0, &resends));
+    for (int i = 0; i < num_tides; i++) {
+        CHECK(send_scripted(LINK_FRAME_LIST_ITEM, (const uint8_t *)tides[i], strlen(tides[i]), &resends));
+    }
+    CHECK(send_scripted(LINK_FRAME_LIST_END, NULL, 0, &resends));
+    int list_ms = (esp_timer_get_time() - start_us) / 1000;
+
+    int first_pixel_ms = byte_times_ms(RESPONSE_SIZE + LINK_HEADER_SIZE + strlen(tides[0]) + 2)
+                         + LEDS * NEOPIXEL_US_PER_PIXEL / 1000;
+    CHECK_INT(resends, 0);
+    CHECK(display::time_to_first_pixel_ms <= (unsigned long)first_pixel_ms + 2);
+    CHECK((int)display::time_to_first_pixel_ms < list_ms / 3);
+    printf("%d tides at %d baud: first pixel %lu ms after LIST_START, whole list %d ms\n", num_tides,
+           LINK_DEFAULT_BAUD, display::time_to_first_pixel_ms, list_ms);
+}
+
+// What the old renderer did, sitting in delay() while the ESP sent
+static void test_overflow_is_counted_when_not_drained() {
+    reset_frame_stats();
+    uint8_t frame[MAX_FRAME_SIZE];
+    int size = build_frame(frame, LINK_FRAME_PING, NULL, 0);
+    uint8_t junk[100];
+    memset(junk, 'x', sizeof(junk));
+    serial_line_write(SERIAL_TO_DISPLAY, junk, sizeof(junk), LINK_DEFAULT_BAUD);
+    sim_advance_clock_us((int64_t)(sizeof(junk) + 10) * SERIAL_BITS_PER_BYTE * 1000000 / LINK_DEFAULT_BAUD);
+
+    run_loop_for_ms(1);
+    CHECK_INT(display::rx_overflows, 1);
+
+    // Once it's drained again nothing more is lost
+    serial_line_write(SERIAL_TO_DISPLAY, frame, size, LINK_DEFAULT_BAUD);
+    CHECK_INT(run_loop_for_ms(ACK_TIMEOUT_MS), LINK_FRAME_ACK);
+    CHECK_INT(display::rx_overflows, 1);
+}
+
+// A frame that arrives while show() has interrupts off never makes it in
+static void test_show_misses_serial() {
+    serial_line_stats before = get_serial_line_stats(SERIAL_TO_DISPLAY);
+    uint8_t frame[MAX_FRAME_SIZE];
+    int size = build_frame(frame, LINK_FRAME_PING, NULL, 0);
+    serial_line_write(SERIAL_TO_DISPLAY, frame, size, LINK_DEFAULT_BAUD);
+    display::strip.show();
+
+    CHECK_INT(run_loop_for_ms(ACK_TIMEOUT_MS), 0);
+    CHECK_INT(get_serial_line_stats(SERIAL_TO_DISPLAY).bytes_missed - before.bytes_missed, size);
+
+    serial_line_write(SERIAL_TO_DISPLAY, frame, size, LINK_DEFAULT_BAUD);
+    CHECK_INT(run_loop_for_ms(ACK_TIMEOUT_MS), LINK_FRAME_ACK);
+}
+
+int main() {
+    serial_line_init(SERIAL_TO_DISPLAY, 64);
+    serial_line_init(SERIAL_FROM_DISPLAY, 0);
+    // Nothing else is running, so waiting on the serial line doesn't have to take real time
+    sim_set_skip_sleeps(true);
+    display::setup();
+
+    test_lists_that_fit_arrive_whole();
+    test_overflow_is_counted();
+    test_list_swaps_on_first_message();
+    test_frames_keep_to_schedule();
+    test_receive_while_scrolling();
+    test_first_pixel_before_list_arrives();
+    test_overflow_is_counted_when_not_drained();
+    test_show_misses_serial();
+    return CHECK_RESULT();
+}
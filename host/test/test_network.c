@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "network.h"
+#include "cache.h"
+#include "dns.h"
+#include "refresh.h"
+#include "inflate.h"
+#include "json.h"
+#include "arena.h"
+#include "check.h"
+#include "sim_hooks.h"
+#include "standin.h"
+
+/*
+ * Runs the firmware's requests against the stand-in server, which tags every
+ * response with an ETag so all but the first of each get 304s. This builds
+ * three times, as the firmware ships, with HTTP_KEEP_ALIVE off and with
+ * STREAM_JSON_RESPONSES off, and each prints the per-request latency so
+ * they can be compared.
+ */
+#define API_HOST "spotcheck.brianteam.dev"
+#define NUM_REQUESTS 20
+// About one round trip to the API from a home connection, which is what
+// opening a socket costs before the GET can go out
+#define CONNECT_DELAY_MS 20
+#define TIDES_VALUES 8
+#define SWELL_VALUES 3
+// tides_2.json is a 60 day list, bigger than the buffered path can take
+#define LONG_TIDES_VERSION 2
+#define LONG_TIDES_VALUES 300
+// Same as network.c's
+#define MAX_READ_BUFFER_SIZE 4096
+// log2 of INFLATE_WINDOW_SIZE, as zlib takes it
+#define INFLATE_WINDOW_BITS 12
+
+static void count_value(char *value, int length, void *handler_arg) {
+    (*(int *)handler_arg)++;
+}
+
+// Alternates tides and swell, the way the main loop would over a few cycles,
+// on whichever path STREAM_JSON_RESPONSES picks. Returns how many strings
+// came back, or REQUEST_NOT_MODIFIED
+static int fetch(int i) {
+    char url_buf[REFRESH_MAX_URL_LENGTH];
+    query_param params[2];
+    request request;
+    CHECK(build_request(i % 2 == 0 ? "tides" : "swell", "wedge", "2", url_buf, sizeof(url_buf), params, &request));
+    // The read chunk and any buffered response come from the arena, which
+    // refresh_all resets after each source
+    arena_reset();
+
+    int values = 0;
+    if (STREAM_JSON_RESPONSES) {
+        json_stream_parser parser;
+        json_stream_init(&parser, count_value, &values);
+        if (perform_streamed_request(&request, &parser) == REQUEST_NOT_MODIFIED) {
+            return REQUEST_NOT_MODIFIED;
+        }
+    } else {
+        char *response;
+        int length = perform_request(&request, &response);
+        if (length == REQUEST_NOT_MODIFIED) {
+            return REQUEST_NOT_MODIFIED;
+        }
+        json_list_iter iter;
+        char *value;
+        int value_length;
+        if (length > 0 && json_list_find(&iter, response, length - 1)) {
+            while (json_list_next(&iter, &value, &value_length)) {
+                values++;
+            }
+            // Same as refresh.c, it's only 304ed next time once it's parsed whole
+            if (iter.complete) {
+                perform_request_parsed();
+            }
+        }
+    }
+
+    return values;
+}
+
+static void test_connections_per_request() {
+    connection_stats conn_before = get_connection_stats();
+    standin_stats server_before = get_standin_stats();
+
+    int64_t first_us = 0;
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < NUM_REQUESTS; i++) {
+        int64_t request_start_us = esp_timer_get_time();
+        // Only the first of each comes back in full, after that the ETag
+        // gets a 304
+        int expected_values = i % 2 == 0 ? TIDES_VALUES : SWELL_VALUES;
+        CHECK_INT(fetch(i), i < 2 ? expected_values : REQUEST_NOT_MODIFIED);
+        if (i == 0) {
+            first_us = esp_timer_get_time() - request_start_us;
+        }
+    }
+    int64_t total_us = esp_timer_get_time() - start_us;
+
+    connection_stats conn = get_connection_stats();
+    standin_stats server = get_standin_stats();
+    int opened = conn.connections_opened - conn_before.connections_opened;
+    CHECK_INT(conn.requests - conn_before.requests, NUM_REQUESTS);
+    CHECK_INT(server.requests - server_before.requests, NUM_REQUESTS);
+    CHECK_INT(server.host_mismatches, 0);
+    // Still open from before this test if it was kept alive
+    CHECK_INT(opened, HTTP_KEEP_ALIVE ? (conn_before.requests == 0 ? 1 : 0) : NUM_REQUESTS);
+    CHECK_INT(conn.connections_reused - conn_before.connections_reused, NUM_REQUESTS - opened);
+    CHECK_INT(server.connections - server_before.connections, opened);
+
+    printf("keep-alive %s, %s: %d requests, %d connections opened, first %.2f ms, average %.2f ms "
+           "(%d ms to open a connection)\n", HTTP_KEEP_ALIVE ? "on" : "off",
+           STREAM_JSON_RESPONSES ? "streamed" : "buffered", NUM_REQUESTS, opened,
+           first_us / 1000.0, total_us / 1000.0 / NUM_REQUESTS, CONNECT_DELAY_MS);
+}
+
+// The server timing out an idle connection costs a reconnect, not a re-init
+static void test_reconnects_when_server_drops_idle_connection() {
+    if (!HTTP_KEEP_ALIVE) {
+        return;
+    }
+
+    connection_stats before = get_connection_stats();
+    standin_drop_connections();
+    CHECK_INT(fetch(0), REQUEST_NOT_MODIFIED);
+    CHECK_INT(fetch(1), REQUEST_NOT_MODIFIED);
+
+    connection_stats after = get_connection_stats();
+    CHECK_INT(after.stale_reconnects - before.stale_reconnects, 1);
+    CHECK_INT(after.connections_opened - before.connections_opened, 1);
+    CHECK_INT(after.connections_reused - before.connections_reused, 1);
+    CHECK(http_client_inited);
+}
+
+static void test_server_asking_to_close() {
+    connection_stats before = get_connection_stats();
+    standin_set_connection_close(true);
+    CHECK_INT(fetch(0), REQUEST_NOT_MODIFIED);
+    CHECK_INT(fetch(2), REQUEST_NOT_MODIFIED);
+    standin_set_connection_close(false);
+    CHECK_INT(fetch(0), REQUEST_NOT_MODIFIED);
+
+    // Neither connection the server closed gets reused, whatever HTTP_KEEP_ALIVE says
+    connection_stats after = get_connection_stats();
+    CHECK_INT(after.server_closes - before.server_closes, 2);
+    CHECK_INT(after.connections_opened - before.connections_opened, HTTP_KEEP_ALIVE ? 2 : 3);
+    CHECK_INT(after.stale_reconnects - before.stale_reconnects, 0);
+}
+
+/*
+ * A new version of the data gets a new ETag and comes back in full. Asking
+ * again gets a 304, and then nothing is read, parsed or handed on, so the
+ * main loop has nothing to send the display.
+ */
+static void test_unchanged_data_is_not_fetched_again() {
+    char url_buf[REFRESH_MAX_URL_LENGTH];
+    query_param params[2];
+    request request;
+    CHECK(build_request("tides", "wedge", "2", url_buf, sizeof(url_buf), params, &request));
+
+    standin_set_version(1);
+    cache_stats cache_before = get_cache_stats();
+    standin_stats server_before = get_standin_stats();
+    int values = 0;
+    json_stream_parser parser;
+    json_stream_init(&parser, count_value, &values);
+    CHECK(perform_streamed_request(&request, &parser) > 0);
+    CHECK_INT(values, TIDES_VALUES);
+
+    cache_stats cache = get_cache_stats();
+    standin_stats server = get_standin_stats();
+    CHECK_INT(cache.misses - cache_before.misses, 1);
+    CHECK_INT(cache.revalidated_hits - cache_before.revalidated_hits, 0);
+    CHECK_INT(server.not_modified - server_before.not_modified, 0);
+
+    values = 0;
+    arena_reset();
+    json_stream_init(&parser, count_value, &values);
+    CHECK_INT(perform_streamed_request(&request, &parser), REQUEST_NOT_MODIFIED);
+    CHECK_INT(values, 0);
+    CHECK_INT(parser.values_found, 0);
+
+    char *response = (char *)"not touched";
+    arena_reset();
+    CHECK_INT(perform_request(&request, &response), REQUEST_NOT_MODIFIED);
+    CHECK(response == NULL);
+
+    cache_stats cache_after = get_cache_stats();
+    standin_stats server_after = get_standin_stats();
+    CHECK_INT(cache_after.revalidated_hits - cache.revalidated_hits, 2);
+    CHECK_INT(cache_after.misses - cache.misses, 0);
+    CHECK_INT(server_after.not_modified - server.not_modified, 2);
+    CHECK_INT(server_after.body_bytes_sent - server.body_bytes_sent, 0);
+}
+
+// With a max-age the 304 makes the entry fresh, and the next request never
+// leaves the chip
+static void test_fresh_entry_skips_the_network() {
+    char url_buf[REFRESH_MAX_URL_LENGTH];
+    query_param params[2];
+    request request;
+    CHECK(build_request("swell", "wedge", "2", url_buf, sizeof(url_buf), params, &request));
+    char *response;
+
+    standin_set_max_age_s(60);
+    int first = fetch(1);
+    CHECK(first > 0 || first == REQUEST_NOT_MODIFIED);
+
+    cache_stats before = get_cache_stats();
+    standin_stats server_before = get_standin_stats();
+    CHECK_INT(perform_request(&request, &response), REQUEST_NOT_MODIFIED);
+    CHECK(response == NULL);
+
+    cache_stats after = get_cache_stats();
+    CHECK_INT(after.fresh_hits - before.fresh_hits, 1);
+    CHECK_INT(get_standin_stats().requests - server_before.requests, 0);
+    standin_set_max_age_s(0);
+}
+
+// One streamed request for the 60 day tides. Returns what the first try
+// came back with and counts the values of whichever try got through
+static int fetch_long_tides(int *values, connection_stats *before, standin_stats *server_before) {
+    char url_buf[REFRESH_MAX_URL_LENGTH];
+    query_param params[2];
+    request request;
+    CHECK(build_request("tides", "wedge", "60", url_buf, sizeof(url_buf), params, &request));
+
+    // Forgets the last pass's ETag so this one gets a body
+    init_cache();
+    arena_reset();
+    *before = get_connection_stats();
+    *server_before = get_standin_stats();
+    json_stream_parser parser;
+    *values = 0;
+    json_stream_init(&parser, count_value, values);
+    int result = perform_streamed_request(&request, &parser);
+    if (result == REQUEST_RETRY_UNCOMPRESSED) {
+        // Same as refresh.c
+        *values = 0;
+        arena_reset();
+        json_stream_init(&parser, count_value, values);
+        CHECK(perform_streamed_request(&request, &parser) > 0);
+    }
+    return result;
+}
+
+/*
+ * The stand-in gzips whenever it's asked to, which the firmware does with
+ * ACCEPT_COMPRESSED_RESPONSES on. The streamed path inflates a window at a
+ * time into the parser, so a body that inflates past MAX_READ_BUFFER_SIZE
+ * comes through whole, as long as the server kept its matches inside
+ * INFLATE_WINDOW_SIZE. Compressed with the usual 32KB window, the 60 day
+ * list has matches further back than that, so it's fetched again plain.
+ */
+static void test_long_compressed_response() {
+    if (!ACCEPT_COMPRESSED_RESPONSES) {
+        return;
+    }
+
+    standin_set_version(LONG_TIDES_VERSION);
+    int values;
+    connection_stats before;
+    standin_stats server_before;
+    CHECK_INT(fetch_long_tides(&values, &before, &server_before), REQUEST_RETRY_UNCOMPRESSED);
+    CHECK_INT(values, LONG_TIDES_VALUES);
+    connection_stats after = get_connection_stats();
+    standin_stats server = get_standin_stats();
+    CHECK_INT(server.requests - server_before.requests, 2);
+    CHECK_INT(server.gzip_responses - server_before.gzip_responses, 1);
+    printf("60 day tides, 32KB window: %u bytes over the air for the gzipped try and the plain one\n",
+           after.body_bytes_received - before.body_bytes_received);
+
+    standin_set_gzip_window_bits(INFLATE_WINDOW_BITS);
+    CHECK(fetch_long_tides(&values, &before, &server_before) > 0);
+    CHECK_INT(values, LONG_TIDES_VALUES);
+    after = get_connection_stats();
+    server = get_standin_stats();
+    uint32_t received = after.body_bytes_received - before.body_bytes_received;
+    uint32_t decoded = after.body_bytes_decoded - before.body_bytes_decoded;
+    CHECK_INT(server.requests - server_before.requests, 1);
+    CHECK_INT(server.gzip_responses - server_before.gzip_responses, 1);
+    CHECK_INT(received, server.body_bytes_sent - server_before.body_bytes_sent);
+    CHECK(decoded > MAX_READ_BUFFER_SIZE);
+    CHECK(received < decoded);
+    printf("60 day tides, %dKB window: %u bytes over the air, %u after inflating\n",
+           INFLATE_WINDOW_SIZE / 1024, received, decoded);
+
+    standin_set_gzip_window_bits(STANDIN_GZIP_WINDOW_BITS);
+    standin_set_version(0);
+}
+
+int main() {
+    uint16_t http_port = standin_start_http(FIXTURE_DIR, API_HOST);
+    uint16_t dns_port = standin_start_dns();
+    if (http_port == 0 || dns_port == 0) {
+        printf("Couldn't start the stand-in servers\n");
+        return 1;
+    }
+    sim_net_redirect(http_port, dns_port);
+    sim_http_set_connect_delay_ms(CONNECT_DELAY_MS);
+
+    esp_event_loop_create_default();
+    init_arena();
+    init_cache();
+    init_dns();
+    init_wifi();
+    init_http();
+    CHECK(http_client_inited);
+
+    test_connections_per_request();
+    test_reconnects_when_server_drops_idle_connection();
+    test_server_asking_to_close();
+    test_unchanged_data_is_not_fetched_again();
+    test_fresh_entry_skips_the_network();
+    test_long_compressed_response();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "constants.h"
+#include "timer.h"
+#include "events.h"
+#include "power.h"
+#include "gpio.h"
+#include "check.h"
+#include "sim_hooks.h"
+
+/*
+ * Runs the sleep scheduler through a day's worth of request cycles on the
+ * simulated clock, so it takes no real time. What a cycle costs on the chip
+ * is assumed below, and the duty cycle and wake to data latency that come
+ * out are projections from those, not measurements. This builds once with
+ * the shipped POWER_MODE and once with light sleep.
+ */
+#define NUM_CYCLES (24 * 60 * 60 * 1000 / REQUEST_PERIOD_MS)
+// Light sleep wake up, before the main task runs again
+#define WAKE_MS 3
+// A GET on the kept-alive connection, to a server a few hops away
+#define REQUEST_MS 150
+// About 300 bytes of list to the display at 9600 baud
+#define SEND_MS 320
+// How far into the sleep the button goes down
+#define PRESS_AFTER_MS 1000
+
+static void advance_ms(int ms) {
+    sim_advance_clock_us((int64_t)ms * 1000);
+}
+
+static void test_cycles_stay_on_schedule() {
+    int64_t last_start_us = 0;
+    int64_t max_drift_us = 0;
+
+    for (int i = 0; i < NUM_CYCLES; i++) {
+        if (POWER_SCHEDULES_REQUESTS && i > 0) {
+            // Woken by the scheduler, not the hw_timer
+            event_type event;
+            CHECK(wait_for_event(&event, 0));
+            CHECK_INT(event, EVENT_REQUEST_DUE);
+            advance_ms(WAKE_MS);
+        }
+
+        power_cycle_start();
+        int64_t start_us = esp_timer_get_time();
+        // The first sleep doesn't know how long waking up takes yet, so
+        // that one request is late by the wake up
+        if (i > 1) {
+            int64_t drift_us = start_us - last_start_us - (int64_t)REQUEST_PERIOD_MS * 1000;
+            drift_us = drift_us < 0 ? -drift_us : drift_us;
+            max_drift_us = drift_us > max_drift_us ? drift_us : max_drift_us;
+        }
+        last_start_us = start_us;
+
+        advance_ms(REQUEST_MS + SEND_MS);
+        power_sleep_until_next_request();
+
+        if (!POWER_SCHEDULES_REQUESTS) {
+            // Awake on the hw_timer until the next request's tick
+            advance_ms(REQUEST_PERIOD_MS - REQUEST_MS - SEND_MS);
+        }
+    }
+
+    power_stats stats = get_power_stats();
+    CHECK_INT(stats.cycles, NUM_CYCLES);
+    // Only the real time between calls, which a busy host can stretch to a few
+    // milliseconds. Sleeping a fixed period would be a whole request and send off
+    CHECK(max_drift_us < 20000);
+
+    int expected_duty = POWER_SCHEDULES_REQUESTS ? (WAKE_MS + REQUEST_MS + SEND_MS) * 100 / REQUEST_PERIOD_MS : 100;
+    CHECK(get_duty_cycle_percent() >= expected_duty && get_duty_cycle_percent() <= expected_duty + 1);
+    CHECK(stats.wake_to_data_us / 1000 >= REQUEST_MS + SEND_MS);
+    CHECK(stats.wake_to_data_us / 1000 <= WAKE_MS + REQUEST_MS + SEND_MS + 1);
+
+    printf("POWER_MODE %d: %u cycles, awake %d%% of the time, wake to data %ums, "
+           "requests %ums apart (max drift %lldus)\n", POWER_MODE, stats.cycles, get_duty_cycle_percent(),
+           stats.wake_to_data_us / 1000, REQUEST_PERIOD_MS, (long long)max_drift_us);
+}
+
+#if POWER_MODE == POWER_MODE_LIGHT_SLEEP
+// A press wakes light sleep early. The rest of the period is spent awake so
+// the gesture timers can run, and the request still goes out on schedule
+static void test_button_wakes_light_sleep() {
+    event_type event;
+    while (wait_for_event(&event, 0)) {
+    }
+
+    power_cycle_start();
+    int64_t due_us = esp_timer_get_time() + (int64_t)REQUEST_PERIOD_MS * 1000;
+    advance_ms(REQUEST_MS + SEND_MS);
+    sim_gpio_set_level(GPIO_BUTTON_PIN, 0);
+    sim_light_sleep_wake_after_us((int64_t)PRESS_AFTER_MS * 1000);
+    power_sleep_until_next_request();
+
+    // The ISR never saw the edge that woke it, so it's made up from the level
+    CHECK(wait_for_event(&event, 0));
+    CHECK_INT(event, EVENT_BUTTON_CHANGED);
+    button_edge edge;
+    CHECK(button_edge_pop(&edge));
+    CHECK(edge.pressed);
+    CHECK(!wait_for_event(&event, 0));
+    sim_gpio_set_level(GPIO_BUTTON_PIN, 1);
+
+    // Just short of the request, then up to it
+    advance_ms((due_us - esp_timer_get_time()) / 1000 - WAKE_MS - TIMER_TICK_MS);
+    CHECK(!wait_for_event(&event, 0));
+    advance_ms(WAKE_MS + TIMER_TICK_MS);
+    CHECK(wait_for_event(&event, pdMS_TO_TICKS(100)));
+    CHECK_INT(event, EVENT_REQUEST_DUE);
+    int64_t late_us = esp_timer_get_time() - due_us;
+    CHECK(late_us > -WAKE_MS * 1000 - 20000 && late_us < TIMER_TICK_MS * 1000 + 20000);
+}
+#endif
+
+int main() {
+    init_events();
+    init_power();
+
+#if POWER_MODE == POWER_MODE_MODEM_SLEEP
+    CHECK_INT(sim_wifi_power_save(), WIFI_PS_MAX_MODEM);
+#elif POWER_MODE == POWER_MODE_LIGHT_SLEEP
+    CHECK_INT(sim_wifi_power_save(), WIFI_PS_MIN_MODEM);
+    init_timer();
+#endif
+
+    test_cycles_stay_on_schedule();
+#if POWER_MODE == POWER_MODE_LIGHT_SLEEP
+    test_button_wakes_light_sleep();
+#endif
+    return CHECK_RESULT();
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/uart.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "timer.h"
+#include "network.h"
+#include "cache.h"
+#include "dns.h"
+#include "json.h"
+#include "link.h"
+#include "uart.h"
+#include "refresh.h"
+#include "arena.h"
+
+#include "sim_hooks.h"
+#include "serial_line.h"
+#include "standin.h"
+#include "display_sim.h"
+#include "check.h"
+
+/*
+ * Runs refresh_all against the stand-in server and the display, and times
+ * how long new data for both endpoints takes to reach the sign next to the
+ * tides/swell alternation main.c used to do, which is replayed here with
+ * the same calls it made. Then it times a refresh with the fetching and the
+ * sending overlapped against the two done one after the other. This builds
+ * twice, once as the firmware ships and once with DIFF_LIST_UPDATES off,
+ * since with deltas nothing can go out until the whole list is in.
+ */
+#define API_HOST "spotcheck.brianteam.dev"
+#define TIDES_VALUES 8
+#define SWELL_VALUES 3
+#define DISPLAY_RX_BUFFER_SIZE 64
+#define ESP_RX_BUFFER_SIZE (UART_BUF_SIZE * 2)
+// What a fetch takes on a real connection, where the stand-in takes nothing
+#define RESPONSE_DELAY_MS 100
+
+static void send_value(char *value, int length, void *handler_arg) {
+    int *values_sent = (int *)handler_arg;
+    if (*values_sent == 0) {
+        send_list_start();
+    }
+    send_list_item(value, length);
+    (*values_sent)++;
+}
+
+// The way main.c runs one, returns the number of strings sent
+static int refresh() {
+    refresh_all();
+    return refresh_wait_done();
+}
+
+// One cycle the way main.c ran it before refresh.c, a single endpoint
+// streamed straight to the display as its own list
+static int alternation_cycle(char *endpoint) {
+    char url_buf[REFRESH_MAX_URL_LENGTH];
+    query_param params[2];
+    request request;
+    CHECK(build_request(endpoint, "wedge", REFRESH_DAYS, url_buf, sizeof(url_buf), params, &request));
+
+    int values_sent = 0;
+    json_stream_parser parser;
+    json_stream_init(&parser, send_value, &values_sent);
+    perform_streamed_request(&request, &parser);
+    // The read chunk came from the arena, freed the way refresh_all does
+    // after each source
+    arena_reset();
+    if (values_sent > 0) {
+        send_list_end();
+    }
+    return values_sent;
+}
+
+static void check_message(int index, const char *endpoint, int version, int value_index) {
+    // The stand-in's fixtures, read back here to compare against
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s_%d.json", FIXTURE_DIR, endpoint, version);
+    FILE *f = fopen(path, "rb");
+    CHECK(f != NULL);
+    if (!f) {
+        return;
+    }
+    char body[2048];
+    int body_length = fread(body, 1, sizeof(body) - 1, f);
+    fclose(f);
+
+    json_list_iter iter;
+    char *value;
+    int value_length = 0;
+    CHECK(json_list_find(&iter, body, body_length));
+    for (int i = 0; i <= value_index; i++) {
+        CHECK(json_list_next(&iter, &value, &value_length));
+    }
+
+    char message[64];
+    int length = display_sim_message(index, message, sizeof(message));
+    CHECK_TEXT(message, length, (value[value_length] = '\0', value));
+}
+
+// Both endpoints in one list, over the one connection
+static void test_merged_list() {
+    standin_stats server_before = get_standin_stats();
+    CHECK_INT(refresh(), TIDES_VALUES + SWELL_VALUES);
+
+    standin_stats server = get_standin_stats();
+    CHECK_INT(server.requests - server_before.requests, 2);
+    CHECK_INT(server.connections, 1);
+    CHECK_INT(get_display_sim_stats().messages_shown, TIDES_VALUES + SWELL_VALUES);
+    check_message(0, "tides", 0, 0);
+    check_message(TIDES_VALUES - 1, "tides", 0, TIDES_VALUES - 1);
+    check_message(TIDES_VALUES, "swell", 0, 0);
+}
+
+// Both 304s, so the display's left alone
+static void test_nothing_changed_sends_nothing() {
+    standin_stats server_before = get_standin_stats();
+    link_stats link_before = get_link_stats();
+    CHECK_INT(refresh(), 0);
+
+    standin_stats server = get_standin_stats();
+    CHECK_INT(server.not_modified - server_before.not_modified, 2);
+    CHECK_INT(get_link_stats().frames_sent - link_before.frames_sent, 0);
+    CHECK_INT(get_display_sim_stats().messages_shown, TIDES_VALUES + SWELL_VALUES);
+}
+
+// Only swell changed. Tides comes back 304 and its last strings fill its
+// place, so the list on the sign still has both
+static void test_unchanged_source_fills_in() {
+    standin_set_version(1);
+    standin_set_endpoint_version("tides", 0);
+    standin_stats server_before = get_standin_stats();
+    CHECK_INT(refresh(), TIDES_VALUES + SWELL_VALUES);
+
+    CHECK_INT(get_standin_stats().not_modified - server_before.not_modified, 1);
+    CHECK_INT(get_display_sim_stats().messages_shown, TIDES_VALUES + SWELL_VALUES);
+    check_message(0, "tides", 0, 0);
+    check_message(TIDES_VALUES, "swell", 1, 0);
+    check_message(TIDES_VALUES + SWELL_VALUES - 1, "swell", 1, SWELL_VALUES - 1);
+}
+
+/*
+ * From the first cycle after both endpoints changed until both are on the
+ * sign. The alternation only gets the second one a REQUEST_PERIOD_MS later,
+ * and even then the sign only ever has one of them. The period isn't waited
+ * out, it's added on.
+ */
+static void test_refresh_latency_against_alternation() {
+    // Forgets both ETags, as if both had changed
+    standin_set_version(0);
+    init_cache();
+    display_sim_stop_scrolling();
+    int64_t start_us = esp_timer_get_time();
+    CHECK_INT(refresh(), TIDES_VALUES + SWELL_VALUES);
+    int64_t merged_us = esp_timer_get_time() - start_us;
+
+    standin_set_version(1);
+    display_sim_stop_scrolling();
+    start_us = esp_timer_get_time();
+    CHECK_INT(alternation_cycle("tides"), TIDES_VALUES);
+    int64_t tides_us = esp_timer_get_time() - start_us;
+    display_sim_stop_scrolling();
+    start_us = esp_timer_get_time();
+    CHECK_INT(alternation_cycle("swell"), SWELL_VALUES);
+    int64_t swell_us = esp_timer_get_time() - start_us;
+    CHECK_INT(get_display_sim_stats().messages_shown, SWELL_VALUES);
+
+    int64_t alternation_us = (int64_t)REQUEST_PERIOD_MS * 1000 + swell_us;
+    CHECK(merged_us < alternation_us);
+    printf("both endpoints on the sign: merged %.1f ms in one cycle, alternating %.1f ms "
+           "(tides cycle %.1f ms, %d ms period, swell cycle %.1f ms)\n", merged_us / 1000.0,
+           alternation_us / 1000.0, tides_us / 1000.0, REQUEST_PERIOD_MS, swell_us / 1000.0);
+}
+
+/*
+ * Both endpoints changed and every response held back RESPONSE_DELAY_MS.
+ * Only the full list path can start sending before the last source is in,
+ * with deltas the output is all at the end and there's nothing to overlap.
+ */
+static void test_pipeline_overlap() {
+    standin_set_version(0);
+    init_cache();
+    standin_set_response_delay_ms(RESPONSE_DELAY_MS);
+    display_sim_stop_scrolling();
+    pipeline_stats before = get_pipeline_stats();
+    int64_t start_us = esp_timer_get_time();
+    CHECK_INT(refresh(), TIDES_VALUES + SWELL_VALUES);
+    int64_t refresh_us = esp_timer_get_time() - start_us;
+    standin_set_response_delay_ms(0);
+
+    pipeline_stats after = get_pipeline_stats();
+    uint64_t fetch_us = after.fetch_us - before.fetch_us;
+    uint64_t output_us = after.output_us - before.output_us;
+    uint64_t overlap_us = after.overlap_us - before.overlap_us;
+    CHECK_INT(after.batches - before.batches, 2);
+    CHECK_INT(after.values_capped - before.values_capped, 0);
+    CHECK(fetch_us >= 2 * RESPONSE_DELAY_MS * 1000);
+    if (LINK_SENDS_DELTAS) {
+        // Just the handoff of the first batch, not a whole send
+        CHECK(overlap_us < output_us / 10);
+    } else {
+        CHECK(overlap_us > 0);
+        CHECK((uint64_t)refresh_us < fetch_us + output_us);
+    }
+    printf("%s: refresh %.1f ms, fetch %.1f ms, output %.1f ms, overlapped %.1f ms, "
+           "%.1f ms one after the other (%.2fx), queue depth avg %.2f max %u\n",
+           LINK_SENDS_DELTAS ? "deltas" : "full lists", refresh_us / 1000.0, fetch_us / 1000.0,
+           output_us / 1000.0, overlap_us / 1000.0, (fetch_us + output_us) / 1000.0,
+           (double)(fetch_us + output_us) / refresh_us,
+           (double)(after.queue_depth_total - before.queue_depth_total) / (after.batches - before.batches),
+           after.max_queue_depth);
+}
+
+int main() {
+    uint16_t http_port = standin_start_http(FIXTURE_DIR, API_HOST);
+    uint16_t dns_port = standin_start_dns();
+    if (http_port == 0 || dns_port == 0) {
+        printf("Couldn't start the stand-in servers\n");
+        return 1;
+    }
+    sim_net_redirect(http_port, dns_port);
+
+    serial_line_init(SERIAL_TO_DISPLAY, DISPLAY_RX_BUFFER_SIZE);
+    serial_line_init(SERIAL_FROM_DISPLAY, ESP_RX_BUFFER_SIZE);
+    sim_uart_attach(LINK_UART);
+    display_sim_start();
+    init_uart();
+    init_link();
+
+    esp_event_loop_create_default();
+    init_arena();
+    init_cache();
+    init_dns();
+    init_wifi();
+    init_http();
+    init_refresh();
+
+    test_merged_list();
+    test_nothing_changed_sends_nothing();
+    test_unchanged_source_fills_in();
+    test_refresh_latency_against_alternation();
+    test_pipeline_overlap();
+    return CHECK_RESULT();
+}
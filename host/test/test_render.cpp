@@ -0,0 +1,345 @@
+#include <stdint.h>
+#include <time.h>
+
+// The firmware's renderer and dictionary, before fontALL.h pulls its own
+// copy of the font in
+extern "C" {
+#include "font.h"
+#include "dict.h"
+}
+
+// Everything the sketch includes, the same as display_sim.cpp
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <TVout.h>
+#include <TVoutfonts/fontALL.h>
+#include <SoftwareSerial.h>
+#include <util/crc16.h>
+
+#include "sim_hooks.h"
+#include "display_sim.h"
+#include "check.h"
+
+/*
+ * Scrolls the same messages four ways and checks every frame that goes out
+ * to the strip is the same: with the blocking per-pixel renderer the sketch
+ * had before the column ring (kept below as the reference), with the ring
+ * running text through the font, with the ring expanding the firmware's
+ * dictionary tokens as it goes, and with the ring scrolling the columns
+ * the firmware pre-renders. The sketch is built in here rather than run on
+ * display_sim's thread, so its scroll can be stepped directly. This is
+ * built once for each LAYOUTSTART and LAYOUTMODE.
+ *
+ * What a frame costs is counted three ways: reads from program memory,
+ * which on the AVR are font lookups from flash, LEDs set, and the host CPU
+ * time spent building it, which only means anything relative to the others.
+ */
+namespace display {
+#include "../../spot_check_display/spot_check_display.h"
+#include "sketch_prototypes.h"
+#include "../../spot_check_display/spot_check_display.ino"
+
+void record_frame();
+
+// The reference sat in delay() after every frame
+void scroll_delay() {
+  record_frame();
+  delay(SCROLLSPEED);
+}
+
+// display_text before the column ring, as it was, less the DEBUG output
+void reference_display_text(char* message, int message_length) {
+  uint8_t fontWidth, fontHeight, fontStartChar;
+  uint8_t letter, fontBit;
+  uint8_t letterOffset;
+  uint8_t row, col;
+  uint8_t offset;
+  char    ch;
+  uint8_t layoutStart, layoutMode;
+  uint8_t colDir, rowDir;
+  uint8_t colOffset, rowOffset;
+
+  layoutStart = LAYOUTSTART;
+  layoutMode = LAYOUTMODE;
+
+  if (layoutStart == TOPLEFT || layoutStart == TOPRIGHT)
+  {
+    rowDir = DOWN;
+  }
+  else
+  {
+    rowDir = UP;
+  }
+
+  if (layoutStart == TOPLEFT || layoutStart == BOTTOMLEFT)
+  {
+    colDir = RIGHT;
+  }
+  else
+  {
+    colDir = LEFT;
+  }
+
+  fontWidth = FONTWIDTH;
+  fontHeight = FONTHEIGHT;
+  fontStartChar = FONTSTARTCHAR;
+
+  for (letter = 0; letter < message_length; letter++)
+  {
+    for (offset = 0; offset < fontWidth; offset++)
+    {
+      for (row = 0; row < ROWS && row < fontHeight ; row++)
+      {
+        letterOffset = 0;
+        fontBit = offset;
+
+        if (rowDir == DOWN)
+        {
+          rowOffset = row;
+        }
+        else
+        {
+          rowOffset = (fontHeight < ROWS ? fontHeight : ROWS) - 1 - row;
+        }
+
+        for (col = 0; col < LEDSPERROW; col++)
+        {
+          if (colDir == RIGHT)
+          {
+            colOffset = col;
+          }
+          else
+          {
+            colOffset = LEDSPERROW - 1 - col;
+          }
+
+          if (letter + letterOffset >= message_length)
+          {
+            ch = ' ';
+          }
+          else
+          {
+            ch = message[letter + letterOffset];
+          }
+
+          if (bitRead(pgm_read_byte_near(&font[FONTDATAOFFSET +
+                                               (ch - fontStartChar)*fontHeight + rowOffset]),
+                      7 - fontBit) == 1)
+          {
+            strip.setPixelColor((row * LEDSPERROW) + colOffset,
+                                strip.Color(127, 0, 0));
+          }
+          else
+          {
+            strip.setPixelColor((row * LEDSPERROW) + colOffset, 0);
+          }
+
+          fontBit++;
+          if (fontBit >= fontWidth)
+          {
+            fontBit = 0;
+            letterOffset++;
+          }
+        }
+
+        if (layoutMode == ZIGZAG)
+        {
+          if (colDir == RIGHT)
+          {
+            colDir = LEFT;
+          }
+          else
+          {
+            colDir = RIGHT;
+          }
+        }
+      }
+      strip.show();
+      scroll_delay();
+    }
+  }
+}
+}
+
+#define MAX_FRAMES 256
+
+static const char *messages[] = {
+    "Tue 10/13 High 5.4 ft at 10:48am",
+    "Waves 2-3 ft, glassy ~ 14s @ 270",
+};
+#define NUM_MESSAGES ((int)(sizeof(messages) / sizeof(messages[0])))
+
+typedef struct {
+    int count;
+    uint32_t pixels[MAX_FRAMES][LEDS];
+    uint32_t pgm_reads;
+    uint32_t pixels_set;
+    int64_t cpu_ns;
+} frame_log;
+
+static frame_log reference_frames;
+static frame_log text_frames;
+static frame_log token_frames;
+static frame_log column_frames;
+static frame_log *recording;
+static int64_t last_cpu_ns;
+
+static int64_t cpu_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Nothing polls the serial port here
+void display_sim_yield(void) {
+}
+
+void display::record_frame() {
+    if (recording == NULL) {
+        return;
+    }
+
+    recording->cpu_ns += cpu_now_ns() - last_cpu_ns;
+    if (recording->count < MAX_FRAMES) {
+        for (int i = 0; i < LEDS; i++) {
+            recording->pixels[recording->count][i] = display::strip.getPixelColor(i);
+        }
+    }
+    recording->count++;
+    last_cpu_ns = cpu_now_ns();
+}
+
+// Steps the scroll the way loop() does, a millisecond at a time, taking each
+// frame as it goes out
+static void scroll(display::scroll_source *source) {
+    CHECK(display::scroll_start(source));
+    display::record_frame();
+    while (display::scroll_step >= 0) {
+        uint32_t shows = display::strip.shows;
+        display::scroll_tick();
+        if (display::strip.shows != shows) {
+            display::record_frame();
+        } else {
+            sim_advance_clock_us(1000);
+        }
+    }
+}
+
+// Starts from a blank strip, so a renderer that only sets what changed
+// can't lean on what the last one left behind
+static void start_recording(frame_log *log) {
+    for (int i = 0; i < LEDS; i++) {
+        display::strip.setPixelColor(i, 0);
+    }
+    recording = log;
+    pgm_reads() = 0;
+    log->pixels_set = display::strip.pixels_set;
+    last_cpu_ns = cpu_now_ns();
+}
+
+static void stop_recording() {
+    recording->pgm_reads = pgm_reads();
+    recording->pixels_set = display::strip.pixels_set - recording->pixels_set;
+    recording = NULL;
+}
+
+static int frames_differing(const frame_log *a, const frame_log *b) {
+    int differing = 0;
+    for (int frame = 0; frame < a->count && frame < MAX_FRAMES; frame++) {
+        differing += memcmp(a->pixels[frame], b->pixels[frame], sizeof(a->pixels[frame])) != 0;
+    }
+    return differing;
+}
+
+static void print_cost(const char *name, const frame_log *log) {
+    printf("  %-13s %4u flash reads, %4u LEDs set, %5.1f us\n", name, log->pgm_reads / log->count,
+           log->pixels_set / log->count, log->cpu_ns / 1000.0 / log->count);
+}
+
+static void test_renderers_match() {
+    start_recording(&reference_frames);
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        char message[MAXMSGLEN + 1];
+        int length = strlen(messages[i]);
+        memcpy(message, messages[i], length + 1);
+        display::reference_display_text(message, length);
+    }
+    stop_recording();
+
+    start_recording(&text_frames);
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        display::scroll_source source = {messages[i], NULL, (int)strlen(messages[i]) * FONT_WIDTH, FONT_HEIGHT};
+        scroll(&source);
+    }
+    stop_recording();
+
+    // Stored the way the sketch stores them, so the length pass over the
+    // tokens is in the cost as well
+    int encoded_bytes = 0;
+    start_recording(&token_frames);
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        uint8_t encoded[MAXMSGLEN];
+        int length = dict_encode(messages[i], strlen(messages[i]), encoded, sizeof(encoded));
+        encoded_bytes += length;
+        int num_columns = display::text_expanded_length(encoded, length) * FONT_WIDTH;
+        display::scroll_source source = {(const char *)encoded, NULL, num_columns, FONT_HEIGHT};
+        scroll(&source);
+    }
+    stop_recording();
+
+    start_recording(&column_frames);
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        uint8_t columns[MSGARENASIZE];
+        int num_columns = font_render_columns(messages[i], strlen(messages[i]), columns, sizeof(columns));
+        CHECK_INT(num_columns, (int)strlen(messages[i]) * FONT_WIDTH);
+        display::scroll_source source = {NULL, columns, num_columns, COLUMN_HEIGHT};
+        scroll(&source);
+    }
+    stop_recording();
+
+    // One frame per column scrolled in, whichever way
+    int expected_frames = (strlen(messages[0]) + strlen(messages[1])) * FONT_WIDTH;
+    CHECK_INT(reference_frames.count, expected_frames);
+    CHECK_INT(text_frames.count, expected_frames);
+    CHECK_INT(token_frames.count, expected_frames);
+    CHECK_INT(column_frames.count, expected_frames);
+    CHECK_INT(frames_differing(&reference_frames, &text_frames), 0);
+    CHECK_INT(frames_differing(&reference_frames, &token_frames), 0);
+    CHECK(encoded_bytes < (int)(strlen(messages[0]) + strlen(messages[1])));
+    CHECK_INT(frames_differing(&reference_frames, &column_frames), 0);
+
+    int lit = 0;
+    for (int frame = 0; frame < reference_frames.count && frame < MAX_FRAMES; frame++) {
+        for (int i = 0; i < LEDS; i++) {
+            lit += reference_frames.pixels[frame][i] != 0;
+        }
+    }
+    // Not a sign full of nothing matching a sign full of nothing
+    CHECK(lit > reference_frames.count * 10);
+
+    // The reference looks every pixel up in the font and sets it, the ring
+    // only looks up the column coming in and sets what changed
+    CHECK(reference_frames.pgm_reads >= (uint32_t)reference_frames.count * LEDS);
+    CHECK(text_frames.pgm_reads <= (uint32_t)(text_frames.count + NUM_MESSAGES * LEDSPERROW) * (FONT_HEIGHT + 3));
+    CHECK_INT(column_frames.pgm_reads, 0);
+    CHECK(text_frames.pixels_set < reference_frames.pixels_set / 2);
+    CHECK_INT(column_frames.pixels_set, text_frames.pixels_set);
+    CHECK_INT(token_frames.pixels_set, text_frames.pixels_set);
+
+    printf("LAYOUTSTART %d LAYOUTMODE %d, %d frames each, per frame:\n", LAYOUTSTART, LAYOUTMODE, reference_frames.count);
+    print_cost("per pixel", &reference_frames);
+    print_cost("ring, text", &text_frames);
+    print_cost("ring, tokens", &token_frames);
+    print_cost("ring, columns", &column_frames);
+}
+
+int main() {
+    // Nothing else is running, so show() and delay() don't have to take real time
+    sim_set_skip_sleeps(true);
+    init_font();
+    init_dict();
+    display::strip.begin();
+
+    test_renderers_match();
+    return CHECK_RESULT();
+}
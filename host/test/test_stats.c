@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "stats.h"
+#include "check.h"
+#include "sim_hooks.h"
+
+#define OVERHEAD_RECORDS 1000000
+
+static int64_t cpu_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void test_buckets() {
+    stats_record(STAGE_HTTP_CONNECT, 999);
+    stats_record(STAGE_HTTP_CONNECT, 1000);
+    stats_record(STAGE_HTTP_CONNECT, 3999);
+    stats_record(STAGE_HTTP_CONNECT, 4000);
+    // Past the last bucket's 2^11ms, so it lands there anyway
+    stats_record(STAGE_HTTP_CONNECT, 60000000);
+
+    stage_histogram histogram = get_stage_histogram(STAGE_HTTP_CONNECT);
+    CHECK_INT(histogram.count, 5);
+    CHECK_INT(histogram.max_us, 60000000);
+    CHECK_INT(histogram.total_us, 999 + 1000 + 3999 + 4000 + 60000000);
+    CHECK_INT(histogram.buckets[0], 1);
+    CHECK_INT(histogram.buckets[1], 1);
+    CHECK_INT(histogram.buckets[2], 1);
+    CHECK_INT(histogram.buckets[3], 1);
+    CHECK_INT(histogram.buckets[STATS_HISTOGRAM_BUCKETS - 1], 1);
+
+    // Nothing else was touched
+    CHECK_INT(get_stage_histogram(STAGE_HTTP_BODY).count, 0);
+}
+
+static void test_timer() {
+    stats_timer timer;
+    stats_timer_start(&timer);
+    sim_advance_clock_us(12345);
+    CHECK_INT(stats_timer_elapsed_us(&timer), 12345);
+}
+
+// Host CPU time, so only a rough idea of what it costs on the chip. It's
+// there to catch recording getting expensive enough to turn off
+static void test_overhead() {
+    int64_t start_ns = cpu_now_ns();
+    for (int i = 0; i < OVERHEAD_RECORDS; i++) {
+        stats_record(STAGE_LINK_SEND, i);
+    }
+    int64_t record_ns = (cpu_now_ns() - start_ns) / OVERHEAD_RECORDS;
+
+    CHECK_INT(get_stage_histogram(STAGE_LINK_SEND).count, OVERHEAD_RECORDS);
+    printf("stats_record takes %lldns on the host, heap sample included\n", (long long)record_ns);
+}
+
+int main() {
+    // The clock only moves when the tests move it
+    sim_set_skip_sleeps(true);
+    init_stats();
+
+    test_buckets();
+    test_timer();
+    test_overhead();
+    return CHECK_RESULT();
+}
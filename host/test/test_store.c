@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "store.h"
+#include "check.h"
+
+#define NUM_LISTS 2
+
+static message_list saved[NUM_LISTS];
+static message_list loaded[NUM_LISTS];
+
+static void add(message_list *list, const char *text) {
+    message_list_add(list, text, strlen(text));
+}
+
+static void check_same_lists() {
+    for (int i = 0; i < NUM_LISTS; i++) {
+        CHECK_INT(loaded[i].count, saved[i].count);
+        CHECK_INT(loaded[i].used, saved[i].used);
+        CHECK(memcmp(loaded[i].ends, saved[i].ends, saved[i].count * sizeof(saved[i].ends[0])) == 0);
+        CHECK(memcmp(loaded[i].text, saved[i].text, saved[i].used) == 0);
+    }
+}
+
+// Like a reboot, nothing carried over but what's in the file
+static bool reload() {
+    init_store();
+    memset(loaded, 0xAA, sizeof(loaded));
+    return store_load(loaded, NUM_LISTS);
+}
+
+static void patch_file(const char *path, long offset, uint8_t value) {
+    FILE *file = fopen(path, "r+b");
+    fseek(file, offset, SEEK_SET);
+    fwrite(&value, 1, 1, file);
+    fclose(file);
+}
+
+static uint8_t read_file_byte(const char *path, long offset) {
+    uint8_t value = 0;
+    FILE *file = fopen(path, "rb");
+    fseek(file, offset, SEEK_SET);
+    fread(&value, 1, 1, file);
+    fclose(file);
+    return value;
+}
+
+static void test_round_trip() {
+    remove(STORE_FILE);
+    remove(STORE_TEMP_FILE);
+    init_store();
+    CHECK(get_store_stats().mounted);
+    CHECK(!store_load(loaded, NUM_LISTS));
+
+    message_list_clear(&saved[0]);
+    message_list_clear(&saved[1]);
+    add(&saved[0], "High 5.4 ft at 6:15 am");
+    add(&saved[0], "");
+    add(&saved[0], "Low 0.2 ft");
+    // Second list stays empty
+
+    CHECK(store_save(saved, NUM_LISTS));
+    store_stats stats = get_store_stats();
+    CHECK_INT(stats.writes, 1);
+    // One count byte per list, two length bytes per string
+    int payload_length = 1 + 3 * 2 + saved[0].used + 1;
+    CHECK_INT(stats.record_bytes, STORE_HEADER_SIZE + payload_length + STORE_TRAILER_SIZE);
+
+    CHECK(reload());
+    CHECK(get_store_stats().loaded);
+    check_same_lists();
+}
+
+static void test_unchanged_save() {
+    init_store();
+    CHECK(store_load(loaded, NUM_LISTS));
+
+    // Same lists as the record, nothing goes to flash
+    CHECK(store_save(loaded, NUM_LISTS));
+    store_stats stats = get_store_stats();
+    CHECK_INT(stats.unchanged, 1);
+    CHECK_INT(stats.writes, 0);
+
+    add(&loaded[1], "Swell 3 ft");
+    CHECK(store_save(loaded, NUM_LISTS));
+    stats = get_store_stats();
+    CHECK_INT(stats.unchanged, 1);
+    CHECK_INT(stats.writes, 1);
+
+    memcpy(saved, loaded, sizeof(saved));
+    CHECK(reload());
+    check_same_lists();
+}
+
+static void test_bad_records() {
+    long text_offset = STORE_HEADER_SIZE + 1 + 3 * 2;
+    uint8_t text_byte = read_file_byte(STORE_FILE, text_offset);
+
+    // Payload doesn't match its hash
+    patch_file(STORE_FILE, text_offset, text_byte ^ 0x01);
+    CHECK(!reload());
+    // Cleared, not left with whatever made it in
+    CHECK_INT(loaded[0].count, 0);
+    CHECK_INT(loaded[1].count, 0);
+    patch_file(STORE_FILE, text_offset, text_byte);
+    CHECK(reload());
+
+    patch_file(STORE_FILE, 0, 'X');
+    CHECK(!reload());
+    patch_file(STORE_FILE, 0, STORE_MAGIC[0]);
+
+    patch_file(STORE_FILE, STORE_MAGIC_LENGTH, STORE_VERSION + 1);
+    CHECK(!reload());
+    patch_file(STORE_FILE, STORE_MAGIC_LENGTH, STORE_VERSION);
+
+    // Saved for a different number of sources
+    init_store();
+    CHECK(!store_load(loaded, NUM_LISTS - 1));
+
+    // A string longer than the rest of the record
+    patch_file(STORE_FILE, STORE_HEADER_SIZE + 2, 0xFF);
+    CHECK(!reload());
+}
+
+static void test_temp_file_fallback() {
+    CHECK(store_save(saved, NUM_LISTS));
+
+    // Power lost between removing the old record and the rename
+    remove(STORE_TEMP_FILE);
+    rename(STORE_FILE, STORE_TEMP_FILE);
+    CHECK(reload());
+    check_same_lists();
+}
+
+int main() {
+    test_round_trip();
+    test_unchanged_save();
+    test_bad_records();
+    test_temp_file_fallback();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "timer.h"
+
+#include "sim_hooks.h"
+#include "sim_time.h"
+#include "check.h"
+
+/*
+ * Runs against the hw_timer stub in real time, so lateness is only checked
+ * loosely. Early is never allowed. Then thousands of timers are left running
+ * while the clock is stepped a tick at a time, to see what each hw_timer
+ * interrupt costs with that many on the wheel.
+ */
+#define LATE_SLACK_MS 40
+#define MAX_FIRES 64
+// Simulated time each soak runs for
+#define SOAK_TICKS (60 * 1000 / TIMER_TICK_MS)
+#define MAX_SOAK_TIMERS 20000
+// Deadlines and periods go out to several laps of the wheel
+#define SOAK_MAX_DELAY_MS 5000
+// Real time to wait on an interrupt that's due before giving up on it
+#define WAKEUP_WAIT_US 100000
+// How far past each tick boundary a step of the soak lands
+#define STEP_PAST_TICK_US 100
+
+typedef struct {
+    soft_timer timer;
+    int64_t fired_us[MAX_FIRES];
+    int fires;
+    // Restarted from its own callback this many more times
+    int restarts;
+    uint32_t restart_delay_ms;
+} test_timer;
+
+static int64_t start_us;
+// Order timers fired in, by test_timer
+static test_timer *fire_order[MAX_FIRES];
+static int num_fired;
+
+static void on_fire(void *arg) {
+    test_timer *t = arg;
+    if (t->fires < MAX_FIRES) {
+        t->fired_us[t->fires] = esp_timer_get_time();
+    }
+    t->fires++;
+    if (num_fired < MAX_FIRES) {
+        fire_order[num_fired] = t;
+    }
+    num_fired++;
+
+    if (t->restarts > 0) {
+        t->restarts--;
+        timer_start(&t->timer, t->restart_delay_ms, 0, on_fire, t);
+    }
+}
+
+static void reset(test_timer *timers, int count) {
+    memset(timers, 0, count * sizeof(test_timer));
+    num_fired = 0;
+    start_us = esp_timer_get_time();
+}
+
+static void start(test_timer *t, uint32_t delay_ms, uint32_t period_ms) {
+    timer_start(&t->timer, delay_ms, period_ms, on_fire, t);
+}
+
+static void sleep_until_ms(uint32_t ms) {
+    sim_sleep_until(start_us + (int64_t)ms * 1000);
+}
+
+// Fired at or after due_ms from the start, and not much after
+static void check_fired_at(const test_timer *t, int fire, uint32_t due_ms) {
+    int64_t at_us = t->fired_us[fire] - start_us;
+    CHECK(at_us >= (int64_t)due_ms * 1000);
+    CHECK(at_us <= (int64_t)(due_ms + LATE_SLACK_MS) * 1000);
+}
+
+static void test_one_shot_order() {
+    test_timer timers[4];
+    reset(timers, 4);
+    start(&timers[0], 35, 0);
+    start(&timers[1], 5, 0);
+    start(&timers[2], 20, 0);
+    start(&timers[3], 20, 0);
+
+    sleep_until_ms(35 + LATE_SLACK_MS + 50);
+    CHECK_INT(num_fired, 4);
+    CHECK(fire_order[0] == &timers[1]);
+    CHECK(fire_order[3] == &timers[0]);
+    check_fired_at(&timers[1], 0, 5);
+    check_fired_at(&timers[2], 0, 20);
+    check_fired_at(&timers[3], 0, 20);
+    check_fired_at(&timers[0], 0, 35);
+    for (int i = 0; i < 4; i++) {
+        CHECK_INT(timers[i].fires, 1);
+        CHECK(!timers[i].timer.armed);
+    }
+}
+
+static void test_beyond_one_lap() {
+    int lap_ms = TIMER_TICK_MS * TIMER_WHEEL_SIZE;
+    test_timer timers[3];
+    reset(timers, 3);
+    start(&timers[0], lap_ms + 100, 0);
+    start(&timers[1], 2 * lap_ms + 100, 0);
+    // Same slot as the first, one lap earlier
+    start(&timers[2], 100, 0);
+
+    sleep_until_ms(lap_ms + 50);
+    CHECK_INT(timers[2].fires, 1);
+    CHECK_INT(timers[0].fires, 0);
+    CHECK_INT(timers[1].fires, 0);
+
+    sleep_until_ms(2 * lap_ms + 100 + LATE_SLACK_MS + 50);
+    CHECK_INT(timers[0].fires, 1);
+    CHECK_INT(timers[1].fires, 1);
+    check_fired_at(&timers[0], 0, lap_ms + 100);
+    check_fired_at(&timers[1], 0, 2 * lap_ms + 100);
+}
+
+static void test_periodic_and_cancel() {
+    test_timer timers[2];
+    reset(timers, 2);
+    start(&timers[0], 50, 50);
+    // Cancelled before it's due, never fires
+    start(&timers[1], 100, 0);
+    timer_cancel(&timers[1].timer);
+
+    sleep_until_ms(525);
+    timer_cancel(&timers[0].timer);
+    int fires = timers[0].fires;
+    // Fixed rate, so a late wakeup doesn't push the rest back
+    CHECK(fires >= 9 && fires <= 10);
+    for (int i = 0; i < fires && i < MAX_FIRES; i++) {
+        check_fired_at(&timers[0], i, 50 * (i + 1));
+    }
+
+    sleep_until_ms(800);
+    CHECK_INT(timers[0].fires, fires);
+    CHECK_INT(timers[1].fires, 0);
+}
+
+static void test_restart_from_callback() {
+    test_timer timers[1];
+    reset(timers, 1);
+    timers[0].restarts = 2;
+    timers[0].restart_delay_ms = 30;
+    start(&timers[0], 30, 0);
+
+    sleep_until_ms(90 + 3 * LATE_SLACK_MS + 50);
+    CHECK_INT(timers[0].fires, 3);
+    for (int i = 1; i < 3; i++) {
+        CHECK(timers[0].fired_us[i] - timers[0].fired_us[i - 1] >= 30 * 1000);
+    }
+}
+
+/*
+ * Half the soak timers are periodic, the other half one-shots that start
+ * themselves again from their callback with a new random delay, so the
+ * wheel stays just as full the whole time. Everything here is touched from
+ * the hw_timer callback, or before anything's armed.
+ */
+typedef struct {
+    soft_timer timer;
+    int64_t due_us;
+    uint32_t period_ms;
+} soak_timer;
+
+static soak_timer soak_timers[MAX_SOAK_TIMERS];
+static uint32_t soak_random = 12345;
+static uint32_t soak_fires;
+static uint32_t soak_early;
+static int64_t soak_late_total_us;
+static int64_t soak_late_max_us;
+
+static uint32_t soak_delay_ms() {
+    soak_random = soak_random * 1103515245 + 12345;
+    // Whole ticks, so a period doesn't round up and drift from due_us
+    return TIMER_TICK_MS * (1 + (soak_random >> 16) % (SOAK_MAX_DELAY_MS / TIMER_TICK_MS));
+}
+
+static void on_soak_fire(void *arg) {
+    soak_timer *t = arg;
+    int64_t late_us = esp_timer_get_time() - t->due_us;
+    if (late_us < 0) {
+        soak_early++;
+    } else {
+        soak_late_total_us += late_us;
+        soak_late_max_us = late_us > soak_late_max_us ? late_us : soak_late_max_us;
+    }
+    soak_fires++;
+
+    if (t->period_ms) {
+        t->due_us += (int64_t)t->period_ms * 1000;
+    } else {
+        uint32_t delay_ms = soak_delay_ms();
+        t->due_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+        timer_start(&t->timer, delay_ms, 0, on_soak_fire, t);
+    }
+}
+
+// Under the critical section so an interrupt that's started has finished
+static uint32_t wakeup_count() {
+    portENTER_CRITICAL();
+    uint32_t wakeups = get_timer_stats().wakeups;
+    portEXIT_CRITICAL();
+    return wakeups;
+}
+
+static void soak(int num_timers) {
+    soak_fires = 0;
+    soak_early = 0;
+    soak_late_total_us = 0;
+    soak_late_max_us = 0;
+
+    portENTER_CRITICAL();
+    for (int i = 0; i < num_timers; i++) {
+        soak_timer *t = &soak_timers[i];
+        uint32_t delay_ms = soak_delay_ms();
+        t->period_ms = i % 2 ? soak_delay_ms() : 0;
+        t->due_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+        timer_start(&t->timer, delay_ms, t->period_ms, on_soak_fire, t);
+    }
+    portEXIT_CRITICAL();
+
+    /*
+     * Each step goes just past the next tick boundary and waits for the
+     * interrupt that makes due. Stepping a whole tick at a time would let
+     * the real time in between carry a step over two boundaries now and
+     * then, which the wheel counts as running late.
+     */
+    timer_stats before = get_timer_stats();
+    for (int tick = 0; tick < SOAK_TICKS; tick++) {
+        uint32_t wakeups = wakeup_count();
+        int64_t now_us = esp_timer_get_time();
+        int64_t tick_us = TIMER_TICK_MS * 1000;
+        sim_advance_clock_us((now_us / tick_us + 1) * tick_us + STEP_PAST_TICK_US - now_us);
+        int64_t give_up_us = esp_timer_get_time() + WAKEUP_WAIT_US;
+        while (wakeup_count() == wakeups && esp_timer_get_time() < give_up_us) {
+            sched_yield();
+        }
+    }
+
+    portENTER_CRITICAL();
+    for (int i = 0; i < num_timers; i++) {
+        timer_cancel(&soak_timers[i].timer);
+    }
+    timer_stats after = get_timer_stats();
+    uint32_t fires = soak_fires;
+    portEXIT_CRITICAL();
+
+    uint32_t wakeups = after.wakeups - before.wakeups;
+    CHECK_INT(soak_early, 0);
+    CHECK(fires > 0);
+    CHECK(soak_late_max_us <= (TIMER_TICK_MS + LATE_SLACK_MS) * 1000);
+    // Every slot has something in it, so there's no lap to wait out
+    CHECK(wakeups >= SOAK_TICKS * 9 / 10);
+    printf("%5d timers: %u expiries over %d s, none early, late avg %.1f ms max %.1f ms, "
+           "%u wakeups (%u empty), %.1f expiries and %.2f us a wakeup\n", num_timers, fires,
+           SOAK_TICKS * TIMER_TICK_MS / 1000, soak_late_total_us / 1000.0 / fires, soak_late_max_us / 1000.0,
+           wakeups, after.empty_wakeups - before.empty_wakeups, (double)fires / wakeups,
+           (double)(after.wakeup_us - before.wakeup_us) / wakeups);
+}
+
+// With only a few timers, deadlines past one lap cost a wakeup per lap
+static void test_sparse_timers_wake_once_a_lap() {
+    int lap_ms = TIMER_TICK_MS * TIMER_WHEEL_SIZE;
+    test_timer timers[1];
+    reset(timers, 1);
+    timer_stats before = get_timer_stats();
+    start(&timers[0], 5 * lap_ms + 100, 0);
+    sim_advance_clock_us((int64_t)(5 * lap_ms + 100) * 1000);
+    sleep_until_ms(5 * lap_ms + 100 + LATE_SLACK_MS);
+
+    timer_stats after = get_timer_stats();
+    CHECK_INT(timers[0].fires, 1);
+    CHECK(after.empty_wakeups - before.empty_wakeups <= 6);
+}
+
+static void test_thousands_of_timers() {
+    soak(1000);
+    soak(5000);
+    soak(MAX_SOAK_TIMERS);
+}
+
+int main() {
+    init_timer();
+    test_one_shot_order();
+    test_beyond_one_lap();
+    test_periodic_and_cancel();
+    test_restart_from_callback();
+    test_sparse_timers_wake_once_a_lap();
+    test_thousands_of_timers();
+    return CHECK_RESULT();
+}
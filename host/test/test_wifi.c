@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "network.h"
+#include "cache.h"
+#include "dns.h"
+#include "refresh.h"
+#include "stats.h"
+#include "json.h"
+#include "arena.h"
+#include "check.h"
+#include "sim_hooks.h"
+#include "standin.h"
+
+/*
+ * Connects, drops and reconnects wifi against the stub driver, checking when
+ * init_wifi does a full connect and when it goes straight back to the saved
+ * AP, and prints the time to the first usable socket for each. There's no
+ * radio, so what a scan and DHCP cost is assumed below and the times are
+ * projections from those.
+ */
+#define API_HOST "spotcheck.brianteam.dev"
+// An active scan of every channel, then a DHCP exchange with a home router
+#define SCAN_MS 1200
+#define DHCP_MS 400
+#define MOVED_CHANNEL 11
+
+static void ignore_value(char *value, int length, void *handler_arg) {
+}
+
+// Any request will do, it's the socket opening that ends the ready stage
+static void fetch() {
+    char url_buf[REFRESH_MAX_URL_LENGTH];
+    query_param params[2];
+    request request;
+    CHECK(build_request("tides", "wedge", "2", url_buf, sizeof(url_buf), params, &request));
+    json_stream_parser parser;
+    json_stream_init(&parser, ignore_value, NULL);
+    CHECK(perform_streamed_request(&request, &parser) != 0);
+    // The read chunk is in the arena, nothing else is using it
+    arena_reset();
+}
+
+// Time to the first socket after this init_wifi, from the ready stage
+static uint32_t connect_and_fetch_ms() {
+    stage_histogram before = get_stage_histogram(STAGE_NETWORK_READY);
+    init_wifi();
+    // Like the main loop, the http client only comes up once wifi has
+    if (!http_client_inited) {
+        init_http();
+    }
+    fetch();
+
+    stage_histogram after = get_stage_histogram(STAGE_NETWORK_READY);
+    CHECK_INT(after.count - before.count, 1);
+    return (after.total_us - before.total_us) / 1000;
+}
+
+static void test_first_connect_is_full() {
+    uint32_t ready_ms = connect_and_fetch_ms();
+    CHECK(http_client_inited);
+
+    wifi_connect_stats stats = get_wifi_connect_stats();
+    CHECK_INT(stats.full_connects, 1);
+    CHECK_INT(stats.fast_connects, 0);
+    CHECK(ready_ms >= SCAN_MS + DHCP_MS);
+    printf("full connect: first socket %ums after init_wifi\n", ready_ms);
+}
+
+static void test_still_associated_does_nothing() {
+    wifi_connect_stats before = get_wifi_connect_stats();
+    int64_t start_us = esp_timer_get_time();
+    init_wifi();
+
+    wifi_connect_stats after = get_wifi_connect_stats();
+    CHECK_INT(after.full_connects, before.full_connects);
+    CHECK_INT(after.fast_connects, before.fast_connects);
+    CHECK(esp_timer_get_time() - start_us < SCAN_MS * 1000 / 10);
+}
+
+static void test_reconnect_skips_scan_and_dhcp() {
+    sim_wifi_drop();
+    uint32_t ready_ms = connect_and_fetch_ms();
+
+    wifi_connect_stats stats = get_wifi_connect_stats();
+    CHECK_INT(stats.full_connects, 1);
+    CHECK_INT(stats.fast_connects, 1);
+    CHECK(ready_ms < DHCP_MS);
+    printf("fast reconnect: first socket %ums after init_wifi\n", ready_ms);
+}
+
+// The saved channel's no good any more, so that's one failed try and then
+// a full connect, which saves the new channel for the next time
+static void test_moved_ap_falls_back_to_full_connect() {
+    sim_wifi_set_ap_channel(MOVED_CHANNEL);
+    sim_wifi_drop();
+    uint32_t ready_ms = connect_and_fetch_ms();
+
+    wifi_connect_stats stats = get_wifi_connect_stats();
+    CHECK_INT(stats.full_connects, 2);
+    CHECK_INT(stats.fast_connects, 1);
+    CHECK(ready_ms >= SCAN_MS + DHCP_MS);
+    printf("AP moved channel: first socket %ums after init_wifi\n", ready_ms);
+
+    sim_wifi_drop();
+    ready_ms = connect_and_fetch_ms();
+    stats = get_wifi_connect_stats();
+    CHECK_INT(stats.full_connects, 2);
+    CHECK_INT(stats.fast_connects, 2);
+    CHECK(ready_ms < DHCP_MS);
+}
+
+int main() {
+    uint16_t http_port = standin_start_http(FIXTURE_DIR, API_HOST);
+    uint16_t dns_port = standin_start_dns();
+    if (http_port == 0 || dns_port == 0) {
+        printf("Couldn't start the stand-in servers\n");
+        return 1;
+    }
+    sim_net_redirect(http_port, dns_port);
+    sim_wifi_set_connect_delays_ms(SCAN_MS, DHCP_MS);
+
+    esp_event_loop_create_default();
+    init_arena();
+    init_cache();
+    init_dns();
+
+    test_first_connect_is_full();
+    test_still_associated_does_nothing();
+    test_reconnect_skips_scan_and_dhcp();
+    test_moved_ap_falls_back_to_full_connect();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,47 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "constants.h"
+#include "arena.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(ARENA_ALIGNMENT)));
+static size_t used;
+static arena_stats stats;
+
+void init_arena() {
+    used = 0;
+    memset(&stats, 0, sizeof(stats));
+    stats.size = ARENA_SIZE;
+}
+
+// Returns NULL if it doesn't fit in what's left of the arena this cycle
+void *arena_alloc(size_t size) {
+    size_t start = (used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (start > ARENA_SIZE || size > ARENA_SIZE - start) {
+        stats.failed_allocs++;
+        ESP_LOGI(TAG, "Arena out of room: wanted %d with %d of %d used", size, used, ARENA_SIZE);
+        return NULL;
+    }
+
+    used = start + size;
+    stats.allocs++;
+    if (used > stats.high_water) {
+        stats.high_water = used;
+    }
+
+    return &arena[start];
+}
+
+// End of a cycle, everything allocated from the arena is gone after this
+void arena_reset() {
+    used = 0;
+    stats.resets++;
+}
+
+arena_stats get_arena_stats() {
+    stats.used = used;
+    return stats;
+}
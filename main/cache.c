@@ -0,0 +1,117 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "constants.h"
+#include "cache.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static cache_entry entries[CACHE_MAX_ENTRIES];
+static cache_stats stats;
+
+static uint32_t now_ms() {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static void copy_bounded(char *dest, const char *src, int dest_size) {
+    if (!src) {
+        dest[0] = '\0';
+        return;
+    }
+
+    strncpy(dest, src, dest_size - 1);
+    dest[dest_size - 1] = '\0';
+}
+
+static void set_expiry(cache_entry *entry, int max_age_s) {
+    entry->has_expiry = max_age_s != CACHE_NO_MAX_AGE;
+    if (entry->has_expiry) {
+        entry->expires_at_ms = now_ms() + (uint32_t)max_age_s * 1000;
+    }
+}
+
+void init_cache() {
+    memset(entries, 0, sizeof(entries));
+    memset(&stats, 0, sizeof(stats));
+}
+
+cache_entry *cache_lookup(const char *url) {
+    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].in_use && strcmp(entries[i].url, url) == 0) {
+            entries[i].last_used_ms = now_ms();
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+bool cache_entry_is_fresh(cache_entry *entry) {
+    // Signed difference so tick count wraparound doesn't make stale entries look fresh
+    return entry->has_expiry && (int32_t)(entry->expires_at_ms - now_ms()) > 0;
+}
+
+/*
+ * Store validators for a url after its full response has been handled.
+ * Replaces an existing entry for the same url, otherwise takes a free slot
+ * or evicts the least recently used one. Urls too long to key on aren't cached.
+ */
+void cache_store(const char *url, const char *etag, const char *last_modified, int max_age_s) {
+    if (strlen(url) >= CACHE_MAX_URL_LENGTH) {
+        ESP_LOGI(TAG, "Url too long to cache: %s", url);
+        return;
+    }
+
+    cache_entry *entry = cache_lookup(url);
+    if (!entry) {
+        entry = &entries[0];
+        for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+            if (!entries[i].in_use) {
+                entry = &entries[i];
+                break;
+            }
+
+            if ((int32_t)(entries[i].last_used_ms - entry->last_used_ms) < 0) {
+                entry = &entries[i];
+            }
+        }
+    }
+
+    entry->in_use = true;
+    copy_bounded(entry->url, url, CACHE_MAX_URL_LENGTH);
+    copy_bounded(entry->etag, etag, CACHE_MAX_VALIDATOR_LENGTH);
+    copy_bounded(entry->last_modified, last_modified, CACHE_MAX_VALIDATOR_LENGTH);
+    set_expiry(entry, max_age_s);
+    entry->last_used_ms = now_ms();
+}
+
+// A 304 can carry a new max-age, so restart the clock on the existing entry
+void cache_refresh(cache_entry *entry, int max_age_s) {
+    set_expiry(entry, max_age_s);
+}
+
+// Make every entry go back to the server on its next use. Validators are
+// kept, so anything that hasn't changed still comes back as a cheap 304
+void cache_expire_all() {
+    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+        entries[i].has_expiry = false;
+    }
+}
+
+void cache_record_fresh_hit() {
+    stats.fresh_hits++;
+}
+
+void cache_record_revalidated_hit() {
+    stats.revalidated_hits++;
+}
+
+void cache_record_miss() {
+    stats.misses++;
+}
+
+cache_stats get_cache_stats() {
+    return stats;
+}
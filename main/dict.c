@@ -0,0 +1,69 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "constants.h"
+#include "dict.h"
+
+static const char *words[] = DICT_WORDS;
+#define NUM_WORDS (sizeof(words) / sizeof(words[0]))
+
+static uint8_t word_lengths[NUM_WORDS];
+static dict_stats stats;
+
+void init_dict() {
+    for (int i = 0; i < NUM_WORDS; i++) {
+        word_lengths[i] = strlen(words[i]);
+    }
+}
+
+// Encodes into encoded, or just counts if it's NULL
+static int encode(const char *text, int length, uint8_t *encoded, int max_length, int *length_used) {
+    int in = 0;
+    int out = 0;
+    while (in < length && out < max_length) {
+        int best = -1;
+        int best_length = 1;
+        for (int i = 0; i < NUM_WORDS && TOKENIZE_LINK_TEXT; i++) {
+            if (word_lengths[i] > best_length && word_lengths[i] <= length - in
+                && memcmp(&text[in], words[i], word_lengths[i]) == 0) {
+                best = i;
+                best_length = word_lengths[i];
+            }
+        }
+
+        if (encoded != NULL) {
+            encoded[out] = best >= 0 ? DICT_TOKEN_FLAG | best : ((text[in] & DICT_TOKEN_FLAG) ? '?' : text[in]);
+        }
+        out++;
+        in += best_length;
+    }
+
+    *length_used = in;
+    return out;
+}
+
+/*
+ * Turn text into what goes in a list frame: greedy longest match against the
+ * dictionary at every position, or a straight copy without
+ * TOKENIZE_LINK_TEXT. Bytes that would read as tokens (anything non-ASCII) go
+ * out as '?', the display's font doesn't have them anyway. Stops early if
+ * max_length runs out.
+ * Returns the number of bytes written to encoded.
+ */
+int dict_encode(const char *text, int length, uint8_t *encoded, int max_length) {
+    int length_used;
+    int encoded_length = encode(text, length, encoded, max_length, &length_used);
+    stats.bytes_in += length_used;
+    stats.bytes_out += encoded_length;
+    return encoded_length;
+}
+
+// What dict_encode would return, without writing anything
+int dict_encoded_length(const char *text, int length, int max_length) {
+    int length_used;
+    return encode(text, length, NULL, max_length, &length_used);
+}
+
+dict_stats get_dict_stats() {
+    return stats;
+}
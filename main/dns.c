@@ -0,0 +1,356 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "lwip/dns.h"
+#include "lwip/inet.h"
+
+#include "constants.h"
+#include "dns.h"
+#include "stats.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+#define DNS_HEADER_SIZE 12
+#define DNS_FLAG_RESPONSE 0x80
+#define DNS_FLAG_RECURSION_DESIRED 0x01
+#define DNS_RCODE_MASK 0x0F
+#define DNS_TYPE_A 1
+#define DNS_CLASS_IN 1
+
+// Entries are read by the main task and rewritten by the refresh task.
+// The stats are touched from both as well and go under the same lock
+static dns_entry entries[DNS_CACHE_MAX_ENTRIES];
+static SemaphoreHandle_t entries_lock;
+// Queries go one at a time through a single packet buffer
+static SemaphoreHandle_t query_lock;
+static TaskHandle_t refresh_task;
+static dns_stats stats;
+static uint16_t next_query_id;
+
+static uint32_t now_ms() {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static uint16_t read_u16(const uint8_t *data) {
+    return (uint16_t)(data[0] << 8) | data[1];
+}
+
+static uint32_t read_u32(const uint8_t *data) {
+    return ((uint32_t)read_u16(data) << 16) | read_u16(&data[2]);
+}
+
+// Returns the offset just past a (possibly compressed) name, or -1 if it runs off the end
+static int skip_name(const uint8_t *packet, int length, int offset) {
+    while (offset < length) {
+        uint8_t label_length = packet[offset];
+        if (label_length == 0) {
+            return offset + 1;
+        }
+
+        // A pointer ends the name wherever it points
+        if ((label_length & 0xC0) == 0xC0) {
+            return offset + 2 <= length ? offset + 2 : -1;
+        }
+
+        offset += label_length + 1;
+    }
+
+    return -1;
+}
+
+static int build_query(uint8_t *packet, const char *host, uint16_t id) {
+    memset(packet, 0, DNS_HEADER_SIZE);
+    packet[0] = id >> 8;
+    packet[1] = id & 0xFF;
+    packet[2] = DNS_FLAG_RECURSION_DESIRED;
+    packet[5] = 1;              // One question
+
+    // www.example.com goes out as 3www7example3com0
+    int offset = DNS_HEADER_SIZE;
+    const char *label = host;
+    while (*label) {
+        const char *dot = strchr(label, '.');
+        int label_length = dot ? dot - label : strlen(label);
+        packet[offset++] = label_length;
+        memcpy(&packet[offset], label, label_length);
+        offset += label_length;
+        label += label_length + (dot ? 1 : 0);
+    }
+    packet[offset++] = 0;
+
+    packet[offset++] = 0;
+    packet[offset++] = DNS_TYPE_A;
+    packet[offset++] = 0;
+    packet[offset++] = DNS_CLASS_IN;
+    return offset;
+}
+
+/*
+ * Pull the first A record out of a response, walking past any CNAMEs in
+ * front of it. The TTL is the smallest one seen on the way there so a
+ * short lived alias isn't outlived by its address.
+ */
+static bool parse_response(const uint8_t *packet, int length, uint16_t id, uint32_t *addr, uint32_t *ttl_s) {
+    if (length < DNS_HEADER_SIZE || read_u16(packet) != id
+        || !(packet[2] & DNS_FLAG_RESPONSE) || (packet[3] & DNS_RCODE_MASK) != 0) {
+        return false;
+    }
+
+    int num_questions = read_u16(&packet[4]);
+    int num_answers = read_u16(&packet[6]);
+    int offset = DNS_HEADER_SIZE;
+    for (int i = 0; i < num_questions && offset >= 0; i++) {
+        offset = skip_name(packet, length, offset);
+        offset = offset >= 0 ? offset + 4 : -1;
+    }
+
+    uint32_t min_ttl_s = UINT32_MAX;
+    for (int i = 0; i < num_answers && offset >= 0; i++) {
+        offset = skip_name(packet, length, offset);
+        if (offset < 0 || offset + 10 > length) {
+            return false;
+        }
+
+        uint16_t type = read_u16(&packet[offset]);
+        uint32_t record_ttl_s = read_u32(&packet[offset + 4]);
+        uint16_t data_length = read_u16(&packet[offset + 8]);
+        offset += 10;
+        if (offset + data_length > length) {
+            return false;
+        }
+
+        if (record_ttl_s < min_ttl_s) {
+            min_ttl_s = record_ttl_s;
+        }
+
+        if (type == DNS_TYPE_A && data_length == 4) {
+            // Copied as is so it stays in network byte order
+            memcpy(addr, &packet[offset], 4);
+            *ttl_s = min_ttl_s;
+            return true;
+        }
+        offset += data_length;
+    }
+
+    return false;
+}
+
+static bool get_server(struct sockaddr_in *server) {
+    memset(server, 0, sizeof(*server));
+    server->sin_family = AF_INET;
+    server->sin_port = htons(DNS_PORT);
+
+    if (DNS_SERVER_OVERRIDE[0]) {
+        return inet_aton(DNS_SERVER_OVERRIDE, &server->sin_addr) != 0;
+    }
+
+    const ip_addr_t *dhcp_server = dns_getserver(0);
+    if (!dhcp_server || ip_addr_isany(dhcp_server)) {
+        return false;
+    }
+
+    server->sin_addr.s_addr = ip_addr_get_ip4_u32(dhcp_server);
+    return true;
+}
+
+// One query out to the server, blocking for up to DNS_QUERY_TIMEOUT_MS
+static bool query(const char *host, uint32_t *addr, uint32_t *ttl_s) {
+    static uint8_t packet[DNS_MAX_PACKET_SIZE];
+
+    struct sockaddr_in server;
+    if (!get_server(&server)) {
+        ESP_LOGI(TAG, "No DNS server to ask for %s", host);
+        return false;
+    }
+
+    xSemaphoreTake(query_lock, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+
+    bool resolved = false;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock >= 0) {
+        struct timeval timeout = {
+            .tv_sec = DNS_QUERY_TIMEOUT_MS / 1000,
+            .tv_usec = (DNS_QUERY_TIMEOUT_MS % 1000) * 1000
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        uint16_t id = next_query_id++;
+        int query_length = build_query(packet, host, id);
+        if (sendto(sock, packet, query_length, 0, (struct sockaddr *)&server, sizeof(server)) == query_length) {
+            int response_length = recv(sock, packet, sizeof(packet), 0);
+            resolved = response_length > 0 && parse_response(packet, response_length, id, addr, ttl_s);
+        }
+        close(sock);
+    }
+
+    uint32_t query_us = (uint32_t)(esp_timer_get_time() - start_us);
+    xSemaphoreGive(query_lock);
+
+    xSemaphoreTake(entries_lock, portMAX_DELAY);
+    stats.queries++;
+    stats.query_time_us += query_us;
+    if (query_us > stats.max_query_us) {
+        stats.max_query_us = query_us;
+    }
+    if (!resolved) {
+        stats.query_failures++;
+    }
+    xSemaphoreGive(entries_lock);
+
+    stats_record(STAGE_DNS_QUERY, query_us);
+    return resolved;
+}
+
+static dns_entry *find_entry(const char *host) {
+    for (int i = 0; i < DNS_CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].in_use && strcmp(entries[i].host, host) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Call with entries_lock held
+static void store_entry(const char *host, uint32_t addr, uint32_t ttl_s) {
+    dns_entry *entry = find_entry(host);
+    for (int i = 0; !entry && i < DNS_CACHE_MAX_ENTRIES; i++) {
+        if (!entries[i].in_use) {
+            entry = &entries[i];
+        }
+    }
+
+    // Only ever a couple of hosts, so if the table's full just take the first slot
+    if (!entry) {
+        entry = &entries[0];
+    }
+
+    if (ttl_s < DNS_MIN_TTL_S) {
+        ttl_s = DNS_MIN_TTL_S;
+    } else if (ttl_s > DNS_MAX_TTL_S) {
+        ttl_s = DNS_MAX_TTL_S;
+    }
+
+    entry->in_use = true;
+    strcpy(entry->host, host);
+    entry->addr = addr;
+    entry->expires_at_ms = now_ms() + ttl_s * 1000;
+    entry->refreshing = false;
+}
+
+/*
+ * Re-resolves any entry marked for refresh. On failure the stale address is
+ * left in place to keep being served until DNS_MAX_STALE_S runs out, and the
+ * next lookup asks for another try.
+ */
+static void dns_refresh_task(void *arg) {
+    char host[DNS_MAX_HOST_LENGTH];
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (int i = 0; i < DNS_CACHE_MAX_ENTRIES; i++) {
+            xSemaphoreTake(entries_lock, portMAX_DELAY);
+            bool refresh = entries[i].in_use && entries[i].refreshing;
+            strcpy(host, entries[i].host);
+            xSemaphoreGive(entries_lock);
+            if (!refresh) {
+                continue;
+            }
+
+            uint32_t addr;
+            uint32_t ttl_s;
+            bool resolved = query(host, &addr, &ttl_s);
+
+            xSemaphoreTake(entries_lock, portMAX_DELAY);
+            if (resolved) {
+                store_entry(host, addr, ttl_s);
+                stats.refreshes++;
+            } else {
+                entries[i].refreshing = false;
+            }
+            xSemaphoreGive(entries_lock);
+        }
+    }
+}
+
+void init_dns() {
+    memset(entries, 0, sizeof(entries));
+    entries_lock = xSemaphoreCreateMutex();
+    query_lock = xSemaphoreCreateMutex();
+    assert(entries_lock && query_lock);
+    next_query_id = (uint16_t)esp_timer_get_time();
+
+    xTaskCreate(dns_refresh_task, "dns_refresh", 2048, NULL, tskIDLE_PRIORITY + 1, &refresh_task);
+}
+
+/*
+ * Address for host, from the cache if we can. Within its TTL an entry is
+ * used as is. Past its TTL (but inside DNS_MAX_STALE_S) it's still used so
+ * the request doesn't wait, and the refresh task is woken to look it up
+ * again. Only with nothing usable cached does this block on a query.
+ * Returns false if host couldn't be resolved at all.
+ */
+bool dns_resolve(const char *host, uint32_t *addr) {
+    if (strlen(host) >= DNS_MAX_HOST_LENGTH) {
+        return false;
+    }
+
+    xSemaphoreTake(entries_lock, portMAX_DELAY);
+    stats.lookups++;
+    dns_entry *entry = find_entry(host);
+    if (entry) {
+        int32_t ms_past_ttl = (int32_t)(now_ms() - entry->expires_at_ms);
+        if (ms_past_ttl < 0) {
+            *addr = entry->addr;
+            stats.fresh_hits++;
+            xSemaphoreGive(entries_lock);
+            return true;
+        }
+
+        if (ms_past_ttl < DNS_MAX_STALE_S * 1000) {
+            *addr = entry->addr;
+            stats.stale_hits++;
+            if (!entry->refreshing) {
+                entry->refreshing = true;
+                xTaskNotifyGive(refresh_task);
+            }
+            xSemaphoreGive(entries_lock);
+            return true;
+        }
+    }
+    stats.misses++;
+    xSemaphoreGive(entries_lock);
+
+    uint32_t ttl_s;
+    if (!query(host, addr, &ttl_s)) {
+        ESP_LOGI(TAG, "Couldn't resolve %s", host);
+        return false;
+    }
+
+    xSemaphoreTake(entries_lock, portMAX_DELAY);
+    store_entry(host, *addr, ttl_s);
+    xSemaphoreGive(entries_lock);
+    return true;
+}
+
+// For when connecting to the cached address failed, it might have moved
+void dns_invalidate(const char *host) {
+    xSemaphoreTake(entries_lock, portMAX_DELAY);
+    dns_entry *entry = find_entry(host);
+    if (entry) {
+        entry->in_use = false;
+    }
+    xSemaphoreGive(entries_lock);
+}
+
+dns_stats get_dns_stats() {
+    xSemaphoreTake(entries_lock, portMAX_DELAY);
+    dns_stats copy = stats;
+    xSemaphoreGive(entries_lock);
+    return copy;
+}
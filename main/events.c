@@ -0,0 +1,78 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "events.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static QueueHandle_t event_queue;
+static event_stats stats;
+
+// When the main task last came back from waiting, so everything until the
+// next wait counts as busy time
+static int64_t wake_time_us;
+
+void init_events() {
+    event_queue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(event_type));
+    assert(event_queue);
+
+    wake_time_us = esp_timer_get_time();
+}
+
+// For posting from task context
+void post_event(event_type type) {
+    if (xQueueSend(event_queue, &type, 0) != pdTRUE) {
+        stats.events_dropped++;
+    }
+}
+
+/*
+ * Safe to call from the hw_timer callback and gpio ISR. If the queue is full
+ * the main task is already well behind, so the event is counted and dropped.
+ */
+void post_event_from_isr(event_type type) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (xQueueSendFromISR(event_queue, &type, &higher_priority_task_woken) != pdTRUE) {
+        stats.events_dropped++;
+    }
+
+    if (higher_priority_task_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/*
+ * Block until an ISR posts an event or timeout ticks pass. While blocked the
+ * idle task gets to run (and feed the watchdog), which is the whole point.
+ * Returns false on timeout.
+ */
+bool wait_for_event(event_type *type, TickType_t timeout) {
+    int64_t wait_start_us = esp_timer_get_time();
+    stats.busy_us += wait_start_us - wake_time_us;
+
+    bool received = xQueueReceive(event_queue, type, timeout) == pdTRUE;
+
+    wake_time_us = esp_timer_get_time();
+    stats.idle_us += wake_time_us - wait_start_us;
+    if (received) {
+        stats.events_handled++;
+    }
+
+    return received;
+}
+
+event_stats get_event_stats() {
+    return stats;
+}
+
+uint8_t get_idle_percent() {
+    uint64_t total_us = stats.idle_us + stats.busy_us;
+    if (total_us == 0) {
+        return 0;
+    }
+
+    return (uint8_t)((stats.idle_us * 100) / total_us);
+}
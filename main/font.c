@@ -0,0 +1,146 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "font.h"
+
+#define FONT_DATA_OFFSET 3
+#define FONT_NUM_CHARS (FONT_END_CHAR - FONT_START_CHAR + 1)
+
+static const uint8_t font4x6[] = {
+    FONT_WIDTH, FONT_HEIGHT, FONT_START_CHAR,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // space
+    0x40, 0x40, 0x40, 0x00, 0x40, 0x00, // !
+    0xA0, 0xA0, 0x00, 0x00, 0x00, 0x00, // "
+    0xA0, 0xE0, 0xA0, 0xE0, 0xA0, 0x00, // #
+    0x60, 0xC0, 0x40, 0x60, 0xC0, 0x00, // $
+    0x80, 0x20, 0x40, 0x80, 0x20, 0x00, // %
+    0x40, 0xA0, 0x40, 0xA0, 0x60, 0x00, // &
+    0x40, 0x40, 0x00, 0x00, 0x00, 0x00, // '
+    0x20, 0x40, 0x40, 0x40, 0x20, 0x00, // (
+    0x80, 0x40, 0x40, 0x40, 0x80, 0x00, // )
+    0x00, 0xA0, 0x40, 0xA0, 0x00, 0x00, // *
+    0x00, 0x40, 0xE0, 0x40, 0x00, 0x00, // +
+    0x00, 0x00, 0x00, 0x40, 0x80, 0x00, // ,
+    0x00, 0x00, 0xE0, 0x00, 0x00, 0x00, // -
+    0x00, 0x00, 0x00, 0x00, 0x40, 0x00, // .
+    0x20, 0x20, 0x40, 0x80, 0x80, 0x00, // /
+    0x40, 0xA0, 0xA0, 0xA0, 0x40, 0x00, // 0
+    0x40, 0xC0, 0x40, 0x40, 0xE0, 0x00, // 1
+    0xC0, 0x20, 0x40, 0x80, 0xE0, 0x00, // 2
+    0xC0, 0x20, 0x40, 0x20, 0xC0, 0x00, // 3
+    0xA0, 0xA0, 0xE0, 0x20, 0x20, 0x00, // 4
+    0xE0, 0x80, 0xC0, 0x20, 0xC0, 0x00, // 5
+    0x60, 0x80, 0xE0, 0xA0, 0xE0, 0x00, // 6
+    0xE0, 0x20, 0x40, 0x80, 0x80, 0x00, // 7
+    0xE0, 0xA0, 0xE0, 0xA0, 0xE0, 0x00, // 8
+    0xE0, 0xA0, 0xE0, 0x20, 0xC0, 0x00, // 9
+    0x00, 0x40, 0x00, 0x40, 0x00, 0x00, // :
+    0x00, 0x40, 0x00, 0x40, 0x80, 0x00, // ;
+    0x20, 0x40, 0x80, 0x40, 0x20, 0x00, // <
+    0x00, 0xE0, 0x00, 0xE0, 0x00, 0x00, // =
+    0x80, 0x40, 0x20, 0x40, 0x80, 0x00, // >
+    0xC0, 0x20, 0x40, 0x00, 0x40, 0x00, // ?
+    0x40, 0xA0, 0xE0, 0x80, 0x60, 0x00, // @
+    0x40, 0xA0, 0xE0, 0xA0, 0xA0, 0x00, // A
+    0xC0, 0xA0, 0xC0, 0xA0, 0xC0, 0x00, // B
+    0x60, 0x80, 0x80, 0x80, 0x60, 0x00, // C
+    0xC0, 0xA0, 0xA0, 0xA0, 0xC0, 0x00, // D
+    0xE0, 0x80, 0xE0, 0x80, 0xE0, 0x00, // E
+    0xE0, 0x80, 0xE0, 0x80, 0x80, 0x00, // F
+    0x60, 0x80, 0xA0, 0xA0, 0x60, 0x00, // G
+    0xA0, 0xA0, 0xE0, 0xA0, 0xA0, 0x00, // H
+    0xE0, 0x40, 0x40, 0x40, 0xE0, 0x00, // I
+    0x20, 0x20, 0x20, 0xA0, 0x40, 0x00, // J
+    0xA0, 0xA0, 0xC0, 0xA0, 0xA0, 0x00, // K
+    0x80, 0x80, 0x80, 0x80, 0xE0, 0x00, // L
+    0xA0, 0xE0, 0xE0, 0xA0, 0xA0, 0x00, // M
+    0xA0, 0xE0, 0xE0, 0xE0, 0xA0, 0x00, // N
+    0x40, 0xA0, 0xA0, 0xA0, 0x40, 0x00, // O
+    0xC0, 0xA0, 0xC0, 0x80, 0x80, 0x00, // P
+    0x40, 0xA0, 0xA0, 0xE0, 0x60, 0x00, // Q
+    0xC0, 0xA0, 0xE0, 0xC0, 0xA0, 0x00, // R
+    0x60, 0x80, 0x40, 0x20, 0xC0, 0x00, // S
+    0xE0, 0x40, 0x40, 0x40, 0x40, 0x00, // T
+    0xA0, 0xA0, 0xA0, 0xA0, 0x60, 0x00, // U
+    0xA0, 0xA0, 0xA0, 0x40, 0x40, 0x00, // V
+    0xA0, 0xA0, 0xE0, 0xE0, 0xA0, 0x00, // W
+    0xA0, 0xA0, 0x40, 0xA0, 0xA0, 0x00, // X
+    0xA0, 0xA0, 0x40, 0x40, 0x40, 0x00, // Y
+    0xE0, 0x20, 0x40, 0x80, 0xE0, 0x00, // Z
+    0xE0, 0x80, 0x80, 0x80, 0xE0, 0x00, // [
+    0x80, 0x80, 0x40, 0x20, 0x20, 0x00, // backslash
+    0xE0, 0x20, 0x20, 0x20, 0xE0, 0x00, // ]
+    0x40, 0xA0, 0x00, 0x00, 0x00, 0x00, // ^
+    0x00, 0x00, 0x00, 0x00, 0xE0, 0x00, // _
+    0x80, 0x40, 0x00, 0x00, 0x00, 0x00, // `
+    0x00, 0xC0, 0x60, 0xA0, 0xE0, 0x00, // a
+    0x80, 0xC0, 0xA0, 0xA0, 0xC0, 0x00, // b
+    0x00, 0x60, 0x80, 0x80, 0x60, 0x00, // c
+    0x20, 0x60, 0xA0, 0xA0, 0x60, 0x00, // d
+    0x00, 0x60, 0xA0, 0xC0, 0x60, 0x00, // e
+    0x20, 0x40, 0xE0, 0x40, 0x40, 0x00, // f
+    0x00, 0x60, 0xA0, 0x60, 0x20, 0xC0, // g
+    0x80, 0xC0, 0xA0, 0xA0, 0xA0, 0x00, // h
+    0x40, 0x00, 0x40, 0x40, 0x40, 0x00, // i
+    0x20, 0x00, 0x20, 0x20, 0xA0, 0x40, // j
+    0x80, 0xA0, 0xC0, 0xC0, 0xA0, 0x00, // k
+    0xC0, 0x40, 0x40, 0x40, 0xE0, 0x00, // l
+    0x00, 0xE0, 0xE0, 0xE0, 0xA0, 0x00, // m
+    0x00, 0xC0, 0xA0, 0xA0, 0xA0, 0x00, // n
+    0x00, 0x40, 0xA0, 0xA0, 0x40, 0x00, // o
+    0x00, 0xC0, 0xA0, 0xA0, 0xC0, 0x80, // p
+    0x00, 0x60, 0xA0, 0xA0, 0x60, 0x20, // q
+    0x00, 0x60, 0x80, 0x80, 0x80, 0x00, // r
+    0x00, 0x60, 0xC0, 0x60, 0xC0, 0x00, // s
+    0x40, 0xE0, 0x40, 0x40, 0x60, 0x00, // t
+    0x00, 0xA0, 0xA0, 0xA0, 0x60, 0x00, // u
+    0x00, 0xA0, 0xA0, 0x40, 0x40, 0x00, // v
+    0x00, 0xA0, 0xE0, 0xE0, 0xE0, 0x00, // w
+    0x00, 0xA0, 0x40, 0x40, 0xA0, 0x00, // x
+    0x00, 0xA0, 0xA0, 0x60, 0x20, 0xC0, // y
+    0x00, 0xE0, 0x60, 0xC0, 0xE0, 0x00, // z
+    0x60, 0x40, 0xC0, 0x40, 0x60, 0x00, // {
+    0x40, 0x40, 0x40, 0x40, 0x40, 0x00, // |
+    0xC0, 0x40, 0x60, 0x40, 0xC0, 0x00, // }
+    0x00, 0x60, 0xC0, 0x00, 0x00, 0x00, // ~
+};
+
+// font4x6 turned on its side: FONT_WIDTH bytes per char, one per column,
+// with the top row in bit 0. This is what gets shipped to the display
+static uint8_t glyph_columns[FONT_NUM_CHARS][FONT_WIDTH];
+
+void init_font() {
+    for (int ch = 0; ch < FONT_NUM_CHARS; ch++) {
+        const uint8_t *rows = &font4x6[FONT_DATA_OFFSET + ch * FONT_HEIGHT];
+        for (int col = 0; col < FONT_WIDTH; col++) {
+            uint8_t column = 0;
+            for (int row = 0; row < FONT_HEIGHT; row++) {
+                if (rows[row] & (0x80 >> col)) {
+                    column |= 1 << row;
+                }
+            }
+            glyph_columns[ch][col] = column;
+        }
+    }
+}
+
+/*
+ * Rasterize text into one byte per LED column. Only whole characters are
+ * written, so this stops early if max_columns runs out. Anything the font
+ * doesn't have is drawn as a space.
+ * Returns the number of columns written.
+ */
+int font_render_columns(const char *text, int length, uint8_t *columns, int max_columns) {
+    int num_columns = 0;
+    for (int i = 0; i < length && num_columns + FONT_WIDTH <= max_columns; i++) {
+        char ch = text[i];
+        if (ch < FONT_START_CHAR || ch > FONT_END_CHAR) {
+            ch = ' ';
+        }
+
+        memcpy(&columns[num_columns], glyph_columns[ch - FONT_START_CHAR], FONT_WIDTH);
+        num_columns += FONT_WIDTH;
+    }
+
+    return num_columns;
+}
@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "gesture.h"
+
+#define DEBOUNCE_US ((int64_t)GESTURE_DEBOUNCE_MS * 1000)
+#define DOUBLE_PRESS_US ((int64_t)GESTURE_DOUBLE_PRESS_MS * 1000)
+#define LONG_PRESS_US ((int64_t)GESTURE_LONG_PRESS_MS * 1000)
+
+#define NO_DEADLINE (-1)
+
+void gesture_init(gesture_recognizer *recognizer, gesture_handler handler, void *handler_arg) {
+    memset(recognizer, 0, sizeof(gesture_recognizer));
+    recognizer->handler = handler;
+    recognizer->handler_arg = handler_arg;
+}
+
+// Debounced level changed, as of the edge that started it
+static void settle(gesture_recognizer *recognizer) {
+    recognizer->settling = false;
+    recognizer->pressed = recognizer->settling_pressed;
+
+    if (recognizer->pressed) {
+        recognizer->press_start_us = recognizer->settling_since_us;
+        recognizer->long_press_fired = false;
+        return;
+    }
+
+    // The long press already went out while it was held
+    if (recognizer->long_press_fired) {
+        return;
+    }
+
+    recognizer->last_release_us = recognizer->settling_since_us;
+    if (++recognizer->clicks == 2) {
+        recognizer->clicks = 0;
+        recognizer->handler(GESTURE_DOUBLE_PRESS, recognizer->handler_arg);
+    }
+}
+
+/*
+ * Earliest time something happens with no more edges: a level settling, a
+ * hold turning into a long press or a lone press running out of time for its
+ * second. NO_DEADLINE if the recognizer is idle.
+ */
+int64_t gesture_next_deadline_us(const gesture_recognizer *recognizer) {
+    // The edge that started settling came before any timeout still pending
+    // (otherwise the timeout would've fired first), so that has to be
+    // resolved before a timeout can
+    if (recognizer->settling) {
+        return recognizer->settling_since_us + DEBOUNCE_US;
+    }
+
+    if (recognizer->pressed && !recognizer->long_press_fired) {
+        return recognizer->press_start_us + LONG_PRESS_US;
+    }
+
+    if (!recognizer->pressed && recognizer->clicks == 1) {
+        return recognizer->last_release_us + DOUBLE_PRESS_US;
+    }
+
+    return NO_DEADLINE;
+}
+
+// Everything due up to now_us, in the order it came due
+void gesture_advance(gesture_recognizer *recognizer, int64_t now_us) {
+    int64_t deadline;
+    while ((deadline = gesture_next_deadline_us(recognizer)) != NO_DEADLINE && deadline <= now_us) {
+        if (recognizer->settling) {
+            settle(recognizer);
+        } else if (recognizer->pressed) {
+            recognizer->long_press_fired = true;
+            recognizer->clicks = 0;
+            recognizer->handler(GESTURE_LONG_PRESS, recognizer->handler_arg);
+        } else {
+            recognizer->clicks = 0;
+            recognizer->handler(GESTURE_PRESS, recognizer->handler_arg);
+        }
+    }
+}
+
+void gesture_feed_edge(gesture_recognizer *recognizer, const button_edge *edge) {
+    // Whatever came due before this edge happened first
+    gesture_advance(recognizer, edge->time_us);
+
+    if (edge->pressed == recognizer->pressed) {
+        // Bounced back before it settled
+        recognizer->settling = false;
+    } else {
+        recognizer->settling = true;
+        recognizer->settling_pressed = edge->pressed;
+        recognizer->settling_since_us = edge->time_us;
+    }
+}
@@ -1,21 +1,24 @@
 #include "freertos/FreeRTOS.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 
 #include "gpio.h"
-#include "timer.h"
 
-typedef enum {
-    WAITING_FOR_PRESS,
-    DEBOUNCING_PRESS,
-    DEBOUNCING_RELEASE,
-    WAITING_FOR_RELEASE
-} debounce_state;
-
-static volatile debounce_state current_state;
+/*
+ * Edges from the button ISR on their way to the main task. Single producer
+ * (the ISR) and single consumer (the main task), so each index only has one
+ * writer and no lock is needed. Indexes run freely and wrap as uint8_t,
+ * which is why the size has to be a power of two that divides 256.
+ */
+static button_edge edge_ring[GPIO_EDGE_RING_SIZE];
+static volatile uint8_t edge_head;
+static volatile uint8_t edge_tail;
+static volatile uint32_t edges_dropped;
 
 void init_gpio(gpio_isr_t button_isr_handler) {
-    button_pressed = false;
-    current_state = WAITING_FOR_PRESS;
+    edge_head = 0;
+    edge_tail = 0;
+    edges_dropped = 0;
 
     gpio_config_t input_config;
     input_config.intr_type = GPIO_INTR_ANYEDGE;
@@ -29,40 +32,62 @@ void init_gpio(gpio_isr_t button_isr_handler) {
     ESP_ERROR_CHECK(gpio_isr_handler_add(GPIO_BUTTON_PIN, button_isr_handler, (void *)GPIO_BUTTON_PIN));
 }
 
-bool button_was_released() {
-    switch (current_state) {
-        case WAITING_FOR_PRESS:
-            if (button_pressed) {
-                reset_timer();
-                current_state = DEBOUNCING_PRESS;
-            }
-            break;
-        case DEBOUNCING_PRESS:
-            if (timer_expired) {
-                if (button_pressed) {
-                    current_state = WAITING_FOR_RELEASE;
-                } else {
-                    current_state = WAITING_FOR_PRESS;
-                }
-            }
-        break;
-        case WAITING_FOR_RELEASE:
-            if (!button_pressed) {
-                reset_timer();
-                current_state = DEBOUNCING_RELEASE;
-            }
-            break;
-        case DEBOUNCING_RELEASE:
-            if (timer_expired) {
-                if (button_pressed) {
-                    current_state = WAITING_FOR_RELEASE;
-                } else {
-                    current_state = WAITING_FOR_PRESS;
-                    return true;
-                }
-            }
-            break;
+// Call from the button ISR. If the main task is so far behind the ring is
+// full the edge is counted and dropped
+void button_edge_from_isr() {
+    uint8_t head = edge_head;
+    if ((uint8_t)(head - edge_tail) == GPIO_EDGE_RING_SIZE) {
+        edges_dropped++;
+        return;
+    }
+
+    button_edge *edge = &edge_ring[head & (GPIO_EDGE_RING_SIZE - 1)];
+    edge->time_us = esp_timer_get_time();
+    edge->pressed = !gpio_get_level(GPIO_BUTTON_PIN);
+
+    // Edge has to be all there before the main task can see it
+    __sync_synchronize();
+    edge_head = head + 1;
+}
+
+/*
+ * Let a press wake the chip from light sleep. The wakeup only works off a
+ * level, which takes over the pin's interrupt type, so turning it back off
+ * puts the edge interrupt back for the ISR.
+ */
+void button_wakeup_enable(bool enable) {
+    if (enable) {
+        ESP_ERROR_CHECK(gpio_wakeup_enable(GPIO_BUTTON_PIN, GPIO_INTR_LOW_LEVEL));
+    } else {
+        gpio_wakeup_disable(GPIO_BUTTON_PIN);
+        gpio_set_intr_type(GPIO_BUTTON_PIN, GPIO_INTR_ANYEDGE);
+    }
+}
+
+// The edge that woke us came in while the CPU was halted, so the ISR may
+// never have seen it. Record it now if the button's still down
+void button_edge_from_wake() {
+    portENTER_CRITICAL();
+    if (!gpio_get_level(GPIO_BUTTON_PIN)) {
+        button_edge_from_isr();
     }
+    portEXIT_CRITICAL();
+}
+
+// Oldest edge the main task hasn't seen yet. Returns false if there are none
+bool button_edge_pop(button_edge *edge) {
+    uint8_t tail = edge_tail;
+    if (tail == edge_head) {
+        return false;
+    }
+
+    __sync_synchronize();
+    *edge = edge_ring[tail & (GPIO_EDGE_RING_SIZE - 1)];
+    __sync_synchronize();
+    edge_tail = tail + 1;
+    return true;
+}
 
-    return false;
+uint32_t get_button_edges_dropped() {
+    return edges_dropped;
 }
@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+/*
+ * One fixed block, set aside at boot, that everything a request needs only
+ * for that request (the body read chunk, the stream parser or the buffered
+ * response) is bumped out of. Nothing is freed on its own, the whole thing
+ * is reset once each source's list has been copied out, so the heap never
+ * sees those allocations come and go and can't fragment around them.
+ * Only the network task allocates from it.
+ */
+#if STREAM_JSON_RESPONSES
+// A read chunk (STREAM_READ_CHUNK_SIZE in network.c) and a json_stream_parser
+#define ARENA_SIZE 512
+#else
+// A full response (MAX_READ_BUFFER_SIZE in network.c) and a read chunk to
+// make sure a compressed body has nothing after it
+#define ARENA_SIZE (4096 + 256)
+#endif
+
+#define ARENA_ALIGNMENT 8
+
+typedef struct {
+    uint32_t size;
+    uint32_t used;
+    // Most used in any one cycle since boot
+    uint32_t high_water;
+    uint32_t allocs;
+    // Didn't fit, got NULL
+    uint32_t failed_allocs;
+    uint32_t resets;
+} arena_stats;
+
+void init_arena();
+void *arena_alloc(size_t size);
+void arena_reset();
+arena_stats get_arena_stats();
+
+#endif
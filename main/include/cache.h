@@ -0,0 +1,41 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// Only a couple of endpoints get polled, so keep this tiny
+#define CACHE_MAX_ENTRIES 4
+#define CACHE_MAX_URL_LENGTH 96
+#define CACHE_MAX_VALIDATOR_LENGTH 48
+
+// max_age value for a response that didn't say how long it's good for
+#define CACHE_NO_MAX_AGE (-1)
+
+typedef struct {
+    bool in_use;
+    char url[CACHE_MAX_URL_LENGTH];
+    char etag[CACHE_MAX_VALIDATOR_LENGTH];
+    char last_modified[CACHE_MAX_VALIDATOR_LENGTH];
+    bool has_expiry;
+    uint32_t expires_at_ms;
+    uint32_t last_used_ms;
+} cache_entry;
+
+typedef struct {
+    // Served without touching the network since max-age hadn't passed
+    uint32_t fresh_hits;
+    // Server answered our validators with a 304
+    uint32_t revalidated_hits;
+    uint32_t misses;
+} cache_stats;
+
+void init_cache();
+cache_entry *cache_lookup(const char *url);
+bool cache_entry_is_fresh(cache_entry *entry);
+void cache_store(const char *url, const char *etag, const char *last_modified, int max_age_s);
+void cache_refresh(cache_entry *entry, int max_age_s);
+void cache_expire_all();
+void cache_record_fresh_hit();
+void cache_record_revalidated_hit();
+void cache_record_miss();
+cache_stats get_cache_stats();
+
+#endif
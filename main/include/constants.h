@@ -5,21 +5,91 @@
 // false if flashing to large NodeMCU LiLo dev board
 #define ESP_01 true
 
-// Set to true to send requests on button interrupt,
-// false to send periodically every X seconds
+// Set to true to only send requests from the button,
+// false to also send them periodically every X seconds
 #define BUTTON_FOR_REQUESTS false
 
+// Set to true to parse responses as they're read off the socket with no
+// limit on size, false to buffer the whole body (up to 4KB) and parse after.
+// The host build compiles it both ways
+#ifndef STREAM_JSON_RESPONSES
+#define STREAM_JSON_RESPONSES true
+#endif
+
+// Set to true to leave the socket open between requests (HTTP/1.1 keep-alive),
+// false to close it after every response. The host build compiles it both ways
+#ifndef HTTP_KEEP_ALIVE
+#define HTTP_KEEP_ALIVE true
+#endif
+
+// Set to true to ask for gzip/deflate bodies and inflate them on the way into
+// the parser, false to always get them uncompressed. Inflate's buffers take
+// about 5.6KB of static RAM either way, see inflate.h
+#define ACCEPT_COMPRESSED_RESPONSES true
+
+// Set to true to resolve the API host ourselves and keep the address for its
+// TTL (serving it stale while a refresh runs), false to let the http client
+// look it up on every new connection
+#define CACHE_DNS_LOOKUPS true
+
+// Set to true to remember the last AP's BSSID/channel and our IP lease so
+// reconnecting (and waking from deep sleep) skips the scan and DHCP,
+// false to always do a full connect
+#define WIFI_FAST_RECONNECT true
+
+// Set to true to rasterize strings here and send the display one byte per
+// LED column, false to send text and let the display look up the font itself.
+// Columns take 4x the bytes on the link and in the display's RAM. The display
+// holds 256 bytes of list, so that's only about 64 characters across every
+// string, and lists get cut off at that. Not much use until it has more RAM
+#define PRERENDER_GLYPHS false
+
+// Set to true to swap common words in list text for one byte tokens from the
+// dictionary in dict.h, false to send text as is
+#define TOKENIZE_LINK_TEXT true
+
+// Set to true to only send the display the strings that changed since the
+// last list (by index, as inserts/replaces/deletes), false to always resend
+// the whole list. Needs the display's ACKs to know it's still in sync, so has
+// no effect without an RX line or with PRERENDER_GLYPHS. The host build
+// compiles it both ways
+#ifndef DIFF_LIST_UPDATES
+#define DIFF_LIST_UPDATES true
+#endif
+
+// Set to true to keep the last good lists in the SPIFFS partition and show
+// them at boot before wifi is up, false to leave the display blank until the
+// first fetch. Flash is only written when the lists actually change
+#define SAVE_LAST_LISTS true
+
+// What to do with the chip between periodic requests:
+// POWER_MODE_NONE         stay fully awake
+// POWER_MODE_MODEM_SLEEP  keep the CPU running but let the radio sleep through
+//                         POWER_LISTEN_INTERVAL beacons at a time (max modem sleep,
+//                         the SDK's default min modem sleep wakes for every DTIM)
+// POWER_MODE_LIGHT_SLEEP  halt the CPU until just before the next request or a button press
+// POWER_MODE_DEEP_SLEEP   power down completely and reboot for the next request.
+//                         Needs GPIO16 wired to RST to be able to wake up, which
+//                         the ESP-01 doesn't break out, so dev board only
+#define POWER_MODE_NONE 0
+#define POWER_MODE_MODEM_SLEEP 1
+#define POWER_MODE_LIGHT_SLEEP 2
+#define POWER_MODE_DEEP_SLEEP 3
+#ifndef POWER_MODE
+#define POWER_MODE POWER_MODE_MODEM_SLEEP
+#endif
+
 // Logging tag prepended to all serial output from ESP_LOGI
 #define TAG "[tides]"
 
-// Set default minimum level logged to output as WARN if we're on-board to
-// prevent spamming the arduino serial connection with all of the logs
+// Nothing is logged if we're on-board. The display link is on UART0 there
+// too, and log lines landing in the middle of a frame would corrupt it
 #ifndef ESP_01
 #assert "must define ESP_01 as true or false depending on if running on-board or with dev board"
 #endif
 
 #if ESP_01
-#define LOG_LOCAL_LEVEL ESP_LOG_WARN
+#define LOG_LOCAL_LEVEL ESP_LOG_NONE
 #else
 #define LOG_LOCAL_LEVEL ESP_LOG_INFO
 #endif
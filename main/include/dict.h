@@ -0,0 +1,38 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include <stdint.h>
+
+/*
+ * Static dictionary shared with the display for the text in list frames.
+ * Plain text is printable ASCII, so any byte with the top bit set is a token
+ * standing in for word (byte & 0x7F) of DICT_WORDS. The display expands them
+ * as it scrolls and never stores the expanded string.
+ * Must be kept in sync with DICT_WORDS in spot_check_display.h, and only ever
+ * appended to so an older display still reads the tokens it knows.
+ */
+#define DICT_TOKEN_FLAG 0x80
+#define DICT_MAX_WORD_LENGTH 9
+
+#define DICT_WORDS { \
+    " ft", "ft ", "high", "High", "low", "Low", " tide", "tide", \
+    " at ", " am", " pm", ":00", ":15", ":30", ":45", " - ", \
+    "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday", "Today", \
+    "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun", "Tomorrow", \
+    "swell", "Swell", " sec", " from ", "period", "wind", " mph", " kts", \
+    "rising", "falling", "North", "South", "East", "West", "NNW", "WNW", \
+    "WSW", "SSW", "SSE", "ESE", "ENE", "NNE", "NW", "NE", \
+    "SW", "SE", "10", "11", "12", ". ", ", ", "0." \
+}
+
+typedef struct {
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} dict_stats;
+
+void init_dict();
+int dict_encode(const char *text, int length, uint8_t *encoded, int max_length);
+int dict_encoded_length(const char *text, int length, int max_length);
+dict_stats get_dict_stats();
+
+#endif
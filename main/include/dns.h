@@ -0,0 +1,52 @@
+#ifndef DNS_H
+#define DNS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Only the API host ever gets looked up
+#define DNS_CACHE_MAX_ENTRIES 2
+#define DNS_MAX_HOST_LENGTH 64
+
+// Clamp whatever TTL the server hands back
+#define DNS_MIN_TTL_S 30
+#define DNS_MAX_TTL_S (24 * 60 * 60)
+
+// How long past its TTL an entry is still handed out while a refresh runs
+#define DNS_MAX_STALE_S (60 * 60)
+
+#define DNS_PORT 53
+#define DNS_QUERY_TIMEOUT_MS 2000
+#define DNS_MAX_PACKET_SIZE 512
+
+// Set to a dotted quad to send queries somewhere other than the server DHCP
+// gave us (like a local stand-in when testing), empty to use the DHCP one
+#define DNS_SERVER_OVERRIDE ""
+
+typedef struct {
+    bool in_use;
+    char host[DNS_MAX_HOST_LENGTH];
+    uint32_t addr;              // Network byte order, same as ip4_addr_t
+    uint32_t expires_at_ms;
+    bool refreshing;
+} dns_entry;
+
+typedef struct {
+    uint32_t lookups;
+    uint32_t fresh_hits;
+    // Past TTL but handed out anyway while a background refresh runs
+    uint32_t stale_hits;
+    uint32_t misses;
+    uint32_t queries;
+    uint32_t query_failures;
+    uint32_t refreshes;
+    uint64_t query_time_us;
+    uint32_t max_query_us;
+} dns_stats;
+
+void init_dns();
+bool dns_resolve(const char *host, uint32_t *addr);
+void dns_invalidate(const char *host);
+dns_stats get_dns_stats();
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#define EVENT_QUEUE_LENGTH 8
+
+typedef enum {
+    EVENT_TIMER_EXPIRED,
+    EVENT_BUTTON_CHANGED,
+    // Posted by the sleep scheduler when it wakes up for the next request
+    EVENT_REQUEST_DUE,
+    // Button recognizer has a press to decide on with no new edges
+    EVENT_GESTURE_DUE
+} event_type;
+
+typedef struct {
+    // Time the main task spent blocked waiting on the queue vs handling events
+    uint64_t idle_us;
+    uint64_t busy_us;
+    uint32_t events_handled;
+    // ISR couldn't post because the queue was full
+    uint32_t events_dropped;
+} event_stats;
+
+void init_events();
+void post_event(event_type type);
+void post_event_from_isr(event_type type);
+bool wait_for_event(event_type *type, TickType_t timeout);
+event_stats get_event_stats();
+uint8_t get_idle_percent();
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef FONT_H
+#define FONT_H
+
+// Same layout as TVout's font4x6 the display uses: 3 header bytes (width,
+// height, first char) then FONT_HEIGHT row bytes per char, leftmost pixel in bit 7
+#define FONT_WIDTH 4
+#define FONT_HEIGHT 6
+#define FONT_START_CHAR ' '
+#define FONT_END_CHAR '~'
+
+void init_font();
+int font_render_columns(const char *text, int length, uint8_t *columns, int max_columns);
+
+#endif
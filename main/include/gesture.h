@@ -0,0 +1,52 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A level has to hold this long before it counts, anything shorter is bounce
+#define GESTURE_DEBOUNCE_MS 30
+// A second press has to start this soon after the first release to make a double press
+#define GESTURE_DOUBLE_PRESS_MS 350
+// Held this long is a long press, which fires while still held
+#define GESTURE_LONG_PRESS_MS 1500
+
+typedef enum {
+    GESTURE_PRESS,
+    GESTURE_DOUBLE_PRESS,
+    GESTURE_LONG_PRESS
+} gesture_type;
+
+// One raw edge off the button pin, as the ISR saw it
+typedef struct {
+    int64_t time_us;
+    bool pressed;
+} button_edge;
+
+typedef void (*gesture_handler)(gesture_type gesture, void *handler_arg);
+
+/*
+ * Turns raw, bouncy edges into gestures using only the edges' own
+ * timestamps, so edges that sat in a queue for a while are judged on when
+ * they happened rather than when they got looked at. Nothing here touches
+ * hardware or the clock, the caller feeds edges and the current time.
+ */
+typedef struct {
+    bool pressed;               // Debounced level
+    bool settling;              // Raw level differs from pressed, waiting to see if it holds
+    bool settling_pressed;
+    int64_t settling_since_us;
+    int64_t press_start_us;
+    bool long_press_fired;
+    uint8_t clicks;             // Short presses waiting to see if another follows
+    int64_t last_release_us;
+    gesture_handler handler;
+    void *handler_arg;
+} gesture_recognizer;
+
+void gesture_init(gesture_recognizer *recognizer, gesture_handler handler, void *handler_arg);
+void gesture_feed_edge(gesture_recognizer *recognizer, const button_edge *edge);
+void gesture_advance(gesture_recognizer *recognizer, int64_t now_us);
+int64_t gesture_next_deadline_us(const gesture_recognizer *recognizer);
+
+#endif
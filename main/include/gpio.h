@@ -2,6 +2,7 @@
 #define GPIO_H
 
 #include "constants.h"
+#include "gesture.h"
 
 #if ESP_01
 #define GPIO_BUTTON_PIN     2
@@ -12,9 +13,14 @@
 #define GPIO_OUTPUT_PIN_SEL  (1 <<GPIO_ERROR_PIN | 1 << GPIO_SUCCESS_PIN);
 #define GPIO_INPUT_PIN_SEL   (1 << GPIO_BUTTON_PIN)
 
-volatile uint8_t button_pressed;
+// Button edges that can pile up while the main task is busy, power of two
+#define GPIO_EDGE_RING_SIZE 32
 
 void init_gpio();
-bool button_was_released();
+void button_edge_from_isr();
+bool button_edge_pop(button_edge *edge);
+void button_wakeup_enable(bool enable);
+void button_edge_from_wake();
+uint32_t get_button_edges_dropped();
 
 #endif
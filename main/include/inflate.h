@@ -0,0 +1,48 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Back-references can only reach this far. Deflate allows up to 32KB and
+ * most servers compress with the full 32KB, so a body with a match further
+ * back than this is legal, it's just one we can't inflate. That response
+ * comes back as INFLATE_WINDOW_TOO_SMALL and the request is retried
+ * uncompressed. Our responses are only a few KB so it's rare in practice.
+ * Must be a power of 2
+ *
+ * All of inflate's state is static: the window, the input chunk and the two
+ * huffman trees (~600 bytes each) come to about 5.6KB of RAM, whether or
+ * not a compressed response ever shows up.
+ */
+#define INFLATE_WINDOW_SIZE 4096
+#define INFLATE_INPUT_CHUNK_SIZE 256
+
+typedef enum {
+    CONTENT_ENCODING_IDENTITY,
+    CONTENT_ENCODING_GZIP,
+    // Meant to be zlib wrapped, but some servers send it raw so both are taken
+    CONTENT_ENCODING_DEFLATE
+} content_encoding;
+
+typedef enum {
+    INFLATE_OK,
+    // Bad header, bad block, bad checksum, or the input ended too soon
+    INFLATE_DATA_ERROR,
+    // A back-reference reached further than INFLATE_WINDOW_SIZE
+    INFLATE_WINDOW_TOO_SMALL,
+    INFLATE_READ_ERROR,
+    // The write callback asked us to stop
+    INFLATE_WRITE_STOPPED
+} inflate_result;
+
+// Fill buf with up to length compressed bytes. Return how many, 0 at the end of the input, < 0 on error
+typedef int (*inflate_read_fn)(uint8_t *buf, int length, void *arg);
+// Take length decompressed bytes. Return false to stop inflating
+typedef bool (*inflate_write_fn)(const uint8_t *data, int length, void *arg);
+
+inflate_result inflate_stream(content_encoding encoding, inflate_read_fn read, inflate_write_fn write, void *arg);
+const char *inflate_result_name(inflate_result result);
+
+#endif
@@ -1,10 +1,79 @@
 #ifndef JSON_H
 #define JSON_H
 
-#define START_LIST_TRANSMISSION_COMMAND "START_LIST%"
-#define END_LIST_TRANSMISSION_COMMAND "END_LIST%"
+#include <stdint.h>
+#include <stdbool.h>
 
-cJSON* parse_json(char *server_response);
-int send_json_list(cJSON *list_json);
+// Key of the top-level array whose strings get pulled out by the stream parser
+#define JSON_STREAM_LIST_KEY "data"
+
+// Longest single list string we'll hold on to, anything past this is dropped
+#define JSON_STREAM_MAX_STRING_LENGTH 128
+
+// Nesting limit, one bit of array_depths is used per level
+#define JSON_STREAM_MAX_DEPTH 32
+
+// Called once per completed string in the list. value is null terminated
+// and only valid for the duration of the call
+typedef void (*json_stream_value_handler)(char *value, int length, void *handler_arg);
+
+typedef enum {
+    JSON_STREAM_OUTSIDE_STRING,
+    JSON_STREAM_IN_STRING,
+    JSON_STREAM_IN_ESCAPE,
+    JSON_STREAM_IN_UNICODE_ESCAPE,
+    JSON_STREAM_ERROR
+} json_stream_state;
+
+/*
+ * Incremental tokenizer that only understands enough JSON to find the
+ * strings of the top-level `data` array. Nothing is allocated, so memory use
+ * is the size of this struct no matter how large the response is.
+ */
+typedef struct {
+    json_stream_state state;
+    uint8_t depth;
+    // Bit n set if the container at depth n + 1 is an array, clear if object
+    uint32_t array_depths;
+    bool expecting_key;
+    bool key_is_list_key;
+    bool in_list;
+    // The list's closing bracket has been seen
+    bool list_complete;
+    bool capturing_key;
+    bool capturing_value;
+    uint8_t unicode_digits_left;
+    uint16_t unicode_value;
+    char string_buf[JSON_STREAM_MAX_STRING_LENGTH + 1];
+    int string_length;
+    int values_found;
+    int values_truncated;
+    json_stream_value_handler value_handler;
+    void *handler_arg;
+} json_stream_parser;
+
+/*
+ * Cursor over the strings of the top-level `data` array of a fully buffered
+ * response. Strings are unescaped in place and handed back as slices of the
+ * buffer itself, so walking the list doesn't allocate anything.
+ */
+typedef struct {
+    char *cursor;
+    char *end;
+    // Set once the list's closing bracket is reached, so running off the end
+    // of a cut off body can be told apart from the list actually ending
+    bool complete;
+} json_list_iter;
+
+bool json_list_find(json_list_iter *iter, char *buffer, int length);
+bool json_list_next(json_list_iter *iter, char **value, int *length);
+
+void send_list_start();
+void send_list_item(const char *text, int length);
+void send_list_end();
+
+void json_stream_init(json_stream_parser *parser, json_stream_value_handler value_handler, void *handler_arg);
+bool json_stream_feed(json_stream_parser *parser, const char *chunk, int length);
+bool json_stream_complete(const json_stream_parser *parser);
 
 #endif
@@ -0,0 +1,139 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "constants.h"
+
+/*
+ * Framing for the ESP -> display serial link. Every frame is
+ * [SOF] [type] [seq] [length] [payload...] [crc hi] [crc lo]
+ * where the crc is CRC-16/XMODEM over type through the end of the payload.
+ * The display answers each frame with an ACK (or NACK on a bad crc) carrying
+ * the same seq. A frame that arrived fine but can't be applied (a delta
+ * against a list the display doesn't have, a baud it can't do) gets a
+ * REJECT instead, which is never retransmitted and doesn't drop the link.
+ * Must be kept in sync with spot_check_display.h
+ */
+#define LINK_START_OF_FRAME 0x7E
+#define LINK_HEADER_SIZE 4
+#define LINK_CRC_SIZE 2
+#define LINK_MAX_PAYLOAD 128
+
+#define LINK_DEFAULT_BAUD 9600
+// Highest first, the display's SoftwareSerial can't reliably go past these
+#define LINK_BAUD_RATES {57600, 38400, 19200, 9600}
+
+#define LINK_ACK_TIMEOUT_MS 250
+#define LINK_MAX_RETRIES 3
+// After a connect finds no display, frames are dropped without trying again
+// for this long. Each try probes every baud rate, about a second of blocking
+#define LINK_RECONNECT_BACKOFF_MS 30000
+// Pings that all have to make it through at a new baud rate before it's kept
+#define LINK_BAUD_CONFIRM_PINGS 4
+#define LINK_BAUD_PING_SIZE 64
+// Display falls back to its previous baud if it doesn't see a valid frame
+// for this long while confirming a new one
+#define LINK_BAUD_CONFIRM_TIMEOUT_MS 500
+
+// Only a CAPACITY answer carries a payload: [bytes lo] [bytes hi] [max strings]
+#define LINK_MAX_RESPONSE_PAYLOAD 3
+// What a display that doesn't answer CAPACITY (or that we can't hear) is
+// assumed to hold of one list, MSGARENASIZE and MAXMSGS in the sketch
+#define LINK_DEFAULT_CAPACITY_BYTES 256
+#define LINK_DEFAULT_CAPACITY_STRINGS 16
+
+// ESP-01 talks to the display over UART0, which has an RX pin for the ACKs.
+// The dev board uses UART1 which is TX only, so frames are sent blind at the default baud.
+// UART0 is also the console, so sharing it means nothing else can print
+#if ESP_01
+#define LINK_UART UART_NUM_0
+#define LINK_HAS_RX true
+#define LINK_SHARES_CONSOLE true
+#else
+#define LINK_UART UART_NUM_1
+#define LINK_HAS_RX false
+#define LINK_SHARES_CONSOLE false
+#endif
+
+// Only worth it when a REJECT can tell us the display lost track of its list
+#define LINK_SENDS_DELTAS (DIFF_LIST_UPDATES && LINK_HAS_RX && !PRERENDER_GLYPHS)
+
+// Bytes a frame costs on the wire beyond its payload
+#define LINK_FRAME_OVERHEAD (LINK_HEADER_SIZE + LINK_CRC_SIZE)
+
+typedef enum {
+    LINK_FRAME_ACK = 0x01,
+    LINK_FRAME_NACK = 0x02,
+    LINK_FRAME_PING = 0x03,
+    LINK_FRAME_SET_BAUD = 0x04,
+    LINK_FRAME_REJECT = 0x05,
+    // Sent on connect, answered with a CAPACITY frame of its own (same seq)
+    // saying how much of a list the display can hold
+    LINK_FRAME_CAPACITY = 0x06,
+    LINK_FRAME_LIST_START = 0x10,
+    LINK_FRAME_LIST_ITEM = 0x11,
+    LINK_FRAME_LIST_END = 0x12,
+    // Pre-rendered string as column bitmaps. Long strings are split into any
+    // number of LIST_COLUMNS frames followed by one LIST_COLUMNS_END
+    LINK_FRAME_LIST_COLUMNS = 0x13,
+    LINK_FRAME_LIST_COLUMNS_END = 0x14,
+    // Edits to the list the display is already showing, indexes are into the
+    // list as it stands after the previous edit. DELTA_START carries the count
+    // we think the display has so it can REJECT if that's not what it's got
+    LINK_FRAME_DELTA_START = 0x15,      // [old count]
+    LINK_FRAME_DELTA_REPLACE = 0x16,    // [index] [text...]
+    LINK_FRAME_DELTA_INSERT = 0x17,     // [index] [text...]
+    LINK_FRAME_DELTA_DELETE = 0x18,     // [index]
+    LINK_FRAME_DELTA_END = 0x19         // [new count]
+} link_frame_type;
+
+typedef enum {
+    LINK_SENT,
+    // The display got the frame but won't apply it, the link is still fine
+    LINK_REJECTED,
+    // No ACK after every retry, the link's down until the next connect
+    LINK_FAILED
+} link_send_result;
+
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t length;
+    uint8_t payload[LINK_MAX_PAYLOAD];
+} link_frame;
+
+// Room in the display's list, in bytes as they're stored there (dict
+// encoded text, or FONT_WIDTH columns per character when prerendered)
+typedef struct {
+    uint16_t bytes;
+    uint8_t strings;
+} link_capacity;
+
+typedef struct {
+    uint32_t baud_rate;
+    uint32_t frames_sent;
+    uint32_t frames_failed;
+    // Dropped without a try while backing off from a failed connect
+    uint32_t frames_skipped;
+    uint32_t retransmits;
+    uint32_t nacks;
+    uint32_t rejects;
+    uint32_t timeouts;
+    // List data only, framing/acks/retransmits don't count
+    uint32_t payload_bytes;
+    // Time spent in link_send, including waiting for acks
+    uint64_t send_time_us;
+    // Successful link_connect calls. A change means the display may have
+    // reset and anything we assumed it still had is gone
+    uint32_t connects;
+} link_stats;
+
+void init_link();
+bool link_connect();
+bool link_send(link_frame_type type, const uint8_t *payload, uint8_t length);
+link_send_result link_try_send(link_frame_type type, const uint8_t *payload, uint8_t length);
+uint16_t link_crc16(uint16_t crc, const uint8_t *data, int length);
+link_stats get_link_stats();
+link_capacity get_link_capacity();
+uint32_t get_link_bytes_per_sec();
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MESSAGE_LIST_MAX_MESSAGES 16
+#define MESSAGE_LIST_BUFFER_SIZE 1024
+
+/*
+ * A list of display strings packed back to back in one fixed buffer, ends[i]
+ * is where string i stops. Strings aren't null terminated. Whatever doesn't
+ * fit is dropped and counted.
+ */
+typedef struct {
+    char text[MESSAGE_LIST_BUFFER_SIZE];
+    uint16_t ends[MESSAGE_LIST_MAX_MESSAGES];
+    uint16_t used;
+    uint8_t count;
+    uint8_t dropped;
+} message_list;
+
+// Bytes on the wire for list updates, framing included. full_bytes is what
+// the same updates would have cost sent as whole lists
+typedef struct {
+    uint32_t full_updates;
+    uint32_t delta_updates;
+    uint32_t unchanged_updates;
+    // Deltas the display turned down, each followed by a full list
+    uint32_t rejected_deltas;
+    uint32_t bytes_sent;
+    uint32_t full_bytes;
+} list_update_stats;
+
+void message_list_clear(message_list *list);
+bool message_list_add(message_list *list, const char *text, int length);
+const char *message_list_get(const message_list *list, int index, int *length);
+int message_display_bytes(const char *text, int length);
+void message_list_send(const message_list *list);
+void message_list_send_update(const message_list *list);
+list_update_stats get_list_update_stats();
+
+#endif
@@ -1,7 +1,19 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
-#define URL_BASE "http://spotcheck.brianteam.dev/"
+#include "json.h"
+
+#define API_HOST "spotcheck.brianteam.dev"
+#define URL_BASE "http://" API_HOST "/"
+
+// Returned from perform_request/perform_streamed_request when the data from
+// the last response for the same url is still current (fresh cache or 304)
+#define REQUEST_NOT_MODIFIED (-1)
+
+// Returned when a compressed response needed a bigger window than inflate
+// has. Nothing from it is usable, but the next request goes out without
+// Accept-Encoding, so sending the same one again gets it uncompressed
+#define REQUEST_RETRY_UNCOMPRESSED (-2)
 
 typedef struct {
     char* key;
@@ -14,11 +26,33 @@ typedef struct {
     uint8_t num_params;
 } request;
 
+// Counters for how often the kept-alive socket gets reused
+typedef struct {
+    uint32_t requests;
+    uint32_t connections_opened;
+    uint32_t connections_reused;
+    uint32_t stale_reconnects;
+    uint32_t server_closes;
+    // Response bodies as they came over the air and after inflating
+    uint32_t body_bytes_received;
+    uint32_t body_bytes_decoded;
+} connection_stats;
+
+// How each successful wifi connect went
+typedef struct {
+    uint32_t fast_connects;
+    uint32_t full_connects;
+} wifi_connect_stats;
+
 bool http_client_inited;
 
 void init_wifi();
 void init_http();
 int perform_request(request *request_obj, char **read_buffer);
-request build_request(char* endpoint, char *spot, char *days, char *url_buf, query_param *params);
+void perform_request_parsed();
+int perform_streamed_request(request *request_obj, json_stream_parser *parser);
+connection_stats get_connection_stats();
+wifi_connect_stats get_wifi_connect_stats();
+bool build_request(char* endpoint, char *spot, char *days, char *url_buf, int url_buf_length, query_param *params, request *request_out);
 
 #endif
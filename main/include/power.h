@@ -0,0 +1,52 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include "constants.h"
+
+#ifndef POWER_MODE
+#assert "must define POWER_MODE as one of the POWER_MODE_* options"
+#endif
+
+// In these modes the chip is asleep when the hw_timer would fire, so the sleep
+// scheduler decides when requests happen instead
+#define POWER_SCHEDULES_REQUESTS (POWER_MODE == POWER_MODE_LIGHT_SLEEP || POWER_MODE == POWER_MODE_DEEP_SLEEP)
+
+#if POWER_SCHEDULES_REQUESTS && BUTTON_FOR_REQUESTS
+#error "light/deep sleep only work with periodic requests, not the button"
+#endif
+
+// Waking from deep sleep is the RTC pulling GPIO16 low into RST
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP && ESP_01
+#error "the ESP-01 has no GPIO16 pin to wire to RST, so it can never wake from deep sleep"
+#endif
+
+// Beacons the radio sleeps through between listens in max modem sleep.
+// Higher saves more but adds up to this many beacon intervals (~100ms each)
+// to anything the AP has buffered for us
+#define POWER_LISTEN_INTERVAL 3
+
+// Checked against what's in RTC memory to tell a deep sleep wake from a cold boot
+#define POWER_STATE_MAGIC 0x5350544b
+
+// Kept in RTC memory so it survives deep sleep
+typedef struct {
+    uint32_t magic;
+    uint32_t cycles;
+    // Totals across all cycles, used for the duty cycle
+    uint64_t awake_us;
+    uint64_t asleep_us;
+    // From wake until the next request could start (boot + wifi for deep sleep).
+    // Used to wake up this much early so the request still goes out on time
+    uint32_t wake_to_ready_us;
+    // From wake until the data was sent to the display
+    uint32_t wake_to_data_us;
+} power_stats;
+
+void init_power();
+bool power_woke_from_deep_sleep();
+void power_cycle_start();
+void power_sleep_until_next_request();
+power_stats get_power_stats();
+uint8_t get_duty_cycle_percent();
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Every spot gets every endpoint fetched each refresh, in this order, and it
+// all goes to the display as one list
+#define REFRESH_SPOTS {"wedge"}
+#define REFRESH_ENDPOINTS {"tides", "swell"}
+#define REFRESH_DAYS "2"
+
+#define REFRESH_MAX_URL_LENGTH 64
+
+// Parsed sources the output task can be behind by, queued or being sent,
+// before the network task blocks. Each is a whole message_list
+#define REFRESH_QUEUE_DEPTH 2
+// Room for a SPIFFS write too, the output task saves the lists
+#define REFRESH_OUTPUT_STACK_SIZE 3072
+
+/*
+ * How well fetching and sending to the display overlap. overlap_us is time
+ * both were busy at once, so fetch_us + output_us - overlap_us is roughly what
+ * the whole refresh took and overlap_us what the pipeline saved over doing
+ * them one after the other.
+ */
+typedef struct {
+    uint32_t batches;
+    // Sources waiting on the output task, sampled as each one is queued
+    uint32_t queue_depth_total;
+    uint32_t max_queue_depth;
+    // Network task stuck waiting for a free buffer
+    uint64_t producer_wait_us;
+    uint64_t fetch_us;
+    uint64_t output_us;
+    uint64_t overlap_us;
+    // Strings left off the end of a list because the display had no room
+    uint32_t values_capped;
+} pipeline_stats;
+
+void init_refresh();
+void refresh_load_saved(bool show);
+void refresh_all();
+int refresh_wait_done();
+pipeline_stats get_pipeline_stats();
+
+#endif
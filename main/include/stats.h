@@ -0,0 +1,55 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Bucket i counts stage durations under 2^i ms, the last bucket takes everything longer
+#define STATS_HISTOGRAM_BUCKETS 13
+
+// Console command that dumps everything over UART0
+#define STATS_COMMAND "stats"
+#define STATS_COMMAND_MAX_LENGTH 16
+
+typedef enum {
+    STAGE_WIFI_CONNECT,
+    // Socket open through response headers
+    STAGE_HTTP_CONNECT,
+    // Reading the body off the socket, in streaming mode just the reads
+    STAGE_HTTP_BODY,
+    STAGE_RESPONSE_ALLOC,
+    // JSON parsing into the list that goes to the output task
+    STAGE_JSON_PARSE,
+    // One frame out to the display, ACK included
+    STAGE_LINK_SEND,
+    STAGE_REQUEST_CYCLE,
+    // Boot or a wifi reconnect until the next socket opens
+    STAGE_NETWORK_READY,
+    // A DNS query that actually went out, cache hits aren't counted
+    STAGE_DNS_QUERY,
+    // Inflating a compressed body, not counting the reads and parsing around it
+    STAGE_INFLATE,
+    // Boot until the display first has a list, saved or fetched. Only ever once
+    STAGE_FIRST_DISPLAY,
+    STAGE_COUNT
+} stats_stage;
+
+typedef struct {
+    uint16_t buckets[STATS_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} stage_histogram;
+
+typedef struct {
+    int64_t start_us;
+} stats_timer;
+
+void init_stats();
+void stats_timer_start(stats_timer *timer);
+uint32_t stats_timer_elapsed_us(stats_timer *timer);
+void stats_record(stats_stage stage, uint32_t duration_us);
+void stats_sample_heap();
+void stats_dump();
+stage_histogram get_stage_histogram(stats_stage stage);
+
+#endif
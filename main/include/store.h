@@ -0,0 +1,56 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "messages.h"
+
+// SPIFFS partition from partitions.csv and where it's mounted. The host
+// build mounts a directory of its own instead
+#define STORE_PARTITION_LABEL "storage"
+#ifndef STORE_BASE_PATH
+#define STORE_BASE_PATH "/spiffs"
+#endif
+#define STORE_FILE STORE_BASE_PATH "/lists.bin"
+// Records are written here and renamed over STORE_FILE, so losing power
+// part way through a write never leaves us with half a record
+#define STORE_TEMP_FILE STORE_BASE_PATH "/lists.tmp"
+#define STORE_MAX_OPEN_FILES 2
+
+/*
+ * The last good lists, little endian:
+ *   [magic 4] [version 1] [list count 1] [payload length 2]
+ *   per list: [string count 1] [string lengths 2 each] [text]
+ *   [FNV-1a of the payload 4]
+ * A record with any other magic or version is ignored, and the version gets
+ * bumped whenever the layout changes.
+ */
+#define STORE_MAGIC "SCLK"
+#define STORE_MAGIC_LENGTH 4
+#define STORE_VERSION 1
+#define STORE_HEADER_SIZE (STORE_MAGIC_LENGTH + 1 + 1 + 2)
+#define STORE_TRAILER_SIZE 4
+
+typedef struct {
+    bool mounted;
+    // A good record was there at boot
+    bool loaded;
+    uint32_t saves;
+    // Saves that actually went to flash, the rest matched what was there
+    uint32_t writes;
+    uint32_t unchanged;
+    uint32_t failed_writes;
+    uint32_t bytes_written;
+    // Size of the current record
+    uint32_t record_bytes;
+    // Mounting and reading the record at boot
+    uint32_t load_us;
+} store_stats;
+
+void init_store();
+bool store_load(message_list *lists, int num_lists);
+bool store_save(const message_list *lists, int num_lists);
+store_stats get_store_stats();
+
+#endif
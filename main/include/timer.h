@@ -3,29 +3,56 @@
 
 #include "constants.h"
 
-#define RELOAD_ON_EXPIRATION true
-
 #ifndef BUTTON_FOR_REQUESTS
 #assert "Need to define BUTTON_FOR_REQUESTS as true or false to send request on button press (true) or timer periodically (false)"
 #endif
 
-#if BUTTON_FOR_REQUESTS
-#define TIMER_PERIOD_MS (100)
-#else
-#define TIMER_PERIOD_MS (1000)
-#endif
-
-// Used for debouncing
-volatile bool timer_expired;
+// How often to send requests when not using the button
+#define REQUEST_PERIOD_MS (4000)
+
+/*
+ * Any number of software timers share the one hw_timer through a hashed
+ * timing wheel. Time is cut into TIMER_TICK_MS ticks and a timer sits in slot
+ * (expiry tick % TIMER_WHEEL_SIZE), so deadlines further out than one lap
+ * just wait in their slot for the right lap to come around. The hw_timer runs
+ * one-shot and is only ever loaded for the next slot that has anything in it.
+ */
+#define TIMER_TICK_MS 10
+// Power of two, and one lap (640ms) has to fit in a single hw_timer load
+#define TIMER_WHEEL_SIZE 64
+// Longest the hw_timer can be loaded for at TIMER_CLKDIV_16
+#define TIMER_MAX_HW_DELAY_US 0x199999
+
+// Called from the hw_timer interrupt, so keep it short and ISR safe
+// (post_event_from_isr and the like). Can start or cancel timers
+typedef void (*soft_timer_callback)(void *callback_arg);
+
+// Owned by the caller and must stay put while armed, nothing is allocated
+typedef struct soft_timer {
+    struct soft_timer *next;
+    struct soft_timer *prev;
+    uint32_t expiry_tick;
+    uint32_t period_ticks;      // 0 for one-shot
+    bool armed;
+    soft_timer_callback callback;
+    void *callback_arg;
+} soft_timer;
+
+typedef struct {
+    uint32_t hw_loads;
+    // hw_timer interrupts, and how many of those found nothing due yet
+    // (a slot only holding timers for a later lap)
+    uint32_t wakeups;
+    uint32_t empty_wakeups;
+    uint32_t expirations;
+    // Time spent in the interrupt, for the average and the worst
+    uint64_t wakeup_us;
+    uint32_t max_wakeup_us;
+} timer_stats;
 
-// Used for debugging to send requests periodically
-volatile int timer_count;
-
-// Does NOT start timer, must use reset_timer to start count
 void init_timer();
-
-// Reset timer and begin counting up to period again.
-// Clears interrupt flag as well
-void reset_timer();
+void timer_start(soft_timer *timer, uint32_t delay_ms, uint32_t period_ms, soft_timer_callback callback, void *callback_arg);
+void timer_cancel(soft_timer *timer);
+timer_stats get_timer_stats();
 
 #endif
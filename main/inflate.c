@@ -0,0 +1,505 @@
+#include <string.h>
+
+#include "inflate.h"
+
+/*
+ * Streaming inflate for gzip and zlib/raw deflate bodies. Compressed bytes
+ * are pulled through the read callback as they're needed, and output goes
+ * to the write callback a window at a time, so the only memory used no
+ * matter how big the body is is the window, the input chunk and the
+ * Huffman tables. Decoding goes a bit at a time which is slow next to a
+ * table driven decoder, but it's still far quicker than the radio.
+ */
+
+#define WINDOW_MASK (INFLATE_WINDOW_SIZE - 1)
+#define MAX_CODE_LENGTH 15
+#define NUM_LITERAL_LENGTH_CODES 288
+#define NUM_DISTANCE_CODES 30
+#define NUM_CODE_LENGTH_CODES 19
+#define END_OF_BLOCK 256
+
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+typedef struct {
+    // Number of codes of each length, then the symbols ordered by code
+    uint16_t counts[MAX_CODE_LENGTH + 1];
+    uint16_t symbols[NUM_LITERAL_LENGTH_CODES];
+} huffman_tree;
+
+static const uint16_t length_base[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra_bits[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distance_base[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distance_extra_bits[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// Order the code length code lengths come in for a dynamic block
+static const uint8_t code_length_order[NUM_CODE_LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Only one body is ever inflated at a time, so all the state is static
+static inflate_read_fn read_input;
+static inflate_write_fn write_output;
+static void *callback_arg;
+static inflate_result status;
+static content_encoding current_encoding;
+
+static uint8_t input[INFLATE_INPUT_CHUNK_SIZE];
+static int input_length;
+static int input_pos;
+static uint32_t bit_buffer;
+static int bit_count;
+
+static uint8_t window[INFLATE_WINDOW_SIZE];
+static uint32_t total_out;
+static uint32_t flushed_out;
+
+static huffman_tree literal_tree;
+static huffman_tree distance_tree;
+
+// Running checksums for the gzip or zlib trailer
+static uint32_t crc32;
+static uint32_t adler_a;
+static uint32_t adler_b;
+
+static void fail(inflate_result result) {
+    if (status == INFLATE_OK) {
+        status = result;
+    }
+}
+
+static bool fill_input() {
+    int length = read_input(input, INFLATE_INPUT_CHUNK_SIZE, callback_arg);
+    if (length <= 0) {
+        fail(length < 0 ? INFLATE_READ_ERROR : INFLATE_DATA_ERROR);
+        return false;
+    }
+
+    input_length = length;
+    input_pos = 0;
+    return true;
+}
+
+// Past the end of the input (or after any failure) this returns zeros,
+// callers check status once they're done with a symbol or header
+static uint8_t read_byte() {
+    if (input_pos == input_length && !fill_input()) {
+        return 0;
+    }
+
+    return input[input_pos++];
+}
+
+static uint32_t read_bits(int num_bits) {
+    while (bit_count < num_bits) {
+        bit_buffer |= (uint32_t)read_byte() << bit_count;
+        bit_count += 8;
+    }
+
+    uint32_t value = bit_buffer & ((1UL << num_bits) - 1);
+    bit_buffer >>= num_bits;
+    bit_count -= num_bits;
+    return value;
+}
+
+// Byte aligned reads for headers and trailers, the rest of a partly used byte is dropped
+static uint32_t read_le(int num_bytes) {
+    bit_buffer >>= bit_count & 7;
+    bit_count -= bit_count & 7;
+
+    uint32_t value = 0;
+    for (int i = 0; i < num_bytes; i++) {
+        value |= read_bits(8) << (i * 8);
+    }
+
+    return value;
+}
+
+static uint32_t read_be(int num_bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < num_bytes; i++) {
+        value = (value << 8) | read_le(1);
+    }
+
+    return value;
+}
+
+// 4 bits at a time off a 16 entry table, small and quick enough
+static void update_crc32(const uint8_t *data, int length) {
+    static const uint32_t nibble_table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    uint32_t crc = ~crc32;
+    for (int i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ nibble_table[crc & 0x0F];
+    }
+    crc32 = ~crc;
+}
+
+static void update_adler32(const uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) {
+        adler_a = (adler_a + data[i]) % 65521;
+        adler_b = (adler_b + adler_a) % 65521;
+    }
+}
+
+// Hand everything written since the last flush to the callback
+static void flush_window() {
+    uint32_t length = total_out - flushed_out;
+    if (length == 0 || status != INFLATE_OK) {
+        return;
+    }
+
+    const uint8_t *start = &window[flushed_out & WINDOW_MASK];
+    if (current_encoding == CONTENT_ENCODING_GZIP) {
+        update_crc32(start, length);
+    } else {
+        update_adler32(start, length);
+    }
+    flushed_out = total_out;
+    if (!write_output(start, length, callback_arg)) {
+        fail(INFLATE_WRITE_STOPPED);
+    }
+}
+
+static void put_byte(uint8_t byte) {
+    window[total_out & WINDOW_MASK] = byte;
+    total_out++;
+
+    // Flushing each time the window wraps keeps every flush one contiguous run
+    if ((total_out & WINDOW_MASK) == 0) {
+        flush_window();
+    }
+}
+
+static bool build_tree(huffman_tree *tree, const uint8_t *lengths, int num_symbols) {
+    uint16_t offsets[MAX_CODE_LENGTH + 1];
+    memset(tree->counts, 0, sizeof(tree->counts));
+    for (int i = 0; i < num_symbols; i++) {
+        tree->counts[lengths[i]]++;
+    }
+    tree->counts[0] = 0;
+
+    // More codes of a length than there's room for means a corrupt stream
+    int codes_left = 1;
+    for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+        codes_left = (codes_left << 1) - tree->counts[length];
+        if (codes_left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t sum = 0;
+    for (int length = 0; length <= MAX_CODE_LENGTH; length++) {
+        offsets[length] = sum;
+        sum += tree->counts[length];
+    }
+
+    for (int i = 0; i < num_symbols; i++) {
+        if (lengths[i]) {
+            tree->symbols[offsets[lengths[i]]++] = i;
+        }
+    }
+
+    return true;
+}
+
+// Walk the canonical code one bit at a time. Returns -1 on a code that isn't in the tree
+static int decode_symbol(huffman_tree *tree) {
+    int first_index = 0;
+    int code = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+        code = (code << 1) | read_bits(1);
+        int count = tree->counts[length];
+        if (code < count) {
+            return tree->symbols[first_index + code];
+        }
+
+        first_index += count;
+        code -= count;
+    }
+
+    return -1;
+}
+
+static void build_fixed_trees() {
+    uint8_t lengths[NUM_LITERAL_LENGTH_CODES];
+    memset(lengths, 8, 144);
+    memset(&lengths[144], 9, 112);
+    memset(&lengths[256], 7, 24);
+    memset(&lengths[280], 8, 8);
+    build_tree(&literal_tree, lengths, NUM_LITERAL_LENGTH_CODES);
+
+    memset(lengths, 5, NUM_DISTANCE_CODES);
+    build_tree(&distance_tree, lengths, NUM_DISTANCE_CODES);
+}
+
+static bool build_dynamic_trees() {
+    uint8_t lengths[NUM_LITERAL_LENGTH_CODES + NUM_DISTANCE_CODES + 2];
+    int num_literal_codes = read_bits(5) + 257;
+    int num_distance_codes = read_bits(5) + 1;
+    int num_code_length_codes = read_bits(4) + 4;
+    if (num_literal_codes > NUM_LITERAL_LENGTH_CODES - 2 || num_distance_codes > NUM_DISTANCE_CODES) {
+        return false;
+    }
+
+    // First a little tree that encodes the lengths of the two real ones
+    memset(lengths, 0, NUM_CODE_LENGTH_CODES);
+    for (int i = 0; i < num_code_length_codes; i++) {
+        lengths[code_length_order[i]] = read_bits(3);
+    }
+    if (!build_tree(&literal_tree, lengths, NUM_CODE_LENGTH_CODES)) {
+        return false;
+    }
+
+    int total_codes = num_literal_codes + num_distance_codes;
+    int num_lengths = 0;
+    while (num_lengths < total_codes) {
+        int symbol = decode_symbol(&literal_tree);
+        if (symbol < 0 || status != INFLATE_OK) {
+            return false;
+        }
+
+        if (symbol < 16) {
+            lengths[num_lengths++] = symbol;
+            continue;
+        }
+
+        uint8_t repeat_length = 0;
+        int repeat_count;
+        if (symbol == 16) {
+            if (num_lengths == 0) {
+                return false;
+            }
+            repeat_length = lengths[num_lengths - 1];
+            repeat_count = 3 + read_bits(2);
+        } else if (symbol == 17) {
+            repeat_count = 3 + read_bits(3);
+        } else {
+            repeat_count = 11 + read_bits(7);
+        }
+
+        if (num_lengths + repeat_count > total_codes) {
+            return false;
+        }
+        memset(&lengths[num_lengths], repeat_length, repeat_count);
+        num_lengths += repeat_count;
+    }
+
+    // A block with no end of block code could never finish
+    if (lengths[END_OF_BLOCK] == 0) {
+        return false;
+    }
+
+    return build_tree(&literal_tree, lengths, num_literal_codes)
+        && build_tree(&distance_tree, &lengths[num_literal_codes], num_distance_codes);
+}
+
+static void inflate_huffman_block() {
+    while (status == INFLATE_OK) {
+        int symbol = decode_symbol(&literal_tree);
+        if (symbol < 0) {
+            fail(INFLATE_DATA_ERROR);
+            return;
+        }
+
+        if (symbol < END_OF_BLOCK) {
+            put_byte(symbol);
+            continue;
+        } else if (symbol == END_OF_BLOCK) {
+            return;
+        }
+
+        // Length's extra bits come before the distance code
+        symbol -= END_OF_BLOCK + 1;
+        if (symbol >= (int)sizeof(length_base) / (int)sizeof(length_base[0])) {
+            fail(INFLATE_DATA_ERROR);
+            return;
+        }
+        int length = length_base[symbol] + read_bits(length_extra_bits[symbol]);
+
+        int distance_symbol = decode_symbol(&distance_tree);
+        if (distance_symbol < 0 || distance_symbol >= NUM_DISTANCE_CODES) {
+            fail(INFLATE_DATA_ERROR);
+            return;
+        }
+        uint32_t distance = distance_base[distance_symbol] + read_bits(distance_extra_bits[distance_symbol]);
+        if (distance > INFLATE_WINDOW_SIZE) {
+            fail(INFLATE_WINDOW_TOO_SMALL);
+            return;
+        } else if (distance > total_out) {
+            fail(INFLATE_DATA_ERROR);
+            return;
+        }
+
+        // Byte at a time since the match can overlap what it's writing
+        for (int i = 0; i < length; i++) {
+            put_byte(window[(total_out - distance) & WINDOW_MASK]);
+        }
+    }
+}
+
+static void inflate_stored_block() {
+    uint32_t length = read_le(2);
+    uint32_t inverted_length = read_le(2);
+    if ((length ^ 0xFFFF) != inverted_length) {
+        fail(INFLATE_DATA_ERROR);
+        return;
+    }
+
+    while (length-- && status == INFLATE_OK) {
+        put_byte(read_le(1));
+    }
+}
+
+static void inflate_blocks() {
+    bool final_block = false;
+    while (!final_block && status == INFLATE_OK) {
+        final_block = read_bits(1);
+        switch (read_bits(2)) {
+            case 0:
+                inflate_stored_block();
+                break;
+            case 1:
+                build_fixed_trees();
+                inflate_huffman_block();
+                break;
+            case 2:
+                if (build_dynamic_trees()) {
+                    inflate_huffman_block();
+                } else {
+                    fail(INFLATE_DATA_ERROR);
+                }
+                break;
+            default:
+                fail(INFLATE_DATA_ERROR);
+                break;
+        }
+    }
+
+    flush_window();
+}
+
+static void inflate_gzip() {
+    if (read_le(1) != 0x1F || read_le(1) != 0x8B || read_le(1) != 8) {
+        fail(INFLATE_DATA_ERROR);
+        return;
+    }
+
+    // Skip mtime, extra flags and OS
+    uint8_t flags = read_le(1);
+    read_le(4);
+    read_le(2);
+
+    if (flags & GZIP_FLAG_EXTRA) {
+        for (uint32_t extra_length = read_le(2); extra_length > 0 && status == INFLATE_OK; extra_length--) {
+            read_le(1);
+        }
+    }
+    if (flags & GZIP_FLAG_NAME) {
+        while (read_le(1) != 0 && status == INFLATE_OK);
+    }
+    if (flags & GZIP_FLAG_COMMENT) {
+        while (read_le(1) != 0 && status == INFLATE_OK);
+    }
+    if (flags & GZIP_FLAG_HCRC) {
+        read_le(2);
+    }
+
+    inflate_blocks();
+    if (status == INFLATE_OK && (read_le(4) != crc32 || read_le(4) != total_out)) {
+        fail(INFLATE_DATA_ERROR);
+    }
+}
+
+static void inflate_zlib_or_raw() {
+    // Look at the first two bytes without using them up to tell if there's a zlib header
+    if (!fill_input() || input_length < 2) {
+        fail(INFLATE_DATA_ERROR);
+        return;
+    }
+
+    uint8_t method = input[0];
+    uint8_t flags = input[1];
+    bool zlib_wrapped = (method & 0x0F) == 8 && ((method << 8) | flags) % 31 == 0;
+    if (!zlib_wrapped) {
+        inflate_blocks();
+        return;
+    }
+
+    // A preset dictionary is never used for http bodies
+    input_pos = 2;
+    if (flags & 0x20) {
+        fail(INFLATE_DATA_ERROR);
+        return;
+    }
+
+    inflate_blocks();
+    if (status == INFLATE_OK && read_be(4) != ((adler_b << 16) | adler_a)) {
+        fail(INFLATE_DATA_ERROR);
+    }
+}
+
+/*
+ * Inflate a whole gzip or deflate body, pulling it through read and pushing
+ * the output through write. Blocks until the body is done or something goes
+ * wrong. Output already written before a failure stays written.
+ */
+inflate_result inflate_stream(content_encoding encoding, inflate_read_fn read, inflate_write_fn write, void *arg) {
+    read_input = read;
+    write_output = write;
+    callback_arg = arg;
+    current_encoding = encoding;
+    status = INFLATE_OK;
+    input_length = 0;
+    input_pos = 0;
+    bit_buffer = 0;
+    bit_count = 0;
+    total_out = 0;
+    flushed_out = 0;
+    crc32 = 0;
+    adler_a = 1;
+    adler_b = 0;
+
+    if (encoding == CONTENT_ENCODING_GZIP) {
+        inflate_gzip();
+    } else {
+        inflate_zlib_or_raw();
+    }
+
+    return status;
+}
+
+const char *inflate_result_name(inflate_result result) {
+    switch (result) {
+        case INFLATE_OK:
+            return "ok";
+        case INFLATE_DATA_ERROR:
+            return "data error";
+        case INFLATE_WINDOW_TOO_SMALL:
+            return "window too small";
+        case INFLATE_READ_ERROR:
+            return "read error";
+        case INFLATE_WRITE_STOPPED:
+            return "write stopped";
+    }
+
+    return "unknown";
+}
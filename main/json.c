@@ -1,73 +1,462 @@
+#include <string.h>
 #include "freertos/FreeRTOS.h"
-#include "cJSON.h"
 
 #include "constants.h"
 #include "json.h"
+#include "link.h"
+#include "font.h"
+#include "dict.h"
 
 // Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
 #include "esp_log.h"
 
-cJSON* parse_json(char *server_response) {
-    cJSON *json = cJSON_Parse(server_response);
-    if (json == NULL) {
-        const char *err_ptr = cJSON_GetErrorPtr();
-        if (err_ptr) {
-            ESP_LOGI(TAG, "JSON parsing err: %s\n", err_ptr);
+void send_list_start() {
+    // Tell the display we're about to start sending a list of strings to display
+    if (!link_send(LINK_FRAME_LIST_START, NULL, 0)) {
+        ESP_LOGI(TAG, "Display didn't ack list start");
+    }
+}
+
+#if PRERENDER_GLYPHS
+// Rasterized columns for the frame being sent, FONT_WIDTH per character
+static uint8_t column_payload[LINK_MAX_PAYLOAD];
+
+static void send_list_item_columns(const char *text, int length) {
+    int chars_per_frame = LINK_MAX_PAYLOAD / FONT_WIDTH;
+    int offset = 0;
+    do {
+        int chunk_length = length - offset < chars_per_frame ? length - offset : chars_per_frame;
+        int num_columns = font_render_columns(&text[offset], chunk_length, column_payload, LINK_MAX_PAYLOAD);
+        offset += chunk_length;
+
+        link_frame_type type = offset < length ? LINK_FRAME_LIST_COLUMNS : LINK_FRAME_LIST_COLUMNS_END;
+        if (!link_send(type, column_payload, num_columns)) {
+            ESP_LOGI(TAG, "Display didn't ack columns for: %.*s", length, text);
+            return;
         }
+    } while (offset < length);
+}
+#endif
+
+void send_list_item(const char *text, int length) {
+#if PRERENDER_GLYPHS
+    // Display only has to shift these into its framebuffer, no font lookups
+    send_list_item_columns(text, length);
+#else
+    // Each string is its own frame, which the display appends to its list
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    int payload_length = dict_encode(text, length, payload, LINK_MAX_PAYLOAD);
+    if (payload_length == LINK_MAX_PAYLOAD && length > LINK_MAX_PAYLOAD) {
+        ESP_LOGI(TAG, "String may be truncated to fit in a frame: %.*s", length, text);
+    }
+
+    if (!link_send(LINK_FRAME_LIST_ITEM, payload, payload_length)) {
+        ESP_LOGI(TAG, "Display didn't ack string: %.*s", length, text);
+    }
+#endif
+}
+
+void send_list_end() {
+    // Display knows it can stop collecting strings and show what it's stored
+    if (!link_send(LINK_FRAME_LIST_END, NULL, 0)) {
+        ESP_LOGI(TAG, "Display didn't ack list end");
     }
 
-    return json;
+    ESP_LOGI(TAG, "Link at %d baud, %d bytes/sec", get_link_stats().baud_rate, get_link_bytes_per_sec());
+}
+
+void json_stream_init(json_stream_parser *parser, json_stream_value_handler value_handler, void *handler_arg) {
+    memset(parser, 0, sizeof(json_stream_parser));
+    parser->state = JSON_STREAM_OUTSIDE_STRING;
+    parser->value_handler = value_handler;
+    parser->handler_arg = handler_arg;
+}
+
+static bool json_stream_in_object(json_stream_parser *parser) {
+    return parser->depth > 0 && !(parser->array_depths & (1UL << (parser->depth - 1)));
+}
+
+static void json_stream_append(json_stream_parser *parser, char c) {
+    if (!parser->capturing_key && !parser->capturing_value) {
+        return;
+    }
+
+    if (parser->string_length < JSON_STREAM_MAX_STRING_LENGTH) {
+        parser->string_buf[parser->string_length++] = c;
+    } else if (parser->string_length == JSON_STREAM_MAX_STRING_LENGTH) {
+        // Bump one past the max so we only count each truncated string once
+        parser->string_length++;
+        parser->values_truncated++;
+    }
+}
+
+static void json_stream_end_string(json_stream_parser *parser) {
+    int length = parser->string_length > JSON_STREAM_MAX_STRING_LENGTH
+        ? JSON_STREAM_MAX_STRING_LENGTH
+        : parser->string_length;
+
+    if (parser->capturing_key) {
+        parser->key_is_list_key = length == sizeof(JSON_STREAM_LIST_KEY) - 1
+            && memcmp(parser->string_buf, JSON_STREAM_LIST_KEY, length) == 0;
+    } else if (parser->capturing_value) {
+        parser->string_buf[length] = '\0';
+        parser->values_found++;
+        if (parser->value_handler) {
+            parser->value_handler(parser->string_buf, length, parser->handler_arg);
+        }
+    }
+
+    parser->capturing_key = false;
+    parser->capturing_value = false;
+    parser->state = JSON_STREAM_OUTSIDE_STRING;
+}
+
+static void json_stream_structural(json_stream_parser *parser, char c) {
+    switch (c) {
+        case '{':
+        case '[':
+            if (parser->depth >= JSON_STREAM_MAX_DEPTH) {
+                ESP_LOGI(TAG, "JSON stream nested too deep, giving up");
+                parser->state = JSON_STREAM_ERROR;
+                return;
+            }
+
+            // Only an array directly under the top-level list key is the one we want
+            if (c == '[' && parser->depth == 1 && parser->key_is_list_key) {
+                parser->in_list = true;
+            }
+
+            parser->depth++;
+            if (c == '[') {
+                parser->array_depths |= (1UL << (parser->depth - 1));
+            } else {
+                parser->array_depths &= ~(1UL << (parser->depth - 1));
+            }
+            parser->expecting_key = c == '{';
+            break;
+        case '}':
+        case ']':
+            if (parser->depth == 0) {
+                parser->state = JSON_STREAM_ERROR;
+                return;
+            }
+
+            parser->depth--;
+            if (parser->depth == 1) {
+                parser->list_complete = parser->list_complete || parser->in_list;
+                parser->in_list = false;
+                parser->key_is_list_key = false;
+            }
+            parser->expecting_key = false;
+            break;
+        case ':':
+            parser->expecting_key = false;
+            break;
+        case ',':
+            parser->expecting_key = json_stream_in_object(parser);
+            if (parser->depth == 1) {
+                parser->key_is_list_key = false;
+            }
+            break;
+        case '"':
+            parser->string_length = 0;
+            parser->capturing_key = parser->depth == 1 && parser->expecting_key && json_stream_in_object(parser);
+            parser->capturing_value = parser->in_list && parser->depth == 2;
+            parser->state = JSON_STREAM_IN_STRING;
+            break;
+        default:
+            // Whitespace, numbers, true/false/null. None of it matters to us
+            break;
+    }
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
 }
 
 /*
- * Takes in a cJSON pointer pointing to a json list object.
- * This will be sent serially using the command format of
- * [start command], [data]$, [data]$, [end command]
- * For example:
- * START_LIST%
- * This is a tide string$
- * This is another tide string$
- * .....
- * END_LIST%
+ * Feed the next chunk of the response body through the parser. Chunks can be
+ * split anywhere, including in the middle of an escape sequence. Every
+ * completed string from the list is handed to the value handler as soon as
+ * its closing quote arrives.
+ * Returns false if the stream is malformed, after which further feeds are ignored.
  */
-int send_json_list(cJSON *list_json) {
-    int num_sent = 0;
+bool json_stream_feed(json_stream_parser *parser, const char *chunk, int length) {
+    for (int i = 0; i < length && parser->state != JSON_STREAM_ERROR; i++) {
+        char c = chunk[i];
+        switch (parser->state) {
+            case JSON_STREAM_OUTSIDE_STRING:
+                json_stream_structural(parser, c);
+                break;
+            case JSON_STREAM_IN_STRING:
+                if (c == '\\') {
+                    parser->state = JSON_STREAM_IN_ESCAPE;
+                } else if (c == '"') {
+                    json_stream_end_string(parser);
+                } else {
+                    json_stream_append(parser, c);
+                }
+                break;
+            case JSON_STREAM_IN_ESCAPE:
+                parser->state = JSON_STREAM_IN_STRING;
+                switch (c) {
+                    case 'n': json_stream_append(parser, '\n'); break;
+                    case 't': json_stream_append(parser, '\t'); break;
+                    case 'r': json_stream_append(parser, '\r'); break;
+                    case 'b': json_stream_append(parser, '\b'); break;
+                    case 'f': json_stream_append(parser, '\f'); break;
+                    case 'u':
+                        parser->unicode_digits_left = 4;
+                        parser->unicode_value = 0;
+                        parser->state = JSON_STREAM_IN_UNICODE_ESCAPE;
+                        break;
+                    default:
+                        // Covers \" \\ and \/
+                        json_stream_append(parser, c);
+                        break;
+                }
+                break;
+            case JSON_STREAM_IN_UNICODE_ESCAPE: {
+                int digit = hex_value(c);
+                if (digit < 0) {
+                    parser->state = JSON_STREAM_ERROR;
+                    break;
+                }
 
-    // Write our command to signal to the arduino we're about to start
-    // sending a list of strings to display
-#if ESP_01
-    printf("%s\n", START_LIST_TRANSMISSION_COMMAND);
-#else
-    uart_write_bytes(UART_NUM_1, START_LIST_TRANSMISSION_COMMAND, sizeof(START_LIST_TRANSMISSION_COMMAND) - 1);
-    ESP_LOGI(TAG, "Sending string: %s\n", START_LIST_TRANSMISSION_COMMAND);
-#endif
+                parser->unicode_value = (parser->unicode_value << 4) | digit;
+                if (--parser->unicode_digits_left == 0) {
+                    // Display font is ascii only, anything else becomes a placeholder
+                    json_stream_append(parser, parser->unicode_value < 0x80 ? (char)parser->unicode_value : '?');
+                    parser->state = JSON_STREAM_IN_STRING;
+                }
+                break;
+            }
+            case JSON_STREAM_ERROR:
+                break;
+        }
+    }
 
-    cJSON *data_list_value = NULL;
-    cJSON_ArrayForEach(data_list_value, list_json) {
-        char *text = cJSON_GetStringValue(data_list_value);
+    return parser->state != JSON_STREAM_ERROR;
+}
 
-        // Write string and '$' terminator to tell arduino to store everything
-        // received so far as a new array element
-#if ESP_01
-        printf("%s$\n", text);
-#else
-        uart_write_bytes(UART_NUM_1, (const char *)text, strlen(text));
-        uart_write_bytes(UART_NUM_1, "$", 1);
-        ESP_LOGI(TAG, text);
-#endif
-        cJSON_free(text);
-        num_sent++;
+/*
+ * True once everything fed so far makes up a whole document with the list
+ * in it, closed. Anything else (cut off, malformed, no list at all) means
+ * whatever the value handler was given can't be trusted to be the full list.
+ */
+bool json_stream_complete(const json_stream_parser *parser) {
+    return parser->state == JSON_STREAM_OUTSIDE_STRING && parser->depth == 0 && parser->list_complete;
+}
+
+static char *skip_whitespace(char *cursor, char *end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')) {
+        cursor++;
     }
 
-    // Arduino knows it can stop looking for '$' terminated strings and
-    // display what it's stored in its array
-#if ESP_01
-    printf("%s\n", END_LIST_TRANSMISSION_COMMAND);
-#else
-    uart_write_bytes(UART_NUM_1, END_LIST_TRANSMISSION_COMMAND, sizeof(END_LIST_TRANSMISSION_COMMAND) - 1);
-    ESP_LOGI(TAG, "Sending string: %s\n", END_LIST_TRANSMISSION_COMMAND);
-#endif
+    return cursor;
+}
+
+/*
+ * Cursor must point at the opening quote. Unescapes the string over top of
+ * itself (output is never longer than input) and null terminates it where
+ * the unescaped text ends. Returns a pointer just past the closing quote,
+ * or NULL if the string runs off the end of the buffer or is malformed.
+ */
+static char *unescape_string_in_place(char *cursor, char *end, char **value, int *length) {
+    char *read = cursor + 1;
+    char *write = read;
+    *value = read;
 
+    while (read < end && *read != '"') {
+        char c = *read++;
+        if (c != '\\') {
+            *write++ = c;
+            continue;
+        }
+
+        if (read >= end) {
+            return NULL;
+        }
+
+        c = *read++;
+        switch (c) {
+            case 'n': *write++ = '\n'; break;
+            case 't': *write++ = '\t'; break;
+            case 'r': *write++ = '\r'; break;
+            case 'b': *write++ = '\b'; break;
+            case 'f': *write++ = '\f'; break;
+            case 'u': {
+                if (end - read < 4) {
+                    return NULL;
+                }
+
+                uint16_t unicode_value = 0;
+                for (int i = 0; i < 4; i++) {
+                    int digit = hex_value(*read++);
+                    if (digit < 0) {
+                        return NULL;
+                    }
+                    unicode_value = (unicode_value << 4) | digit;
+                }
+
+                // Display font is ascii only, anything else becomes a placeholder
+                *write++ = unicode_value < 0x80 ? (char)unicode_value : '?';
+                break;
+            }
+            default:
+                // Covers \" \\ and \/
+                *write++ = c;
+                break;
+        }
+    }
+
+    if (read >= end) {
+        return NULL;
+    }
+
+    // Safe to terminate since write never passes the closing quote
+    *write = '\0';
+    *length = write - *value;
+    return read + 1;
+}
+
+static char *skip_string(char *cursor, char *end) {
+    for (cursor++; cursor < end; cursor++) {
+        if (*cursor == '\\') {
+            cursor++;
+        } else if (*cursor == '"') {
+            return cursor + 1;
+        }
+    }
+
+    return NULL;
+}
+
+// Skips one full value of any type, returns NULL if it runs off the end
+static char *skip_value(char *cursor, char *end) {
+    if (cursor >= end) {
+        return NULL;
+    }
+
+    if (*cursor == '"') {
+        return skip_string(cursor, end);
+    }
+
+    if (*cursor == '{' || *cursor == '[') {
+        int depth = 0;
+        while (cursor < end) {
+            if (*cursor == '"') {
+                cursor = skip_string(cursor, end);
+                if (!cursor) {
+                    return NULL;
+                }
+                continue;
+            }
+
+            if (*cursor == '{' || *cursor == '[') {
+                depth++;
+            } else if (*cursor == '}' || *cursor == ']') {
+                if (--depth == 0) {
+                    return cursor + 1;
+                }
+            }
+            cursor++;
+        }
+
+        return NULL;
+    }
+
+    // Number, true/false/null
+    while (cursor < end && *cursor != ',' && *cursor != '}' && *cursor != ']') {
+        cursor++;
+    }
+    return cursor;
+}
+
+/*
+ * Points iter at the first element of the top-level `data` array in buffer.
+ * Returns false if the buffer isn't an object or has no such array.
+ */
+bool json_list_find(json_list_iter *iter, char *buffer, int length) {
+    char *end = buffer + length;
+    char *cursor = skip_whitespace(buffer, end);
+    if (cursor >= end || *cursor != '{') {
+        return false;
+    }
+
+    cursor = skip_whitespace(cursor + 1, end);
+    while (cursor < end && *cursor == '"') {
+        char *key_start = cursor + 1;
+        cursor = skip_string(cursor, end);
+        if (!cursor) {
+            return false;
+        }
+        int key_length = (cursor - 1) - key_start;
+
+        cursor = skip_whitespace(cursor, end);
+        if (cursor >= end || *cursor != ':') {
+            return false;
+        }
+        cursor = skip_whitespace(cursor + 1, end);
+
+        if (cursor < end && *cursor == '['
+                && key_length == sizeof(JSON_STREAM_LIST_KEY) - 1
+                && memcmp(key_start, JSON_STREAM_LIST_KEY, key_length) == 0) {
+            iter->cursor = cursor + 1;
+            iter->end = end;
+            iter->complete = false;
+            return true;
+        }
+
+        cursor = skip_value(cursor, end);
+        if (!cursor) {
+            return false;
+        }
+
+        cursor = skip_whitespace(cursor, end);
+        if (cursor >= end || *cursor != ',') {
+            return false;
+        }
+        cursor = skip_whitespace(cursor + 1, end);
+    }
+
+    return false;
+}
+
+/*
+ * Returns the next string in the list as a null terminated slice of the
+ * original buffer. Non-string elements are skipped over.
+ * Returns false once the end of the list is reached or on malformed input,
+ * iter->complete says which.
+ */
+bool json_list_next(json_list_iter *iter, char **value, int *length) {
+    while (iter->cursor) {
+        char *cursor = skip_whitespace(iter->cursor, iter->end);
+        if (cursor < iter->end && *cursor == ',') {
+            cursor = skip_whitespace(cursor + 1, iter->end);
+        }
+
+        if (cursor >= iter->end || *cursor == ']') {
+            iter->complete = cursor < iter->end;
+            iter->cursor = NULL;
+            return false;
+        }
+
+        if (*cursor == '"') {
+            iter->cursor = unescape_string_in_place(cursor, iter->end, value, length);
+            return iter->cursor != NULL;
+        }
+
+        iter->cursor = skip_value(cursor, iter->end);
+    }
 
-    return num_sent;
+    return false;
 }
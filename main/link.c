@@ -0,0 +1,327 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "link.h"
+#include "stats.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static const uint32_t baud_rates[] = LINK_BAUD_RATES;
+#define NUM_BAUD_RATES (sizeof(baud_rates) / sizeof(baud_rates[0]))
+
+static uint8_t next_seq = 0;
+static bool connected = false;
+// No connect attempts before this, set when one finds no display
+static int64_t next_connect_us = 0;
+static link_stats stats;
+static link_capacity capacity = {
+    .bytes = LINK_DEFAULT_CAPACITY_BYTES,
+    .strings = LINK_DEFAULT_CAPACITY_STRINGS
+};
+
+// Payload of the last response, only ever a CAPACITY answer has one
+static uint8_t response_payload[LINK_MAX_RESPONSE_PAYLOAD];
+static uint8_t response_length;
+
+// Whole frame is built here so it goes out in a single uart write
+static uint8_t tx_buffer[LINK_HEADER_SIZE + LINK_MAX_PAYLOAD + LINK_CRC_SIZE];
+
+/*
+ * CRC-16/XMODEM (poly 0x1021, init 0). Same as avr-libc's _crc_xmodem_update
+ * so the display can check it without carrying its own table.
+ */
+uint16_t link_crc16(uint16_t crc, const uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static void set_baud(uint32_t baud_rate) {
+    // Let anything still in the fifo go out at the old rate first
+    uart_wait_tx_done(LINK_UART, pdMS_TO_TICKS(100));
+    uart_set_baudrate(LINK_UART, baud_rate);
+    stats.baud_rate = baud_rate;
+}
+
+static void write_frame(link_frame_type type, uint8_t seq, const uint8_t *payload, uint8_t length) {
+    tx_buffer[0] = LINK_START_OF_FRAME;
+    tx_buffer[1] = type;
+    tx_buffer[2] = seq;
+    tx_buffer[3] = length;
+    memcpy(&tx_buffer[LINK_HEADER_SIZE], payload, length);
+
+    uint16_t crc = link_crc16(0, &tx_buffer[1], LINK_HEADER_SIZE - 1 + length);
+    tx_buffer[LINK_HEADER_SIZE + length] = crc >> 8;
+    tx_buffer[LINK_HEADER_SIZE + length + 1] = crc & 0xFF;
+
+    uart_write_bytes(LINK_UART, (const char *)tx_buffer, LINK_HEADER_SIZE + length + LINK_CRC_SIZE);
+}
+
+#if LINK_HAS_RX
+/*
+ * Read bytes until a valid ACK/NACK/REJECT/CAPACITY frame shows up or timeout
+ * passes. Anything that isn't a well formed frame (log output, line noise) is
+ * skipped. Returns the frame type, or 0 on timeout. Any payload is left in
+ * response_payload.
+ */
+static uint8_t wait_for_response(uint8_t seq, uint32_t timeout_ms) {
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    uint8_t header[LINK_HEADER_SIZE];
+    uint8_t crc_bytes[LINK_CRC_SIZE];
+    int header_length = 0;
+
+    while (esp_timer_get_time() < deadline_us) {
+        TickType_t ticks_left = pdMS_TO_TICKS((deadline_us - esp_timer_get_time()) / 1000) + 1;
+        uint8_t c;
+        if (uart_read_bytes(LINK_UART, &c, 1, ticks_left) != 1) {
+            continue;
+        }
+
+        if (header_length == 0 && c != LINK_START_OF_FRAME) {
+            continue;
+        }
+        header[header_length++] = c;
+        if (header_length < LINK_HEADER_SIZE) {
+            continue;
+        }
+        header_length = 0;
+
+        // Responses carry a few bytes at most, anything longer isn't meant for us
+        uint8_t length = header[3];
+        if (length > LINK_MAX_RESPONSE_PAYLOAD) {
+            continue;
+        }
+
+        if (length > 0 && uart_read_bytes(LINK_UART, response_payload, length, pdMS_TO_TICKS(LINK_ACK_TIMEOUT_MS)) != length) {
+            continue;
+        }
+        if (uart_read_bytes(LINK_UART, crc_bytes, LINK_CRC_SIZE, pdMS_TO_TICKS(LINK_ACK_TIMEOUT_MS)) != LINK_CRC_SIZE) {
+            continue;
+        }
+
+        uint16_t crc = link_crc16(0, &header[1], LINK_HEADER_SIZE - 1);
+        crc = link_crc16(crc, response_payload, length);
+        if (crc != ((crc_bytes[0] << 8) | crc_bytes[1]) || header[2] != seq) {
+            continue;
+        }
+
+        response_length = length;
+        if (header[1] == LINK_FRAME_ACK || header[1] == LINK_FRAME_NACK
+            || header[1] == LINK_FRAME_REJECT || header[1] == LINK_FRAME_CAPACITY) {
+            return header[1];
+        }
+    }
+
+    return 0;
+}
+#endif
+
+/*
+ * Send one frame and wait for its ACK, retransmitting on NACK or timeout up
+ * to max_attempts times. Retransmits reuse the seq so the display can tell a
+ * resend of something it already applied (when only our ACK got lost).
+ * A REJECT means resending won't help, so that's returned straight away.
+ * A CAPACITY answer stands in for the ACK of a CAPACITY frame.
+ */
+static link_send_result send_frame(link_frame_type type, const uint8_t *payload, uint8_t length, int max_attempts) {
+    uint8_t seq = next_seq++;
+
+#if LINK_HAS_RX
+    for (int attempt = 0; attempt < max_attempts; attempt++) {
+        if (attempt > 0) {
+            stats.retransmits++;
+        }
+
+        write_frame(type, seq, payload, length);
+        response_length = 0;
+        uint8_t response = wait_for_response(seq, LINK_ACK_TIMEOUT_MS);
+        if (response == LINK_FRAME_ACK || response == LINK_FRAME_CAPACITY) {
+            stats.frames_sent++;
+            return LINK_SENT;
+        } else if (response == LINK_FRAME_REJECT) {
+            stats.rejects++;
+            return LINK_REJECTED;
+        } else if (response == LINK_FRAME_NACK) {
+            stats.nacks++;
+        } else {
+            stats.timeouts++;
+        }
+    }
+
+    stats.frames_failed++;
+    return LINK_FAILED;
+#else
+    write_frame(type, seq, payload, length);
+    stats.frames_sent++;
+    return LINK_SENT;
+#endif
+}
+
+static bool ping(int max_attempts) {
+    uint8_t pattern[LINK_BAUD_PING_SIZE];
+    for (int i = 0; i < LINK_BAUD_PING_SIZE; i++) {
+        // Mix of edges and runs to give the display's bit timing a workout
+        pattern[i] = (i & 1) ? 0x55 : (uint8_t)i;
+    }
+
+    return send_frame(LINK_FRAME_PING, pattern, LINK_BAUD_PING_SIZE, max_attempts) == LINK_SENT;
+}
+
+/*
+ * Ask the display to move to baud_rate, then make sure a burst of pings all
+ * get through at it. Either side falls back to the old rate if that fails,
+ * the display on its own once LINK_BAUD_CONFIRM_TIMEOUT_MS passes quietly.
+ */
+static bool try_baud(uint32_t baud_rate) {
+    uint32_t previous_baud = stats.baud_rate;
+    uint8_t payload[4] = {
+        baud_rate & 0xFF,
+        (baud_rate >> 8) & 0xFF,
+        (baud_rate >> 16) & 0xFF,
+        (baud_rate >> 24) & 0xFF
+    };
+
+    // Rejected if the display can't do this rate
+    if (send_frame(LINK_FRAME_SET_BAUD, payload, sizeof(payload), LINK_MAX_RETRIES) != LINK_SENT) {
+        return false;
+    }
+
+    set_baud(baud_rate);
+    for (int i = 0; i < LINK_BAUD_CONFIRM_PINGS; i++) {
+        // No retries, a rate that needs them isn't one we want to keep
+        if (!ping(1)) {
+            ESP_LOGI(TAG, "Link not reliable at %d baud, staying at %d", baud_rate, previous_baud);
+            set_baud(previous_baud);
+            vTaskDelay(pdMS_TO_TICKS(LINK_BAUD_CONFIRM_TIMEOUT_MS * 2));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#if LINK_HAS_RX
+/*
+ * Ask the display how much of a list it can hold so lists can be cut to fit
+ * here, rather than silently on the display. One that predates CAPACITY just
+ * ACKs it like a ping, and gets the defaults.
+ */
+static void query_capacity() {
+    capacity.bytes = LINK_DEFAULT_CAPACITY_BYTES;
+    capacity.strings = LINK_DEFAULT_CAPACITY_STRINGS;
+    if (send_frame(LINK_FRAME_CAPACITY, NULL, 0, LINK_MAX_RETRIES) == LINK_SENT && response_length == LINK_MAX_RESPONSE_PAYLOAD) {
+        capacity.bytes = response_payload[0] | (response_payload[1] << 8);
+        capacity.strings = response_payload[2];
+    }
+
+    ESP_LOGI(TAG, "Display holds %d bytes, %d strings per list", capacity.bytes, capacity.strings);
+}
+#endif
+
+void init_link() {
+    memset(&stats, 0, sizeof(stats));
+    stats.baud_rate = LINK_DEFAULT_BAUD;
+    link_connect();
+}
+
+/*
+ * Find whatever baud the display is at right now (it keeps its rate if only
+ * we rebooted), then step up to the highest rate it can keep up with.
+ * Without an RX line there's no way to hear back, so just stay at the default.
+ */
+bool link_connect() {
+#if LINK_HAS_RX
+    connected = false;
+    int current_index = -1;
+    for (int i = 0; i < NUM_BAUD_RATES && current_index < 0; i++) {
+        set_baud(baud_rates[i]);
+        if (ping(1)) {
+            current_index = i;
+        }
+    }
+
+    if (current_index < 0) {
+        ESP_LOGI(TAG, "Display not answering at any baud rate, not trying again for %dms", LINK_RECONNECT_BACKOFF_MS);
+        set_baud(LINK_DEFAULT_BAUD);
+        next_connect_us = esp_timer_get_time() + (int64_t)LINK_RECONNECT_BACKOFF_MS * 1000;
+        return false;
+    }
+
+    // Rates are highest first, so everything before the current one is an upgrade
+    for (int i = 0; i < current_index; i++) {
+        if (try_baud(baud_rates[i])) {
+            break;
+        }
+    }
+
+    ESP_LOGI(TAG, "Link up at %d baud", stats.baud_rate);
+    query_capacity();
+#endif
+    connected = true;
+    stats.connects++;
+    return true;
+}
+
+/*
+ * Reliable send of a single frame. If the display stops answering we assume
+ * it reset (and lost our baud rate), so the next send starts with a reconnect.
+ * If that finds nothing (the display's unplugged) frames fail straight away
+ * until LINK_RECONNECT_BACKOFF_MS has passed, rather than each one blocking
+ * on a connect of its own. A rejected frame leaves the link as it is.
+ */
+link_send_result link_try_send(link_frame_type type, const uint8_t *payload, uint8_t length) {
+    if (!connected) {
+        if (esp_timer_get_time() < next_connect_us) {
+            stats.frames_skipped++;
+            return LINK_FAILED;
+        }
+        if (!link_connect()) {
+            return LINK_FAILED;
+        }
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    link_send_result result = send_frame(type, payload, length, LINK_MAX_RETRIES);
+    int64_t send_time_us = esp_timer_get_time() - start_us;
+    stats.send_time_us += send_time_us;
+    stats_record(STAGE_LINK_SEND, (uint32_t)send_time_us);
+
+    if (result == LINK_SENT) {
+        stats.payload_bytes += length;
+    } else if (result == LINK_FAILED) {
+        connected = false;
+    }
+
+    return result;
+}
+
+// For frames the display never rejects, where all that matters is whether it got there
+bool link_send(link_frame_type type, const uint8_t *payload, uint8_t length) {
+    return link_try_send(type, payload, length) == LINK_SENT;
+}
+
+link_stats get_link_stats() {
+    return stats;
+}
+
+link_capacity get_link_capacity() {
+    return capacity;
+}
+
+uint32_t get_link_bytes_per_sec() {
+    if (stats.send_time_us == 0) {
+        return 0;
+    }
+
+    return (uint32_t)(((uint64_t)stats.payload_bytes * 1000000) / stats.send_time_us);
+}
@@ -3,96 +3,177 @@
 #include "freertos/FreeRTOS.h"
 #include "esp_event.h"
 #include "esp_err.h"
+#include "esp_system.h"
 #include "esp_task_wdt.h"
-#include "cJSON.h"
+#include "esp_timer.h"
 
 #include "driver/gpio.h"
 
 #include "constants.h"
 #include "uart.h"
 #include "gpio.h"
+#include "gesture.h"
 #include "timer.h"
 #include "network.h"
 #include "json.h"
+#include "cache.h"
+#include "dns.h"
+#include "events.h"
+#include "power.h"
+#include "link.h"
+#include "font.h"
+#include "dict.h"
+#include "stats.h"
+#include "refresh.h"
+#include "arena.h"
+#include "store.h"
 
 // Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
 #include "esp_log.h"
 
-// For testing on esp, flips tide and swell each request
-volatile bool tides = true;
+// Set from button gestures, picked up once all queued edges are handled
+static bool refresh_requested = false;
 
-void timer_expired_callback(void *timer_args) {
-    #if ESP_01
-        timer_count += 1;
-    #else
-        timer_expired = true;
-    #endif
+// Periodic requests, and the button recognizer's next deadline
+static soft_timer request_timer;
+static soft_timer gesture_timer;
+
+// Timer callbacks and the button ISR only record what happened and wake the
+// main task, all the actual work happens back in app_main
+void request_timer_callback(void *callback_arg) {
+    post_event_from_isr(EVENT_TIMER_EXPIRED);
+}
+
+void gesture_timer_callback(void *callback_arg) {
+    post_event_from_isr(EVENT_GESTURE_DUE);
 }
 
 void button_isr_handler(void *arg) {
-    button_pressed = !(bool)gpio_get_level(GPIO_BUTTON_PIN);
+    button_edge_from_isr();
+    post_event_from_isr(EVENT_BUTTON_CHANGED);
+}
+
+// Press refreshes, double press refreshes without trusting the cache's
+// max-age, long press dumps stats (on the dev board, the ESP-01's UART0 is
+// the display link so stats_dump doesn't print anything there)
+static void handle_gesture(gesture_type gesture, void *handler_arg) {
+    switch (gesture) {
+        case GESTURE_PRESS:
+            ESP_LOGI(TAG, "Button pressed, refreshing");
+            refresh_requested = true;
+            break;
+        case GESTURE_DOUBLE_PRESS:
+            ESP_LOGI(TAG, "Button double pressed, refreshing past the cache");
+            cache_expire_all();
+            refresh_requested = true;
+            break;
+        case GESTURE_LONG_PRESS:
+            stats_dump();
+            ESP_LOGI(TAG, "Button edges dropped: %d", get_button_edges_dropped());
+            break;
+    }
+}
+
+// Wake the main task when the button recognizer has something to decide
+// with no new edges coming in
+static void schedule_gesture_deadline(const gesture_recognizer *buttons) {
+    int64_t deadline_us = gesture_next_deadline_us(buttons);
+    if (deadline_us < 0) {
+        timer_cancel(&gesture_timer);
+        return;
+    }
+
+    int64_t wait_us = deadline_us - esp_timer_get_time();
+    timer_start(&gesture_timer, wait_us > 0 ? (wait_us + 999) / 1000 : 0, 0, gesture_timer_callback, NULL);
 }
 
 void app_main(void)
 {
+#if LINK_SHARES_CONSOLE
+    // LOG_LOCAL_LEVEL only quiets our own files, this covers the SDK's
+    esp_log_level_set("*", ESP_LOG_NONE);
+#endif
+
     // Create default event loop - handle hidden from user so no return
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    // Before anything that registers an ISR that might post to it
+    init_events();
+    init_font();
+    init_dict();
     init_uart();
+    init_stats();
+    init_link();
     init_gpio(button_isr_handler);
+    init_cache();
+    init_arena();
+    init_refresh();
+#if SAVE_LAST_LISTS
+    // Up on the display while wifi connects, and there to fall back on if
+    // the server can't be reached. Out of deep sleep the display's still
+    // showing them, so they're only loaded
+    init_store();
+    refresh_load_saved(esp_reset_reason() != ESP_RST_DEEPSLEEP);
+#endif
+    init_dns();
+
+    stats_timer timer;
+    stats_timer_start(&timer);
     init_wifi();
+    stats_record(STAGE_WIFI_CONNECT, stats_timer_elapsed_us(&timer));
+    init_power();
     init_http();
-    init_timer(timer_expired_callback);
+
+    init_timer();
+#if POWER_SCHEDULES_REQUESTS
+    // Either just booted or woke from deep sleep, so go right away. After
+    // that the sleep scheduler posts when it's time for the next one
+    post_event(EVENT_REQUEST_DUE);
+#elif !BUTTON_FOR_REQUESTS
+    timer_start(&request_timer, REQUEST_PERIOD_MS, REQUEST_PERIOD_MS, request_timer_callback, NULL);
+#endif
+
+    gesture_recognizer buttons;
+    gesture_init(&buttons, handle_gesture, NULL);
 
     while (1) {
+        // Sleep until a timer or the button ISR has something for us
+        event_type event;
+        if (!wait_for_event(&event, portMAX_DELAY)) {
+            continue;
+        }
+
         esp_task_wdt_reset();
-        bool execute_request;
-#if BUTTON_FOR_REQUESTS
-        execute_request = button_was_released();
-#else
-        execute_request = timer_count >= 4;
-#endif
+
+        // Edges keep their ISR timestamps, so ones that queued up during a
+        // long request still make the same gestures
+        button_edge edge;
+        while (button_edge_pop(&edge)) {
+            gesture_feed_edge(&buttons, &edge);
+        }
+        gesture_advance(&buttons, esp_timer_get_time());
+        schedule_gesture_deadline(&buttons);
+
+        bool execute_request = refresh_requested || event == EVENT_REQUEST_DUE || event == EVENT_TIMER_EXPIRED;
         if (execute_request) {
-            timer_count = 0;
-            timer_expired = false;
-
-            // Sometimes stuff gets screwy and run out of sockets. When that happens
-            // we fully cleanup our http_client and re-init it
-            if (!http_client_inited) {
-                ESP_LOGI(TAG, "http_client not yet inited, doing it now before request");
-                init_wifi();
-                init_http();
-            }
-
-            // Space for base url, endpoint, and some extra
-            char url_buf[strlen(URL_BASE) + 20];
-            request request;
-            query_param params[2];
-            if (tides) {
-                request = build_request("tides", "wedge", "2", url_buf, params);
-                tides = false;
-            } else {
-                request = build_request("swell", "wedge", "2", url_buf, params);
-                tides = true;
-            }
-
-            char *server_response;
-            int data_length = perform_request(&request, &server_response);
-            if (data_length != 0) {
-                cJSON *json = parse_json(server_response);
-
-                cJSON *data_value = cJSON_GetObjectItem(json, "data");
-                int values_written = send_json_list(data_value);
-                assert(values_written > 0);
-
-                cJSON_free(data_value);
-                cJSON_free(json);
-            }
-
-            // Caller responsible for freeing buffer if non-null on return
-            if (server_response != NULL) {
-                free(server_response);
-            }
+            stats_timer cycle_timer;
+            stats_timer_start(&cycle_timer);
+            power_cycle_start();
+            refresh_requested = false;
+#if !POWER_SCHEDULES_REQUESTS && !BUTTON_FOR_REQUESTS
+            // Next periodic request is a full period after this one, however it started
+            timer_start(&request_timer, REQUEST_PERIOD_MS, REQUEST_PERIOD_MS, request_timer_callback, NULL);
+#endif
+
+            // Every spot and endpoint, merged into one list for the display.
+            // Fetching and sending overlap, but it all has to be out before sleeping
+            refresh_all();
+            int values_sent = refresh_wait_done();
+            ESP_LOGI(TAG, "Sent %d strings to display", values_sent);
+
+            stats_record(STAGE_REQUEST_CYCLE, stats_timer_elapsed_us(&cycle_timer));
+            ESP_LOGI(TAG, "Main task idle %d%% of the time", get_idle_percent());
+            power_sleep_until_next_request();
         }
     }
 }
@@ -0,0 +1,260 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "constants.h"
+#include "messages.h"
+#include "json.h"
+#include "link.h"
+#include "dict.h"
+#include "font.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static list_update_stats update_stats;
+
+#if LINK_SENDS_DELTAS
+// Hash of every string the display was last sent, in order. Only trusted
+// while display_in_sync and the link hasn't reconnected since
+static uint32_t sent_hashes[MESSAGE_LIST_MAX_MESSAGES];
+static int sent_count;
+static bool display_in_sync = false;
+static uint32_t synced_connects;
+#endif
+
+void message_list_clear(message_list *list) {
+    list->used = 0;
+    list->count = 0;
+    list->dropped = 0;
+}
+
+bool message_list_add(message_list *list, const char *text, int length) {
+    if (list->count == MESSAGE_LIST_MAX_MESSAGES || list->used + length > MESSAGE_LIST_BUFFER_SIZE) {
+        list->dropped++;
+        return false;
+    }
+
+    memcpy(&list->text[list->used], text, length);
+    list->used += length;
+    list->ends[list->count++] = list->used;
+    return true;
+}
+
+const char *message_list_get(const message_list *list, int index, int *length) {
+    int start = index == 0 ? 0 : list->ends[index - 1];
+    *length = list->ends[index] - start;
+    return &list->text[start];
+}
+
+// Bytes text takes up in the display's list, in whatever form it's sent
+int message_display_bytes(const char *text, int length) {
+#if PRERENDER_GLYPHS
+    return length * FONT_WIDTH;
+#else
+    return dict_encoded_length(text, length, LINK_MAX_PAYLOAD);
+#endif
+}
+
+// Items only, the caller decides where the display list starts and ends
+void message_list_send(const message_list *list) {
+    for (int i = 0; i < list->count; i++) {
+        int length;
+        const char *text = message_list_get(list, i, &length);
+        send_list_item(text, length);
+    }
+}
+
+
+static int full_list_bytes(const message_list *list) {
+    int bytes = 2 * LINK_FRAME_OVERHEAD;
+    for (int i = 0; i < list->count; i++) {
+        int length;
+        const char *text = message_list_get(list, i, &length);
+        bytes += LINK_FRAME_OVERHEAD + dict_encoded_length(text, length, LINK_MAX_PAYLOAD);
+    }
+
+    return bytes;
+}
+
+#if LINK_SENDS_DELTAS
+// Just the DELTA_START/DELTA_END pair
+#define DELTA_EMPTY_BYTES (2 * (LINK_FRAME_OVERHEAD + 1))
+
+// FNV-1a
+static uint32_t hash_text(const char *text, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)text[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool send_op(link_frame_type type, uint8_t index, const message_list *list, int item) {
+    uint8_t payload[1 + LINK_MAX_PAYLOAD];
+    int length = 0;
+    payload[0] = index;
+    if (item >= 0) {
+        int text_length;
+        const char *text = message_list_get(list, item, &text_length);
+        length = dict_encode(text, text_length, &payload[1], LINK_MAX_PAYLOAD - 1);
+    }
+
+    return link_send(type, payload, 1 + length);
+}
+
+/*
+ * Everything the old and new lists share at the start and end stays where
+ * it is, only the middle is sent: replaces for as many strings as both
+ * middles have, then inserts or deletes for the difference. Only the middle
+ * strings that actually changed get a replace.
+ * Returns bytes sent, or -1 if a delta would cost more than the whole list or
+ * didn't make it and a full list needs to go instead.
+ */
+static int send_delta(const message_list *list, const uint32_t *hashes, int full_bytes) {
+    int old_count = sent_count;
+    int new_count = list->count;
+    int prefix = 0;
+    while (prefix < old_count && prefix < new_count && sent_hashes[prefix] == hashes[prefix]) {
+        prefix++;
+    }
+    int suffix = 0;
+    while (suffix < old_count - prefix && suffix < new_count - prefix
+           && sent_hashes[old_count - 1 - suffix] == hashes[new_count - 1 - suffix]) {
+        suffix++;
+    }
+
+    int old_middle = old_count - prefix - suffix;
+    int new_middle = new_count - prefix - suffix;
+    int common = old_middle < new_middle ? old_middle : new_middle;
+
+    // Cost it out before sending anything
+    int bytes = DELTA_EMPTY_BYTES;
+    int ops = 0;
+    for (int i = prefix; i < prefix + new_middle; i++) {
+        if (i - prefix >= common || sent_hashes[i] != hashes[i]) {
+            int length;
+            const char *text = message_list_get(list, i, &length);
+            // Index takes one byte of the frame
+            bytes += LINK_FRAME_OVERHEAD + 1 + dict_encoded_length(text, length, LINK_MAX_PAYLOAD - 1);
+            ops++;
+        }
+    }
+    if (old_middle > new_middle) {
+        bytes += (old_middle - new_middle) * (LINK_FRAME_OVERHEAD + 1);
+        ops += old_middle - new_middle;
+    }
+
+    // With no ops the start/end pair still goes out, it's how we find out
+    // the display reset and needs the whole list again
+    if (bytes >= full_bytes) {
+        return -1;
+    }
+
+    // A rejected start or end means the display's list isn't the one we
+    // diffed against. The link's fine, the whole list just has to go
+    uint8_t count_byte = old_count;
+    link_send_result result = link_try_send(LINK_FRAME_DELTA_START, &count_byte, 1);
+    if (result != LINK_SENT) {
+        if (result == LINK_REJECTED) {
+            ESP_LOGI(TAG, "Display refused delta against %d strings", old_count);
+            update_stats.rejected_deltas++;
+        }
+        return -1;
+    }
+
+    bool sent = true;
+    for (int i = prefix; i < prefix + common && sent; i++) {
+        if (sent_hashes[i] != hashes[i]) {
+            sent = send_op(LINK_FRAME_DELTA_REPLACE, i, list, i);
+        }
+    }
+    for (int i = prefix + common; i < prefix + new_middle && sent; i++) {
+        sent = send_op(LINK_FRAME_DELTA_INSERT, i, list, i);
+    }
+    // Each delete shifts the rest down, so it's the same index every time
+    for (int i = common; i < old_middle && sent; i++) {
+        sent = send_op(LINK_FRAME_DELTA_DELETE, prefix + common, list, -1);
+    }
+
+    if (!sent) {
+        return -1;
+    }
+
+    count_byte = new_count;
+    result = link_try_send(LINK_FRAME_DELTA_END, &count_byte, 1);
+    if (result == LINK_REJECTED) {
+        ESP_LOGI(TAG, "Display didn't end up with %d strings after delta", new_count);
+        update_stats.rejected_deltas++;
+    }
+    if (result != LINK_SENT) {
+        return -1;
+    }
+
+    return bytes;
+}
+#endif
+
+/*
+ * Get list onto the display as cheaply as we can. With LINK_SENDS_DELTAS
+ * that's just the strings that changed since the last update when the
+ * display is known to still have it, otherwise (and whenever that fails) the
+ * whole list.
+ */
+void message_list_send_update(const message_list *list) {
+    int full_bytes = full_list_bytes(list);
+    update_stats.full_bytes += full_bytes;
+
+#if LINK_SENDS_DELTAS
+    uint32_t hashes[MESSAGE_LIST_MAX_MESSAGES];
+    for (int i = 0; i < list->count; i++) {
+        int length;
+        const char *text = message_list_get(list, i, &length);
+        hashes[i] = hash_text(text, length);
+    }
+
+    int delta_bytes = -1;
+    if (display_in_sync && get_link_stats().connects == synced_connects) {
+        delta_bytes = send_delta(list, hashes, full_bytes);
+    }
+    display_in_sync = false;
+
+    if (delta_bytes >= 0) {
+        if (delta_bytes == DELTA_EMPTY_BYTES) {
+            update_stats.unchanged_updates++;
+        } else {
+            update_stats.delta_updates++;
+        }
+        update_stats.bytes_sent += delta_bytes;
+        ESP_LOGI(TAG, "List update: %d bytes as delta, %d as full list", delta_bytes, full_bytes);
+        display_in_sync = true;
+        memcpy(sent_hashes, hashes, list->count * sizeof(hashes[0]));
+        sent_count = list->count;
+        return;
+    }
+
+    uint32_t failed_before = get_link_stats().frames_failed;
+#endif
+
+    send_list_start();
+    message_list_send(list);
+    send_list_end();
+    update_stats.full_updates++;
+    update_stats.bytes_sent += full_bytes;
+    ESP_LOGI(TAG, "List update: %d bytes as full list", full_bytes);
+
+#if LINK_SENDS_DELTAS
+    link_stats link = get_link_stats();
+    if (link.frames_failed == failed_before) {
+        display_in_sync = true;
+        synced_connects = link.connects;
+        memcpy(sent_hashes, hashes, list->count * sizeof(hashes[0]));
+        sent_count = list->count;
+    }
+#endif
+}
+
+list_update_stats get_list_update_stats() {
+    return update_stats;
+}
@@ -1,13 +1,25 @@
 #include <string.h>
+#include <strings.h>
+#include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "esp_wifi.h"
 #include "esp_http_client.h"
 #include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "lwip/inet.h"
 
 #include "constants.h"
 #include "network.h"
+#include "json.h"
+#include "cache.h"
+#include "dns.h"
+#include "inflate.h"
+#include "stats.h"
+#include "arena.h"
+#include "power.h"
 
 // Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
 #include "esp_log.h"
@@ -19,31 +31,100 @@
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 #define MAX_READ_BUFFER_SIZE 4096
+#define STREAM_READ_CHUNK_SIZE 256
+#define MAX_REQUEST_URL_LENGTH 128
+#define FAST_CONNECT_MAGIC 0x57494649
 
-// Event group to signal when connected to the AP
+typedef enum {
+    REQUEST_STARTED,
+    REQUEST_CACHED,
+    REQUEST_FAILED
+} request_start_result;
+
+// Event group to signal when connected to the AP. Created once and kept for every reconnect
 static EventGroupHandle_t wifi_event_group;
 static volatile int retry_count = 0;
+static bool wifi_driver_inited = false;
+static bool wifi_started = false;
+static tcpip_adapter_ip_info_t connected_ip_info;
+static wifi_connect_stats wifi_stats;
+
+// Boot or whenever init_wifi had to reconnect, until the next socket opens
+static int64_t network_down_us;
+static bool waiting_for_socket = false;
+
+#if WIFI_FAST_RECONNECT
+// Last AP and lease that worked, kept in RTC memory so waking from deep
+// sleep can skip the scan and DHCP too
+typedef struct {
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    tcpip_adapter_ip_info_t ip_info;
+} fast_connect_info;
+
+RTC_DATA_ATTR static fast_connect_info fast_connect;
+#endif
+static volatile bool fast_connecting = false;
 static esp_http_client_handle_t client;
 
 bool http_client_inited = false;
 
+// Set from http_event_handler while a request is in flight
+static bool connection_opened;
+static bool response_headers_seen;
+static bool server_closing;
+
+// Validators and freshness info pulled from the current response's headers
+static char response_etag[CACHE_MAX_VALIDATOR_LENGTH];
+static char response_last_modified[CACHE_MAX_VALIDATOR_LENGTH];
+static int response_max_age;
+static bool response_no_store;
+static content_encoding response_encoding;
+
+// Set when a compressed response needed a bigger window than we have, so
+// the retry of that url asks for it uncompressed. Only lasts one request
+static bool skip_compression = false;
+
+// A compressed body on its way through inflate, either into the json
+// parser or into a buffer
+typedef struct {
+    json_stream_parser *parser;
+    char *buffer;
+    // Room for one read, to check nothing's left after the stream ends
+    char *chunk;
+    int buffer_used;
+    int bytes_read;
+    int bytes_decoded;
+    uint32_t read_us;
+    uint32_t parse_us;
+    bool window_too_small;
+} compressed_body;
+
+// Full url of the current request, used as the cache key
+static char request_url[MAX_REQUEST_URL_LENGTH];
+
+// Same url with the API host swapped for its cached address, what the client actually connects to
+static char connect_url[MAX_REQUEST_URL_LENGTH];
+
+// Whether the socket was left open after the last request
+static bool connection_kept_alive = false;
+static connection_stats conn_stats;
+
 // Forward declarations for handlers used in init functions
+static void finish_request(bool body_complete);
 void wifi_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 esp_err_t http_event_handler(esp_http_client_event_t *event);
 
-/**
- * Instantiate an event group and register 2 events on the default event handler,
- * both of which call `wifi_event_handler`.
- * THIS WILL BLOCK UNTIL EVENT RECEIVED OR `portMAX_DELAY` EXPIRES
+/*
+ * Register for the connect events, kick off the connection with the given
+ * config and block until we have an IP or the handler gives up. The handlers
+ * are only registered while we're waiting, after that the http client is
+ * what notices the network's gone.
  */
-void init_wifi() {
-    if (!wifi_event_group) {
-        wifi_event_group = xEventGroupCreate();
-    }
-    tcpip_adapter_init();
-
-    wifi_init_config_t wifi_config = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&wifi_config));
+static bool connect_and_wait(wifi_config_t *sta_config) {
+    xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    retry_count = 0;
 
     // Register both connection and getting IP events with the
     // default loop with our single handler as the callback
@@ -61,17 +142,14 @@ void init_wifi() {
         NULL
     ));
 
-    // We want to connect to AP, not be one
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-
-    wifi_config_t sta_config = {
-        .sta = {
-            .ssid = SSID,
-            .password = PASSWORD
-        }
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &sta_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, sta_config));
+    if (wifi_started) {
+        // Driver's already running so there won't be another STA_START to connect from
+        ESP_ERROR_CHECK(esp_wifi_connect());
+    } else {
+        ESP_ERROR_CHECK(esp_wifi_start());
+        wifi_started = true;
+    }
 
     // Block and wait for bits set from event handler
     EventBits_t wifi_bits = xEventGroupWaitBits(
@@ -82,16 +160,6 @@ void init_wifi() {
         portMAX_DELAY
     );
 
-    if (wifi_bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 SSID, PASSWORD);
-    } else if (wifi_bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 SSID, PASSWORD);
-    } else {
-        ESP_LOGI(TAG, "Unknown event: %x", wifi_bits);
-    }
-
     ESP_ERROR_CHECK(esp_event_handler_unregister(
         WIFI_EVENT,
         ESP_EVENT_ANY_ID,
@@ -104,7 +172,127 @@ void init_wifi() {
         &wifi_event_handler
     ));
 
-    vEventGroupDelete(wifi_event_group);
+    if (wifi_bits & WIFI_CONNECTED_BIT) {
+        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
+                 SSID, PASSWORD);
+        return true;
+    } else if (wifi_bits & WIFI_FAIL_BIT) {
+        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
+                 SSID, PASSWORD);
+    } else {
+        ESP_LOGI(TAG, "Unknown event: %x", wifi_bits);
+    }
+
+    return false;
+}
+
+#if WIFI_FAST_RECONNECT
+// Once we've seen the AP and have a lease, remember them so the next connect
+// can skip the scan and DHCP
+static void save_fast_connect(const tcpip_adapter_ip_info_t *ip_info) {
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+
+    memcpy(fast_connect.bssid, ap_info.bssid, sizeof(fast_connect.bssid));
+    fast_connect.channel = ap_info.primary;
+    fast_connect.ip_info = *ip_info;
+    fast_connect.magic = FAST_CONNECT_MAGIC;
+}
+
+/*
+ * Go straight to the AP and channel we were last on with the IP we last had.
+ * Any failure (AP moved channel, lease reassigned and the AP kicks us) drops
+ * the saved info so the caller falls back to a full scan and DHCP.
+ */
+static bool fast_connect_and_wait() {
+    wifi_config_t sta_config = {
+        .sta = {
+            .ssid = SSID,
+            .password = PASSWORD,
+            .bssid_set = true,
+            .channel = fast_connect.channel,
+            .listen_interval = POWER_LISTEN_INTERVAL
+        }
+    };
+    memcpy(sta_config.sta.bssid, fast_connect.bssid, sizeof(sta_config.sta.bssid));
+
+    tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+    tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &fast_connect.ip_info);
+
+    fast_connecting = true;
+    bool connected = connect_and_wait(&sta_config);
+    fast_connecting = false;
+    if (connected) {
+        wifi_stats.fast_connects++;
+        return true;
+    }
+
+    ESP_LOGI(TAG, "Fast connect to saved AP failed, doing a full connect");
+    fast_connect.magic = 0;
+    esp_wifi_disconnect();
+    tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+    return false;
+}
+#endif
+
+/**
+ * Bring up the wifi driver the first time through, then connect if we aren't
+ * already. Called again from the main loop after a failed request, in which
+ * case the driver is still running and only the connection gets redone.
+ * Tries the saved AP/IP first when WIFI_FAST_RECONNECT is on.
+ * THIS WILL BLOCK UNTIL EVENT RECEIVED OR `portMAX_DELAY` EXPIRES
+ */
+void init_wifi() {
+    if (!wifi_event_group) {
+        wifi_event_group = xEventGroupCreate();
+    }
+
+    if (!wifi_driver_inited) {
+        tcpip_adapter_init();
+
+        wifi_init_config_t wifi_config = WIFI_INIT_CONFIG_DEFAULT();
+        ESP_ERROR_CHECK(esp_wifi_init(&wifi_config));
+
+        // We want to connect to AP, not be one
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+        wifi_driver_inited = true;
+    } else {
+        wifi_ap_record_t ap_info;
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+            ESP_LOGI(TAG, "Still associated with AP, skipping wifi reconnect");
+            return;
+        }
+    }
+
+    // From here until a socket opens is time the network's unusable
+    if (!waiting_for_socket) {
+        network_down_us = esp_timer_get_time();
+        waiting_for_socket = true;
+    }
+
+#if WIFI_FAST_RECONNECT
+    if (fast_connect.magic == FAST_CONNECT_MAGIC && fast_connect_and_wait()) {
+        ESP_LOGI(TAG, "Succesfully set up and connected to wifi");
+        return;
+    }
+#endif
+
+    wifi_config_t sta_config = {
+        .sta = {
+            .ssid = SSID,
+            .password = PASSWORD,
+            .listen_interval = POWER_LISTEN_INTERVAL
+        }
+    };
+    if (connect_and_wait(&sta_config)) {
+        wifi_stats.full_connects++;
+#if WIFI_FAST_RECONNECT
+        save_fast_connect(&connected_ip_info);
+#endif
+    }
+
     ESP_LOGI(TAG, "Succesfully set up and connected to wifi");
 }
 
@@ -141,7 +329,11 @@ void wifi_event_handler(void *event_handler_arg, esp_event_base_t event_base, in
             ESP_LOGI(TAG, "Got sta_start, initiating wifi_connect");
             ESP_ERROR_CHECK(esp_wifi_connect());
         } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
-            if (retry_count < MAX_RETRY) {
+            if (fast_connecting) {
+                // Saved AP info is no good, don't burn retries on it
+                ESP_LOGI(TAG, "Received discon during fast connect, setting fail bit");
+                xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
+            } else if (retry_count < MAX_RETRY) {
                 retry_count++;
                 ESP_ERROR_CHECK(esp_wifi_connect());
                 ESP_LOGI(TAG, "Received discon, trying to reconnect");
@@ -156,6 +348,7 @@ void wifi_event_handler(void *event_handler_arg, esp_event_base_t event_base, in
         if (event_id == IP_EVENT_STA_GOT_IP) {
             ip_event_got_ip_t *event = (ip_event_got_ip_t*)event_data;
             ESP_LOGI(TAG, "Got IP addr: %s", ip4addr_ntoa(&event->ip_info.ip));
+            connected_ip_info = event->ip_info;
             retry_count = 0;
             xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
         } else {
@@ -166,6 +359,20 @@ void wifi_event_handler(void *event_handler_arg, esp_event_base_t event_base, in
     }
 }
 
+static void parse_cache_control(const char *value) {
+    if (strstr(value, "no-store")) {
+        response_no_store = true;
+    }
+
+    // no-cache means we can keep the validators but must always check with the server
+    const char *max_age = strstr(value, "max-age=");
+    if (strstr(value, "no-cache")) {
+        response_max_age = 0;
+    } else if (max_age) {
+        response_max_age = atoi(max_age + sizeof("max-age=") - 1);
+    }
+}
+
 esp_err_t http_event_handler(esp_http_client_event_t *event) {
     switch(event->event_id) {
         case HTTP_EVENT_ERROR:
@@ -173,12 +380,29 @@ esp_err_t http_event_handler(esp_http_client_event_t *event) {
             break;
         case HTTP_EVENT_ON_CONNECTED:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED");
+            connection_opened = true;
             break;
         case HTTP_EVENT_HEADER_SENT:
             ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
             break;
         case HTTP_EVENT_ON_HEADER:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", event->header_key, event->header_value);
+            response_headers_seen = true;
+            if (strcasecmp(event->header_key, "Connection") == 0 && strcasecmp(event->header_value, "close") == 0) {
+                server_closing = true;
+            } else if (strcasecmp(event->header_key, "ETag") == 0) {
+                strncpy(response_etag, event->header_value, CACHE_MAX_VALIDATOR_LENGTH - 1);
+            } else if (strcasecmp(event->header_key, "Last-Modified") == 0) {
+                strncpy(response_last_modified, event->header_value, CACHE_MAX_VALIDATOR_LENGTH - 1);
+            } else if (strcasecmp(event->header_key, "Cache-Control") == 0) {
+                parse_cache_control(event->header_value);
+            } else if (strcasecmp(event->header_key, "Content-Encoding") == 0) {
+                if (strcasecmp(event->header_value, "gzip") == 0) {
+                    response_encoding = CONTENT_ENCODING_GZIP;
+                } else if (strcasecmp(event->header_value, "deflate") == 0) {
+                    response_encoding = CONTENT_ENCODING_DEFLATE;
+                }
+            }
             break;
         case HTTP_EVENT_ON_DATA:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", event->data_len);
@@ -193,37 +417,163 @@ esp_err_t http_event_handler(esp_http_client_event_t *event) {
             break;
         case HTTP_EVENT_DISCONNECTED:
             ESP_LOGD(TAG, "HTTP_EVENT_DISCONNECTED");
+            connection_kept_alive = false;
             break;
     }
     return ESP_OK;
 }
 
 /*
- * request obj is optional, but highly recommended to ensure the
- * right url/params are set up. If not supplied, request will be
- * performed using whatever was last set.
+ * Builds request_url from the request's base url and params. Returns false,
+ * without touching the client, if the whole thing won't fit.
  */
-int perform_request(request *request_obj, char **read_buffer) {
-    if (request_obj) {
-        // assume we won't have that many query params. Could calc this too
-        char req_url[strlen(request_obj->url) + 40];
-        strcpy(req_url, request_obj->url);
-        strcat(req_url, "?");
-        for (int i = 0; i < request_obj->num_params; i++) {
-            query_param param = request_obj->params[i];
-            strcat(req_url, param.key);
-            strcat(req_url, "=");
-            strcat(req_url, param.value);
+static bool set_request_url(request *request_obj) {
+    int length = snprintf(request_url, MAX_REQUEST_URL_LENGTH, "%s?", request_obj->url);
+    for (int i = 0; i < request_obj->num_params && length < MAX_REQUEST_URL_LENGTH; i++) {
+        query_param param = request_obj->params[i];
+        length += snprintf(&request_url[length], MAX_REQUEST_URL_LENGTH - length, "%s%s=%s",
+                           i > 0 ? "&" : "", param.key, param.value);
+    }
+
+    if (length >= MAX_REQUEST_URL_LENGTH) {
+        ESP_LOGI(TAG, "Request url too long for buffer: buffer=%d, url=%d", MAX_REQUEST_URL_LENGTH, length);
+        request_url[0] = '\0';
+        return false;
+    }
+
+    const char *url = request_url;
+#if CACHE_DNS_LOOKUPS
+    // Connect straight to the address so the client never does its own lookup.
+    // The server still needs to see the real host name
+    uint32_t addr;
+    int base_length = strlen(URL_BASE);
+    if (strncmp(request_url, URL_BASE, base_length) == 0 && dns_resolve(API_HOST, &addr)) {
+        struct in_addr host_addr = { .s_addr = addr };
+        int connect_length = snprintf(connect_url, MAX_REQUEST_URL_LENGTH, "http://%s/%s", inet_ntoa(host_addr), &request_url[base_length]);
+        // Can't happen with our host name, but go by name if the address doesn't fit
+        if (connect_length < MAX_REQUEST_URL_LENGTH) {
+            url = connect_url;
         }
+    }
+#endif
 
-        ESP_ERROR_CHECK(esp_http_client_set_url(client, req_url));
-        ESP_LOGI(TAG, "Setting url to %s\n", req_url);
+    ESP_ERROR_CHECK(esp_http_client_set_url(client, url));
+#if CACHE_DNS_LOOKUPS
+    // set_url rewrites Host from the url it's given, so this has to come after it
+    if (url == connect_url) {
+        esp_http_client_set_header(client, "Host", API_HOST);
     }
+#endif
+    ESP_LOGI(TAG, "Setting url to %s\n", url);
+    return true;
+}
 
-    esp_err_t error = esp_http_client_perform(client);
+static void close_connection() {
+    // Close current connection but don't free http_client data and un-init with cleanup
+    esp_err_t error = esp_http_client_close(client);
     if (error != ESP_OK) {
+        const char *err_str = esp_err_to_name(error);
+        ESP_LOGI(TAG, "Error closing http client connection: %s", err_str);
+    }
+
+    connection_kept_alive = false;
+}
+
+static void reset_response_headers() {
+    response_headers_seen = false;
+    server_closing = false;
+    response_etag[0] = '\0';
+    response_last_modified[0] = '\0';
+    response_max_age = CACHE_NO_MAX_AGE;
+    response_no_store = false;
+    response_encoding = CONTENT_ENCODING_IDENTITY;
+}
+
+/*
+ * Sends the GET and reads the response headers, reusing the socket from the
+ * last request if it was kept alive. If the server closed that socket while
+ * we were idle, only the socket is reopened and the request is retried once.
+ * On any other failure the client is cleaned up so the main loop does a full
+ * wifi/http re-init.
+ * If the url is cached and still fresh nothing is sent at all, and if it's
+ * cached but stale the stored validators make it a conditional GET. Either
+ * way, REQUEST_CACHED means the caller's last copy of the data is still good.
+ */
+static request_start_result start_request(request *request_obj, int *content_length) {
+    if (request_obj && !set_request_url(request_obj)) {
+        return REQUEST_FAILED;
+    }
+
+    cache_entry *entry = cache_lookup(request_url);
+    if (entry && cache_entry_is_fresh(entry)) {
+        ESP_LOGI(TAG, "Cached response for %s still fresh, skipping request", request_url);
+        cache_record_fresh_hit();
+        return REQUEST_CACHED;
+    }
+
+    if (entry && entry->etag[0]) {
+        esp_http_client_set_header(client, "If-None-Match", entry->etag);
+    }
+    if (entry && entry->last_modified[0]) {
+        esp_http_client_set_header(client, "If-Modified-Since", entry->last_modified);
+    }
+
+    if (ACCEPT_COMPRESSED_RESPONSES && !skip_compression) {
+        esp_http_client_set_header(client, "Accept-Encoding", "gzip, deflate");
+    } else {
+        esp_http_client_delete_header(client, "Accept-Encoding");
+    }
+    skip_compression = false;
+
+    request_start_result result = REQUEST_FAILED;
+    while (true) {
+        bool reusing_connection = connection_kept_alive;
+        connection_opened = false;
+        reset_response_headers();
+
+        esp_err_t error = esp_http_client_open(client, 0);
+        if (error == ESP_OK) {
+            *content_length = esp_http_client_fetch_headers(client);
+        }
+
+        // fetch_headers also returns -1 for chunked responses, so go off of
+        // whether we actually got any headers back to tell if this worked
+        if (error == ESP_OK && response_headers_seen) {
+            conn_stats.requests++;
+            if (connection_opened) {
+                conn_stats.connections_opened++;
+            } else {
+                conn_stats.connections_reused++;
+            }
+
+            ESP_LOGI(TAG, "Connection %s, reused %u of %u requests",
+                     connection_opened ? "opened" : "reused",
+                     conn_stats.connections_reused,
+                     conn_stats.requests);
+
+            if (waiting_for_socket) {
+                uint32_t down_us = (uint32_t)(esp_timer_get_time() - network_down_us);
+                ESP_LOGI(TAG, "First usable socket %ums after boot/reconnect", down_us / 1000);
+                stats_record(STAGE_NETWORK_READY, down_us);
+                waiting_for_socket = false;
+            }
+            result = REQUEST_STARTED;
+            break;
+        }
+
+        close_connection();
+        if (reusing_connection) {
+            ESP_LOGI(TAG, "Kept-alive connection closed by server, reconnecting socket");
+            conn_stats.stale_reconnects++;
+            continue;
+        }
+
         const char *err_text = esp_err_to_name(error);
-        ESP_LOGI(TAG, "Error performing test GET, error: %s", err_text);
+        ESP_LOGI(TAG, "Error performing GET, error: %s", err_text);
+#if CACHE_DNS_LOOKUPS
+        // The host may have moved, look it up fresh next time
+        dns_invalidate(API_HOST);
+#endif
 
         // clean up and re-init client
         error = esp_http_client_cleanup(client);
@@ -232,51 +582,336 @@ int perform_request(request *request_obj, char **read_buffer) {
         }
 
         http_client_inited = false;
-        return NULL;
+        return REQUEST_FAILED;
+    }
+
+    // Don't let this request's validators tag along on the next url
+    esp_http_client_delete_header(client, "If-None-Match");
+    esp_http_client_delete_header(client, "If-Modified-Since");
+
+    if (entry && esp_http_client_get_status_code(client) == 304) {
+        ESP_LOGI(TAG, "Server says %s not modified", request_url);
+        cache_record_revalidated_hit();
+        cache_refresh(entry, response_max_age);
+        finish_request(true);
+        return REQUEST_CACHED;
     }
 
-    int content_length = esp_http_client_get_content_length(client);
+    cache_record_miss();
+    return result;
+}
+
+// Only called once the whole body has been handled, so a cache hit always
+// means the display already has this data
+static void store_response_validators() {
+    bool has_validators = response_etag[0] || response_last_modified[0];
+    if (response_no_store || (!has_validators && response_max_age == CACHE_NO_MAX_AGE)) {
+        return;
+    }
+
+    cache_store(request_url, response_etag, response_last_modified, response_max_age);
+}
+
+/*
+ * Leaves the socket open for the next request only if keep-alive is on, the
+ * whole body was read off of it, and the server didn't say it's closing.
+ */
+static void finish_request(bool body_complete) {
+    if (HTTP_KEEP_ALIVE && body_complete && !server_closing) {
+        connection_kept_alive = true;
+        return;
+    }
+
+    if (server_closing) {
+        conn_stats.server_closes++;
+    }
+
+    close_connection();
+}
+
+static int read_compressed(uint8_t *buf, int length, void *arg) {
+    compressed_body *body = (compressed_body *)arg;
+    stats_timer timer;
+    stats_timer_start(&timer);
+    int length_received = esp_http_client_read(client, (char *)buf, length);
+    body->read_us += stats_timer_elapsed_us(&timer);
+    if (length_received > 0) {
+        body->bytes_read += length_received;
+    }
+
+    return length_received;
+}
+
+static bool write_decompressed(const uint8_t *data, int length, void *arg) {
+    compressed_body *body = (compressed_body *)arg;
+    body->bytes_decoded += length;
+
+    if (body->buffer) {
+        // Leave room for the null terminator
+        if (body->buffer_used + length >= MAX_READ_BUFFER_SIZE) {
+            ESP_LOGI(TAG, "Inflated response too big for read buffer: buffer=%d", MAX_READ_BUFFER_SIZE);
+            return false;
+        }
+
+        memcpy(&body->buffer[body->buffer_used], data, length);
+        body->buffer_used += length;
+        return true;
+    }
+
+    stats_timer timer;
+    stats_timer_start(&timer);
+    bool parsed = json_stream_feed(body->parser, (char *)data, length);
+    body->parse_us += stats_timer_elapsed_us(&timer);
+    if (!parsed) {
+        ESP_LOGI(TAG, "Malformed JSON after %d inflated bytes, dropping rest of response", body->bytes_decoded);
+    }
+
+    return parsed;
+}
+
+/*
+ * Run a gzip/deflate body through inflate to wherever body points. Returns
+ * true only if the whole body was read off the socket and decoded.
+ */
+static bool inflate_body(compressed_body *body) {
+    stats_timer timer;
+    stats_timer_start(&timer);
+    inflate_result result = inflate_stream(response_encoding, read_compressed, write_decompressed, body);
+    uint32_t elapsed_us = stats_timer_elapsed_us(&timer);
+    uint32_t around_us = body->read_us + body->parse_us;
+    uint32_t inflate_us = elapsed_us > around_us ? elapsed_us - around_us : 0;
+
+    stats_record(STAGE_HTTP_BODY, body->read_us);
+    stats_record(STAGE_INFLATE, inflate_us);
+    if (!body->buffer) {
+        stats_record(STAGE_JSON_PARSE, body->parse_us);
+    }
+    conn_stats.body_bytes_received += body->bytes_read;
+    conn_stats.body_bytes_decoded += body->bytes_decoded;
+    ESP_LOGI(TAG, "Inflated %d bytes off the air to %d in %uus: %s",
+             body->bytes_read, body->bytes_decoded, inflate_us, inflate_result_name(result));
+
+    if (result == INFLATE_WINDOW_TOO_SMALL) {
+        ESP_LOGI(TAG, "Server's compression window is bigger than ours, retrying uncompressed");
+        body->window_too_small = true;
+        skip_compression = true;
+    }
+
+    // The stream can end before the body does (like a trailing newline), so
+    // make sure there's nothing left before calling the socket reusable
+    return result == INFLATE_OK && esp_http_client_read(client, body->chunk, STREAM_READ_CHUNK_SIZE) == 0;
+}
+
+/*
+ * request obj is optional, but highly recommended to ensure the
+ * right url/params are set up. If not supplied, request will be
+ * performed using whatever was last set.
+ * read_buffer comes from the cycle arena and is good until arena_reset.
+ * Returns bytes used in read_buffer including the null terminator, 0 on
+ * failure or if the body didn't all make it, REQUEST_NOT_MODIFIED if the last response for this url is
+ * still good (read_buffer is left NULL), or REQUEST_RETRY_UNCOMPRESSED.
+ */
+int perform_request(request *request_obj, char **read_buffer) {
+    *read_buffer = NULL;
+
+    int content_length;
+    stats_timer timer;
+    stats_timer_start(&timer);
+    request_start_result result = start_request(request_obj, &content_length);
+    if (result == REQUEST_FAILED) {
+        return 0;
+    } else if (result == REQUEST_CACHED) {
+        return REQUEST_NOT_MODIFIED;
+    }
+    stats_record(STAGE_HTTP_CONNECT, stats_timer_elapsed_us(&timer));
+
     int status = esp_http_client_get_status_code(client);
     if (status >= 200 && status <= 299) {
         ESP_LOGI(TAG, "GET success! Status=%d, Content-length=%d", status, content_length);
     } else {
         ESP_LOGI(TAG, "GET failed. Status=%d, Content-length=%d", status, content_length);
-        error = esp_http_client_close(client);
-        if (error != ESP_OK) {
-            const char *err_str = esp_err_to_name(error);
-            ESP_LOGI(TAG, "Error closing http client connection: %s", err_str);
-            return 0;
-        }
+        finish_request(false);
+        return 0;
     }
 
     int alloced_space_used = 0;
-    if (content_length < MAX_READ_BUFFER_SIZE) {
-        // Did a lot of work here to try to read into buffer in chunks since default response buffer
-        // inside client is inited to ~512 bytes but something's borked in the SDK. This is technically
-        // double-allocating buffers of MAX_READ_BUFFER_SIZE since there's one internally and another
-        // here, but hopefully the quick malloc/free shouldn't cause any issues
-        *read_buffer = malloc(content_length + 1);
-        int length_received = esp_http_client_read(client, *read_buffer, content_length);
-        (*read_buffer)[length_received + 1] = '\0';
+    bool body_complete = false;
+    if (response_encoding != CONTENT_ENCODING_IDENTITY) {
+        // Content-length is the compressed size, so there's no knowing how
+        // big it'll be until it's inflated. Give it the most we'd ever allow
+        stats_timer_start(&timer);
+        *read_buffer = arena_alloc(MAX_READ_BUFFER_SIZE);
+        char *chunk = arena_alloc(STREAM_READ_CHUNK_SIZE);
+        stats_record(STAGE_RESPONSE_ALLOC, stats_timer_elapsed_us(&timer));
+        if (*read_buffer == NULL || chunk == NULL) {
+            finish_request(false);
+            return 0;
+        }
+
+        compressed_body body = { .buffer = *read_buffer, .chunk = chunk };
+        body_complete = inflate_body(&body);
+        if (body.window_too_small) {
+            finish_request(false);
+            return REQUEST_RETRY_UNCOMPRESSED;
+        }
+        (*read_buffer)[body.buffer_used] = '\0';
+        alloced_space_used = body.buffer_used + 1;
+    } else if (content_length >= 0 && content_length < MAX_READ_BUFFER_SIZE) {
+        // Read in a loop since the client hands back at most its internal buffer size per read
+        stats_timer_start(&timer);
+        *read_buffer = arena_alloc(content_length + 1);
+        stats_record(STAGE_RESPONSE_ALLOC, stats_timer_elapsed_us(&timer));
+        if (*read_buffer == NULL) {
+            finish_request(false);
+            return 0;
+        }
+
+        stats_timer_start(&timer);
+        int length_received = 0;
+        while (length_received < content_length) {
+            int read_length = esp_http_client_read(client, *read_buffer + length_received, content_length - length_received);
+            if (read_length <= 0) {
+                break;
+            }
+            length_received += read_length;
+        }
+
+        stats_record(STAGE_HTTP_BODY, stats_timer_elapsed_us(&timer));
+        conn_stats.body_bytes_received += length_received;
+        conn_stats.body_bytes_decoded += length_received;
+
+        (*read_buffer)[length_received] = '\0';
         alloced_space_used = length_received + 1;
+        body_complete = length_received == content_length;
     } else {
         ESP_LOGI(TAG, "Not enough room in read buffer: buffer=%d, content=%d", MAX_READ_BUFFER_SIZE, content_length);
     }
 
-    // Close current connection but don't free http_client data and un-init with cleanup
-    error = esp_http_client_close(client);
-    if (error != ESP_OK) {
-        const char *err_str = esp_err_to_name(error);
-        ESP_LOGI(TAG, "Error closing http client connection: %s", err_str);
+    finish_request(body_complete);
+    if (!body_complete) {
+        ESP_LOGI(TAG, "Response body not read in full, dropping it");
+        return 0;
     }
 
     return alloced_space_used;
 }
 
+/*
+ * Call once a body from perform_request has been parsed and had the whole
+ * list in it. Only then are its validators cached, so a body that turned out
+ * to be malformed is fetched again in full next time rather than 304ed.
+ */
+void perform_request_parsed() {
+    store_response_validators();
+}
+
+/*
+ * Same as perform_request, but instead of buffering the whole body it's read
+ * in STREAM_READ_CHUNK_SIZE pieces and fed straight through the json stream
+ * parser, which hands off each list string as it completes. There's no limit
+ * on response size since nothing but the parser state is held between chunks.
+ * The chunk comes from the cycle arena.
+ * Returns the number of body bytes read only if the whole body arrived and
+ * parsed into a complete list. 0 on any failure (including a cut off or
+ * malformed body, after which the parser's list is partial),
+ * REQUEST_NOT_MODIFIED if the last response for this url is still good, or
+ * REQUEST_RETRY_UNCOMPRESSED.
+ */
+int perform_streamed_request(request *request_obj, json_stream_parser *parser) {
+    int content_length;
+    stats_timer timer;
+    stats_timer_start(&timer);
+    request_start_result result = start_request(request_obj, &content_length);
+    if (result == REQUEST_FAILED) {
+        return 0;
+    } else if (result == REQUEST_CACHED) {
+        return REQUEST_NOT_MODIFIED;
+    }
+    stats_record(STAGE_HTTP_CONNECT, stats_timer_elapsed_us(&timer));
+
+    char *chunk = arena_alloc(STREAM_READ_CHUNK_SIZE);
+    if (chunk == NULL) {
+        finish_request(false);
+        return 0;
+    }
+
+    int status = esp_http_client_get_status_code(client);
+    int total_read = 0;
+    bool body_complete = false;
+    if (status >= 200 && status <= 299 && response_encoding != CONTENT_ENCODING_IDENTITY) {
+        ESP_LOGI(TAG, "GET success! Status=%d, Content-length=%d, compressed", status, content_length);
+        compressed_body body = { .parser = parser, .chunk = chunk };
+        body_complete = inflate_body(&body);
+        if (body.window_too_small) {
+            finish_request(false);
+            return REQUEST_RETRY_UNCOMPRESSED;
+        }
+        total_read = body.bytes_read;
+    } else if (status >= 200 && status <= 299) {
+        ESP_LOGI(TAG, "GET success! Status=%d, Content-length=%d", status, content_length);
+
+        // Content-length is -1 for chunked responses, so just read until the client says we're done
+        // Reads and parsing alternate, so add each up over the whole body
+        uint32_t read_us = 0;
+        uint32_t parse_us = 0;
+        int length_received;
+        while (1) {
+            stats_timer_start(&timer);
+            length_received = esp_http_client_read(client, chunk, STREAM_READ_CHUNK_SIZE);
+            read_us += stats_timer_elapsed_us(&timer);
+            if (length_received <= 0) {
+                break;
+            }
+
+            total_read += length_received;
+            stats_timer_start(&timer);
+            bool parsed = json_stream_feed(parser, chunk, length_received);
+            parse_us += stats_timer_elapsed_us(&timer);
+            if (!parsed) {
+                ESP_LOGI(TAG, "Malformed JSON after %d bytes, dropping rest of response", total_read);
+                break;
+            }
+        }
+        stats_record(STAGE_HTTP_BODY, read_us);
+        stats_record(STAGE_JSON_PARSE, parse_us);
+        conn_stats.body_bytes_received += total_read;
+        conn_stats.body_bytes_decoded += total_read;
+
+        if (length_received < 0) {
+            ESP_LOGI(TAG, "Error reading streamed response after %d bytes", total_read);
+        }
+        body_complete = length_received == 0;
+    } else {
+        ESP_LOGI(TAG, "GET failed. Status=%d, Content-length=%d", status, content_length);
+    }
+
+    // The socket's fine to reuse as long as the body was all read, but the
+    // list is only any good if it parsed all the way through
+    finish_request(body_complete);
+    if (!body_complete || !json_stream_complete(parser)) {
+        if (status >= 200 && status <= 299) {
+            ESP_LOGI(TAG, "No complete '%s' list in response after %d bytes, dropping it", JSON_STREAM_LIST_KEY, total_read);
+        }
+        return 0;
+    }
+
+    store_response_validators();
+    return total_read;
+}
+
+connection_stats get_connection_stats() {
+    return conn_stats;
+}
+
+wifi_connect_stats get_wifi_connect_stats() {
+    return wifi_stats;
+}
+
 // Caller passes in endpoint (tides/swell) the values for the 2 query params,
-// a pointer to a block of already-allocated memory for the base url + endpoint,
-// and a pointer to a block of already-allocated memory to hold the query params structs
-request build_request(char* endpoint, char *spot, char *days, char *url_buf, query_param *params) {
+// a pointer to a block of already-allocated memory (and its length) for the
+// base url + endpoint, and a pointer to a block of already-allocated memory to
+// hold the query params structs. Returns false if the url doesn't fit in url_buf
+bool build_request(char* endpoint, char *spot, char *days, char *url_buf, int url_buf_length, query_param *params, request *request_out) {
     query_param temp_params[] = {
         {
             .key = "days",
@@ -290,13 +925,18 @@ request build_request(char* endpoint, char *spot, char *days, char *url_buf, que
 
     memcpy(params, temp_params, sizeof(temp_params));
 
-    strcpy(url_buf, URL_BASE);
-    strcat(url_buf, endpoint);
+    int length = snprintf(url_buf, url_buf_length, "%s%s", URL_BASE, endpoint);
+    if (length >= url_buf_length) {
+        ESP_LOGI(TAG, "Url for %s too long for buffer: buffer=%d, url=%d", endpoint, url_buf_length, length);
+        return false;
+    }
+
     request tide_request = {
         .url = url_buf,
         .params = params,
         .num_params = sizeof(temp_params) / sizeof(query_param)
     };
 
-    return tide_request;
+    *request_out = tide_request;
+    return true;
 }
@@ -0,0 +1,155 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "constants.h"
+#include "timer.h"
+#include "power.h"
+#include "events.h"
+#include "gpio.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+RTC_DATA_ATTR static power_stats stats;
+
+static bool woke_from_deep_sleep;
+
+// esp_timer time of the last wake, 0 is boot. Then when the current request
+// cycle started and when the one before it started
+static int64_t wake_us = 0;
+static int64_t cycle_start_us;
+static bool first_cycle = true;
+
+#if POWER_MODE == POWER_MODE_LIGHT_SLEEP
+// Posts the request a button wake left still to come
+static soft_timer request_due_timer;
+
+static void request_due_callback(void *callback_arg) {
+    post_event_from_isr(EVENT_REQUEST_DUE);
+}
+#endif
+
+/*
+ * Call once wifi is up. Restores stats kept through deep sleep and picks the
+ * radio's power save. Plain modem sleep only saves anything over the SDK's
+ * default if the radio skips beacons, light sleep gets its savings from
+ * halting and keeps the radio quick to answer while it's awake
+ */
+void init_power() {
+    woke_from_deep_sleep = esp_reset_reason() == ESP_RST_DEEPSLEEP && stats.magic == POWER_STATE_MAGIC;
+    if (!woke_from_deep_sleep) {
+        memset(&stats, 0, sizeof(stats));
+        stats.magic = POWER_STATE_MAGIC;
+    }
+
+#if POWER_MODE == POWER_MODE_MODEM_SLEEP
+    // Listen interval comes from the station config set in network.c
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
+#elif POWER_MODE == POWER_MODE_LIGHT_SLEEP
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MIN_MODEM));
+#else
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+#endif
+}
+
+bool power_woke_from_deep_sleep() {
+    return woke_from_deep_sleep;
+}
+
+// Call as a request cycle begins
+void power_cycle_start() {
+    cycle_start_us = esp_timer_get_time();
+#if POWER_MODE == POWER_MODE_LIGHT_SLEEP
+    // A button press got in before a request left over from a wake did
+    timer_cancel(&request_due_timer);
+#endif
+
+    // Only the sleeping modes have a wake to measure from, but the first
+    // cycle after boot is still worth knowing for the others
+    if (POWER_SCHEDULES_REQUESTS || first_cycle) {
+        stats.wake_to_ready_us = cycle_start_us - wake_us;
+    }
+}
+
+static uint32_t time_until_next_request_us(int64_t now_us) {
+    int64_t sleep_us = (int64_t)REQUEST_PERIOD_MS * 1000
+        - (now_us - cycle_start_us)
+        - stats.wake_to_ready_us;
+
+    return sleep_us > 0 ? (uint32_t)sleep_us : 0;
+}
+
+/*
+ * Call once the cycle's data has gone out to the display. In the modes that
+ * stay awake this just records stats and returns. Light sleep returns once
+ * it's time for the next request (and posts EVENT_REQUEST_DUE so the main
+ * loop knows) or as soon as the button is pressed. After a button wake the
+ * rest of the period is spent awake, so the gesture timers can run, and a
+ * soft timer posts the request when it's due. Deep sleep doesn't return at all.
+ */
+void power_sleep_until_next_request() {
+    int64_t now_us = esp_timer_get_time();
+    if (POWER_SCHEDULES_REQUESTS || first_cycle) {
+        stats.wake_to_data_us = now_us - wake_us;
+    }
+    first_cycle = false;
+
+    stats.cycles++;
+    stats.awake_us += now_us - wake_us;
+    wake_us = now_us;
+
+    uint32_t sleep_us = time_until_next_request_us(now_us);
+    ESP_LOGI(TAG, "Cycle %u: wake to data %ums, awake %d%% of the time, sleeping %ums",
+             stats.cycles,
+             stats.wake_to_data_us / 1000,
+             get_duty_cycle_percent(),
+             sleep_us / 1000);
+
+#if POWER_MODE == POWER_MODE_LIGHT_SLEEP
+    uint32_t slept_us = 0;
+    if (sleep_us > 0) {
+        ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(sleep_us));
+        ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+        button_wakeup_enable(true);
+        esp_light_sleep_start();
+        button_wakeup_enable(false);
+
+        slept_us = (uint32_t)(esp_timer_get_time() - now_us);
+        stats.asleep_us += slept_us;
+    }
+
+    wake_us = esp_timer_get_time();
+    if (slept_us + TIMER_TICK_MS * 1000 < sleep_us) {
+        ESP_LOGI(TAG, "Woken by the button %ums early", (sleep_us - slept_us) / 1000);
+        button_edge_from_wake();
+        post_event(EVENT_BUTTON_CHANGED);
+        timer_start(&request_due_timer, (sleep_us - slept_us) / 1000, 0, request_due_callback, NULL);
+    } else {
+        post_event(EVENT_REQUEST_DUE);
+    }
+#elif POWER_MODE == POWER_MODE_DEEP_SLEEP
+    // esp_timer starts back at 0 after the reboot, so wake_us = 0 is right
+    stats.asleep_us += sleep_us;
+    esp_deep_sleep(sleep_us);
+#endif
+    // Otherwise we stay awake and the wait for the next timer event gets
+    // counted as awake time at the end of the next cycle
+}
+
+power_stats get_power_stats() {
+    return stats;
+}
+
+uint8_t get_duty_cycle_percent() {
+    uint64_t total_us = stats.awake_us + stats.asleep_us;
+    if (total_us == 0) {
+        return 100;
+    }
+
+    return (uint8_t)((stats.awake_us * 100) / total_us);
+}
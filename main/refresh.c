@@ -0,0 +1,459 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "refresh.h"
+#include "network.h"
+#include "json.h"
+#include "messages.h"
+#include "stats.h"
+#include "link.h"
+#include "arena.h"
+#include "store.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static char *spots[] = REFRESH_SPOTS;
+static char *endpoints[] = REFRESH_ENDPOINTS;
+
+#define NUM_SPOTS (sizeof(spots) / sizeof(spots[0]))
+#define NUM_ENDPOINTS (sizeof(endpoints) / sizeof(endpoints[0]))
+#define NUM_SOURCES (NUM_SPOTS * NUM_ENDPOINTS)
+
+// Queued or being sent, plus the one being fetched into
+#define NUM_BATCHES (REFRESH_QUEUE_DEPTH + 1)
+
+typedef enum {
+    BATCH_UPDATED,
+    BATCH_NOT_MODIFIED,
+    BATCH_FAILED,
+    // Not a source, just a nudge to send every last list as they are
+    BATCH_SAVED
+} batch_status;
+
+// One source's response, parsed by the network task and waiting to be sent
+typedef struct {
+    message_list list;
+    uint8_t source;
+    batch_status status;
+} refresh_batch;
+
+static refresh_batch batches[NUM_BATCHES];
+// Both hold refresh_batch pointers. Every batch is always in exactly one of
+// them or held by one of the two tasks, so running out of free ones is what
+// bounds the queue and full_batches itself never blocks
+static QueueHandle_t free_batches;
+static QueueHandle_t full_batches;
+static SemaphoreHandle_t refresh_done;
+
+// Whether each half of the pipeline is working and since when
+typedef struct {
+    bool busy;
+    int64_t since_us;
+} stage_activity;
+
+static pipeline_stats stats;
+static pipeline_stats stats_at_start;
+static stage_activity fetching;
+static stage_activity outputting;
+static int64_t both_busy_since_us;
+
+// What each spot/endpoint pair last sent, or had saved in flash at boot, so
+// one that comes back not modified (or fails) can still be part of the
+// merged list. This and the state below belong to the output task
+static message_list last_lists[NUM_SOURCES];
+// Set once a source's last list came from a fully parsed response (or the
+// saved record). Nothing is saved until every source has one, so a source
+// that's never fetched right can't blank out what was saved for it
+static bool last_list_good[NUM_SOURCES];
+
+// State for the refresh being sent
+static bool list_started;
+static int values_sent;
+// What of the display's list (see get_link_capacity) the refresh has used,
+// once a string doesn't fit the rest of the list is left off
+static int display_bytes_used;
+static bool display_full;
+static bool displayed_since_boot;
+
+#if LINK_SENDS_DELTAS
+// The whole list is built up before anything is sent so it can be diffed
+// against what the display already has
+static message_list merged_list;
+#endif
+
+static void add_merged_value(const char *value, int length) {
+    link_capacity capacity = get_link_capacity();
+    int bytes = message_display_bytes(value, length);
+    if (display_full || values_sent >= capacity.strings || display_bytes_used + bytes > capacity.bytes) {
+        if (!display_full) {
+            ESP_LOGI(TAG, "Display full after %d strings, %d bytes, leaving off the rest", values_sent, display_bytes_used);
+        }
+        display_full = true;
+        stats.values_capped++;
+        return;
+    }
+    display_bytes_used += bytes;
+
+#if LINK_SENDS_DELTAS
+    message_list_add(&merged_list, value, length);
+#else
+    send_list_item(value, length);
+#endif
+    values_sent++;
+}
+
+static void add_merged_list(const message_list *list) {
+    for (int i = 0; i < list->count; i++) {
+        int length;
+        const char *text = message_list_get(list, i, &length);
+        add_merged_value(text, length);
+    }
+}
+
+/*
+ * Nothing goes to the display until some source actually has new data. At
+ * that point every source before it was unchanged, so their last lists go
+ * out first to keep the merged list in order.
+ */
+static void start_merged_list(int source) {
+#if LINK_SENDS_DELTAS
+    message_list_clear(&merged_list);
+#else
+    send_list_start();
+#endif
+    list_started = true;
+    display_bytes_used = 0;
+    display_full = false;
+    for (int i = 0; i < source; i++) {
+        add_merged_list(&last_lists[i]);
+    }
+}
+
+static void finish_merged_list() {
+#if LINK_SENDS_DELTAS
+    message_list_send_update(&merged_list);
+#else
+    send_list_end();
+#endif
+
+    if (!displayed_since_boot) {
+        displayed_since_boot = true;
+        stats_record(STAGE_FIRST_DISPLAY, (uint32_t)esp_timer_get_time());
+    }
+}
+
+/*
+ * Merge one source into the refresh. The first one with new data starts the
+ * list, anything unchanged or failed after that fills in with its last list,
+ * and the final source finishes it off.
+ */
+static void output_batch(refresh_batch *batch) {
+    if (batch->source == 0) {
+        list_started = false;
+        values_sent = 0;
+    }
+
+    if (batch->status == BATCH_UPDATED) {
+        memcpy(&last_lists[batch->source], &batch->list, sizeof(message_list));
+        last_list_good[batch->source] = true;
+        if (!list_started) {
+            start_merged_list(batch->source);
+        }
+        add_merged_list(&last_lists[batch->source]);
+    } else if (list_started) {
+        add_merged_list(&last_lists[batch->source]);
+    }
+
+    if (batch->source == NUM_SOURCES - 1 && list_started) {
+        finish_merged_list();
+#if SAVE_LAST_LISTS
+        // Failed sources still hold what they last had, so their part of the
+        // record stays as it was
+        bool all_good = true;
+        for (int i = 0; i < NUM_SOURCES; i++) {
+            all_good = all_good && last_list_good[i];
+        }
+        if (all_good) {
+            store_save(last_lists, NUM_SOURCES);
+        } else {
+            ESP_LOGI(TAG, "Not saving lists until every source has fetched once");
+        }
+#endif
+    }
+}
+
+// Everything saved at boot, as one list
+static void output_saved() {
+    list_started = false;
+    values_sent = 0;
+    start_merged_list(NUM_SOURCES);
+    finish_merged_list();
+}
+
+/*
+ * Each task flips only its own stage, the critical section keeps the pair,
+ * and the totals they add to, consistent for working out the overlap.
+ */
+static void set_busy(stage_activity *stage, uint64_t *stage_total_us, bool busy) {
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL();
+    bool was_overlapping = fetching.busy && outputting.busy;
+    if (busy) {
+        stage->since_us = now_us;
+    } else {
+        *stage_total_us += now_us - stage->since_us;
+    }
+    stage->busy = busy;
+
+    bool overlapping = fetching.busy && outputting.busy;
+    if (overlapping && !was_overlapping) {
+        both_busy_since_us = now_us;
+    } else if (was_overlapping && !overlapping) {
+        stats.overlap_us += now_us - both_busy_since_us;
+    }
+    portEXIT_CRITICAL();
+}
+
+static void output_task(void *args) {
+    while (1) {
+        refresh_batch *batch;
+        if (xQueueReceive(full_batches, &batch, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        set_busy(&outputting, &stats.output_us, true);
+        bool refresh_finished = false;
+        if (batch->status == BATCH_SAVED) {
+            output_saved();
+        } else {
+            output_batch(batch);
+            refresh_finished = batch->source == NUM_SOURCES - 1;
+        }
+        set_busy(&outputting, &stats.output_us, false);
+
+        xQueueSend(free_batches, &batch, portMAX_DELAY);
+        if (refresh_finished) {
+            xSemaphoreGive(refresh_done);
+        }
+    }
+}
+
+static void collect_value(char *value, int length, void *handler_arg) {
+    message_list_add((message_list *)handler_arg, value, length);
+}
+
+/*
+ * Returns bytes read off the body, 0 on failure, or REQUEST_NOT_MODIFIED.
+ * Only a body that came in whole with the full list in it counts. Anything
+ * short of that fails, and whatever had made it into list is ignored.
+ * A compressed response inflate can't handle is fetched again uncompressed,
+ * throwing away whatever of it had already been parsed.
+ */
+#if STREAM_JSON_RESPONSES
+// Parsed as it comes off the socket, nothing but the list is kept. The
+// parser lives in the arena alongside the read chunk
+static int fetch_streamed(request *request, message_list *list) {
+    json_stream_parser *parser = arena_alloc(sizeof(json_stream_parser));
+    if (parser == NULL) {
+        return 0;
+    }
+
+    json_stream_init(parser, collect_value, list);
+    return perform_streamed_request(request, parser);
+}
+#endif
+
+static int fetch_source(request *request, message_list *list) {
+#if STREAM_JSON_RESPONSES
+    int result = fetch_streamed(request, list);
+    if (result == REQUEST_RETRY_UNCOMPRESSED) {
+        // Nothing from the first try is kept, the second gets the whole arena
+        message_list_clear(list);
+        arena_reset();
+        result = fetch_streamed(request, list);
+    }
+
+    return result == REQUEST_RETRY_UNCOMPRESSED ? 0 : result;
+#else
+    char *server_response;
+    int data_length = perform_request(request, &server_response);
+    if (data_length == REQUEST_RETRY_UNCOMPRESSED) {
+        // The first try's buffer is all that's in the arena, make room for the second
+        arena_reset();
+        data_length = perform_request(request, &server_response);
+    }
+
+    if (data_length > 0) {
+        // data_length includes the null terminator
+        stats_timer timer;
+        stats_timer_start(&timer);
+        json_list_iter iter;
+        char *value;
+        int value_length;
+        bool list_complete = false;
+        if (json_list_find(&iter, server_response, data_length - 1)) {
+            while (json_list_next(&iter, &value, &value_length)) {
+                collect_value(value, value_length, list);
+            }
+            list_complete = iter.complete;
+        }
+        stats_record(STAGE_JSON_PARSE, stats_timer_elapsed_us(&timer));
+
+        if (list_complete) {
+            perform_request_parsed();
+        } else {
+            ESP_LOGI(TAG, "No complete '%s' list in response", JSON_STREAM_LIST_KEY);
+            data_length = 0;
+        }
+    }
+
+    // server_response is in the arena, refresh_all resets it
+    return data_length == REQUEST_RETRY_UNCOMPRESSED ? 0 : data_length;
+#endif
+}
+
+void init_refresh() {
+    memset(&stats, 0, sizeof(stats));
+    free_batches = xQueueCreate(NUM_BATCHES, sizeof(refresh_batch *));
+    full_batches = xQueueCreate(NUM_BATCHES, sizeof(refresh_batch *));
+    refresh_done = xSemaphoreCreateBinary();
+    for (int i = 0; i < NUM_BATCHES; i++) {
+        refresh_batch *batch = &batches[i];
+        xQueueSend(free_batches, &batch, 0);
+    }
+
+    // Same priority as the network side, each spends most of its time
+    // blocked on a socket or the display's ACKs
+    xTaskCreate(output_task, "refresh_output", REFRESH_OUTPUT_STACK_SIZE, NULL, uxTaskPriorityGet(NULL), NULL);
+}
+
+#if SAVE_LAST_LISTS
+/*
+ * Fill in every source's last list from flash, so they're there to fall
+ * back on even if the first fetches fail. With show they go out to the
+ * display too, from the output task, while wifi is still coming up.
+ * Call before the first refresh_all.
+ */
+void refresh_load_saved(bool show) {
+    // The output task won't look at last_lists until it gets a batch
+    if (!store_load(last_lists, NUM_SOURCES)) {
+        return;
+    }
+
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        last_list_good[i] = true;
+    }
+    if (!show) {
+        return;
+    }
+
+    refresh_batch *batch;
+    xQueueReceive(free_batches, &batch, portMAX_DELAY);
+    batch->status = BATCH_SAVED;
+    xQueueSend(full_batches, &batch, portMAX_DELAY);
+}
+#endif
+
+/*
+ * Fetch every endpoint for every spot back to back, so with keep-alive they
+ * all go over the one connection, and send the display a single list with
+ * all of them in order. Sources that weren't modified or failed fill in with
+ * what they sent last time. If nothing at all changed nothing is sent and
+ * the display keeps its list. With LINK_SENDS_DELTAS the merged list is
+ * diffed against the last one and only the strings that changed go out.
+ *
+ * This is the network half. Each parsed source is queued for the output
+ * task, so the next one downloads while the last one goes to the display.
+ * Returns once everything's fetched, refresh_wait_done waits for the sending.
+ */
+void refresh_all() {
+    stats_at_start = get_pipeline_stats();
+
+    for (int source = 0; source < NUM_SOURCES; source++) {
+        char *spot = spots[source / NUM_ENDPOINTS];
+        char *endpoint = endpoints[source % NUM_ENDPOINTS];
+
+        refresh_batch *batch;
+        int64_t wait_start_us = esp_timer_get_time();
+        xQueueReceive(free_batches, &batch, portMAX_DELAY);
+        stats.producer_wait_us += esp_timer_get_time() - wait_start_us;
+        set_busy(&fetching, &stats.fetch_us, true);
+
+        // Sometimes stuff gets screwy and run out of sockets. When that happens
+        // we fully cleanup our http_client and re-init it
+        if (!http_client_inited) {
+            ESP_LOGI(TAG, "http_client not yet inited, doing it now before request");
+            stats_timer timer;
+            stats_timer_start(&timer);
+            init_wifi();
+            stats_record(STAGE_WIFI_CONNECT, stats_timer_elapsed_us(&timer));
+            init_http();
+        }
+
+        char url_buf[REFRESH_MAX_URL_LENGTH];
+        query_param params[2];
+        request request;
+        message_list_clear(&batch->list);
+        int result = 0;
+        if (build_request(endpoint, spot, REFRESH_DAYS, url_buf, REFRESH_MAX_URL_LENGTH, params, &request)) {
+            result = fetch_source(&request, &batch->list);
+        }
+
+        // Everything worth keeping from the response was copied into the
+        // batch, so each source gets the whole arena to itself
+        arena_reset();
+
+        batch->source = source;
+        if (result > 0) {
+            batch->status = BATCH_UPDATED;
+        } else if (result == REQUEST_NOT_MODIFIED) {
+            batch->status = BATCH_NOT_MODIFIED;
+        } else {
+            batch->status = BATCH_FAILED;
+        }
+
+        set_busy(&fetching, &stats.fetch_us, false);
+
+        // Count ourselves in, messages_waiting can't see what we're about to add
+        uint32_t depth = uxQueueMessagesWaiting(full_batches) + 1;
+        xQueueSend(full_batches, &batch, portMAX_DELAY);
+        stats.batches++;
+        stats.queue_depth_total += depth;
+        if (depth > stats.max_queue_depth) {
+            stats.max_queue_depth = depth;
+        }
+
+        ESP_LOGI(TAG, "%s %s: %s", spot, endpoint,
+                 result == REQUEST_NOT_MODIFIED ? "not modified" : (result > 0 ? "updated" : "failed"));
+    }
+}
+
+/*
+ * Block until the output task is done with the last refresh_all.
+ * Returns the number of strings sent.
+ */
+int refresh_wait_done() {
+    xSemaphoreTake(refresh_done, portMAX_DELAY);
+
+    pipeline_stats now = get_pipeline_stats();
+    ESP_LOGI(TAG, "Refresh fetched in %dms, output in %dms, %dms of that at the same time",
+             (int)((now.fetch_us - stats_at_start.fetch_us) / 1000),
+             (int)((now.output_us - stats_at_start.output_us) / 1000),
+             (int)((now.overlap_us - stats_at_start.overlap_us) / 1000));
+
+    return values_sent;
+}
+
+pipeline_stats get_pipeline_stats() {
+    portENTER_CRITICAL();
+    pipeline_stats copy = stats;
+    portEXIT_CRITICAL();
+    return copy;
+}
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "driver/uart.h"
+
+#include "constants.h"
+#include "stats.h"
+#include "uart.h"
+#include "arena.h"
+#include "refresh.h"
+#include "store.h"
+#include "link.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+static const char *stage_names[STAGE_COUNT] = {
+    "wifi",
+    "connect",
+    "body",
+    "alloc",
+    "parse",
+    "link",
+    "cycle",
+    "ready",
+    "dns",
+    "inflate",
+    "first"
+};
+
+static stage_histogram histograms[STAGE_COUNT];
+
+// Lowest free heap seen at any stage boundary since boot
+static uint32_t min_free_heap = UINT32_MAX;
+
+/*
+ * Smallest largest-free-block seen at a stage boundary. Free heap alone can
+ * look healthy while it's too fragmented to hand out a response buffer.
+ */
+static uint32_t min_largest_free_block = UINT32_MAX;
+
+#if !ESP_01
+/*
+ * On the dev board UART0 is only the console, so listen on it for a line
+ * saying STATS_COMMAND. On the ESP-01 UART0 is the display link, there the
+ * dump happens on whatever asks for it in app_main.
+ */
+static void stats_console_task(void *arg) {
+    char line[STATS_COMMAND_MAX_LENGTH];
+    int line_length = 0;
+    uint8_t c;
+
+    while (1) {
+        if (uart_read_bytes(UART_NUM_0, &c, 1, portMAX_DELAY) != 1) {
+            continue;
+        }
+
+        if (c == '\r' || c == '\n') {
+            line[line_length] = '\0';
+            if (strcmp(line, STATS_COMMAND) == 0) {
+                stats_dump();
+            }
+            line_length = 0;
+        } else if (line_length < STATS_COMMAND_MAX_LENGTH - 1) {
+            line[line_length++] = c;
+        }
+    }
+}
+#endif
+
+void init_stats() {
+#if !ESP_01
+    uart_driver_install(UART_NUM_0, UART_BUF_SIZE, 0, 0, NULL, 0);
+    xTaskCreate(stats_console_task, "stats_console", 2048, NULL, tskIDLE_PRIORITY + 1, NULL);
+#endif
+    stats_sample_heap();
+}
+
+void stats_timer_start(stats_timer *timer) {
+    timer->start_us = esp_timer_get_time();
+}
+
+uint32_t stats_timer_elapsed_us(stats_timer *timer) {
+    return (uint32_t)(esp_timer_get_time() - timer->start_us);
+}
+
+/*
+ * Called from the main, output and DNS tasks, and stats_dump can run on the
+ * console task, so the histogram update and the heap minimums go under a
+ * critical section. Only a handful of stores, cheap enough to not be worth
+ * a mutex.
+ */
+void stats_record(stats_stage stage, uint32_t duration_us) {
+    stage_histogram *histogram = &histograms[stage];
+    uint32_t duration_ms = duration_us / 1000;
+
+    // Number of bits needed for the ms value, 0ms lands in bucket 0, 1ms in 1, 2-3ms in 2...
+    int bucket = duration_ms == 0 ? 0 : 32 - __builtin_clz(duration_ms);
+    if (bucket >= STATS_HISTOGRAM_BUCKETS) {
+        bucket = STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    portENTER_CRITICAL();
+    // Saturate rather than wrap so a long uptime can't make a bucket look empty
+    if (histogram->buckets[bucket] < UINT16_MAX) {
+        histogram->buckets[bucket]++;
+    }
+    histogram->count++;
+    histogram->total_us += duration_us;
+    if (duration_us > histogram->max_us) {
+        histogram->max_us = duration_us;
+    }
+    portEXIT_CRITICAL();
+
+    stats_sample_heap();
+}
+
+void stats_sample_heap() {
+    // Both of these take the heap lock themselves, keep them outside ours
+    uint32_t free_heap = esp_get_free_heap_size();
+    uint32_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    portENTER_CRITICAL();
+    if (free_heap < min_free_heap) {
+        min_free_heap = free_heap;
+    }
+    if (largest_free_block < min_largest_free_block) {
+        min_largest_free_block = largest_free_block;
+    }
+    portEXIT_CRITICAL();
+}
+
+/*
+ * One line per stage that's run at least once, then one each for the heap,
+ * the cycle arena, the refresh pipeline and the saved lists:
+ *   S <stage> n=<count> avg=<us> max=<us> h=<bucket 0>,<bucket 1>,...
+ *   H free=<bytes> min=<lowest at a stage boundary> sys_min=<lowest ever> block=<largest free> block_min=
+ *   A size=<bytes> high=<most used in a cycle> allocs= failed= resets=
+ *   P n=<sources> depth=<avg queued, x100> max= wait=<ms> fetch=<ms> out=<ms> both=<ms>
+ *   F loaded=<0/1> record=<bytes> saves= writes= unchanged= failed= written=<bytes> load=<us>
+ * Goes out with printf so it shows regardless of log level. When UART0 is
+ * the display link there's nowhere safe to print, so nothing is.
+ */
+void stats_dump() {
+#if !LINK_SHARES_CONSOLE
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        stage_histogram histogram = get_stage_histogram(stage);
+        if (histogram.count == 0) {
+            continue;
+        }
+
+        printf("S %s n=%u avg=%u max=%u h=",
+               stage_names[stage],
+               histogram.count,
+               (uint32_t)(histogram.total_us / histogram.count),
+               histogram.max_us);
+        for (int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+            printf(bucket == 0 ? "%u" : ",%u", histogram.buckets[bucket]);
+        }
+        printf("\n");
+    }
+
+    uint32_t free_heap = esp_get_free_heap_size();
+    uint32_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    portENTER_CRITICAL();
+    uint32_t min_heap = min_free_heap;
+    uint32_t min_block = min_largest_free_block;
+    portEXIT_CRITICAL();
+    printf("H free=%u min=%u sys_min=%u block=%u block_min=%u\n",
+           free_heap,
+           min_heap,
+           esp_get_minimum_free_heap_size(),
+           largest_free_block,
+           min_block);
+
+    arena_stats arena = get_arena_stats();
+    printf("A size=%u high=%u allocs=%u failed=%u resets=%u\n",
+           arena.size,
+           arena.high_water,
+           arena.allocs,
+           arena.failed_allocs,
+           arena.resets);
+
+    pipeline_stats pipeline = get_pipeline_stats();
+    printf("P n=%u depth=%u max=%u wait=%u fetch=%u out=%u both=%u\n",
+           pipeline.batches,
+           pipeline.batches == 0 ? 0 : pipeline.queue_depth_total * 100 / pipeline.batches,
+           pipeline.max_queue_depth,
+           (uint32_t)(pipeline.producer_wait_us / 1000),
+           (uint32_t)(pipeline.fetch_us / 1000),
+           (uint32_t)(pipeline.output_us / 1000),
+           (uint32_t)(pipeline.overlap_us / 1000));
+
+    store_stats store = get_store_stats();
+    printf("F loaded=%u record=%u saves=%u writes=%u unchanged=%u failed=%u written=%u load=%u\n",
+           store.loaded,
+           store.record_bytes,
+           store.saves,
+           store.writes,
+           store.unchanged,
+           store.failed_writes,
+           store.bytes_written,
+           store.load_us);
+#endif
+}
+
+// A copy, taken under the same lock stats_record updates it under
+stage_histogram get_stage_histogram(stats_stage stage) {
+    portENTER_CRITICAL();
+    stage_histogram histogram = histograms[stage];
+    portEXIT_CRITICAL();
+    return histogram;
+}
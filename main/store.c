@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+
+#include "constants.h"
+#include "store.h"
+
+// Must included below constants.h where we overwite the define of LOG_LOCAL_LEVEL
+#include "esp_log.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+
+static store_stats stats;
+// Hash of the record in flash, so a save can tell it has nothing new
+// without reading it back
+static uint32_t stored_hash;
+static bool has_stored;
+
+// FNV-1a, carried on from hash
+static uint32_t hash_bytes(uint32_t hash, const uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void put_u16(uint8_t *out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static uint16_t get_u16(const uint8_t *in) {
+    return in[0] | (in[1] << 8);
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    put_u16(out, value & 0xFFFF);
+    put_u16(&out[2], value >> 16);
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+    return get_u16(in) | ((uint32_t)get_u16(&in[2]) << 16);
+}
+
+// A list's string count and lengths, everything it has in the payload but its text
+static int encode_list_header(const message_list *list, uint8_t *out) {
+    out[0] = list->count;
+    int start = 0;
+    for (int i = 0; i < list->count; i++) {
+        put_u16(&out[1 + i * 2], list->ends[i] - start);
+        start = list->ends[i];
+    }
+
+    return 1 + list->count * 2;
+}
+
+static uint32_t payload_hash(const message_list *lists, int num_lists, int *payload_length) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    uint8_t list_header[1 + MESSAGE_LIST_MAX_MESSAGES * 2];
+    *payload_length = 0;
+    for (int i = 0; i < num_lists; i++) {
+        int header_length = encode_list_header(&lists[i], list_header);
+        hash = hash_bytes(hash, list_header, header_length);
+        hash = hash_bytes(hash, (const uint8_t *)lists[i].text, lists[i].used);
+        *payload_length += header_length + lists[i].used;
+    }
+
+    return hash;
+}
+
+/*
+ * Read one list's part of the payload straight into list. Returns false if
+ * it's cut short or wouldn't fit in a message_list.
+ */
+static bool read_list(FILE *file, message_list *list, uint32_t *hash, int *bytes_read) {
+    message_list_clear(list);
+    uint8_t lengths[MESSAGE_LIST_MAX_MESSAGES * 2];
+    uint8_t count;
+    if (fread(&count, 1, 1, file) != 1 || count > MESSAGE_LIST_MAX_MESSAGES
+        || fread(lengths, 2, count, file) != count) {
+        return false;
+    }
+    *hash = hash_bytes(*hash, &count, 1);
+    *hash = hash_bytes(*hash, lengths, count * 2);
+
+    // Strings are back to back just like in the list, so the text goes in
+    // in one read and only the ends need working out
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        used += get_u16(&lengths[i * 2]);
+        if (used > MESSAGE_LIST_BUFFER_SIZE) {
+            return false;
+        }
+        list->ends[i] = used;
+    }
+    if (fread(list->text, 1, used, file) != used) {
+        return false;
+    }
+    *hash = hash_bytes(*hash, (const uint8_t *)list->text, used);
+
+    list->count = count;
+    list->used = used;
+    *bytes_read += 1 + count * 2 + used;
+    return true;
+}
+
+static bool read_record(const char *path, message_list *lists, int num_lists, uint32_t *hash) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t header[STORE_HEADER_SIZE];
+    if (fread(header, 1, STORE_HEADER_SIZE, file) != STORE_HEADER_SIZE
+        || memcmp(header, STORE_MAGIC, STORE_MAGIC_LENGTH) != 0) {
+        ESP_LOGI(TAG, "%s isn't a saved list record", path);
+        fclose(file);
+        return false;
+    }
+
+    // Lists are by source, if the sources changed they don't line up anymore
+    if (header[4] != STORE_VERSION || header[5] != num_lists) {
+        ESP_LOGI(TAG, "Ignoring saved lists, version %d with %d lists", header[4], header[5]);
+        fclose(file);
+        return false;
+    }
+
+    *hash = FNV_OFFSET_BASIS;
+    int payload_length = 0;
+    bool read = true;
+    for (int i = 0; i < num_lists && read; i++) {
+        read = read_list(file, &lists[i], hash, &payload_length);
+    }
+
+    uint8_t trailer[STORE_TRAILER_SIZE];
+    read = read && payload_length == get_u16(&header[6])
+           && fread(trailer, 1, STORE_TRAILER_SIZE, file) == STORE_TRAILER_SIZE
+           && get_u32(trailer) == *hash;
+    fclose(file);
+
+    if (!read) {
+        ESP_LOGI(TAG, "Saved lists in %s are cut short or corrupt", path);
+        for (int i = 0; i < num_lists; i++) {
+            message_list_clear(&lists[i]);
+        }
+        return false;
+    }
+
+    stats.record_bytes = STORE_HEADER_SIZE + payload_length + STORE_TRAILER_SIZE;
+    return true;
+}
+
+void init_store() {
+    memset(&stats, 0, sizeof(stats));
+    has_stored = false;
+
+    int64_t start_us = esp_timer_get_time();
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = STORE_BASE_PATH,
+        .partition_label = STORE_PARTITION_LABEL,
+        .max_files = STORE_MAX_OPEN_FILES,
+        // Blank on the first boot after flashing the partition table
+        .format_if_mount_failed = true
+    };
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    stats.mounted = err == ESP_OK;
+    stats.load_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    if (!stats.mounted) {
+        ESP_LOGI(TAG, "Couldn't mount SPIFFS partition '%s' (%d), lists won't be saved", STORE_PARTITION_LABEL, err);
+    }
+}
+
+/*
+ * Fill lists with the last good ones saved. Returns false, with lists
+ * cleared, if there's no good record for this many lists.
+ */
+bool store_load(message_list *lists, int num_lists) {
+    if (!stats.mounted) {
+        return false;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    // Power lost between removing the old record and renaming the new one
+    // leaves only the temp file, which is whole if it checks out
+    stats.loaded = read_record(STORE_FILE, lists, num_lists, &stored_hash)
+                   || read_record(STORE_TEMP_FILE, lists, num_lists, &stored_hash);
+    stats.load_us += (uint32_t)(esp_timer_get_time() - start_us);
+    has_stored = stats.loaded;
+
+    if (stats.loaded) {
+        ESP_LOGI(TAG, "Loaded saved lists, %d byte record", stats.record_bytes);
+    }
+    return stats.loaded;
+}
+
+/*
+ * Save lists as the last good ones. Flash only gets written when they hash
+ * differently from what's already there, so calling this every refresh
+ * costs a hash unless something changed.
+ */
+bool store_save(const message_list *lists, int num_lists) {
+    stats.saves++;
+    if (!stats.mounted) {
+        return false;
+    }
+
+    int payload_length;
+    uint32_t hash = payload_hash(lists, num_lists, &payload_length);
+    if (has_stored && hash == stored_hash) {
+        stats.unchanged++;
+        return true;
+    }
+
+    FILE *file = fopen(STORE_TEMP_FILE, "wb");
+    if (!file) {
+        ESP_LOGI(TAG, "Couldn't open %s to save lists", STORE_TEMP_FILE);
+        stats.failed_writes++;
+        return false;
+    }
+
+    uint8_t header[STORE_HEADER_SIZE];
+    memcpy(header, STORE_MAGIC, STORE_MAGIC_LENGTH);
+    header[4] = STORE_VERSION;
+    header[5] = num_lists;
+    put_u16(&header[6], payload_length);
+    bool written = fwrite(header, 1, STORE_HEADER_SIZE, file) == STORE_HEADER_SIZE;
+
+    uint8_t list_header[1 + MESSAGE_LIST_MAX_MESSAGES * 2];
+    for (int i = 0; i < num_lists && written; i++) {
+        int header_length = encode_list_header(&lists[i], list_header);
+        written = fwrite(list_header, 1, header_length, file) == header_length
+                  && fwrite(lists[i].text, 1, lists[i].used, file) == lists[i].used;
+    }
+
+    uint8_t trailer[STORE_TRAILER_SIZE];
+    put_u32(trailer, hash);
+    written = written && fwrite(trailer, 1, STORE_TRAILER_SIZE, file) == STORE_TRAILER_SIZE;
+    written = fclose(file) == 0 && written;
+
+    if (!written) {
+        ESP_LOGI(TAG, "Couldn't write %s", STORE_TEMP_FILE);
+        remove(STORE_TEMP_FILE);
+        stats.failed_writes++;
+        return false;
+    }
+
+    // SPIFFS won't rename over an existing file. If this fails the temp
+    // file is still a good record, and store_load falls back to it
+    remove(STORE_FILE);
+    if (rename(STORE_TEMP_FILE, STORE_FILE) != 0) {
+        ESP_LOGI(TAG, "Couldn't rename %s", STORE_TEMP_FILE);
+        has_stored = false;
+        stats.failed_writes++;
+        return false;
+    }
+
+    stored_hash = hash;
+    has_stored = true;
+    stats.writes++;
+    stats.record_bytes = STORE_HEADER_SIZE + payload_length + STORE_TRAILER_SIZE;
+    stats.bytes_written += stats.record_bytes;
+    ESP_LOGI(TAG, "Saved lists, %d byte record", stats.record_bytes);
+    return true;
+}
+
+store_stats get_store_stats() {
+    return stats;
+}
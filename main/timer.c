@@ -1,45 +1,226 @@
+#include <string.h>
 #include "freeRTOS/FreeRTOS.h"
 #include "driver/hw_timer.h"
+#include "esp_timer.h"
 
 #include "timer.h"
 
-void init_timer(void *timer_expired_callback) {
-    timer_count = 0;
-    timer_expired = false;
+#define WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TICK_US ((int64_t)TIMER_TICK_MS * 1000)
 
-    // Init code adapted from the hw_timer.c hw_timer_alarm_us function
-    // used for abstracting timer load and start
-    ESP_ERROR_CHECK(hw_timer_init(timer_expired_callback, NULL));
-    hw_timer_set_clkdiv(TIMER_CLKDIV_16);
+static soft_timer *wheel[TIMER_WHEEL_SIZE];
+// Bit n set when wheel[n] has anything in it
+static uint64_t occupied_slots;
+// Every tick up to and including this one has been run
+static uint32_t last_tick;
+// Tick the hw_timer is loaded to fire at, if it's running
+static bool hw_armed;
+static uint32_t hw_tick;
+static timer_stats stats;
 
-    // Reload new timer val on expiration
-    bool reload = true;
-    hw_timer_set_reload(reload);
-    hw_timer_set_intr_type(TIMER_EDGE_INT);
+static uint32_t now_tick() {
+    return (uint32_t)(esp_timer_get_time() / TICK_US);
+}
+
+static void slot_insert(soft_timer *timer) {
+    int slot = timer->expiry_tick & WHEEL_MASK;
+    timer->prev = NULL;
+    timer->next = wheel[slot];
+    if (timer->next) {
+        timer->next->prev = timer;
+    }
+    wheel[slot] = timer;
+    occupied_slots |= 1ULL << slot;
+    timer->armed = true;
+}
+
+static void slot_remove(soft_timer *timer) {
+    int slot = timer->expiry_tick & WHEEL_MASK;
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel[slot] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    if (!wheel[slot]) {
+        occupied_slots &= ~(1ULL << slot);
+    }
+    timer->armed = false;
+}
+
+/*
+ * First slot after last_tick with anything in it, as an absolute tick. It
+ * might only hold timers for a later lap, in which case that wakeup finds
+ * nothing due and moves on to the next one, at most once a lap.
+ * Returns false if the wheel is empty.
+ */
+static bool next_occupied_tick(uint32_t *tick) {
+    if (occupied_slots == 0) {
+        return false;
+    }
+
+    int start = (last_tick + 1) & WHEEL_MASK;
+    uint64_t rotated = start == 0 ? occupied_slots : (occupied_slots >> start) | (occupied_slots << (TIMER_WHEEL_SIZE - start));
+    *tick = last_tick + 1 + __builtin_ctzll(rotated);
+    return true;
+}
+
+// Load the hw_timer for the next occupied slot, or stop it if there's none
+static void program_hw() {
+    uint32_t tick;
+    if (!next_occupied_tick(&tick)) {
+        if (hw_armed) {
+            hw_timer_enable(false);
+            hw_armed = false;
+        }
+        return;
+    }
+
+    if (hw_armed && hw_tick == tick) {
+        return;
+    }
 
-    // alarm_us handles load in and enable of timer and settings
-    // Use the same assert check as the hw_timer.c init code
-    int timer_period_us = TIMER_PERIOD_MS * 1000;
-    assert((reload ? ((timer_period_us > 50) ? 1 : 0) : ((timer_period_us > 10) ? 1 : 0)) && (timer_period_us <= 0x199999));
+    // Relative to the current tick so it holds up when ticks wrap
+    int64_t now_us = esp_timer_get_time();
+    int64_t delay_us = (int32_t)(tick - (uint32_t)(now_us / TICK_US)) * TICK_US - now_us % TICK_US;
+    // hw_timer won't take anything too short, it'll just be a little late
+    if (delay_us < 20) {
+        delay_us = 20;
+    } else if (delay_us > TIMER_MAX_HW_DELAY_US) {
+        delay_us = TIMER_MAX_HW_DELAY_US;
+    }
 
-#if BUTTON_FOR_REQUESTS
-    // Timer will be used for debouncing, make sure you set a short period
-    assert(TIMER_PERIOD_MS < 200);
-    hw_timer_set_load_data(((TIMER_BASE_CLK >> hw_timer_get_clkdiv()) / 1000000) * timer_period_us);
+    hw_timer_enable(false);
+    hw_timer_set_load_data(((TIMER_BASE_CLK >> hw_timer_get_clkdiv()) / 1000000) * (uint32_t)delay_us);
     hw_timer_enable(true);
-#else
-    // Timer will be used to send requests, make sure you set a long period
-    assert(TIMER_PERIOD_MS > 200);
-    reset_timer();
-#endif
+    hw_armed = true;
+    hw_tick = tick;
+    stats.hw_loads++;
+}
+
+/*
+ * Pull everything due out of the slots for every tick since the last run,
+ * then call them. Callbacks run after the wheel is settled so they can start
+ * and cancel timers, including the one being called.
+ */
+static void run_due_timers(uint32_t tick) {
+    soft_timer *due = NULL;
+    uint32_t ticks = tick - last_tick;
+    if (ticks > TIMER_WHEEL_SIZE) {
+        // Fell more than a lap behind, every slot needs a look
+        ticks = TIMER_WHEEL_SIZE;
+    }
+
+    for (uint32_t i = 0; i < ticks; i++) {
+        soft_timer *timer = wheel[(tick - i) & WHEEL_MASK];
+        while (timer) {
+            soft_timer *next = timer->next;
+            if ((int32_t)(timer->expiry_tick - tick) <= 0) {
+                slot_remove(timer);
+                timer->next = due;
+                due = timer;
+            }
+            timer = next;
+        }
+    }
+    last_tick = tick;
+
+    if (!due) {
+        stats.empty_wakeups++;
+    }
+
+    while (due) {
+        soft_timer *timer = due;
+        due = timer->next;
+        stats.expirations++;
+
+        if (timer->period_ticks) {
+            // Fixed rate, unless we're so late the next one is already due
+            timer->expiry_tick += timer->period_ticks;
+            if ((int32_t)(timer->expiry_tick - tick) <= 0) {
+                timer->expiry_tick = tick + 1;
+            }
+            slot_insert(timer);
+        }
+        timer->callback(timer->callback_arg);
+    }
+}
+
+static void hw_timer_callback(void *arg) {
+    int64_t start_us = esp_timer_get_time();
+    hw_armed = false;
+    stats.wakeups++;
+
+    run_due_timers(now_tick());
+    program_hw();
+
+    uint32_t wakeup_us = esp_timer_get_time() - start_us;
+    stats.wakeup_us += wakeup_us;
+    if (wakeup_us > stats.max_wakeup_us) {
+        stats.max_wakeup_us = wakeup_us;
+    }
+}
+
+void init_timer() {
+    memset(wheel, 0, sizeof(wheel));
+    memset(&stats, 0, sizeof(stats));
+    occupied_slots = 0;
+    hw_armed = false;
+    last_tick = now_tick();
+
+    // Same setup as hw_timer_alarm_us, but one-shot since every load is
+    // for a different deadline
+    ESP_ERROR_CHECK(hw_timer_init(hw_timer_callback, NULL));
+    hw_timer_set_clkdiv(TIMER_CLKDIV_16);
+    hw_timer_set_reload(false);
+    hw_timer_set_intr_type(TIMER_EDGE_INT);
 }
 
-void reset_timer() {
-    hw_timer_set_load_data(((TIMER_BASE_CLK >> hw_timer_get_clkdiv()) / 1000000) * (TIMER_PERIOD_MS * 1000));
-    timer_expired = false;
+/*
+ * Arm timer to call callback after delay_ms, then every period_ms after that
+ * if it's non-zero. Restarts it if it's already armed. It fires on the first
+ * tick boundary after the deadline and the period is rounded up to whole
+ * ticks. Safe to call from a timer callback.
+ */
+void timer_start(soft_timer *timer, uint32_t delay_ms, uint32_t period_ms, soft_timer_callback callback, void *callback_arg) {
+    portENTER_CRITICAL();
+    if (timer->armed) {
+        slot_remove(timer);
+    }
+    if (occupied_slots == 0) {
+        // Nothing's been run while the wheel sat empty, catch up so the
+        // search for the next slot starts from now
+        last_tick = now_tick();
+    }
+
+    // First tick boundary at or after the deadline, so it never fires early
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    timer->expiry_tick = (uint32_t)((deadline_us + TICK_US - 1) / TICK_US);
+    // Ticks up to last_tick have already been run, anything due in one of
+    // them would otherwise sit in its slot for a lap
+    if ((int32_t)(timer->expiry_tick - last_tick) <= 0) {
+        timer->expiry_tick = last_tick + 1;
+    }
+    timer->period_ticks = (period_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    timer->callback = callback;
+    timer->callback_arg = callback_arg;
+    slot_insert(timer);
+
+    program_hw();
+    portEXIT_CRITICAL();
+}
 
-    // Start timer on our first call to reset
-    if (!hw_timer_get_enable()) {
-        hw_timer_enable(true);
+void timer_cancel(soft_timer *timer) {
+    portENTER_CRITICAL();
+    if (timer->armed) {
+        slot_remove(timer);
+        program_hw();
     }
+    portEXIT_CRITICAL();
+}
+
+timer_stats get_timer_stats() {
+    return stats;
 }
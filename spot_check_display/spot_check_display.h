@@ -14,4 +14,57 @@
 
 #define RIGHT       0
 #define LEFT        1
+
+// Serial link framing, must match main/include/link.h on the ESP side.
+// [SOF] [type] [seq] [length] [payload...] [crc hi] [crc lo], CRC-16/XMODEM over type through payload
+#define LINK_START_OF_FRAME   0x7E
+#define LINK_HEADER_SIZE      4
+#define LINK_MAX_PAYLOAD      128
+#define LINK_MAX_RESPONSE_PAYLOAD 3
+#define LINK_DEFAULT_BAUD     9600
+#define LINK_BAUD_RATES       {57600, 38400, 19200, 9600}
+#define LINK_BAUD_CONFIRM_PINGS 4
+#define LINK_BAUD_CONFIRM_TIMEOUT_MS 500
+
+#define LINK_FRAME_ACK        0x01
+#define LINK_FRAME_NACK       0x02
+#define LINK_FRAME_PING       0x03
+#define LINK_FRAME_SET_BAUD   0x04
+#define LINK_FRAME_REJECT     0x05  // Good crc but can't apply it, the ESP doesn't resend
+#define LINK_FRAME_CAPACITY   0x06  // Answered with our own CAPACITY: [MSGARENASIZE lo] [hi] [MAXMSGS]
+#define LINK_FRAME_LIST_START 0x10
+#define LINK_FRAME_LIST_ITEM  0x11
+#define LINK_FRAME_LIST_END   0x12
+#define LINK_FRAME_LIST_COLUMNS     0x13
+#define LINK_FRAME_LIST_COLUMNS_END 0x14
+#define LINK_FRAME_DELTA_START      0x15  // [old count], REJECTed if that's not the count we have
+#define LINK_FRAME_DELTA_REPLACE    0x16  // [index] [text...]
+#define LINK_FRAME_DELTA_INSERT     0x17  // [index] [text...]
+#define LINK_FRAME_DELTA_DELETE     0x18  // [index]
+#define LINK_FRAME_DELTA_END        0x19  // [new count]
+
+// Pre-rendered columns are one byte per LED column, top row in bit 0
+#define COLUMN_HEIGHT         6
+
+// Text bytes with the top bit set are tokens for word (byte & 0x7F) of
+// DICT_WORDS, must match main/include/dict.h on the ESP side
+#define DICT_TOKEN_FLAG       0x80
+#define DICT_MAX_WORD_LENGTH  9
+#define DICT_WORDS { \
+    " ft", "ft ", "high", "High", "low", "Low", " tide", "tide", \
+    " at ", " am", " pm", ":00", ":15", ":30", ":45", " - ", \
+    "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday", "Today", \
+    "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun", "Tomorrow", \
+    "swell", "Swell", " sec", " from ", "period", "wind", " mph", " kts", \
+    "rising", "falling", "North", "South", "East", "West", "NNW", "WNW", \
+    "WSW", "SSW", "SSE", "ESE", "ENE", "NNE", "NW", "NE", \
+    "SW", "SE", "10", "11", "12", ". ", ", ", "0." \
+}
+
+struct link_frame {
+  uint8_t type;
+  uint8_t seq;
+  uint8_t length;
+  uint8_t payload[LINK_MAX_PAYLOAD + 1];  // +1 leaves room to null terminate text
+};
 #endif
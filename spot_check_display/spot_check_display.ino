@@ -24,6 +24,7 @@
 #include <TVoutfonts/fontALL.h>
 
 #include <SoftwareSerial.h>
+#include <util/crc16.h>
 
 // Prints ascii text through the serial port that mirrors LEDs when defined
 //#define DEBUG
@@ -36,24 +37,45 @@
 #define LEDS           (LEDSPERSTRIP*LEDSTRIPS)
 #define ROWS           (LEDS/LEDSPERROW)
 
+// Layout can be overridden from the build, the host tests check the renderer in all of them
+#ifndef LAYOUTSTART
 #define LAYOUTSTART    TOPLEFT  // First LED where data comes in [TOPLEFT, TOPRIGHT, BOTTOMLEFT, or BOTTOMRIGHT]
+#endif
+#ifndef LAYOUTMODE
 #define LAYOUTMODE     ZIGZAG       // Is the end of a strip connected on the same side of the matrix
 // to the next [ZIGZAG], or back at the next strips beginning? [STRAIGHT]
+#endif
 
 #define SCROLLSPEED    100          // Speed in ms to delay before shifting text
 #define LEDBRIGHTNESS  64           // Neopixel param between 0-255 for brightness. Be mindful of power consumption (start low and work up)
 #define MAXMSGLEN 80                // Longest message we can display.
+#define MAXMSGS   16                // Most messages we'll hold from a single list
+#define MSGARENASIZE 256            // Bytes of text (1 per char) or pre-rendered columns (4 per char) we can hold across a whole list.
+                                    // There are two of these, one showing and one receiving. Pre-rendered that's only ~64 chars
+                                    // for the whole list. The ESP asks for this and MAXMSGS on connect and cuts lists to fit
 
 #define FONTWIDTH      (pgm_read_byte_near(&font[0])) // Font arrays hold metadata in their first 3 bytes
 #define FONTHEIGHT     (pgm_read_byte_near(&font[1]))
 #define FONTSTARTCHAR  (pgm_read_byte_near(&font[2]))
 #define FONTDATAOFFSET 3                              // First byte in font data that's actual text bytes
 
-#define ESP_BAUD_RATE 9600                  // Rate at which the ESP8266 is serially sending data
+#define ESP_BAUD_RATE LINK_DEFAULT_BAUD      // Rate the ESP8266 starts at before negotiating up
 #define SERIAL_RX_PIN 6
 #define SERIAL_TX_PIN 11
 #define SERIAL_JSON_TIMEOUT_MILLIS 1000
 
+// Link frame receive states
+#define RX_WAIT_FOR_START 0
+#define RX_TYPE           1
+#define RX_SEQ            2
+#define RX_LENGTH         3
+#define RX_PAYLOAD        4
+#define RX_CRC_HI         5
+#define RX_CRC_LO         6
+#define RX_FRAME_TIMEOUT_MS 50  // A frame that stops partway is dropped after this long without a byte, well
+                                // inside the ESP's ACK timeout so its resend gets parsed from the start
+#define RX_NEXT_FRAME_MS    5   // After we answer a frame, how long to hold off drawing for the ESP's next one to start
+
 const unsigned char *font = font4x6;    // Font data bytes. Most fonts barely or don't at all use their bottom row or two, so you
 // might be able to make a 6x8 work with only 6 or 7 rows depnding on your text
 
@@ -66,6 +88,55 @@ Adafruit_NeoPixel strip = Adafruit_NeoPixel(LEDS, PIN, NEO_GRB + NEO_KHZ800);
 
 SoftwareSerial esp_serial(SERIAL_RX_PIN, SERIAL_TX_PIN);
 
+// Frame currently being received and the parser state for it
+struct link_frame rx_frame;
+uint8_t rx_state = RX_WAIT_FOR_START;
+uint8_t rx_index;
+uint16_t rx_crc;
+uint16_t rx_received_crc;
+unsigned long rx_last_byte_ms;
+unsigned long last_response_ms;
+bool ack_pending = false;     // rx_frame has been applied and its ACK is still to go out
+uint8_t ack_seq;
+int16_t last_seq = -1;
+
+// Baud rate negotiation. After switching to a new rate we have to see
+// LINK_BAUD_CONFIRM_PINGS good pings with no gaps longer than the timeout,
+// otherwise we go back to the old rate (which is what the ESP does too)
+const uint32_t baud_rates[] = LINK_BAUD_RATES;
+uint32_t current_baud = ESP_BAUD_RATE;
+uint32_t previous_baud;
+bool confirming_baud = false;
+uint8_t confirm_pings;
+unsigned long confirm_deadline;
+
+// Every message in a list is packed back to back in arena, either as text or as
+// pre-rendered column bytes. msg_end[i] is where message i stops
+struct message_list {
+  uint8_t arena[MSGARENASIZE];
+  uint16_t msg_end[MAXMSGS];
+  uint16_t used;
+  uint8_t count;
+  bool is_columns;
+  bool complete;              // LIST_END has arrived, no more messages are coming
+  unsigned long start_ms;     // When LIST_START arrived
+};
+
+// A list is received into whichever of these isn't on the sign. As soon as its
+// first message is complete it becomes the front list and starts playing while
+// the rest of it is still arriving. Nothing is allocated while receiving, what
+// doesn't fit in a list's arena is cut off and counted
+struct message_list lists[2];
+struct message_list *front_list = &lists[0];  // List being shown
+struct message_list *rx_list = NULL;          // List being received, NULL between lists
+uint16_t arena_dropped_bytes = 0;
+uint8_t arena_dropped_msgs = 0;
+bool playing = false;         // Working through front_list
+uint8_t play_index;           // Next message in front_list to start scrolling
+
+// Time from a list starting to arrive to its first message being on the sign
+unsigned long time_to_first_pixel_ms = 0;
+
 // IMPORTANT: To reduce NeoPixel burnout risk, add 1000 uF capacitor across
 // pixel power leads, add 300 - 500 Ohm resistor on first pixel's data input
 // and minimize distance between Arduino and first pixel.  Avoid connecting
@@ -86,152 +157,682 @@ SoftwareSerial esp_serial(SERIAL_RX_PIN, SERIAL_TX_PIN);
 #define DEBUG_PRINTLN(...)
 #endif
 
-void display_text(char* message, int message_length) {
-  uint8_t fontWidth, fontHeight, fontStartChar;
-  uint8_t letter, fontByte, fontBit;
-  uint8_t letterOffset;
-  uint8_t row, col;
-  uint8_t offset;
-  char    ch;
-  uint8_t layoutStart, layoutMode;
-  uint8_t colDir, rowDir;
-  uint8_t colOffset, rowOffset;
-
-  layoutStart = LAYOUTSTART;
-  layoutMode = LAYOUTMODE;
-
-  // If LED 0 starts at the bottom, we need to invert the rows when we
-  // display the message.
-  if (layoutStart == TOPLEFT || layoutStart == TOPRIGHT)
+// Compile-time map from a row/column on the sign to its LED index. Every row
+// is a straight run of LEDs, so all that varies is where a row starts and
+// which way it runs. With LAYOUTSTART/LAYOUTMODE fixed these fold down to
+// constants and the renderer never looks at the layout per pixel.
+constexpr uint8_t start_col_dir()
+{
+  return (LAYOUTSTART == TOPLEFT || LAYOUTSTART == BOTTOMLEFT) ? RIGHT : LEFT;
+}
+
+constexpr uint8_t row_col_dir(uint8_t row)
+{
+  // Zigzagged strips reverse direction at the end of each row
+  return (LAYOUTMODE == ZIGZAG && (row & 1)) ? (start_col_dir() == RIGHT ? LEFT : RIGHT) : start_col_dir();
+}
+
+constexpr uint16_t led_row_first(uint8_t row)
+{
+  return (row * LEDSPERROW) + (row_col_dir(row) == RIGHT ? 0 : LEDSPERROW - 1);
+}
+
+constexpr int8_t led_row_step(uint8_t row)
+{
+  return row_col_dir(row) == RIGHT ? 1 : -1;
+}
+
+// If LED 0 starts at the bottom, we need to invert the rows when we display the message.
+constexpr uint8_t source_row(uint8_t row, uint8_t visible_rows)
+{
+  return (LAYOUTSTART == TOPLEFT || LAYOUTSTART == TOPRIGHT) ? row : visible_rows - 1 - row;
+}
+
+// Where the columns for the message being scrolled come from. Exactly one of
+// text or columns is set
+struct scroll_source {
+  const char *text;           // Text to run through the font one column at a time
+  const uint8_t *columns;     // Columns the ESP already rendered
+  int num_columns;
+  uint8_t height;             // Rows used in each column byte, top row in bit 0
+  uint16_t text_byte;         // Stored text byte the last character came from
+  uint16_t text_byte_char;    // Position in the expanded text that byte starts at
+};
+
+// Columns currently on the sign. It's a ring so each scroll step only has to
+// compute the one column coming in on the right, not redo the whole sign
+uint8_t column_ring[LEDSPERROW];
+uint8_t ring_head;            // Ring index of the leftmost column on the sign
+
+// Message currently scrolling. It's stepped from loop() against a millis()
+// deadline so serial keeps getting drained between frames
+struct scroll_source scroll;
+struct message_list *scroll_list;  // List the scroll's text or columns live in
+int scroll_step = -1;         // Next column to shift in, -1 when nothing is scrolling
+unsigned long next_frame_ms;
+
+// How far behind schedule frames went out, how often SoftwareSerial's RX
+// buffer filled up before we got to it, and how many frames stopped partway
+uint32_t frames_drawn = 0;
+uint32_t frame_late_total_ms = 0;
+uint16_t frame_late_max_ms = 0;
+uint16_t rx_overflows = 0;
+uint16_t rx_timeouts = 0;
+
+// Words the ESP sends as single byte tokens, see DICT_WORDS
+const char dict_words[][DICT_MAX_WORD_LENGTH + 1] PROGMEM = DICT_WORDS;
+#define DICTWORDS (sizeof(dict_words) / sizeof(dict_words[0]))
+
+// How many characters one stored text byte stands for
+uint8_t text_byte_length(uint8_t b)
+{
+  if (!(b & DICT_TOKEN_FLAG))
   {
-    rowDir = DOWN;
+    return 1;
   }
-  else
+
+  return (b & ~DICT_TOKEN_FLAG) < DICTWORDS ? strlen_P(dict_words[b & ~DICT_TOKEN_FLAG]) : 1;
+}
+
+// Characters the stored text turns into once tokens are expanded
+uint16_t text_expanded_length(const uint8_t *text, uint16_t length)
+{
+  uint16_t expanded = 0;
+  for (uint16_t i = 0; i < length; i++)
+  {
+    expanded += text_byte_length(text[i]);
+  }
+
+  return expanded;
+}
+
+// Character at position in the expanded text. Tokens are expanded on the fly,
+// the scroll only ever moves forward so the source remembers where the last
+// character came from and carries on from there
+char text_char(struct scroll_source *source, uint16_t position)
+{
+  if (position < source->text_byte_char)
+  {
+    source->text_byte = 0;
+    source->text_byte_char = 0;
+  }
+
+  while (true)
+  {
+    uint8_t b = source->text[source->text_byte];
+    uint8_t length = text_byte_length(b);
+    if (position < source->text_byte_char + length)
+    {
+      if (!(b & DICT_TOKEN_FLAG))
+      {
+        return b;
+      }
+      // Unknown tokens (a newer ESP) come out as '?'
+      return (b & ~DICT_TOKEN_FLAG) < DICTWORDS ? pgm_read_byte_near(&dict_words[b & ~DICT_TOKEN_FLAG][position - source->text_byte_char]) : '?';
+    }
+
+    source->text_byte++;
+    source->text_byte_char += length;
+  }
+}
+
+// Turn one column of one character into a column byte
+uint8_t text_column(struct scroll_source *source, int index)
+{
+  uint8_t fontWidth = FONTWIDTH;
+  uint8_t fontHeight = FONTHEIGHT;
+  char ch = text_char(source, index / fontWidth);
+  uint8_t fontBit = index % fontWidth;
+  const unsigned char *glyph = &font[FONTDATAOFFSET + (ch - FONTSTARTCHAR) * fontHeight];
+  uint8_t column = 0;
+
+  for (uint8_t row = 0; row < fontHeight && row < 8; row++)
+  {
+    if (bitRead(pgm_read_byte_near(&glyph[row]), 7 - fontBit) == 1)
+    {
+      column |= 1 << row;
+    }
+  }
+
+  return column;
+}
+
+uint8_t source_column(struct scroll_source *source, int index)
+{
+  // Past the end of the message is blank, the same as scrolling in spaces
+  if (index >= source->num_columns)
+  {
+    return 0;
+  }
+
+  return source->text ? text_column(source, index) : source->columns[index];
+}
+
+// Push the ring out to the strip. After a one column shift, the pixel at
+// column c last showed what column c - 1 shows now, so only LEDs where those
+// differ need setting. Column 0 has no neighbour to compare to and is always set
+void draw_columns(uint8_t height, bool full_redraw)
+{
+  uint8_t visible_rows = height < ROWS ? height : ROWS;
+
+  for (uint8_t row = 0; row < visible_rows; row++)
+  {
+    uint8_t mask = 1 << source_row(row, visible_rows);
+    uint16_t led = led_row_first(row);
+    int8_t step = led_row_step(row);
+    uint8_t pos = ring_head;
+    uint8_t last_lit = 0;
+
+    for (uint8_t col = 0; col < LEDSPERROW; col++)
+    {
+      uint8_t lit = column_ring[pos] & mask;
+      if (full_redraw || col == 0 || lit != last_lit)
+      {
+        strip.setPixelColor(led, lit ? strip.Color(127, 0, 0) : 0);
+      }
+
+      last_lit = lit;
+      led += step;
+      pos = (pos + 1 == LEDSPERROW) ? 0 : pos + 1;
+    }
+  }
+
+  strip.show();
+}
+
+void list_reset(struct message_list *list)
+{
+  list->used = 0;
+  list->count = 0;
+  list->is_columns = false;
+  list->complete = false;
+  list->start_ms = millis();
+}
+
+// Add to the message currently being built, the start of it is msg_end[count - 1]
+void list_append(struct message_list *list, const uint8_t *data, uint8_t length)
+{
+  if (list->count >= MAXMSGS) {
+    return;
+  }
+
+  uint16_t room = MSGARENASIZE - list->used;
+  uint8_t copy_length = length < room ? length : room;
+  memcpy(&list->arena[list->used], data, copy_length);
+  list->used += copy_length;
+  arena_dropped_bytes += length - copy_length;
+}
+
+void list_end_message(struct message_list *list)
+{
+  if (list->count >= MAXMSGS) {
+    arena_dropped_msgs++;
+    return;
+  }
+
+  list->msg_end[list->count++] = list->used;
+}
+
+uint16_t list_message_start(struct message_list *list, uint8_t index)
+{
+  return index == 0 ? 0 : list->msg_end[index - 1];
+}
+
+// Take message index out of the list, everything after it moves down one
+void list_delete(struct message_list *list, uint8_t index)
+{
+  if (index >= list->count) {
+    return;
+  }
+
+  uint16_t start = list_message_start(list, index);
+  uint16_t length = list->msg_end[index] - start;
+  memmove(&list->arena[start], &list->arena[start + length], list->used - start - length);
+  list->used -= length;
+  list->count--;
+  for (uint8_t i = index; i < list->count; i++) {
+    list->msg_end[i] = list->msg_end[i + 1] - length;
+  }
+}
+
+// Put a new message in at index, moving it and everything after it up one.
+// Same limits as receiving a whole list
+void list_insert(struct message_list *list, uint8_t index, const uint8_t *data, uint8_t length)
+{
+  if (index > list->count) {
+    return;
+  }
+  if (list->count >= MAXMSGS) {
+    arena_dropped_msgs++;
+    return;
+  }
+
+  uint16_t room = MSGARENASIZE - list->used;
+  uint8_t copy_length = length < room ? length : room;
+  arena_dropped_bytes += length - copy_length;
+
+  uint16_t start = list_message_start(list, index);
+  memmove(&list->arena[start + copy_length], &list->arena[start], list->used - start);
+  memcpy(&list->arena[start], data, copy_length);
+  list->used += copy_length;
+  for (uint8_t i = list->count; i > index; i--) {
+    list->msg_end[i] = list->msg_end[i - 1] + copy_length;
+  }
+  list->msg_end[index] = start + copy_length;
+  list->count++;
+}
+
+// Put the start of a message on the sign and schedule the first shift.
+// Returns false if there's nothing to show
+bool scroll_start(struct scroll_source *source)
+{
+  if (source->num_columns == 0)
   {
-    rowDir = UP;
+    return false;
   }
 
-  // If we start from the right side, we will be going backwards.
-  if (layoutStart == TOPLEFT || layoutStart == BOTTOMLEFT)
+  scroll = *source;
+  for (uint8_t col = 0; col < LEDSPERROW; col++)
   {
-    colDir = RIGHT;
+    column_ring[col] = source_column(&scroll, col);
+  }
+  ring_head = 0;
+  // Scheduled from before the draw, like every frame after it
+  next_frame_ms = millis() + SCROLLSPEED;
+  draw_columns(scroll.height, true);
+  scroll_step = 1;
+  return true;
+}
+
+// Shift one column if its frame is due. Each message runs until its last
+// column has scrolled to the left edge and been shown for a full frame
+void scroll_tick()
+{
+  unsigned long now = millis();
+  if ((long)(now - next_frame_ms) < 0)
+  {
+    return;
+  }
+
+  unsigned long late_ms = now - next_frame_ms;
+  frames_drawn++;
+  frame_late_total_ms += late_ms;
+  if (late_ms > frame_late_max_ms)
+  {
+    frame_late_max_ms = late_ms;
+  }
+
+  if (scroll_step >= scroll.num_columns)
+  {
+    scroll_step = -1;
+    return;
+  }
+
+  column_ring[ring_head] = source_column(&scroll, scroll_step + LEDSPERROW - 1);
+  ring_head = (ring_head + 1 == LEDSPERROW) ? 0 : ring_head + 1;
+  draw_columns(scroll.height, false);
+  scroll_step++;
+
+  // Step off the deadline rather than now so render time doesn't add up.
+  // If we're already a whole frame behind don't rush to catch up
+  next_frame_ms += SCROLLSPEED;
+  if (late_ms >= SCROLLSPEED)
+  {
+    next_frame_ms = now + SCROLLSPEED;
+  }
+}
+
+bool start_message(struct message_list *list, uint8_t index)
+{
+  uint16_t start = list_message_start(list, index);
+  uint16_t length = list->msg_end[index] - start;
+  struct scroll_source source;
+  if (list->is_columns)
+  {
+    // The ESP has already done the font lookups
+    source = {NULL, &list->arena[start], length, COLUMN_HEIGHT};
   }
   else
   {
-    colDir = LEFT;
+    source = {(const char *)&list->arena[start], NULL, text_expanded_length(&list->arena[start], length) * FONTWIDTH, FONTHEIGHT};
   }
 
-  fontWidth = FONTWIDTH;
-  fontHeight = FONTHEIGHT;
-  fontStartChar = FONTSTARTCHAR;
+  scroll_list = list;
+  return scroll_start(&source);
+}
 
-  // Loop through each letter in the message.
-  for (letter = 0; letter < message_length; letter++)
+// Advance whatever is on the sign by at most one frame, moving on to the
+// next message in the list once the current one has scrolled off
+void display_tick()
+{
+  if (scroll_step >= 0)
   {
-    // Scroll fontWidth pixels for each letter.
-    for (offset = 0; offset < fontWidth; offset++)
-      // If you comment out the above for loop, and then just set offset
-      // to 0, the sign will scroll a character at a time.
-      //offset = 0;
+    scroll_tick();
+    return;
+  }
+
+  if (!playing)
+  {
+    return;
+  }
+
+  while (play_index < front_list->count)
+  {
+    if (start_message(front_list, play_index++))
     {
-      // Loop through each row...
-      for (row = 0; row < ROWS && row < fontHeight ; row++)
+      if (play_index == 1)
       {
-        letterOffset = 0;
-        fontBit = offset;
-
-        // If going down (starting at top), we will use the loop row,
-        // else we will calculate a row that goes backwards.
-        if (rowDir == DOWN)
-        {
-          rowOffset = row;
-        }
-        else
-        {
-          rowOffset = (fontHeight < ROWS ? fontHeight : ROWS) - 1 - row;
-        }
+        time_to_first_pixel_ms = millis() - front_list->start_ms;
+      }
+      return;
+    }
+  }
 
-        // Now loop through each pixel in the row (column).
-        for (col = 0; col < LEDSPERROW; col++)
-        {
-          // If going right (starting at left), we will use the loop col,
-          // else we will calculate a col that goes backwards.
-          if (colDir == RIGHT)
-          {
-            colOffset = col;
-          }
-          else
-          {
-            colOffset = LEDSPERROW - 1 - col; // -1
-          }
-
-          // If we run out of letters, replace with a space.
-          if (letter + letterOffset >= message_length)
-          {
-            ch = ' ';
-          }
-          else // Otherwise, get the actual letter.
-          {
-            ch = message[letter + letterOffset];
-          }
-
-          // Get the appropriate byte from the font data.
-          if (bitRead(pgm_read_byte_near(&font[FONTDATAOFFSET +
-                                               (ch - fontStartChar)*fontHeight + rowOffset]),
-                      //(colDir==RIGHT ? 7-fontBit : 7-(fontWidth-1)+fontBit))==1)
-                      //(colDir==LEFT ? 7-fontBit : 7-(fontWidth-1)+fontBit))==1)
-                      7 - fontBit) == 1)
-          {
-            // 1 = set a pixel.
-            strip.setPixelColor((row * LEDSPERROW) + colOffset,
-                                strip.Color(127, 0, 0));
-
-            DEBUG_PRINT(F("#"));
-          }
-          else
-          {
-            // 0 = unset a pixel.
-            strip.setPixelColor((row * LEDSPERROW) + colOffset, 0);
-
-            DEBUG_PRINT(F(" "));
-          }
-
-          // Move to next bit in the character.
-          fontBit++;
-          // If we get to the width of the font, move to the next letter.
-          if (fontBit >= fontWidth)
-          {
-            fontBit = 0;
-            letterOffset++;
-          }
-        } // end of for (col=0; col<LEDSPERROW; col++)
-
-        DEBUG_PRINTLN();
-
-        // If the LED strips are zig zagged, at the end of each row we
-        // will reverse the direction.
-        if (layoutMode == ZIGZAG)
-        {
-          // Invert direction.
-          if (colDir == RIGHT)
-          {
-            colDir = LEFT;
-          }
-          else
-          {
-            colDir = RIGHT;
-          }
-        } // end of if (layoutMode==ZIGZAG)
-      } // end of for (row=0; row<ROWS && row<fontHeight ; row++)
-      strip.show();
+  // Caught up with a list that's still arriving, wait for its next message.
+  // A finished list goes round again until something replaces or edits it
+  if (front_list->complete)
+  {
+    play_index = 0;
+    playing = front_list->count > 0;
+    DEBUG_PRINT(F("First pixel after "));
+    DEBUG_PRINT(time_to_first_pixel_ms);
+    DEBUG_PRINT(F("ms, frames late by max "));
+    DEBUG_PRINT(frame_late_max_ms);
+    DEBUG_PRINT(F("ms avg "));
+    DEBUG_PRINT(frames_drawn ? frame_late_total_ms / frames_drawn : 0);
+    DEBUG_PRINT(F("ms, rx overflows "));
+    DEBUG_PRINT(rx_overflows);
+    DEBUG_PRINT(F(" timeouts "));
+    DEBUG_PRINTLN(rx_timeouts);
+  }
+}
 
-#if defined(DEBUG)
-      for (uint8_t i = 0; i < LEDSPERROW; i++) Serial.print(F("-"));
-      Serial.println();
-#endif
-      delay(SCROLLSPEED);
+// A message has finished arriving in rx_list. If that list isn't on the sign
+// yet, swap it in now so it doesn't have to wait for the rest of the list.
+// Whatever's scrolling from the old list finishes first
+void message_received()
+{
+  list_end_message(rx_list);
+  if (rx_list != front_list && rx_list->count > 0) {
+    front_list = rx_list;
+    play_index = 0;
+    playing = true;
+  }
+}
+
+void set_baud(uint32_t baud)
+{
+  esp_serial.end();
+  esp_serial.begin(baud);
+  current_baud = baud;
+}
+
+void revert_baud()
+{
+  confirming_baud = false;
+  set_baud(previous_baud);
+}
+
+// ACK, NACK and REJECT are just a header and crc, no payload
+void link_send_response(uint8_t type, uint8_t seq)
+{
+  link_send_response_payload(type, seq, NULL, 0);
+}
+
+// Only CAPACITY answers carry a payload, and only a few bytes of one
+void link_send_response_payload(uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t length)
+{
+  uint8_t frame[LINK_HEADER_SIZE + LINK_MAX_RESPONSE_PAYLOAD + 2] = {LINK_START_OF_FRAME, type, seq, length};
+  if (length > 0) {
+    memcpy(&frame[LINK_HEADER_SIZE], payload, length);
+  }
+  uint16_t crc = 0;
+  for (uint8_t i = 1; i < LINK_HEADER_SIZE + length; i++) {
+    crc = _crc_xmodem_update(crc, frame[i]);
+  }
+
+  frame[LINK_HEADER_SIZE + length] = crc >> 8;
+  frame[LINK_HEADER_SIZE + length + 1] = crc & 0xFF;
+  esp_serial.write(frame, LINK_HEADER_SIZE + length + 2);
+  last_response_ms = millis();
+}
+
+// Feed one received byte through the frame parser. Returns true once a full frame
+// with a good crc is sitting in rx_frame. Bad crcs get NACKed right here so the
+// ESP resends. Anything outside a frame (like ESP log output) is skipped.
+bool link_receive_byte(uint8_t c)
+{
+  switch (rx_state) {
+    case RX_WAIT_FOR_START:
+      if (c == LINK_START_OF_FRAME) {
+        rx_state = RX_TYPE;
+      }
+      break;
+    case RX_TYPE:
+      rx_frame.type = c;
+      rx_crc = _crc_xmodem_update(0, c);
+      rx_state = RX_SEQ;
+      break;
+    case RX_SEQ:
+      rx_frame.seq = c;
+      rx_crc = _crc_xmodem_update(rx_crc, c);
+      rx_state = RX_LENGTH;
+      break;
+    case RX_LENGTH:
+      if (c > LINK_MAX_PAYLOAD) {
+        // Can't be a real frame, start looking for the next one
+        rx_state = RX_WAIT_FOR_START;
+        break;
+      }
+
+      rx_frame.length = c;
+      rx_crc = _crc_xmodem_update(rx_crc, c);
+      rx_index = 0;
+      rx_state = c > 0 ? RX_PAYLOAD : RX_CRC_HI;
+      break;
+    case RX_PAYLOAD:
+      rx_frame.payload[rx_index++] = c;
+      rx_crc = _crc_xmodem_update(rx_crc, c);
+      if (rx_index == rx_frame.length) {
+        rx_state = RX_CRC_HI;
+      }
+      break;
+    case RX_CRC_HI:
+      rx_received_crc = (uint16_t)c << 8;
+      rx_state = RX_CRC_LO;
+      break;
+    case RX_CRC_LO:
+      rx_state = RX_WAIT_FOR_START;
+      if ((rx_received_crc | c) == rx_crc) {
+        rx_frame.payload[rx_frame.length] = '\0';
+        return true;
+      }
+
+      link_send_response(LINK_FRAME_NACK, rx_frame.seq);
+      if (confirming_baud) {
+        // Not clean at this rate, don't bother waiting for the timeout
+        revert_baud();
+      }
+      break;
+  }
+
+  return false;
+}
+
+void handle_set_baud(struct link_frame *frame)
+{
+  uint32_t requested_baud = 0;
+  bool supported = false;
+  if (frame->length == 4) {
+    requested_baud = (uint32_t)frame->payload[0]
+                     | ((uint32_t)frame->payload[1] << 8)
+                     | ((uint32_t)frame->payload[2] << 16)
+                     | ((uint32_t)frame->payload[3] << 24);
+    for (uint8_t i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++) {
+      supported = supported || baud_rates[i] == requested_baud;
     }
   }
+
+  if (!supported) {
+    link_send_response(LINK_FRAME_REJECT, frame->seq);
+    return;
+  }
+
+  // ACK goes out at the old rate, SoftwareSerial writes block so it's done before we switch
+  link_send_response(LINK_FRAME_ACK, frame->seq);
+  previous_baud = current_baud;
+  set_baud(requested_baud);
+  confirming_baud = true;
+  confirm_pings = 0;
+  confirm_deadline = millis() + LINK_BAUD_CONFIRM_TIMEOUT_MS;
+}
+
+// Edits only make sense against the list the ESP thinks we have. If that's
+// not what's on the sign (we reset, or a list is half received) or the edits
+// didn't leave us with the count it expects, REJECT and the ESP sends the
+// whole list instead. NACK would only get the same frame resent
+bool delta_applies(struct link_frame *frame)
+{
+  if (frame->length != 1) {
+    return false;
+  }
+
+  if (frame->type == LINK_FRAME_DELTA_START) {
+    return rx_list == NULL && front_list->complete && !front_list->is_columns
+           && front_list->count == frame->payload[0];
+  }
+  return rx_list != NULL && rx_list->count == frame->payload[0];
+}
+
+// The edited list becomes the front list without restarting the sign, it
+// just carries on from the same spot in the new one
+void delta_end()
+{
+  rx_list->complete = true;
+  front_list = rx_list;
+  rx_list = NULL;
+  if (play_index > front_list->count) {
+    play_index = front_list->count;
+  }
+  playing = true;
+}
+
+void handle_frame(struct link_frame *frame)
+{
+  if (frame->type == LINK_FRAME_SET_BAUD) {
+    handle_set_baud(frame);
+    return;
+  }
+
+  if (frame->type == LINK_FRAME_CAPACITY) {
+    // Tells the ESP how much of a list fits, so it cuts lists down rather than us
+    uint8_t capacity[LINK_MAX_RESPONSE_PAYLOAD] = {MSGARENASIZE & 0xFF, MSGARENASIZE >> 8, MAXMSGS};
+    link_send_response_payload(LINK_FRAME_CAPACITY, frame->seq, capacity, sizeof(capacity));
+    return;
+  }
+
+  bool is_delta_edge = frame->type == LINK_FRAME_DELTA_START || frame->type == LINK_FRAME_DELTA_END;
+  if (is_delta_edge && frame->seq != last_seq && !delta_applies(frame)) {
+    link_send_response(LINK_FRAME_REJECT, frame->seq);
+    return;
+  }
+
+  // Answered by answer_frame() once loop() has drawn anything that's due
+  ack_pending = true;
+  ack_seq = frame->seq;
+
+  if (confirming_baud) {
+    confirm_deadline = millis() + LINK_BAUD_CONFIRM_TIMEOUT_MS;
+    if (frame->type == LINK_FRAME_PING && ++confirm_pings >= LINK_BAUD_CONFIRM_PINGS) {
+      confirming_baud = false;
+    }
+  }
+
+  // The ESP resends with the same seq when our ACK got lost, don't apply it twice
+  if (frame->seq == last_seq) {
+    return;
+  }
+  last_seq = frame->seq;
+
+  switch (frame->type) {
+    case LINK_FRAME_LIST_START:
+      rx_list = front_list == &lists[0] ? &lists[1] : &lists[0];
+      if (scroll_list == rx_list) {
+        // Still scrolling the tail of the list we're about to overwrite
+        scroll_step = -1;
+      }
+      list_reset(rx_list);
+      break;
+    case LINK_FRAME_LIST_COLUMNS:
+    case LINK_FRAME_LIST_COLUMNS_END:
+      if (rx_list) {
+        rx_list->is_columns = true;
+        list_append(rx_list, frame->payload, frame->length);
+        if (frame->type == LINK_FRAME_LIST_COLUMNS_END) {
+          message_received();
+        }
+      }
+      break;
+    case LINK_FRAME_LIST_ITEM:
+      if (rx_list) {
+        list_append(rx_list, frame->payload, frame->length);
+        message_received();
+      }
+      break;
+    case LINK_FRAME_LIST_END:
+      if (rx_list) {
+        rx_list->complete = true;
+        if (rx_list != front_list) {
+          // Nothing made it in, an empty list still replaces the old one
+          front_list = rx_list;
+          play_index = 0;
+          playing = false;
+        }
+        rx_list = NULL;
+      }
+      break;
+    case LINK_FRAME_DELTA_START:
+      // Edit a copy so the sign keeps going from the current list meanwhile
+      rx_list = front_list == &lists[0] ? &lists[1] : &lists[0];
+      if (scroll_list == rx_list) {
+        scroll_step = -1;
+      }
+      *rx_list = *front_list;
+      rx_list->complete = false;
+      break;
+    case LINK_FRAME_DELTA_REPLACE:
+      if (rx_list && frame->length > 0) {
+        list_delete(rx_list, frame->payload[0]);
+        list_insert(rx_list, frame->payload[0], &frame->payload[1], frame->length - 1);
+      }
+      break;
+    case LINK_FRAME_DELTA_INSERT:
+      if (rx_list && frame->length > 0) {
+        list_insert(rx_list, frame->payload[0], &frame->payload[1], frame->length - 1);
+      }
+      break;
+    case LINK_FRAME_DELTA_DELETE:
+      if (rx_list && frame->length > 0) {
+        list_delete(rx_list, frame->payload[0]);
+      }
+      break;
+    case LINK_FRAME_DELTA_END:
+      delta_end();
+      break;
+    default:
+      // Pings only need the ACK
+      break;
+  }
+}
+
+// The ESP doesn't send anything more until it has this ACK, so a frame
+// drawn just before it goes out can't miss any serial
+void answer_frame()
+{
+  if (ack_pending) {
+    ack_pending = false;
+    link_send_response(LINK_FRAME_ACK, ack_seq);
+  }
 }
 
 void setup()
@@ -259,74 +860,35 @@ void setup()
 }
 
 void loop() {
-  String received_str = "";
-  //  unsigned long timeout_start = 0;
-  bool display_received_text = false;
-
-  // Assume we'll have 10 strings max
-  String display_strs[10];
-  int display_str_index = 0;
-  bool building_list = false;
-  bool red = true;
-
- while (1) {
-     String str = "hello";
-
-     if (red) {
-       red = !red;
-       digitalWrite(4, LOW);
-       digitalWrite(3, HIGH);
-     } else {
-       red = !red;
-       digitalWrite(4, HIGH);
-       digitalWrite(3, LOW);
-     }
-   display_text(str.c_str(), str.length());
- }
-
- while (1) {
-   if (esp_serial.available()) {
-     char c = esp_serial.read();
-//      Serial.print(c);
-
-     if (c == '$') {
-       // Our string terminator, go ahead and display
-       if (building_list) {
-         display_strs[display_str_index] = received_str;
-         display_str_index++;
-       } else {
-//          Serial.println("Got a '$' terminated string when not in list-building mode");
-       }
-
-       received_str = "";
-     } else if (c == '%') {
-       // Got a command string, strip the newlines from it
-       received_str.trim();
-       if (received_str == "START_LIST") {
-         display_str_index = 0;
-         building_list = true;
-       } else if (received_str == "END_LIST") {
-         building_list = false;
-         display_received_text = true;
-       } else {
-//          Serial.print("Received unsupported command: ");
-//          Serial.println(received_str);
-       }
-
-       received_str = "";
-     } else {
-       received_str += c;
-     }
-   }
-
-   if (display_received_text) {
-     display_received_text = false;
-     for (int i = 0; i < display_str_index; i++) {
-//        Serial.println(display_strs[i]);
-       display_text(display_strs[i].c_str(), display_strs[i].length());
-     }
-
-     received_str = "";
-   }
- }
+  while (!ack_pending && esp_serial.available()) {
+    rx_last_byte_ms = millis();
+    if (link_receive_byte(esp_serial.read())) {
+      handle_frame(&rx_frame);
+    }
+  }
+
+  if (rx_state != RX_WAIT_FOR_START && millis() - rx_last_byte_ms >= RX_FRAME_TIMEOUT_MS) {
+    // The rest isn't coming (or got lost), look for the next frame
+    rx_state = RX_WAIT_FOR_START;
+    rx_timeouts++;
+  }
+
+  if (confirming_baud && (long)(millis() - confirm_deadline) >= 0) {
+    revert_baud();
+  }
+
+  if (esp_serial.overflow()) {
+    rx_overflows++;
+  }
+
+  // strip.show() turns interrupts off for the whole strip (~9ms for 300
+  // LEDs) and SoftwareSerial loses anything that arrives then, so nothing
+  // is drawn while a frame is partway in, or just after we've answered one
+  // and the ESP's about to send the next. The frame just goes out late,
+  // and a frame still waiting on its ACK is a safe time to catch up
+  if (rx_state == RX_WAIT_FOR_START && (ack_pending || millis() - last_response_ms >= RX_NEXT_FRAME_MS)) {
+    display_tick();
+  }
+
+  answer_frame();
 }